@@ -14,6 +14,7 @@ set(llfio_HEADERS
   "include/llfio/v2.0/algorithm/handle_adapter/cached_parent.hpp"
   "include/llfio/v2.0/algorithm/handle_adapter/combining.hpp"
   "include/llfio/v2.0/algorithm/handle_adapter/xor.hpp"
+  "include/llfio/v2.0/algorithm/readahead.hpp"
   "include/llfio/v2.0/algorithm/reduce.hpp"
   "include/llfio/v2.0/algorithm/shared_fs_mutex/atomic_append.hpp"
   "include/llfio/v2.0/algorithm/shared_fs_mutex/base.hpp"
@@ -21,7 +22,9 @@ set(llfio_HEADERS
   "include/llfio/v2.0/algorithm/shared_fs_mutex/lock_files.hpp"
   "include/llfio/v2.0/algorithm/shared_fs_mutex/memory_map.hpp"
   "include/llfio/v2.0/algorithm/shared_fs_mutex/safe_byte_ranges.hpp"
+  "include/llfio/v2.0/algorithm/stat_batch.hpp"
   "include/llfio/v2.0/algorithm/summarize.hpp"
+  "include/llfio/v2.0/algorithm/synchronise.hpp"
   "include/llfio/v2.0/algorithm/traverse.hpp"
   "include/llfio/v2.0/algorithm/trivial_vector.hpp"
   "include/llfio/v2.0/byte_io_handle.hpp"
@@ -43,10 +46,12 @@ set(llfio_HEADERS
   "include/llfio/v2.0/detail/impl/posix/byte_io_handle.ipp"
   "include/llfio/v2.0/detail/impl/posix/byte_socket_handle.ipp"
   "include/llfio/v2.0/detail/impl/posix/directory_handle.ipp"
+  "include/llfio/v2.0/detail/impl/posix/epoll_multiplexer.ipp"
   "include/llfio/v2.0/detail/impl/posix/file_handle.ipp"
   "include/llfio/v2.0/detail/impl/posix/fs_handle.ipp"
   "include/llfio/v2.0/detail/impl/posix/handle.ipp"
   "include/llfio/v2.0/detail/impl/posix/import.hpp"
+  "include/llfio/v2.0/detail/impl/posix/io_uring_multiplexer.ipp"
   "include/llfio/v2.0/detail/impl/posix/lockable_byte_io_handle.ipp"
   "include/llfio/v2.0/detail/impl/posix/map_handle.ipp"
   "include/llfio/v2.0/detail/impl/posix/mapped_file_handle.ipp"
@@ -58,11 +63,12 @@ set(llfio_HEADERS
   "include/llfio/v2.0/detail/impl/posix/statfs.ipp"
   "include/llfio/v2.0/detail/impl/posix/storage_profile.ipp"
   "include/llfio/v2.0/detail/impl/posix/symlink_handle.ipp"
-  "include/llfio/v2.0/detail/impl/posix/test/io_uring_multiplexer.ipp"
   "include/llfio/v2.0/detail/impl/posix/utils.ipp"
   "include/llfio/v2.0/detail/impl/reduce.ipp"
   "include/llfio/v2.0/detail/impl/safe_byte_ranges.ipp"
+  "include/llfio/v2.0/detail/impl/stat_batch.ipp"
   "include/llfio/v2.0/detail/impl/storage_profile.ipp"
+  "include/llfio/v2.0/detail/impl/synchronise.ipp"
   "include/llfio/v2.0/detail/impl/test/null_multiplexer.ipp"
   "include/llfio/v2.0/detail/impl/tls_socket_handle.ipp"
   "include/llfio/v2.0/detail/impl/tls_socket_sources/openssl.ipp"
@@ -8,6 +8,7 @@ set(llfio_TESTS
   "test/tests/directory_handle_create_close/runner.cpp"
   "test/tests/directory_handle_enumerate/kernel_directory_handle_enumerate.cpp.hpp"
   "test/tests/directory_handle_enumerate/runner.cpp"
+  "test/tests/directory_handle_streaming.cpp"
   "test/tests/dynamic_thread_pool_group.cpp"
   "test/tests/extended_attributes.cpp"
   "test/tests/fast_random_file_handle.cpp"
@@ -15,6 +16,7 @@ set(llfio_TESTS
   "test/tests/file_handle_create_close/runner.cpp"
   "test/tests/file_handle_lock_unlock.cpp"
   "test/tests/handle_adapter_xor.cpp"
+  "test/tests/io_uring_multiplexer.cpp"
   "test/tests/issue0009.cpp"
   "test/tests/issue0027.cpp"
   "test/tests/issue0028.cpp"
@@ -35,9 +37,11 @@ set(llfio_TESTS
   "test/tests/section_handle_create_close/kernel_section_handle.cpp.hpp"
   "test/tests/section_handle_create_close/runner.cpp"
   "test/tests/shared_fs_mutex.cpp"
+  "test/tests/stat.cpp"
   "test/tests/statfs.cpp"
   "test/tests/symlink_handle_create_close/kernel_symlink_handle.cpp.hpp"
   "test/tests/symlink_handle_create_close/runner.cpp"
+  "test/tests/synchronise.cpp"
   "test/tests/tls_socket_handle.cpp"
   "test/tests/traverse.cpp"
   "test/tests/trivial_vector.cpp"
@@ -136,6 +136,112 @@ namespace algorithm
                                                                         bool atomic_replace = true, bool preserve_timestamps = true,
                                                                         bool force_copy_now = false, deadline d = {}) noexcept;
 
+  /*! \brief Clone or copy the extents of `src` to `dest` using many kernel threads
+  at once, which can be considerably faster than `file_handle::clone_extents_to()`
+  for very large files when the storage can sustain more than one kernel thread
+  can drive.
+
+  \return The extent cloned or copied, with the same meaning as for `file_handle::clone_extents_to()`.
+  \param src The file whose extents are to be cloned or copied.
+  \param extent The extent in `src` to clone or copy. `{-1, -1}` means the whole file.
+  \param dest The file to clone or copy into.
+  \param destoffset The offset in `dest` at which to place `extent`.
+  \param threads The maximum number of kernel threads to use. Zero means the hardware concurrency.
+  \param chunk_size The size of the chunks into which allocated extents are split, which
+  is rounded up to a multiple of `utils::file_buffer_default_size()`.
+  \param d Deadline by which to complete the operation.
+  \param force_copy_now As for `file_handle::clone_extents_to()`.
+  \param emulate_if_unsupported As for `file_handle::clone_extents_to()`.
+
+  The destination is firstly extended if necessary to fit the extent, and then
+  any ranges of the destination which correspond to deallocated ranges of the source
+  are deallocated, so sparse allocation is preserved. The allocated extents of
+  the source are then split into chunks of `chunk_size`, and handed out to up to
+  `threads` kernel threads which each call `file_handle::clone_extents_to()` on
+  their chunk, so each chunk is cloned, or copied, exactly as it would be by that
+  function.
+
+  The deadline applies to the whole operation, with each chunk being given what
+  remains of it. If any chunk fails, or the deadline is exceeded, no more chunks are
+  handed out, and the first failure is returned once all kernel threads have finished,
+  in which case some of the destination will have been modified. If the destination
+  was extended, it is truncated back to its original length.
+
+  If there are fewer than two chunks, if `threads` is one, or if `src` and `dest` refer
+  to the same inode, this is equivalent to calling `file_handle::clone_extents_to()`.
+
+  \mallocs Allocates the list of chunks, and the kernel threads used.
+  */
+  LLFIO_HEADERS_ONLY_FUNC_SPEC result<file_handle::extent_pair>
+  parallel_clone_extents_to(file_handle &src, file_handle::extent_pair extent, file_handle &dest, file_handle::extent_type destoffset, size_t threads = 0,
+                            file_handle::extent_type chunk_size = (file_handle::extent_type) 64 * 1024 * 1024, deadline d = {}, bool force_copy_now = false,
+                            bool emulate_if_unsupported = true) noexcept;
+  //! \overload
+  inline result<file_handle::extent_pair> parallel_clone_extents_to(file_handle &src, file_handle &dest, size_t threads = 0, deadline d = {},
+                                                                    bool force_copy_now = false, bool emulate_if_unsupported = true) noexcept
+  {
+    return parallel_clone_extents_to(src, {(file_handle::extent_type) -1, (file_handle::extent_type) -1}, dest, 0, threads,
+                                     (file_handle::extent_type) 64 * 1024 * 1024, d, force_copy_now, emulate_if_unsupported);
+  }
+
+  //! \brief A request to clone or copy a file, for the pipelined `clone_or_copy()`.
+  struct clone_or_copy_request
+  {
+    file_handle *src{nullptr};            //!< The file to clone or copy.
+    const path_handle *destdir{nullptr};  //!< The base to lookup `destleaf` within.
+    path_view destleaf;                   //!< The leafname to use. If empty, use the same leafname as `src` currently has.
+    //! Filled in with the number of bytes cloned or copied, or the failure which occurred.
+    result<file_handle::extent_type> copied{0};
+  };
+
+  /*! \brief Clone or copy the extents of many files at once, overlapping the reads
+  from many source files with the writes to many destinations.
+
+  \return The total number of bytes cloned or copied. Each request's `copied` is
+  filled in with the outcome for that file, so this only fails if the pipeline
+  itself fails.
+  \param requests The files to clone or copy.
+  \param inflight_bytes The maximum bytes of copy buffers in flight at any one time.
+  \param multiplexer The i/o multiplexer to use. If null, the calling thread's
+  multiplexer is used, and if that is null, on Linux a `multiplexer_linux_io_uring()`
+  is created for the duration of the call if any source is multiplexable.
+  \param preserve_timestamps Use `stat_t::stamp()` to preserve as much metadata from
+  the original to the clone/copy as possible.
+  \param force_copy_now Parameter to pass to `file_handle::clone_extents()` to force
+  extents to be copied now, not copy-on-write lazily later.
+  \param creation How to create the destination file handles, with the same meaning
+  as for the single file `clone_or_copy()`.
+
+  Each file is firstly treated exactly as by the single file `clone_or_copy()`
+  up to and including the attempt to clone its extents. Files whose extents
+  could not be cloned, usually because the destination is on a different
+  device, then have their allocated extents copied in blocks of
+  `utils::file_buffer_default_size()` by a pipeline with up to `inflight_bytes`
+  of blocks in flight at once, drawn from as many files as necessary. The
+  destination is truncated to the source length before copying, so sparse
+  sources remain sparse.
+
+  If an i/o multiplexer is available, the pipeline initiates asynchronous reads
+  and writes through it from the calling kernel thread, with each block's write
+  initiated as soon as its read completes. Any multiplexer already set on a
+  source is restored once its copy finishes. Sources not opened with
+  `handle::flag::multiplexable`, and all sources if no multiplexer is available,
+  are instead copied by blocking reads and writes issued by up to
+  `inflight_bytes` worth of kernel threads each with one block in flight. A
+  multiplexable source whose multiplexer cannot be changed is copied with
+  `file_handle::clone_extents_to()`.
+
+  Files are opened lazily as the pipeline reaches them, so only a few destination
+  files are open at any one time. Kernel threads open files without holding up
+  the others.
+
+  \mallocs Allocates the copy buffers, and per file state.
+  */
+  LLFIO_HEADERS_ONLY_FUNC_SPEC result<file_handle::extent_type> clone_or_copy(span<clone_or_copy_request> requests, size_t inflight_bytes = 64 * 1024 * 1024,
+                                                                              byte_io_multiplexer *multiplexer = nullptr, bool preserve_timestamps = true,
+                                                                              bool force_copy_now = false,
+                                                                              file_handle::creation creation = file_handle::creation::always_new) noexcept;
+
 #if 0
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -0,0 +1,394 @@
+/* An asynchronous readahead engine for mapped files
+(C) 2026 agent <agent@local>
+File Created: Oct 2026
+
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License in the accompanying file
+Licence.txt or at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+
+Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file Licence.txt or copy at
+          http://www.boost.org/LICENSE_1_0.txt)
+*/
+
+#ifndef LLFIO_ALGORITHM_READAHEAD_HPP
+#define LLFIO_ALGORITHM_READAHEAD_HPP
+
+#include "../mapped_file_handle.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+//! \file readahead.hpp Provides an asynchronous readahead engine for mapped files.
+
+LLFIO_V2_NAMESPACE_BEGIN
+
+namespace algorithm
+{
+  /*! \class mapped_file_readahead
+  \brief Detects sequential and strided access to a `mapped_file_handle`, and prefetches
+  the pages which will be accessed next ahead of the cursor.
+
+  Touching a page of a mapped file not in the kernel's page cache causes a major fault,
+  which stalls the touching thread for the full latency of the storage device. Kernels do
+  implement readahead for maps, but it only recognises forwards sequential access, and its
+  window is small. Scans of large columnar files, which touch every Nth record, or which walk
+  backwards, therefore stall on almost every page.
+
+  Tell this engine about each access before it is made by calling `access()`. Once an access
+  pattern has been confirmed by `config::confirmations` consecutive accesses with the same
+  stride (or which are contiguous, for sequential access), the engine prefetches the regions
+  which will be accessed next using `map_handle::prefetch()`. On POSIX this is
+  `MADV_WILLNEED`, which schedules readahead i/o for the backing file. On Windows it is
+  `PrefetchVirtualMemory()`. The prefetch window starts at `config::initial_window` bytes, and
+  doubles on every further prefetch until `config::max_window`, as with kernel readahead. As with
+  kernel readahead, more is only prefetched once the cursor comes within half a window of what
+  has already been prefetched. Any break in the pattern resets the window.
+
+  You can also prefetch any region explicitly with `will_need()`.
+
+  If `config::asynchronous` is true, prefetches are queued to a worker thread owned by this
+  engine, so `access()` never blocks upon the kernel. Otherwise prefetches are issued
+  by the thread calling `access()`.
+
+  `access()` and `will_need()` are not threadsafe, you should use one engine per cursor.
+  `statistics()` is threadsafe.
+
+  \warning Prefetch regions are computed from `mapped_file_handle::address()` at the time of
+  the access. If the handle is remapped e.g. by `truncate()` or `reserve()`, any queued prefetches
+  become meaningless, though harmless. You should `reset()` the engine after remapping.
+  */
+  class mapped_file_readahead
+  {
+  public:
+    //! The extent type
+    using extent_type = mapped_file_handle::extent_type;
+    //! The size type
+    using size_type = mapped_file_handle::size_type;
+    //! The buffer type
+    using buffer_type = mapped_file_handle::buffer_type;
+
+    //! Configuration of the engine
+    struct config
+    {
+      //! The number of bytes to prefetch when a pattern is first confirmed.
+      size_type initial_window{128 * 1024};
+      //! The maximum number of bytes to prefetch ahead of the cursor.
+      size_type max_window{16 * 1024 * 1024};
+      //! How many consecutive accesses must match a pattern before prefetching begins.
+      unsigned confirmations{2};
+      //! Whether to issue prefetches from a worker thread.
+      bool asynchronous{true};
+    };
+
+    //! Statistics about the engine
+    struct statistics_type
+    {
+      uint64_t accesses{0};          //!< Calls to `access()`
+      uint64_t hits{0};              //!< Accesses which fell wholly within a previously prefetched region
+      uint64_t misses{0};            //!< Accesses which did not
+      uint64_t pattern_changes{0};   //!< Times a confirmed pattern was broken
+      uint64_t prefetches{0};        //!< Prefetches issued to the kernel
+      uint64_t bytes_prefetched{0};  //!< Bytes asked of the kernel to prefetch
+      uint64_t prefetches_dropped{0};  //!< Prefetches dropped because the worker thread was too far behind
+    };
+
+  private:
+    static constexpr size_t _history_size = 64;  // prefetched regions remembered for hit detection
+    static constexpr size_t _queue_size = 64;    // prefetches queued to the worker thread
+    static constexpr size_t _max_strided_prefetches = _history_size / 2;  // so a batch fits in the history and queue
+
+    struct _region
+    {
+      extent_type offset{0};
+      size_type bytes{0};
+    };
+
+    mapped_file_handle *_mfh{nullptr};
+    config _config;
+
+    // Pattern detection state, only touched by the thread calling access()
+    bool _have_last{false}, _sequential{false};
+    extent_type _last_offset{0};
+    size_type _last_bytes{0};
+    int64_t _stride{0};
+    unsigned _confirmed{0};
+    size_type _window{0};
+    extent_type _frontier{0};  // sequential: end of what has been prefetched
+    size_t _ahead{0};          // strided: how many predicted accesses beyond the cursor have been prefetched
+    _region _history[_history_size];
+    size_t _history_idx{0};
+
+    struct _stats_t
+    {
+      std::atomic<uint64_t> accesses{0}, hits{0}, misses{0}, pattern_changes{0}, prefetches{0}, bytes_prefetched{0}, prefetches_dropped{0};
+    } _stats;
+
+    // Worker thread state
+    std::mutex _lock;
+    std::condition_variable _cond;
+    buffer_type _queue[_queue_size];
+    size_t _queue_head{0}, _queue_count{0};
+    bool _stop{false};
+    std::thread _worker;
+
+    void _prefetch(buffer_type b) noexcept
+    {
+      auto r = map_handle::prefetch(b);
+      if(r)
+      {
+        _stats.prefetches.fetch_add(1, std::memory_order_relaxed);
+        _stats.bytes_prefetched.fetch_add(r.assume_value().size(), std::memory_order_relaxed);
+      }
+    }
+    void _worker_thread() noexcept
+    {
+      std::unique_lock<std::mutex> g(_lock);
+      for(;;)
+      {
+        while(_queue_count == 0 && !_stop)
+        {
+          _cond.wait(g);
+        }
+        if(_stop)
+        {
+          return;
+        }
+        const buffer_type b = _queue[_queue_head];
+        _queue_head = (_queue_head + 1) % _queue_size;
+        _queue_count--;
+        g.unlock();
+        _prefetch(b);
+        g.lock();
+      }
+    }
+    bool _was_prefetched(extent_type offset, size_type bytes) const noexcept
+    {
+      for(const auto &i : _history)
+      {
+        if(i.bytes > 0 && offset >= i.offset && offset + bytes <= i.offset + i.bytes)
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+    void _issue(extent_type offset, size_type bytes) noexcept
+    {
+      const auto length = _mfh->map().length();
+      if(offset >= length || bytes == 0)
+      {
+        return;
+      }
+      if(offset + bytes > length)
+      {
+        bytes = (size_type)(length - offset);
+      }
+      const buffer_type b = utils::round_to_page_size_larger(buffer_type{_mfh->address() + offset, bytes}, _mfh->map().page_size());
+      if(!_worker.joinable())
+      {
+        _prefetch(b);
+      }
+      else
+      {
+        {
+          std::lock_guard<std::mutex> g(_lock);
+          if(_queue_count == _queue_size)
+          {
+            // Not remembered, so a later access here counts as a miss
+            _stats.prefetches_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+          }
+          _queue[(_queue_head + _queue_count) % _queue_size] = b;
+          _queue_count++;
+        }
+        _cond.notify_one();
+      }
+      // Extend the previous history entry if contiguous, as sequential prefetches always are
+      auto &last = _history[(_history_idx + _history_size - 1) % _history_size];
+      if(last.bytes > 0 && last.offset + last.bytes == offset)
+      {
+        last.bytes += bytes;
+      }
+      else
+      {
+        _history[_history_idx] = {offset, bytes};
+        _history_idx = (_history_idx + 1) % _history_size;
+      }
+    }
+
+  public:
+    /*! Constructs an engine prefetching for `mfh`, which must outlive the engine.
+    \throws Any exception `std::thread` can throw, if `c.asynchronous` is true.
+    */
+    mapped_file_readahead(mapped_file_handle &mfh, config c)
+        : _mfh(&mfh)
+        , _config(c)
+        , _window(c.initial_window)
+    {
+      if(_config.asynchronous)
+      {
+        _worker = std::thread([this] { _worker_thread(); });
+      }
+    }
+    //! \overload
+    explicit mapped_file_readahead(mapped_file_handle &mfh)
+        : mapped_file_readahead(mfh, config())
+    {
+    }
+    mapped_file_readahead(const mapped_file_readahead &) = delete;
+    mapped_file_readahead(mapped_file_readahead &&) = delete;
+    mapped_file_readahead &operator=(const mapped_file_readahead &) = delete;
+    mapped_file_readahead &operator=(mapped_file_readahead &&) = delete;
+    //! Stops the worker thread, abandoning any prefetches queued but not yet issued.
+    ~mapped_file_readahead()
+    {
+      if(_worker.joinable())
+      {
+        {
+          std::lock_guard<std::mutex> g(_lock);
+          _stop = true;
+        }
+        _cond.notify_one();
+        _worker.join();
+      }
+    }
+
+    //! The mapped file handle this engine prefetches for.
+    mapped_file_handle &handle() const noexcept { return *_mfh; }
+    //! The configuration of this engine.
+    const config &configuration() const noexcept { return _config; }
+
+    /*! \brief Tell the engine that `bytes` at `offset` into the mapped file are about to be accessed.
+
+    This is cheap, it performs no syscalls unless `config::asynchronous` is false and
+    a prefetch is due.
+    */
+    void access(extent_type offset, size_type bytes) noexcept
+    {
+      _stats.accesses.fetch_add(1, std::memory_order_relaxed);
+      if(_was_prefetched(offset, bytes))
+      {
+        _stats.hits.fetch_add(1, std::memory_order_relaxed);
+      }
+      else
+      {
+        _stats.misses.fetch_add(1, std::memory_order_relaxed);
+      }
+      const bool sequential = _have_last && offset == _last_offset + _last_bytes;
+      const auto stride = (int64_t) offset - (int64_t) _last_offset;
+      if(_have_last && (sequential ? _sequential : (!_sequential && stride == _stride && stride != 0)))
+      {
+        _confirmed++;
+      }
+      else
+      {
+        if(_confirmed >= _config.confirmations)
+        {
+          _stats.pattern_changes.fetch_add(1, std::memory_order_relaxed);
+        }
+        _sequential = sequential;
+        _stride = stride;
+        _confirmed = _have_last ? 1 : 0;
+        _window = _config.initial_window;
+        _frontier = 0;
+        _ahead = 0;
+      }
+      _have_last = true;
+      _last_offset = offset;
+      _last_bytes = bytes;
+      if(_confirmed < _config.confirmations)
+      {
+        return;
+      }
+      if(_sequential)
+      {
+        const extent_type end = offset + bytes;
+        if(_frontier < end)
+        {
+          _frontier = end;
+        }
+        if(_frontier - end > _window / 2)
+        {
+          return;
+        }
+        const extent_type until = end + _window;
+        _issue(_frontier, (size_type)(until - _frontier));
+        _frontier = until;
+      }
+      else
+      {
+        if(_ahead > 0)
+        {
+          _ahead--;  // this access was one of those predicted
+        }
+        const size_t count = std::min(_max_strided_prefetches, std::max((size_t) 1, (size_t)(_window / std::max(bytes, (size_type) 1))));
+        if(_ahead > count / 2)
+        {
+          return;
+        }
+        for(size_t k = _ahead + 1; k <= count; k++)
+        {
+          const int64_t next = (int64_t) offset + (int64_t) k * _stride;
+          if(next < 0)
+          {
+            break;
+          }
+          _issue((extent_type) next, bytes);
+        }
+        _ahead = count;
+      }
+      _window = std::min(_window * 2, _config.max_window);
+    }
+
+    //! Prefetch `bytes` at `offset` into the mapped file, independent of any access pattern.
+    void will_need(extent_type offset, size_type bytes) noexcept { _issue(offset, bytes); }
+
+    //! Forget any access pattern and prefetch history, as if freshly constructed.
+    void reset() noexcept
+    {
+      _have_last = _sequential = false;
+      _confirmed = 0;
+      _window = _config.initial_window;
+      _frontier = 0;
+      _ahead = 0;
+      for(auto &i : _history)
+      {
+        i = {};
+      }
+      std::lock_guard<std::mutex> g(_lock);
+      _queue_count = 0;
+    }
+
+    //! Threadsafe. Statistics about the engine so far.
+    statistics_type statistics() const noexcept
+    {
+      statistics_type ret;
+      ret.accesses = _stats.accesses.load(std::memory_order_relaxed);
+      ret.hits = _stats.hits.load(std::memory_order_relaxed);
+      ret.misses = _stats.misses.load(std::memory_order_relaxed);
+      ret.pattern_changes = _stats.pattern_changes.load(std::memory_order_relaxed);
+      ret.prefetches = _stats.prefetches.load(std::memory_order_relaxed);
+      ret.bytes_prefetched = _stats.bytes_prefetched.load(std::memory_order_relaxed);
+      ret.prefetches_dropped = _stats.prefetches_dropped.load(std::memory_order_relaxed);
+      return ret;
+    }
+  };
+}  // namespace algorithm
+
+LLFIO_V2_NAMESPACE_END
+
+#endif
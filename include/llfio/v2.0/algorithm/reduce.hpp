@@ -51,6 +51,25 @@ namespace algorithm
   {
     std::chrono::steady_clock::duration timeout{std::chrono::seconds(10)};
     std::chrono::steady_clock::time_point begin;
+    /*! The number of entries enumerated from a single directory at or above which
+    unlinking them is split across multiple kernel threads, if the filing system
+    is one which can unlink many entries within the same directory concurrently.
+    */
+    size_t parallel_unlink_threshold{4096};
+
+    //! The unlink throughput achieved by one kernel thread during a reduction round.
+    struct unlink_rate
+    {
+      size_t items_unlinked{0};                    //!< The entries unlinked by this kernel thread.
+      std::chrono::steady_clock::duration busy{};  //!< The time this kernel thread spent unlinking.
+
+      //! The entries unlinked per second.
+      double per_second() const noexcept
+      {
+        auto secs = std::chrono::duration_cast<std::chrono::duration<double>>(busy).count();
+        return (secs > 0) ? (items_unlinked / secs) : 0;
+      }
+    };
 
     //! Constructs an instance with the default timeout of ten seconds.
     constexpr reduce_visitor() {}
@@ -87,6 +106,22 @@ namespace algorithm
       (void) depth;
       return false;
     }
+    /*! \brief Called with the unlink throughput of a single full round of
+    reduction, just before `reduction_round()`. The default implementation does nothing.
+
+    `rates` has an item for each kernel thread which unlinked entries during
+    the round, including those used to unlink the entries of single large
+    directories concurrently.
+
+    \note Always called from the original kernel thread.
+    */
+    virtual result<void> reduction_round_unlink_rates(void *data, size_t round_completed, span<const unlink_rate> rates) noexcept
+    {
+      (void) data;
+      (void) round_completed;
+      (void) rates;
+      return success();
+    }
     /*! \brief Called when we have performed a single full round of reduction.
 
     \note Always called from the original kernel thread.
@@ -144,12 +179,19 @@ namespace algorithm
   error code comparing equal to `errc::timed_out` is returned.
 
   Even on slow filesystems such as those on Windows, or networked filesystems, this
-  algorithm performs very well. We do not currently inspect the filing system to see
-  if bisect unlinking directories with millions of entries will perform well (some filing
-  systems can store very large directories with multiple independent inode
-  locks, thus using multiple kernel threads on the same directory sees a large performance
-  increase for very large directories). We also remove items based on enumerated order,
-  under the assumption that filesystems will have optimised for this specific use case.
+  algorithm performs very well. Some filing systems (currently we recognise XFS, ext4,
+  btrfs and ZFS) can unlink many entries within a very large directory concurrently,
+  thus using multiple kernel threads on the same directory sees a large performance
+  increase for very large directories. On those filing systems, if a single enumeration
+  returns at least `reduce_visitor::parallel_unlink_threshold` entries, its non-directory
+  entries are handed out to up to `threads` kernel threads in chunks of consecutive
+  enumerated order. The number of kernel threads used is chosen adaptively: it is doubled
+  for as long as doing so improves the measured unlink throughput by more than 10%, and
+  the additional kernel threads are retired as soon as it does not. The additional kernel
+  threads are drawn from a budget of `threads - 1` shared by all the directories being
+  traversed concurrently, so no more than that many are ever added to traversal's own. We remove items based
+  on enumerated order, under the assumption that filesystems will have optimised for this
+  specific use case.
 
   If the function succeeds, `dirh` is moved into the function, and the total number of
   filesystem entries removed is returned.
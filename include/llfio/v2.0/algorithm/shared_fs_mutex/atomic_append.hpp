@@ -102,17 +102,19 @@ namespace algorithm
     - Much slower than byte_ranges for few waiters or small number of entities.
     - Sudden process exit with locks held will deadlock all other users.
     - Maximum of twelve entities may be locked concurrently.
-    - Wasteful of disk space if used on a non-extents based filing system (e.g. FAT32, ext3).
-    It is best used in `/tmp` if possible (`file_handle::temp_file()`). If you really must use a non-extents based filing
-    system, destroy and recreate the object instance periodically to force resetting the lock
-    file's length to zero.
+    - The lock file grows by 128 bytes per lock. Every 32 unlocks or so, one user performs a
+    maintenance pass bounded to about a millisecond, which advances the header past completed lock requests,
+    punches holes via `file_handle::zero()` in whole megabytes of completed lock requests, and if no lock
+    requests are outstanding, truncates the lock file back to just its header. Lock latency therefore
+    stays flat over long uptimes so long as the lock is occasionally idle.
+    - Wasteful of disk space if used on a non-extents based filing system (e.g. FAT32, ext3) and
+    the lock is never idle. It is best used in `/tmp` if possible (`file_handle::temp_file()`).
     - Similarly older operating systems (e.g. Linux < 3.0) do not implement extent hole punching
     and therefore will also see excessive disk space consumption. Note at the time of writing
     OS X doesn't implement hole punching at all.
     - If your OS doesn't have sane byte range locks (OS X, BSD, older Linuxes) and multiple
     objects in your process use the same lock file, misoperation will occur. Use lock_files instead.
 
-    \todo Implement hole punching once I port that code from LLFIO v1.
     \todo Decide on some resolution mechanism for sudden process exit.
     \todo There is a 1 out of 2^64-2 chance of unique id collision. It would be nice if we
     actually formally checked that our chosen unique id is actually unique.
@@ -126,6 +128,17 @@ namespace algorithm
       uint64 _unique_id;                     // My (very random) unique id
       atomic_append_detail::header _header;  // Header as of the last time I read it
 
+      /* Byte range locks within the header. Appenders hold the append gate shared until they have
+      found their appended lock request, and compaction holds it exclusive. Only one user performs
+      maintenance at a time, and holds the maintenance byte exclusive whilst doing so.
+      */
+      static constexpr file_handle::extent_type _append_gate_offset = 64;
+      static constexpr file_handle::extent_type _maintenance_offset = 65;
+      // The granularity of hole punching
+      static constexpr file_handle::extent_type _hole_punch_granularity = 1024U * 1024U;
+      // The maximum time a maintenance pass may take
+      static constexpr std::chrono::microseconds _maintenance_budget{1000};
+
       atomic_append(file_handle &&h, file_handle::extent_guard &&guard, bool nfs_compatibility, bool skip_hashing)
           : _h(std::move(h))
           , _guard(std::move(guard))
@@ -285,6 +298,8 @@ namespace algorithm
         {
           lock_request.hash = QUICKCPPLIB_NAMESPACE::algorithm::hash::fast_hash::hash((reinterpret_cast<char *>(&lock_request)) + 16, sizeof(lock_request) - 16);
         }
+        // Prevent the file being compacted until I have found my lock request
+        OUTCOME_TRY(auto &&append_gate, _h.lock_file_range(_append_gate_offset, 1, lock_kind::shared));
         // My lock request will be the file's current length or higher
         OUTCOME_TRY(auto &&my_lock_request_offset, _h.maximum_extent());
         {
@@ -330,6 +345,8 @@ namespace algorithm
             break;
           }
         }
+        // My lock request now prevents compaction
+        append_gate.unlock();
 
         // extent_guard is now valid and will be unlocked on error
         out.hint = my_lock_request_offset;
@@ -505,62 +522,113 @@ namespace algorithm
           (void) _h.write(my_lock_request_offset, {{reinterpret_cast<byte *>(&record), sizeof(record)}});
         }
 
-        // Every 32 records or so, bump _header.first_known_good
+        // Every 32 records or so, perform maintenance
         if((my_lock_request_offset & 4095U) == 0U)
         {
-          //_read_header();
+          _maintain();
+        }
+      }
+
+    private:
+      /* Advances first_known_good past completed lock requests, hole punches completed
+      lock requests, and truncates the file if no lock requests are outstanding. Bounded
+      to roughly _maintenance_budget, whatever isn't done is left for the next pass.
+      */
+      void _maintain() noexcept
+      {
+        auto maintenance_guard = _h.lock_file_range(_maintenance_offset, 1, lock_kind::exclusive, std::chrono::seconds(0));
+        if(!maintenance_guard)
+        {
+          // Somebody else is performing maintenance
+          return;
+        }
+        const auto began = std::chrono::steady_clock::now();
+        auto out_of_time = [&] { return std::chrono::steady_clock::now() - began >= _maintenance_budget; };
+        if(!_read_header())
+        {
+          return;
+        }
+        const auto original_header = _header;
 
-          // Forward scan records until first non-zero record is found
-          // and update header with new info
-          alignas(64) byte _buffer[4096 + 2048];
-          bool done = false;
-          while(!done)
+        // Forward scan records until first non-zero record is found
+        alignas(64) byte _buffer[4096 + 2048];
+        bool done = false;
+        while(!done && !out_of_time())
+        {
+          file_handle::buffer_type req{_buffer, sizeof(_buffer)};
+          auto bytesread_ = _h.read({{&req, 1}, _header.first_known_good});
+          if(bytesread_.has_error())
+          {
+            // If distance between original first known good and end of file is exactly
+            // 6Kb we can read an EOF
+            break;
+          }
+          const auto &bytesread = bytesread_.value();
+          // If read was partial, we are done after this round
+          if(bytesread[0].size() < sizeof(_buffer))
           {
-            file_handle::buffer_type req{_buffer, sizeof(_buffer)};
-            auto bytesread_ = _h.read({{&req, 1}, _header.first_known_good});
-            if(bytesread_.has_error())
+            done = true;
+          }
+          const auto *record = reinterpret_cast<const atomic_append_detail::lock_request *>(bytesread[0].data());
+          const auto *lastrecord = reinterpret_cast<const atomic_append_detail::lock_request *>(bytesread[0].data() + bytesread[0].size());
+          for(; record < lastrecord; ++record)
+          {
+            if(!record->hash && (record->unique_id == 0u))
             {
-              // If distance between original first known good and end of file is exactly
-              // 6Kb we can read an EOF
-              break;
+              _header.first_known_good += sizeof(atomic_append_detail::lock_request);
             }
-            const auto &bytesread = bytesread_.value();
-            // If read was partial, we are done after this round
-            if(bytesread[0].size() < sizeof(_buffer))
+            else
             {
+              // Found an outstanding lock request
               done = true;
-            }
-            const auto *record = reinterpret_cast<const atomic_append_detail::lock_request *>(bytesread[0].data());
-            const auto *lastrecord = reinterpret_cast<const atomic_append_detail::lock_request *>(bytesread[0].data() + bytesread[0].size());
-            for(; record < lastrecord; ++record)
-            {
-              if(!record->hash && (record->unique_id == 0u))
-              {
-                _header.first_known_good += sizeof(atomic_append_detail::lock_request);
-              }
-              else
-              {
-                break;
-              }
+              break;
             }
           }
-          // Hole punch if >= 1Mb of zeros exists
-          if(_header.first_known_good - _header.first_after_hole_punch >= 1024U * 1024U)
+        }
+        // Hole punch whole megabytes of completed lock requests
+        while(_header.first_known_good - _header.first_after_hole_punch >= _hole_punch_granularity && !out_of_time())
+        {
+          const handle::extent_type holepunchend =
+          std::min(_header.first_known_good & ~(_hole_punch_granularity - 1), (_header.first_after_hole_punch & ~(_hole_punch_granularity - 1)) + _hole_punch_granularity);
+          if(holepunchend <= _header.first_after_hole_punch || !_h.zero({_header.first_after_hole_punch, holepunchend - _header.first_after_hole_punch}))
           {
-            handle::extent_type holepunchend = _header.first_known_good & ~(1024U * 1024U - 1);
-#ifdef _DEBUG
-            fprintf(stderr, "hole_punch(%llx, %llx)\n", _header.first_after_hole_punch, holepunchend - _header.first_after_hole_punch);
-#endif
-            _header.first_after_hole_punch = holepunchend;
+            break;
           }
-          ++_header.generation;
-          if(!_skip_hashing)
+          _header.first_after_hole_punch = holepunchend;
+        }
+        // If there are no outstanding lock requests, compact the file back to just its header
+        auto length = _h.maximum_extent();
+        if(length && length.value() == _header.first_known_good && _header.first_known_good > sizeof(atomic_append_detail::header))
+        {
+          auto append_gate = _h.lock_file_range(_append_gate_offset, 1, lock_kind::exclusive, std::chrono::seconds(0));
+          if(append_gate)
           {
-            _header.hash = QUICKCPPLIB_NAMESPACE::algorithm::hash::fast_hash::hash((reinterpret_cast<char *>(&_header)) + 16, sizeof(_header) - 16);
+            // Nobody can append whilst I hold the gate, so if the length is unchanged every lock request is complete
+            length = _h.maximum_extent();
+            if(length && length.value() == _header.first_known_good && _h.truncate(sizeof(atomic_append_detail::header)))
+            {
+              _header.first_known_good = sizeof(atomic_append_detail::header);
+              _header.first_after_hole_punch = sizeof(atomic_append_detail::header);
+            }
+            // The header must be updated before any new appends see the truncated file
+            _write_header();
+            return;
           }
-          // Rewrite the first part of the header only
-          (void) _h.write(0, {{reinterpret_cast<byte *>(&_header), 48}});
         }
+        if(_header.first_known_good != original_header.first_known_good || _header.first_after_hole_punch != original_header.first_after_hole_punch)
+        {
+          _write_header();
+        }
+      }
+      void _write_header() noexcept
+      {
+        ++_header.generation;
+        if(!_skip_hashing)
+        {
+          _header.hash = QUICKCPPLIB_NAMESPACE::algorithm::hash::fast_hash::hash((reinterpret_cast<char *>(&_header)) + 16, sizeof(_header) - 16);
+        }
+        // Rewrite the first part of the header only
+        (void) _h.write(0, {{reinterpret_cast<byte *>(&_header), 48}});
       }
     };
 
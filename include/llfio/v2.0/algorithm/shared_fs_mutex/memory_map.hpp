@@ -31,6 +31,16 @@ Distributed under the Boost Software License, Version 1.0.
 #include "quickcpplib/algorithm/hash.hpp"
 #include "quickcpplib/algorithm/small_prng.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 //! \file memory_map.hpp Provides algorithm::shared_fs_mutex::memory_map
 
 LLFIO_V2_NAMESPACE_BEGIN
@@ -44,6 +54,7 @@ namespace algorithm
     \tparam Hasher A STL compatible hash algorithm to use (defaults to `fnv1a_hash`)
     \tparam HashIndexSize The size in bytes of the hash index to use (defaults to 4Kb)
     \tparam SpinlockType The type of spinlock to use (defaults to a `SharedMutex` concept spinlock)
+    \tparam PadToCacheLine Whether to give each hash index bucket its own cache line (defaults to false)
 
     This is the highest performing filing system mutex in LLFIO, but it comes with a long list of potential
     gotchas. It works by creating a random temporary file somewhere on the system and placing its path
@@ -64,9 +75,13 @@ namespace algorithm
     - Sudden power loss during use is recovered from.
     - Safe for multithreaded usage of the same instance.
     - In the lightly contended case, an order of magnitude faster than any other `shared_fs_mutex` algorithm.
+    - On Linux, unless `spin_not_sleep` is set, waiters spin briefly and then sleep in the kernel on a
+    futex word kept per hash index slot after the hash index. Each slot also counts the waiters about
+    to sleep upon it, and unlockers only make a syscall to wake sleepers if that count is not zero, so
+    the uncontended case remains syscall free.
 
     Caveats:
-    - No ability to sleep until a lock becomes free, so CPUs are spun at 100%.
+    - On platforms other than Linux, there is no ability to sleep until a lock becomes free, so CPUs are spun at 100%.
     - Sudden process exit with locks held will deadlock all other users.
     - Exponential complexity to number of entities being concurrently locked.
     - Exponential complexity to concurrency if entities hash to the same cache line. Most SMP and especially
@@ -75,6 +90,13 @@ namespace algorithm
     whole system performance very noticeably nose dives from excessive atomic operations, things like audio and the
     mouse pointer will stutter.
     - Sometimes different entities hash to the same offset and collide with one another, causing very poor performance.
+    A larger `HashIndexSize` reduces the collision rate, and indices of many megabytes are fine as the hash index file
+    is sparse and lives in memory backed temporary storage where available.
+    - By default buckets are packed, so unrelated entities hashing to neighbouring buckets false share a cache line.
+    Setting `PadToCacheLine` eliminates this at the cost of several times fewer buckets for the same `HashIndexSize`,
+    so you will usually want to increase `HashIndexSize` correspondingly.
+    - All users of a lock file must use the same `HashIndexSize` and `PadToCacheLine`, as these determine the
+    layout of the shared hash index.
     - Memory mapped files need to be cache unified with normal i/o in your OS kernel. Known OSs which
     don't use a unified cache for memory mapped and normal i/o are QNX, OpenBSD. Furthermore, doing
     normal i/o and memory mapped i/o to the same file needs to not corrupt the file. In the past,
@@ -82,10 +104,10 @@ namespace algorithm
     - If your OS doesn't have sane byte range locks (OS X, BSD, older Linuxes) and multiple
     objects in your process use the same lock file, misoperation will occur.
     - Requires `handle::current_path()` to be working.
-
-    \todo memory_map::_hash_entities needs to hash x16, x8 and x4 at a time to encourage auto vectorisation
     */
-    template <template <class> class Hasher = QUICKCPPLIB_NAMESPACE::algorithm::hash::fnv1a_hash, size_t HashIndexSize = 4096, class SpinlockType = QUICKCPPLIB_NAMESPACE::configurable_spinlock::shared_spinlock<>> class memory_map : public shared_fs_mutex
+    template <template <class> class Hasher = QUICKCPPLIB_NAMESPACE::algorithm::hash::fnv1a_hash, size_t HashIndexSize = 4096, class SpinlockType = QUICKCPPLIB_NAMESPACE::configurable_spinlock::shared_spinlock<>,
+              bool PadToCacheLine = false>
+    class memory_map : public shared_fs_mutex
     {
     public:
       //! The type of an entity id
@@ -98,27 +120,93 @@ namespace algorithm
       using spinlock_type = SpinlockType;
 
     private:
-      static constexpr size_t _container_entries = HashIndexSize / sizeof(spinlock_type);
-      using _hash_index_type = std::array<spinlock_type, _container_entries>;
+      // A bucket of the hash index, optionally padded out to its own cache line
+      struct alignas(PadToCacheLine ? 64 : alignof(spinlock_type)) _bucket_type : public spinlock_type
+      {
+      };
+      static_assert(!PadToCacheLine || (sizeof(_bucket_type) == 64 && alignof(_bucket_type) == 64), "A padded bucket does not occupy exactly one cache line");
+      static_assert(PadToCacheLine || sizeof(_bucket_type) == sizeof(spinlock_type), "A packed bucket is not the size of its spinlock");
+      static constexpr size_t _container_entries = HashIndexSize / sizeof(_bucket_type);
+      static_assert(_container_entries > 0 && HashIndexSize % sizeof(_bucket_type) == 0, "HashIndexSize must be a multiple of the bucket size");
+      static_assert(_container_entries < (1ULL << 31), "HashIndexSize is too large");
+      using _hash_index_type = std::array<_bucket_type, _container_entries>;
+      // Placed after the hash index, one per slot. The futex word is a wake generation count.
+      struct _waiter_type
+      {
+        std::atomic<uint32_t> generation;
+        std::atomic<uint32_t> sleepers;  // how many waiters may be sleeping upon generation
+      };
+      using _waiters_type = std::array<_waiter_type, _container_entries>;
+      static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "std::atomic<uint32_t> is not the size of a futex word!");
+      static constexpr size_t _hash_index_file_size = HashIndexSize + sizeof(_waiters_type);
+      // How many times to retry a contended lock before going to sleep
+      static constexpr size_t _spins_before_sleeping = 16;
+      // The maximum time to sleep, which bounds the cost of a missed wake e.g. from a process using an older build of this lock
+      static constexpr long long _max_sleep_nsecs = 100000000LL;
       static constexpr file_handle::extent_type _initialisingoffset = static_cast<file_handle::extent_type>(1024) * 1024;
       static constexpr file_handle::extent_type _lockinuseoffset = static_cast<file_handle::extent_type>(1024) * 1024 + 1;
 
       file_handle _h, _temph;
       file_handle::extent_guard _hlockinuse;  // shared lock of last byte of _h marking if lock is in use
       map_handle _hmap, _temphmap;
+      bool _can_sleep{false};  // whether the hash index file has the futex words
 
       _hash_index_type &_index() const
       {
         auto *ret = reinterpret_cast<_hash_index_type *>(_temphmap.address());
         return *ret;
       }
+      _waiters_type *_waiters() const noexcept
+      {
+#ifdef __linux__
+        return _can_sleep ? reinterpret_cast<_waiters_type *>(_temphmap.address() + HashIndexSize) : nullptr;
+#else
+        return nullptr;
+#endif
+      }
+      // Sleep until the slot's futex word no longer has the value `expected`, or the timeout elapses
+      static void _sleep(std::atomic<uint32_t> &word, uint32_t expected, long long nsecs) noexcept
+      {
+#ifdef __linux__
+        struct timespec ts;
+        ts.tv_sec = (time_t) (nsecs / 1000000000LL);
+        ts.tv_nsec = (long) (nsecs % 1000000000LL);
+        // Not FUTEX_PRIVATE_FLAG, as the word is shared between processes
+        (void) syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+#else
+        (void) word;
+        (void) expected;
+        (void) nsecs;
+        std::this_thread::yield();
+#endif
+      }
+      // Wake any sleepers on a slot just unlocked
+      void _wake(unsigned idx) const noexcept
+      {
+        auto *waiters = _waiters();
+        if(waiters == nullptr)
+        {
+          return;
+        }
+        auto &waiter = (*waiters)[idx];
+        // Pairs with the fetch_add() in _lock(), so either we see the sleeper or the sleeper sees our unlock
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(waiter.sleepers.load(std::memory_order_relaxed) != 0)
+        {
+          waiter.generation.fetch_add(1, std::memory_order_relaxed);
+#ifdef __linux__
+          (void) syscall(SYS_futex, reinterpret_cast<uint32_t *>(&waiter.generation), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+        }
+      }
 
-      memory_map(file_handle &&h, file_handle &&temph, file_handle::extent_guard &&hlockinuse, map_handle &&hmap, map_handle &&temphmap)
+      memory_map(file_handle &&h, file_handle &&temph, file_handle::extent_guard &&hlockinuse, map_handle &&hmap, map_handle &&temphmap, bool can_sleep)
           : _h(std::move(h))
           , _temph(std::move(temph))
           , _hlockinuse(std::move(hlockinuse))
           , _hmap(std::move(hmap))
           , _temphmap(std::move(temphmap))
+          , _can_sleep(can_sleep)
       {
         _hlockinuse.set_handle(&_h);
       }
@@ -129,7 +217,7 @@ namespace algorithm
       //! No copy assignment
       memory_map &operator=(const memory_map &) = delete;
       //! Move constructor
-      memory_map(memory_map &&o) noexcept : _h(std::move(o._h)), _temph(std::move(o._temph)), _hlockinuse(std::move(o._hlockinuse)), _hmap(std::move(o._hmap)), _temphmap(std::move(o._temphmap)) { _hlockinuse.set_handle(&_h); }
+      memory_map(memory_map &&o) noexcept : _h(std::move(o._h)), _temph(std::move(o._temph)), _hlockinuse(std::move(o._hlockinuse)), _hmap(std::move(o._hmap)), _temphmap(std::move(o._temphmap)), _can_sleep(o._can_sleep) { _hlockinuse.set_handle(&_h); }
       //! Move assign
       memory_map &operator=(memory_map &&o) noexcept
       {
@@ -226,23 +314,26 @@ namespace algorithm
               return errc::no_lock_available;
             }
             temph = std::move(_temph.value());
+            // If the hash index file was created by an older build of this lock, it will lack the futex words
+            OUTCOME_TRY(auto &&temphsize, temph.maximum_extent());
+            const bool can_sleep = (temphsize >= _hash_index_file_size);
             // Map the hash index file into memory for read/write access
-            OUTCOME_TRY(auto &&temphsection, section_handle::section(temph, HashIndexSize));
-            OUTCOME_TRY(auto &&temphmap, map_handle::map(temphsection, HashIndexSize));
+            OUTCOME_TRY(auto &&temphsection, section_handle::section(temph, can_sleep ? _hash_index_file_size : HashIndexSize));
+            OUTCOME_TRY(auto &&temphmap, map_handle::map(temphsection, can_sleep ? _hash_index_file_size : HashIndexSize));
             // Map the path file into memory with its maximum possible size, read only
             OUTCOME_TRY(auto &&hsection, section_handle::section(ret, 65536, section_handle::flag::read));
             OUTCOME_TRY(auto &&hmap, map_handle::map(hsection, 0, 0, section_handle::flag::read));
-            return memory_map(std::move(ret), std::move(temph), std::move(lockinuse.value()), std::move(hmap), std::move(temphmap));
+            return memory_map(std::move(ret), std::move(temph), std::move(lockinuse.value()), std::move(hmap), std::move(temphmap), can_sleep);
           }
 
           // I am the first person to be using this (stale?) file, so create a new hash index file in /tmp
           auto &tempdirh = path_discovery::memory_backed_temporary_files_directory().is_valid() ? path_discovery::memory_backed_temporary_files_directory() : path_discovery::storage_backed_temporary_files_directory();
           OUTCOME_TRY(auto &&_temph, file_handle::uniquely_named_file(tempdirh));
           temph = std::move(_temph);
-          // Truncate it out to the hash index size, and map it into memory for read/write access
-          OUTCOME_TRYV(temph.truncate(HashIndexSize));
-          OUTCOME_TRY(auto &&temphsection, section_handle::section(temph, HashIndexSize));
-          OUTCOME_TRY(auto &&temphmap, map_handle::map(temphsection, HashIndexSize));
+          // Truncate it out to the hash index size plus its futex words, and map it into memory for read/write access
+          OUTCOME_TRYV(temph.truncate(_hash_index_file_size));
+          OUTCOME_TRY(auto &&temphsection, section_handle::section(temph, _hash_index_file_size));
+          OUTCOME_TRY(auto &&temphmap, map_handle::map(temphsection, _hash_index_file_size));
           // Write the path of my new hash index file, padding zeros to the nearest page size
           // multiple to work around a race condition in the Linux kernel
           OUTCOME_TRY(auto &&temppath, temph.current_path());
@@ -261,7 +352,7 @@ namespace algorithm
           */
           OUTCOME_TRY(auto &&lockinuse2, ret.lock_file_range(_lockinuseoffset, 1, lock_kind::shared));
           lockinuse = std::move(lockinuse2);  // releases exclusive lock on all three offsets
-          return memory_map(std::move(ret), std::move(temph), std::move(lockinuse.value()), std::move(hmap), std::move(temphmap));
+          return memory_map(std::move(ret), std::move(temph), std::move(lockinuse.value()), std::move(hmap), std::move(temphmap), true);
         }
         LLFIO_EXCEPTION_CATCH_ALL
         {
@@ -278,32 +369,84 @@ namespace algorithm
         unsigned value : 31;
         unsigned exclusive : 1;
       };
+      // Hash a block of entities with no dependencies between iterations, to encourage auto vectorisation
+      template <size_t N> static void _hash_block(_entity_idx *out, const entity_type *in) noexcept
+      {
+        size_t hashes[N];
+        for(size_t m = 0; m < N; m++)
+        {
+          hashes[m] = hasher_type()(in[m].value);
+        }
+        for(size_t m = 0; m < N; m++)
+        {
+          out[m].value = static_cast<unsigned>(hashes[m] % _container_entries);
+          out[m].exclusive = static_cast<unsigned>(in[m].exclusive);
+        }
+      }
       // Create a cache of entities to their indices, eliding collisions where necessary
       static span<_entity_idx> _hash_entities(_entity_idx *entity_to_idx, entities_type &entities)
       {
+        const size_t count = entities.size();
+        if(count == 0)
+        {
+          return span<_entity_idx>(entity_to_idx, entity_to_idx);
+        }
+        const entity_type *in = entities.data();
+        size_t n = 0;
+        for(; n + 16 <= count; n += 16)
+        {
+          _hash_block<16>(entity_to_idx + n, in + n);
+        }
+        for(; n + 8 <= count; n += 8)
+        {
+          _hash_block<8>(entity_to_idx + n, in + n);
+        }
+        for(; n + 4 <= count; n += 4)
+        {
+          _hash_block<4>(entity_to_idx + n, in + n);
+        }
+        for(; n < count; n++)
+        {
+          _hash_block<1>(entity_to_idx + n, in + n);
+        }
         _entity_idx *ep = entity_to_idx;
-        for(size_t n = 0; n < entities.size(); n++)
+        if(count <= 16)
         {
-          ep->value = hasher_type()(entities[n].value) % _container_entries;
-          ep->exclusive = entities[n].exclusive;
-          bool skip = false;
-          for(size_t m = 0; m < n; m++)
+          // For few entities, a linear search for collisions is fastest
+          for(n = 0; n < count; n++)
           {
-            if(entity_to_idx[m].value == ep->value)
+            const _entity_idx i = entity_to_idx[n];
+            bool skip = false;
+            for(_entity_idx *m = entity_to_idx; m < ep; ++m)
             {
-              if(ep->exclusive && !entity_to_idx[m].exclusive)
+              if(m->value == i.value)
               {
-                entity_to_idx[m].exclusive = true;
+                m->exclusive = m->exclusive | i.exclusive;
+                skip = true;
+                break;
               }
-              skip = true;
+            }
+            if(!skip)
+            {
+              *ep++ = i;
             }
           }
-          if(!skip)
+          return span<_entity_idx>(entity_to_idx, ep - entity_to_idx);
+        }
+        // Otherwise sort by index so collisions become adjacent
+        std::sort(entity_to_idx, entity_to_idx + count, [](const _entity_idx &a, const _entity_idx &b) { return a.value < b.value; });
+        for(n = 1; n < count; n++)
+        {
+          if(entity_to_idx[n].value == ep->value)
+          {
+            ep->exclusive = ep->exclusive | entity_to_idx[n].exclusive;
+          }
+          else
           {
-            ++ep;
+            *++ep = entity_to_idx[n];
           }
         }
-        return span<_entity_idx>(entity_to_idx, ep - entity_to_idx);
+        return span<_entity_idx>(entity_to_idx, ep + 1 - entity_to_idx);
       }
       LLFIO_HEADERS_ONLY_VIRTUAL_SPEC result<void> _lock(entities_guard &out, deadline d, bool spin_not_sleep) noexcept final
       {
@@ -324,9 +467,22 @@ namespace algorithm
         // alloca() always returns 16 byte aligned addresses
         span<_entity_idx> entity_to_idx(_hash_entities(reinterpret_cast<_entity_idx *>(alloca(sizeof(_entity_idx) * out.entities.size())), out.entities));
         _hash_index_type &index = _index();
+        _waiters_type *waiters = spin_not_sleep ? nullptr : _waiters();
         // Fire this if an error occurs
         auto disableunlock = make_scope_exit([&]() noexcept { out.release(); });
-        size_t n;
+        size_t n, spins = 0;
+        // The slot we have counted ourselves as sleeping upon, and the value of its futex word when we did so
+        unsigned sleep_idx = static_cast<unsigned>(-1);
+        uint32_t sleep_value = 0;
+        auto unsleep = [&]() noexcept {
+          if(sleep_idx != static_cast<unsigned>(-1))
+          {
+            (*waiters)[sleep_idx].sleepers.fetch_sub(1, std::memory_order_relaxed);
+            sleep_idx = static_cast<unsigned>(-1);
+          }
+        };
+        // However we leave, we must no longer be counted as a sleeper
+        auto unsleepguard = make_scope_exit(unsleep);
         for(;;)
         {
           auto was_contended = static_cast<size_t>(-1);
@@ -340,8 +496,10 @@ namespace algorithm
                 for(; n > 0; n--)
                 {
                   entity_to_idx[n].exclusive ? index[entity_to_idx[n].value].unlock() : index[entity_to_idx[n].value].unlock_shared();
+                  _wake(entity_to_idx[n].value);
                 }
                 entity_to_idx[0].exclusive ? index[entity_to_idx[0].value].unlock() : index[entity_to_idx[0].value].unlock_shared();
+                _wake(entity_to_idx[0].value);
               }
             });
             for(n = 0; n < entity_to_idx.size(); n++)
@@ -358,21 +516,48 @@ namespace algorithm
             return success();
           }
         failed:
+          long long remaining_nsecs = _max_sleep_nsecs;
           if(d)
           {
             if((d).steady)
             {
-              if(std::chrono::steady_clock::now() >= (began_steady + std::chrono::nanoseconds((d).nsecs)))
+              auto remaining = (began_steady + std::chrono::nanoseconds((d).nsecs)) - std::chrono::steady_clock::now();
+              if(remaining <= remaining.zero())
               {
                 return errc::timed_out;
               }
+              remaining_nsecs = std::min(remaining_nsecs, (long long) std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count());
             }
             else
             {
-              if(std::chrono::system_clock::now() >= end_utc)
+              auto remaining = end_utc - std::chrono::system_clock::now();
+              if(remaining <= remaining.zero())
               {
                 return errc::timed_out;
               }
+              remaining_nsecs = std::min(remaining_nsecs, (long long) std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count());
+            }
+          }
+          if(waiters != nullptr && ++spins >= _spins_before_sleeping)
+          {
+            const unsigned idx = entity_to_idx[was_contended].value;
+            auto &waiter = (*waiters)[idx];
+            if(idx == sleep_idx)
+            {
+              /* We counted ourselves before the last attempt, so any unlock since either was seen
+              by that attempt, or bumped the generation and so the futex wait won't sleep.
+              */
+              _sleep(waiter.generation, sleep_value, remaining_nsecs);
+              unsleep();
+            }
+            else
+            {
+              // Stop counting ourselves upon any previous slot, count ourselves as sleeping on
+              // this one, and make one more attempt before sleeping
+              unsleep();
+              waiter.sleepers.fetch_add(1, std::memory_order_seq_cst);
+              sleep_value = waiter.generation.load(std::memory_order_seq_cst);
+              sleep_idx = idx;
             }
           }
           // Move was_contended to front and randomise rest of out.entities
@@ -397,6 +582,7 @@ namespace algorithm
         for(const auto &i : entity_to_idx)
         {
           i.exclusive ? index[i.value].unlock() : index[i.value].unlock_shared();
+          _wake(i.value);
         }
       }
     };
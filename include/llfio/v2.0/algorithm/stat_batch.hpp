@@ -0,0 +1,85 @@
+/* A filesystem algorithm which fetches the metadata of many directory entries at once
+(C) 2026 agent <agent@local>
+File Created: Oct 2026
+
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License in the accompanying file
+Licence.txt or at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+
+Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file Licence.txt or copy at
+          http://www.boost.org/LICENSE_1_0.txt)
+*/
+
+#ifndef LLFIO_ALGORITHM_STAT_BATCH_HPP
+#define LLFIO_ALGORITHM_STAT_BATCH_HPP
+
+#include "../directory_handle.hpp"
+
+//! \file stat_batch.hpp Provides a batched fetch of directory entry metadata.
+
+LLFIO_V2_NAMESPACE_BEGIN
+
+namespace algorithm
+{
+  /*! \brief Fills in place the metadata `wanted` of every entry in `entries`,
+  looking up each leafname relative to `base`.
+
+  This is the batch equivalent of calling `entry.stat.fill(base, entry.leafname, wanted)`
+  for every entry, as `traverse_visitor::post_enumeration()` implementations
+  frequently need to do when `directory_handle::read()` did not return all the
+  metadata they need.
+
+  On Linux, a private `io_uring` is created upon first use by each calling thread
+  and thereafter reused by that thread, and an `IORING_OP_STATX` is issued for
+  every leafname with up to 256 in flight at a time,
+  so the kernel can fetch the metadata of many inodes concurrently instead of
+  one syscall at a time. If `io_uring` is not available (kernels before 5.6,
+  seccomp filters etc), and on all other platforms, the entries are instead
+  divided between up to `threads` threads each calling `stat_t::fill()`. Each
+  thread remembers if its kernel lacks `IORING_OP_STATX`, and does not try the
+  `io_uring` again.
+
+  Entries whose metadata could not be fetched are left unmodified. If `filled`
+  is not empty, it must be the same size as `entries`, and each item is set
+  to whether the corresponding entry was filled.
+
+  \return The number of entries which were filled.
+  \param base The directory relative to which the leafnames are looked up.
+  \param entries The entries to fill.
+  \param wanted The metadata to fetch.
+  \param filled An optional span to receive which entries were filled.
+  \param threads The maximum number of threads to use if `io_uring` is unavailable.
+  Zero means use the hardware concurrency. One means use only the calling thread,
+  which you should use when already running inside a thread pool e.g. from
+  within a `traverse_visitor`.
+
+  \mallocs Allocates a buffer for each in flight leafname upon first use by each
+  thread, more if a leafname is longer than any before, and any threads used.
+  */
+  LLFIO_HEADERS_ONLY_FUNC_SPEC result<size_t> stat_batch(const path_handle &base, span<directory_entry> entries, stat_t::want wanted = stat_t::want::all,
+                                                         span<bool> filled = {}, size_t threads = 0) noexcept;
+
+}  // namespace algorithm
+
+LLFIO_V2_NAMESPACE_END
+
+#if LLFIO_HEADERS_ONLY == 1 && !defined(DOXYGEN_SHOULD_SKIP_THIS)
+#define LLFIO_INCLUDED_BY_HEADER 1
+#include "../detail/impl/stat_batch.ipp"
+#undef LLFIO_INCLUDED_BY_HEADER
+#endif
+
+
+#endif
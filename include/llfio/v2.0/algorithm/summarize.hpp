@@ -25,6 +25,7 @@ Distributed under the Boost Software License, Version 1.0.
 #ifndef LLFIO_ALGORITHM_SUMMARIZE_HPP
 #define LLFIO_ALGORITHM_SUMMARIZE_HPP
 
+#include "stat_batch.hpp"
 #include "traverse.hpp"
 
 #include "../stat.hpp"
@@ -157,38 +158,11 @@ namespace algorithm
     {
       if((state->want & already_have_metadata) != state->want)
       {
-        // Fetch any missing metadata
-        if(entry.stat.st_type == filesystem::file_type::directory)
-        {
-          if(auto fh = directory_handle::directory(*dirh, entry.leafname, file_handle::mode::attr_read))
-          {
-            if(!entry.stat.fill(fh.assume_value(), state->want & ~already_have_metadata))
-            {
-              acc.stats_failed++;
-              return;
-            }
-          }
-          else
-          {
-            acc.stats_failed++;
-            return;
-          }
-        }
-        else
+        // Fetch any missing metadata, without opening the entry
+        if(!entry.stat.fill(*dirh, entry.leafname, state->want & ~already_have_metadata))
         {
-          if(auto fh = file_handle::file(*dirh, entry.leafname, file_handle::mode::attr_read))
-          {
-            if(!entry.stat.fill(fh.assume_value(), state->want & ~already_have_metadata))
-            {
-              acc.stats_failed++;
-              return;
-            }
-          }
-          else
-          {
-            acc.stats_failed++;
-            return;
-          }
+          acc.stats_failed++;
+          return;
         }
       }
       if(state->want & stat_t::want::dev)
@@ -241,9 +215,33 @@ namespace algorithm
         auto *state = (traversal_summary *) data;
         traversal_summary acc;
         acc.max_depth = depth;
-        for(auto &entry : contents)
+        if((state->want & contents.metadata()) != state->want)
+        {
+          // Fetch all the missing metadata at once. We are already running within traverse()'s threads.
+          std::unique_ptr<bool[]> filled(new(std::nothrow) bool[contents.size()]);
+          if(!filled)
+          {
+            return errc::not_enough_memory;
+          }
+          OUTCOME_TRY(stat_batch(dirh, contents, state->want & ~contents.metadata(), {filled.get(), contents.size()}, 1));
+          for(size_t n = 0; n < contents.size(); n++)
+          {
+            if(filled[n])
+            {
+              accumulate(acc, state, &dirh, contents[n], state->want);
+            }
+            else
+            {
+              acc.stats_failed++;
+            }
+          }
+        }
+        else
         {
-          accumulate(acc, state, &dirh, entry, contents.metadata());
+          for(auto &entry : contents)
+          {
+            accumulate(acc, state, &dirh, entry, contents.metadata());
+          }
         }
         state->operator+=(acc);
         return success();
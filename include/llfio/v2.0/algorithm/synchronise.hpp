@@ -0,0 +1,180 @@
+/* A filesystem algorithm which makes one directory tree identical to another
+(C) 2026 agent <agent@local>
+File Created: Oct 2026
+
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License in the accompanying file
+Licence.txt or at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+
+Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file Licence.txt or copy at
+          http://www.boost.org/LICENSE_1_0.txt)
+*/
+
+#ifndef LLFIO_ALGORITHM_SYNCHRONISE_HPP
+#define LLFIO_ALGORITHM_SYNCHRONISE_HPP
+
+#include "clone.hpp"
+#include "reduce.hpp"
+#include "stat_batch.hpp"
+
+//! \file synchronise.hpp Provides an incremental directory tree synchronisation algorithm.
+
+LLFIO_V2_NAMESPACE_BEGIN
+
+namespace algorithm
+{
+  //! \brief A summary of what `synchronise()` did.
+  struct synchronise_summary
+  {
+    size_t entries_unchanged{0};  //!< Entries which were already identical.
+    size_t entries_created{0};    //!< Entries created in the destination.
+    size_t entries_updated{0};    //!< Entries in the destination whose content or metadata was updated.
+    size_t entries_removed{0};    //!< Entries removed from the destination, including everything under removed directories.
+    size_t entries_skipped{0};    //!< Entries which the visitor declined to synchronise, or which are not of a synchronisable kind.
+    file_handle::extent_type bytes_compared{0};  //!< Bytes of changed files compared block by block.
+    file_handle::extent_type bytes_copied{0};    //!< Bytes cloned or copied into the destination.
+  };
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251)  // dll interface
+#pragma warning(disable : 4275)  // dll interface
+#endif
+  /*! \brief A visitor for the filesystem traversal and synchronisation algorithm.
+
+  Note that at any time, returning a failure causes `synchronise()` to exit as soon
+  as possible with the same failure.
+
+  You can override the members here inherited from `traverse_visitor`, however note
+  that `synchronise()` is entirely implemented using `traverse()` of the source tree,
+  so not calling the implementations here will affect operation.
+  */
+  struct LLFIO_DECL synchronise_visitor : public traverse_visitor
+  {
+    //! The kind of difference between source and destination entries of the same name
+    enum class difference_type : uint8_t
+    {
+      entry_added,          //!< Entry is in the source but not the destination
+      entry_removed,        //!< Entry is in the destination but not the source
+      entry_kind,           //!< Same entry name has different kind e.g. file vs directory
+      content_metadata,     //!< Maximum extent or modified timestamp metadata is different, or symbolic link target is different
+      noncontent_metadata,  //!< Non-content metadata (perms, ownership) is different
+    };
+
+    /*! Regular files with a maximum extent at or above this whose content metadata
+    differs are updated in place by comparing blocks, writing only those blocks
+    which differ. Smaller files are replaced whole.
+    */
+    file_handle::extent_type delta_threshold{(file_handle::extent_type) 1024 * 1024};
+
+    /*! If true, changed files at or above `delta_threshold` are reflinked to the source
+    where the filing system can do so without copying any bytes. Set this to false to
+    always compare blocks, e.g. so the destination shares no extents with the source.
+    */
+    bool reflink_changed_files{true};
+
+    //! This override implements the synchronisation of the entries of each source directory.
+    virtual result<void> post_enumeration(void *data, const directory_handle &dirh, directory_handle::buffers_type &contents, size_t depth) noexcept override;
+
+    /*! \brief Called for each difference found between source and destination, just
+    before it is resolved. `src` is null for `entry_removed`, and `dest` is null for
+    `entry_added`. The default returns true. Return false to leave the destination
+    entry unmodified, which for an added directory also skips everything under it.
+
+    Returning false for every difference implements a dry run which computes the
+    difference list between the two trees.
+
+    \note May be called from multiple kernel threads concurrently.
+    */
+    virtual result<bool> difference(void *data, const directory_handle &srcdirh, const directory_handle &destdirh, const directory_entry *src,
+                                    const directory_entry *dest, difference_type kind, size_t depth) noexcept
+    {
+      (void) data;
+      (void) srcdirh;
+      (void) destdirh;
+      (void) src;
+      (void) dest;
+      (void) kind;
+      (void) depth;
+      return true;
+    }
+  };
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+  /*! \brief Make the directory tree identified by `destdirh` identical to the one identified
+  by `srcdirh`, modifying as little of the destination as possible.
+
+  The algorithm is as follows:
+
+  1. `algorithm::traverse()` of the source tree is begun, using the visitor supplied.
+  Traversal is breadth first, so the destination directory corresponding to each source
+  directory has always been created before that source directory is enumerated.
+
+  2. The corresponding destination directory is enumerated, and any metadata not
+  returned by either enumeration is fetched using `algorithm::stat_batch()`.
+
+  3. Every difference between the two sets of entries is passed to the visitor's
+  `difference()`, and if that returns true, is resolved:
+
+     - Entries in the destination but not in the source are removed, using
+     `algorithm::reduce()` for directories.
+     - Entries of a different kind are removed and recreated.
+     - Missing directories are created, missing symbolic links are created with the
+     same target, and missing regular files are copied using `algorithm::clone_or_copy()`.
+     - Regular files are considered unchanged if their maximum extent and last modified
+     timestamp are identical, same as for `algorithm::clone_or_copy()`. If only their
+     permissions or ownership differ, the destination is restamped.
+     - Changed regular files smaller than `synchronise_visitor::delta_threshold` are
+     replaced using `algorithm::clone_or_copy()`.
+     - Changed regular files at or above that threshold are first truncated to the
+     source's maximum extent. If `synchronise_visitor::reflink_changed_files` is true
+     and the filing system can reflink the source's extents without copying any bytes,
+     they are (on Linux, `FICLONE`; on Windows, duplicate extents on ReFS). Otherwise
+     ranges allocated in the destination but not in the source are deallocated, and
+     the allocated extents of the source are compared block by block with the
+     destination, with only differing blocks being written. Mirror refreshes of
+     large files of which only a little has changed therefore write only what
+     has changed.
+     - Changed files are restamped with the source metadata.
+
+  Block devices, character devices, fifos and sockets are not synchronised. The
+  timestamps of directories are not synchronised, as they would be changed again
+  by the synchronisation of their contents.
+
+  Any failure to open, read or modify an entry fails the synchronisation, which
+  may leave the destination partially synchronised. Calling this function again
+  resumes from where it left off, as already synchronised entries are unchanged.
+
+  You should review the documentation for `algorithm::traverse()`, as this algorithm is
+  entirely implemented using that algorithm.
+  */
+  LLFIO_HEADERS_ONLY_FUNC_SPEC result<synchronise_summary> synchronise(const path_handle &srcdirh, const path_handle &destdirh,
+                                                                       synchronise_visitor *visitor = nullptr, size_t threads = 0,
+                                                                       bool force_slow_path = false) noexcept;
+
+}  // namespace algorithm
+
+LLFIO_V2_NAMESPACE_END
+
+#if LLFIO_HEADERS_ONLY == 1 && !defined(DOXYGEN_SHOULD_SKIP_THIS)
+#define LLFIO_INCLUDED_BY_HEADER 1
+#include "../detail/impl/synchronise.ipp"
+#undef LLFIO_INCLUDED_BY_HEADER
+#endif
+
+
+#endif
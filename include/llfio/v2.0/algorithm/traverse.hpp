@@ -144,12 +144,17 @@ namespace algorithm
   3. Call `post_enumeration()` of the visitor on the contents just enumerated.
 
   4. For each directory in the contents, append a base directory handle and a directory
-  fragment to its hierarchy depth level in a stack of lists.
+  fragment to its hierarchy depth level in the calling worker's stack of lists.
 
-  5. Loop, using the least deep available item in the stack, until the stack is empty.
+  5. Loop, using the least deep available item in the worker's stack, until the stack is empty.
+  A worker with an empty stack steals the back half of the least deep level of another
+  worker's stack.
 
   If `known_dirs_remaining` exceeds four, a threadpool of not more than `threads` threads
-  is spun up in order to traverse the hierarchy more quickly.
+  is spun up in order to traverse the hierarchy more quickly. As each worker has its own
+  stack, workers only contend with one another when stealing, so the traversal scales with
+  `threads` for as long as the filesystem does. See `programs/benchmark-traverse` for a
+  benchmark of this scaling.
 
   This algorithm is therefore primarily a breadth-first algorithm, in that we proceed from
   root, level by level, to the tips. The number returned is the total number of directories
@@ -705,11 +705,10 @@ LLFIO_V2_NAMESPACE_END
 #include "detail/impl/windows/byte_io_handle.ipp"
 #endif
 #else
-#if LLFIO_ENABLE_TEST_IO_MULTIPLEXERS
-// #include "detail/impl/posix/test/io_uring_multiplexer.ipp"
-#else
-#endif
 #include "detail/impl/posix/byte_io_handle.ipp"
+#ifdef __linux__
+#include "detail/impl/posix/io_uring_multiplexer.ipp"
+#endif
 #endif
 #undef LLFIO_INCLUDED_BY_HEADER
 #endif
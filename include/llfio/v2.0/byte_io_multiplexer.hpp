@@ -551,6 +551,15 @@ public:
   //! Implements `byte_io_handle::allocate_registered_buffer()`
   LLFIO_HEADERS_ONLY_VIRTUAL_SPEC result<registered_buffer_type> do_byte_io_handle_allocate_registered_buffer(byte_io_handle *h, size_t &bytes) noexcept;
 
+protected:
+  //! For readiness based implementations, attempts a connect using the socket's own implementation.
+  static inline result<void> _do_byte_socket_handle_connect(byte_socket_handle *h, const ip::address &addr, deadline d) noexcept;
+  //! For readiness based implementations, attempts an accept using the listening socket's own implementation.
+  static inline result<void> _do_listening_byte_socket_handle_read(listening_byte_socket_handle *h, std::pair<byte_socket_handle, ip::address> &req,
+                                                                   deadline d) noexcept;
+
+public:
+
   struct io_operation_state_visitor;
   /*! \brief An interface to a state for an i/o operation scheduled against an i/o multiplexer.
 
@@ -657,6 +666,12 @@ public:
     virtual void _lock() noexcept {}
     virtual void _unlock() noexcept {}
 
+    friend class byte_io_multiplexer;
+    // Used by the default chain emulation. Returns the bytes a read or write not yet initiated is to transfer, or -1 if unknown.
+    virtual size_t _bytes_requested() const noexcept { return (size_t) -1; }
+    // Used by the default chain emulation. Completes and finishes with `errc::operation_canceled` an i/o not yet initiated, returning false if not possible.
+    virtual bool _cancel_uninitiated() noexcept { return false; }
+
   public:
     virtual ~io_operation_state() {}
 
@@ -850,6 +865,48 @@ protected:
     {
     }
 
+    virtual size_t _bytes_requested() const noexcept override
+    {
+      size_t ret = 0;
+      switch(state)
+      {
+      case io_operation_state_type::read_initialised:
+        for(auto &b : payload.noncompleted.params.read.reqs.buffers)
+        {
+          ret += b.size();
+        }
+        return ret;
+      case io_operation_state_type::write_initialised:
+        for(auto &b : payload.noncompleted.params.write.reqs.buffers)
+        {
+          ret += b.size();
+        }
+        return ret;
+      default:
+        return (size_t) -1;
+      }
+    }
+    virtual bool _cancel_uninitiated() noexcept override
+    {
+      switch(state)
+      {
+      case io_operation_state_type::read_initialised:
+        this->read_completed(errc::operation_canceled);
+        this->read_finished();
+        return true;
+      case io_operation_state_type::write_initialised:
+        this->write_completed(errc::operation_canceled);
+        this->write_or_barrier_finished();
+        return true;
+      case io_operation_state_type::barrier_initialised:
+        this->barrier_completed(errc::operation_canceled);
+        this->write_or_barrier_finished();
+        return true;
+      default:
+        return false;
+      }
+    }
+
   public:
     virtual ~_unsynchronised_io_operation_state() { clear_storage(); }
 
@@ -1169,6 +1226,8 @@ protected:
 // Size of an awaitable
 #ifdef _WIN32
   static constexpr size_t _awaitable_size = 2048;  // IOCP implementation is unavoidably large
+#elif defined(__linux__)
+  static constexpr size_t _awaitable_size = 256;  // io_uring implementation needs to track partial i/o
 #else
   static constexpr size_t _awaitable_size = 128;
 #endif
@@ -1328,6 +1387,138 @@ public:
   };
   static_assert(sizeof(awaitable<io_result<buffers_type>>) == _awaitable_size, "awaitable<io_result<buffers_type>> is not _awaitable_size bytes in length!");
 
+  /* The default emulation of a chain of i/o. Each i/o's visitor is replaced with a link which
+  forwards to the original visitor, and upon completion initiates the next i/o in the chain if
+  this one transferred everything requested, or cancels the rest of the chain if not. The
+  original visitor is restored upon completion, so the chain deletes itself once every i/o in
+  it has completed.
+  */
+  struct _emulated_chain
+  {
+    struct link final : public io_operation_state_visitor
+    {
+      _emulated_chain *chain{nullptr};
+      size_t idx{0};
+      io_operation_state *state{nullptr};
+      io_operation_state_visitor *original{nullptr};
+      size_t requested{(size_t) -1};
+
+      template <class BuffersType> bool _completed(const io_result<BuffersType> &res) noexcept
+      {
+        // Restore the original visitor, so the finished call goes straight to it
+        state->visitor = original;
+        if(!res)
+        {
+          return false;
+        }
+        if(requested == (size_t) -1)
+        {
+          return true;
+        }
+        size_t transferred = 0;
+        for(auto &b : res.value())
+        {
+          transferred += b.size();
+        }
+        return transferred == requested;
+      }
+      virtual void read_initiated(lock_guard &g, io_operation_state_type former) override
+      {
+        if(original != nullptr)
+        {
+          original->read_initiated(g, former);
+        }
+      }
+      virtual bool read_completed(lock_guard &g, io_operation_state_type former, io_result<buffers_type> &&res) override
+      {
+        const bool succeeded = _completed(res);
+        const bool consumed = (original != nullptr) && original->read_completed(g, former, std::move(res));
+        chain->completed(idx, succeeded);
+        return consumed;
+      }
+      virtual void write_initiated(lock_guard &g, io_operation_state_type former) override
+      {
+        if(original != nullptr)
+        {
+          original->write_initiated(g, former);
+        }
+      }
+      virtual bool write_completed(lock_guard &g, io_operation_state_type former, io_result<const_buffers_type> &&res) override
+      {
+        const bool succeeded = _completed(res);
+        const bool consumed = (original != nullptr) && original->write_completed(g, former, std::move(res));
+        chain->completed(idx, succeeded);
+        return consumed;
+      }
+      virtual void barrier_initiated(lock_guard &g, io_operation_state_type former) override
+      {
+        if(original != nullptr)
+        {
+          original->barrier_initiated(g, former);
+        }
+      }
+      virtual bool barrier_completed(lock_guard &g, io_operation_state_type former, io_result<const_buffers_type> &&res) override
+      {
+        const bool succeeded = _completed(res);
+        const bool consumed = (original != nullptr) && original->barrier_completed(g, former, std::move(res));
+        chain->completed(idx, succeeded);
+        return consumed;
+      }
+    };
+    byte_io_multiplexer *multiplexer{nullptr};
+    std::unique_ptr<link[]> links;
+    size_t count{0}, completions{0};
+
+    _emulated_chain(byte_io_multiplexer *_multiplexer, span<io_operation_state *> states) noexcept
+        : multiplexer(_multiplexer)
+        , links(new(std::nothrow) link[states.size()])
+        , count(states.size())
+    {
+      if(links)
+      {
+        for(size_t n = 0; n < count; n++)
+        {
+          links[n].chain = this;
+          links[n].idx = n;
+          links[n].state = states[n];
+          links[n].original = states[n]->visitor;
+          links[n].requested = states[n]->_bytes_requested();
+          states[n]->visitor = &links[n];
+        }
+      }
+    }
+    void initiate(size_t idx) noexcept
+    {
+      (void) multiplexer->init_io_operation(links[idx].state);
+      (void) multiplexer->flush_inited_io_operations();
+    }
+    void completed(size_t idx, bool succeeded) noexcept
+    {
+      const bool last = (++completions == count);
+      if(idx + 1 < count)
+      {
+        if(succeeded)
+        {
+          initiate(idx + 1);
+        }
+        else
+        {
+          // Cancelling the next i/o completes it, which cancels the one after it and so on
+          io_operation_state *next = links[idx + 1].state;
+          if(!next->_cancel_uninitiated())
+          {
+            (void) multiplexer->init_io_operation(next);
+            (void) multiplexer->cancel_io_operation(next);
+          }
+        }
+      }
+      if(last)
+      {
+        delete this;
+      }
+    }
+  };
+
 public:
   //! Returns the number of bytes, and alignment required, for an `io_operation_state` for this multiplexer
   virtual std::pair<size_t, size_t> io_state_requirements() noexcept = 0;
@@ -1456,9 +1647,122 @@ public:
   //! Flushes any previously initiated i/o, if necessary for this i/o multiplexer
   virtual result<void> flush_inited_io_operations() noexcept { return success(); }
 
+  /*! \brief Initiates the i/o in a batch of previously constructed states, and flushes them.
+
+  This has the same effect as calling `.init_io_operation()` upon each state followed by
+  a single `.flush_inited_io_operations()`, but implementations may take their locks once
+  for the whole batch and submit the whole batch to the kernel in a single syscall. The
+  states may refer to any mix of handles and kinds of i/o registered with this multiplexer.
+
+  `out` must be the same size as `states`, and receives the state of each i/o after initiation
+  so i/o which completed immediately can be seen in bulk. As with `.init_io_operation()`, you
+  cannot relocate in memory any state until it is finished.
+  */
+  virtual result<void> init_io_operations(span<io_operation_state *> states, span<io_operation_state_type> out) noexcept
+  {
+    if(out.size() != states.size())
+    {
+      return errc::invalid_argument;
+    }
+    for(size_t n = 0; n < states.size(); n++)
+    {
+      out[n] = init_io_operation(states[n]);
+    }
+    return flush_inited_io_operations();
+  }
+
+  /*! \brief Initiates a chain of previously constructed states, each of whose i/o begins
+  only once the i/o before it in the chain has completed successfully, and flushes them.
+
+  This expresses dependent i/o such as a write followed by a barrier, or a read followed
+  by a write of what was read, without the caller needing to wait for each completion
+  before initiating the next i/o. Only the last i/o in the chain need be waited upon. An
+  i/o in the chain which fails, or which transfers fewer bytes than requested, causes all
+  the i/o after it in the chain to complete with `errc::operation_canceled`.
+
+  `out` must be the same size as `states`, and receives the state of each i/o after
+  initiation. Every i/o in the chain is initiated by this call, unless it completed
+  immediately. For the purposes of per-handle ordering, each i/o in the chain after the
+  first is initiated when the i/o before it completes. As with `.init_io_operation()`,
+  you cannot relocate in memory any state until it is finished.
+
+  Multiplexers with native support for dependent i/o submit the chain to the kernel in a
+  single operation, so it completes with a single wakeup. Other multiplexers emulate the
+  chain by initiating each i/o internally as the i/o before it completes. The default
+  implementation does so by temporarily interposing upon the visitor of each i/o in the
+  chain, which requires a small dynamic memory allocation per chain.
+  */
+  virtual result<void> init_io_operation_chain(span<io_operation_state *> states, span<io_operation_state_type> out) noexcept
+  {
+    if(out.size() != states.size())
+    {
+      return errc::invalid_argument;
+    }
+    if(states.size() <= 1)
+    {
+      return init_io_operations(states, out);
+    }
+    auto *chain = new(std::nothrow) _emulated_chain(this, states);
+    if(chain == nullptr || !chain->links)
+    {
+      delete chain;
+      return errc::not_enough_memory;
+    }
+    // Once the first i/o is initiated, the chain may complete and delete itself at any time
+    const size_t count = states.size();
+    chain->initiate(0);
+    for(size_t n = 0; n < count; n++)
+    {
+      out[n] = states[n]->current_state();
+    }
+    return success();
+  }
+
   //! Asks the system for the current state of the i/o, returning its current state.
   virtual io_operation_state_type check_io_operation(io_operation_state *op) noexcept { return op->current_state(); }
 
+  /*! \brief Asks the system for the current state of a batch of i/o, waiting up to `d` for at
+  least one of them to finish, and returning how many are finished (this function never
+  fails with timed out).
+
+  `out` must be the same size as `states`, and receives the current state of each i/o.
+  Completions are reaped using `.check_for_any_completed_io()`, so completions for i/o
+  not in the batch may also be dispatched. All the states must remain in existence for
+  the duration of the call.
+  */
+  virtual result<size_t> check_io_operations(span<io_operation_state *> states, span<io_operation_state_type> out,
+                                             deadline d = std::chrono::seconds(0)) noexcept
+  {
+    if(out.size() != states.size())
+    {
+      return errc::invalid_argument;
+    }
+    LLFIO_DEADLINE_TO_SLEEP_INIT(d);
+    auto timed_out = [&]() -> result<void> {
+      LLFIO_DEADLINE_TO_TIMEOUT_LOOP(d);
+      return success();
+    };
+    for(;;)
+    {
+      deadline nd;
+      LLFIO_DEADLINE_TO_PARTIAL_DEADLINE(nd, d);
+      OUTCOME_TRY(check_for_any_completed_io(nd));
+      size_t ret = 0;
+      for(size_t n = 0; n < states.size(); n++)
+      {
+        out[n] = states[n]->current_state();
+        if(is_finished(out[n]))
+        {
+          ++ret;
+        }
+      }
+      if(ret > 0 || states.empty() || !timed_out())
+      {
+        return ret;
+      }
+    }
+  }
+
   //! Cancel an initiated i/o, returning its current state if successful.
   virtual result<io_operation_state_type> cancel_io_operation(io_operation_state *op, deadline d = {}) noexcept = 0;
 
@@ -1491,6 +1795,76 @@ static_assert(OUTCOME_V2_NAMESPACE::concepts::basic_result<byte_io_multiplexer::
               "byte_io_multiplexer::io_result<int> does not match the Outcome basic_result concept!");
 #endif
 
+#if defined(__linux__) || DOXYGEN_IS_IN_THE_HOUSE
+/*! \brief Return an i/o multiplexer implemented using Linux io_uring.
+
+\param threads The number of kernel threads which will use the multiplexer
+concurrently. If one, a multiplexer without any locking is returned.
+\param is_polling If true, a kernel thread polls the submission queue,
+which eliminates the syscall for submission at the cost of a dedicated CPU.
+In addition, reads and writes upon seekable handles opened with `caching::none`
+(i.e. `O_DIRECT`) are submitted to a second io_uring set up with `IORING_SETUP_IOPOLL`,
+whose completions are busy polled from the device rather than signalled by
+interrupt. On NVMe devices with poll queues configured, this completes i/o with
+no syscalls at all, at the cost of a second dedicated CPU. Devices which cannot
+be polled fall back to interrupt driven completion per handle.
+
+The multiplexer can multiplex `file_handle`, `pipe_handle` and `byte_socket_handle`.
+`listening_byte_socket_handle` and connecting `byte_socket_handle` are not
+currently supported, so sockets should be connected before being registered.
+
+The multiplexer implements POSIX read/write concurrency guarantees per file
+descriptor i.e. writes and barriers to seekable handles are ordered with respect
+to all other i/o to that handle, and i/o to non-seekable handles is performed in
+order of initiation. Short reads and writes are resubmitted where the blocking
+equivalent would not return a partial result, and per-i/o deadlines are
+implemented using the kernel's linked timeouts.
+
+Registered handles are also registered with the kernel as fixed files. Buffers
+returned by `byte_io_handle::allocate_registered_buffer()` come from a pool of
+memory registered with the kernel, and i/o from a single such buffer avoids the
+per-i/o page pinning. If the kernel refuses either registration, usually due to
+`RLIMIT_MEMLOCK`, i/o works as before without the optimisation.
+
+Chains of i/o initiated by `init_io_operation_chain()` whose i/o are all upon seekable
+handles, and have no deadlines, are submitted to the kernel linked by `IOSQE_IO_LINK`,
+so e.g. a write followed by a barrier completes with a single wakeup. Other chains are
+emulated, with each i/o submitted as the i/o before it completes.
+
+Whilst polled i/o is in flight, `check_for_any_completed_io()` spins rather than
+sleeps, and polled i/o ignores cancellation, though it completes quickly. Polled
+i/o must not have a deadline, so i/o with a deadline uses interrupt driven completion.
+
+Requires Linux 5.5 or later, otherwise `errc::not_supported` is returned.
+*/
+LLFIO_HEADERS_ONLY_FUNC_SPEC result<byte_io_multiplexer_ptr> multiplexer_linux_io_uring(size_t threads, bool is_polling = false) noexcept;
+
+/*! \brief Return an i/o multiplexer implemented using Linux epoll.
+
+\param threads The number of threads which shall use the multiplexer
+simultaneously. If this is 1, a multiplexer without internal locking is
+returned, and you must only ever use it from one thread at a time.
+
+epoll reports readiness rather than completion, so i/o is performed by
+this multiplexer when the kernel reports a file descriptor ready. Only
+`pipe_handle`, `byte_socket_handle` and `listening_byte_socket_handle`
+can be registered, and they must have been opened with `flag::multiplexable`
+so they are non-blocking. Registering any other handle fails with
+`errc::operation_not_supported`. Unlike `multiplexer_linux_io_uring()`,
+connects and accepts are supported.
+
+File descriptors are registered edge triggered, and i/o is attempted
+immediately upon initiation if nothing is queued before it. Reads complete
+as soon as any bytes are read, writes complete only once all bytes have been
+written, and i/o to each handle is performed in order of initiation. Chains
+of i/o initiated by `init_io_operation_chain()` are emulated.
+
+The implementation of this function is in `byte_socket_handle.hpp`, so
+header only users must include that header (`llfio.hpp` does).
+*/
+LLFIO_HEADERS_ONLY_FUNC_SPEC result<byte_io_multiplexer_ptr> multiplexer_linux_epoll(size_t threads) noexcept;
+#endif
+
 #if LLFIO_ENABLE_TEST_IO_MULTIPLEXERS
 //! Namespace containing functions useful for test code
 namespace test
@@ -1502,10 +1876,6 @@ namespace test
   */
   LLFIO_HEADERS_ONLY_FUNC_SPEC result<byte_io_multiplexer_ptr> multiplexer_null(size_t threads, bool disable_immediate_completions) noexcept;
 
-#if defined(__linux__) || DOXYGEN_IS_IN_THE_HOUSE
-  // LLFIO_HEADERS_ONLY_FUNC_SPEC result<byte_io_multiplexer_ptr> multiplexer_linux_epoll(size_t threads) noexcept;
-  LLFIO_HEADERS_ONLY_FUNC_SPEC result<byte_io_multiplexer_ptr> multiplexer_linux_io_uring(size_t threads, bool is_polling) noexcept;
-#endif
 #if(defined(__FreeBSD__) || defined(__APPLE__)) || DOXYGEN_IS_IN_THE_HOUSE
 // LLFIO_HEADERS_ONLY_FUNC_SPEC result<byte_io_multiplexer_ptr> multiplexer_bsd_kqueue(size_t threads) noexcept;
 #endif
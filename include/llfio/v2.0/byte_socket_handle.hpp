@@ -421,6 +421,7 @@ can call `shutdown_and_close()` manually instead.
 */
 class LLFIO_DECL byte_socket_handle : public byte_io_handle, public pollable_handle
 {
+  friend class byte_io_multiplexer;
   LLFIO_HEADERS_ONLY_VIRTUAL_SPEC const handle &_get_handle() const noexcept final { return *this; }
 
 public:
@@ -849,6 +850,7 @@ template <class Base, class SocketType> struct listening_socket_handle_buffer_ty
 */
 class LLFIO_DECL listening_byte_socket_handle : public listening_socket_handle_buffer_types_injector<handle, byte_socket_handle>, public pollable_handle
 {
+  friend class byte_io_multiplexer;
   using _base = listening_socket_handle_buffer_types_injector<handle, byte_socket_handle>;
   LLFIO_HEADERS_ONLY_VIRTUAL_SPEC const handle &_get_handle() const noexcept final { return *this; }
 
@@ -1140,11 +1142,25 @@ template <> struct construct<listening_byte_socket_handle>
 // BEGIN make_free_functions.py
 // END make_free_functions.py
 
+inline result<void> byte_io_multiplexer::_do_byte_socket_handle_connect(byte_socket_handle *h, const ip::address &addr, deadline d) noexcept
+{
+  return h->byte_socket_handle::_do_connect(addr, d);
+}
+inline result<void> byte_io_multiplexer::_do_listening_byte_socket_handle_read(listening_byte_socket_handle *h,
+                                                                               std::pair<byte_socket_handle, ip::address> &req, deadline d) noexcept
+{
+  OUTCOME_TRY(h->listening_byte_socket_handle::_do_read({req}, d));
+  return success();
+}
+
 LLFIO_V2_NAMESPACE_END
 
 #if LLFIO_HEADERS_ONLY == 1 && !defined(DOXYGEN_SHOULD_SKIP_THIS)
 #define LLFIO_INCLUDED_BY_HEADER 1
 #include "detail/impl/byte_socket_handle.ipp"
+#ifdef __linux__
+#include "detail/impl/posix/epoll_multiplexer.ipp"
+#endif
 #undef LLFIO_INCLUDED_BY_HEADER
 #endif
 
@@ -24,6 +24,12 @@ Distributed under the Boost Software License, Version 1.0.
 
 #include "../../algorithm/clone.hpp"
 
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+
 LLFIO_V2_NAMESPACE_BEGIN
 
 namespace algorithm
@@ -235,6 +241,882 @@ namespace algorithm
     }
   }
 
+  LLFIO_HEADERS_ONLY_FUNC_SPEC result<file_handle::extent_pair> parallel_clone_extents_to(file_handle &src, file_handle::extent_pair extent, file_handle &dest,
+                                                                                          file_handle::extent_type destoffset, size_t threads,
+                                                                                          file_handle::extent_type chunk_size, deadline d, bool force_copy_now,
+                                                                                          bool emulate_if_unsupported) noexcept
+  {
+    using extent_type = file_handle::extent_type;
+    using extent_pair = file_handle::extent_pair;
+    LLFIO_EXCEPTION_TRY
+    {
+      LLFIO_LOG_FUNCTION_CALL(&src);
+      auto serial = [&] { return src.clone_extents_to(extent, dest, destoffset, d, force_copy_now, emulate_if_unsupported); };
+      if(threads == 0)
+      {
+        threads = std::max(std::thread::hardware_concurrency(), 1U);
+      }
+      OUTCOME_TRY(auto &&srclength, src.maximum_extent());
+      if(extent.offset == (extent_type) -1 && extent.length == (extent_type) -1)
+      {
+        extent.offset = 0;
+        extent.length = srclength;
+      }
+      const extent_type blocksize = utils::file_buffer_default_size();
+      chunk_size = std::max((chunk_size + blocksize - 1) / blocksize * blocksize, blocksize);
+      // Let clone_extents_to() deal with all the corner cases
+      if(threads == 1 || extent.length <= chunk_size || extent.offset + extent.length < extent.offset || destoffset + extent.length < destoffset ||
+         extent.offset >= srclength || dest.unique_id() == src.unique_id())
+      {
+        return serial();
+      }
+      if(extent.offset + extent.length > srclength)
+      {
+        extent.length = srclength - extent.offset;
+      }
+      // Split the allocated extents within the region into chunks
+      const extent_type end = extent.offset + extent.length;
+      std::vector<extent_pair> chunks, holes;
+      {
+        OUTCOME_TRY(auto &&allocated, src.extents());
+        extent_type lastend = extent.offset;
+        for(auto &i : allocated)
+        {
+          auto s = std::max(i.offset, extent.offset);
+          const auto e = std::min(i.offset + i.length, end);
+          if(s >= e)
+          {
+            continue;
+          }
+          if(s > lastend)
+          {
+            holes.push_back({lastend, s - lastend});
+          }
+          for(; s < e; s += chunk_size)
+          {
+            chunks.push_back({s, std::min(chunk_size, e - s)});
+          }
+          lastend = e;
+        }
+        if(lastend < end)
+        {
+          holes.push_back({lastend, end - lastend});
+        }
+      }
+      if(chunks.size() < 2)
+      {
+        return serial();
+      }
+      LLFIO_DEADLINE_TO_SLEEP_INIT(d);
+      OUTCOME_TRY(auto &&destlength, dest.maximum_extent());
+      bool truncate_back_on_failure = false;
+      if(destlength < destoffset + extent.length)
+      {
+        OUTCOME_TRY(dest.truncate(destoffset + extent.length));
+        truncate_back_on_failure = true;
+      }
+      auto untruncate = make_scope_exit(
+      [&]() noexcept
+      {
+        if(truncate_back_on_failure)
+        {
+          (void) dest.truncate(destlength);
+        }
+      });
+      const extent_type destoffsetdiff = destoffset - extent.offset;
+      // Deallocate the destination where the source is deallocated, except where we just extended it
+      for(auto &hole : holes)
+      {
+        const auto s = hole.offset + destoffsetdiff;
+        if(s >= destlength)
+        {
+          break;
+        }
+        deadline nd;
+        LLFIO_DEADLINE_TO_PARTIAL_DEADLINE(nd, d);
+        OUTCOME_TRY(dest.zero({s, std::min(hole.length, destlength - s)}, nd));
+        LLFIO_DEADLINE_TO_TIMEOUT_LOOP(d);
+      }
+      std::atomic<size_t> next{0};
+      std::atomic<bool> failed{false};
+      std::mutex errorlock;
+      optional<result<void>::error_type> error;
+      auto worker = [&]() noexcept
+      {
+        auto r = [&]() -> result<void>
+        {
+          for(size_t idx = 0; !failed.load(std::memory_order_relaxed) && (idx = next.fetch_add(1, std::memory_order_relaxed)) < chunks.size();)
+          {
+            const auto &chunk = chunks[idx];
+            deadline nd;
+            LLFIO_DEADLINE_TO_PARTIAL_DEADLINE(nd, d);
+            OUTCOME_TRY(src.clone_extents_to(chunk, dest, chunk.offset + destoffsetdiff, nd, force_copy_now, emulate_if_unsupported));
+            LLFIO_DEADLINE_TO_TIMEOUT_LOOP(d);
+          }
+          return success();
+        }();
+        if(!r)
+        {
+          std::lock_guard<std::mutex> g(errorlock);
+          if(!error)
+          {
+            error.emplace(std::move(r).error());
+          }
+          failed.store(true, std::memory_order_relaxed);
+        }
+      };
+      {
+        const size_t nthreads = std::min(threads, chunks.size());
+        std::vector<std::thread> workers;
+        workers.reserve(nthreads - 1);
+        auto joiner = make_scope_exit(
+        [&]() noexcept
+        {
+          for(auto &t : workers)
+          {
+            t.join();
+          }
+        });
+        for(size_t n = 1; n < nthreads; n++)
+        {
+          workers.emplace_back(worker);
+        }
+        worker();
+      }
+      if(error)
+      {
+        return std::move(*error);
+      }
+      truncate_back_on_failure = false;
+      return extent;
+    }
+    LLFIO_EXCEPTION_CATCH_ALL
+    {
+      return error_from_exception();
+    }
+  }
+
+  namespace detail
+  {
+    // Hands out blocks of the allocated extents of the files to be copied, opening each file lazily
+    class clone_or_copy_pipeline
+    {
+    public:
+      // Which of the requests this pipeline copies
+      enum class sources
+      {
+        all,
+        multiplexable,
+        unmultiplexable
+      };
+      struct file_state
+      {
+        clone_or_copy_request *req{nullptr};
+        bool begun{false};  // until set, only the thread which claimed this file may touch it
+        filesystem::path destleaf;
+        stat_t stat{nullptr};
+        file_handle dest;
+        byte_io_multiplexer *original_multiplexer{nullptr};
+        std::vector<file_handle::extent_pair> extents;
+        size_t extent_idx{0};
+        file_handle::extent_type extent_offset{0};
+        size_t inflight{0};
+        bool multiplexed{false};
+        optional<result<void>::error_type> failure;
+        file_handle::extent_type copied{0};
+      };
+      struct block
+      {
+        file_state *fs{nullptr};
+        file_handle::extent_type offset{0};
+        size_t length{0};
+      };
+
+    private:
+      span<clone_or_copy_request> _requests;
+      size_t _next_request{0};
+      std::list<file_state> _files;  // files being begun, or with blocks still to hand out or in flight
+      size_t _beginning{0};          // files claimed but not yet begun
+      const size_t _blocksize;
+      byte_io_multiplexer *_multiplexer;
+      const sources _sources;
+      const bool _preserve_timestamps, _force_copy_now;
+      const file_handle::creation _creation;
+
+      bool _wanted(const clone_or_copy_request &req) const noexcept
+      {
+        // Requests without a source fail in _begin(), so whichever pipeline copies everything else reports it
+        switch(_sources)
+        {
+        case sources::multiplexable:
+          return req.src == nullptr || req.src->is_multiplexable();
+        case sources::unmultiplexable:
+          return req.src != nullptr && !req.src->is_multiplexable();
+        default:
+          return true;
+        }
+      }
+
+    public:
+      file_handle::extent_type total{0};
+
+      clone_or_copy_pipeline(span<clone_or_copy_request> requests, size_t blocksize, byte_io_multiplexer *multiplexer, sources which,
+                             bool preserve_timestamps, bool force_copy_now, file_handle::creation creation)
+          : _requests(requests)
+          , _blocksize(blocksize)
+          , _multiplexer(multiplexer)
+          , _sources(which)
+          , _preserve_timestamps(preserve_timestamps)
+          , _force_copy_now(force_copy_now)
+          , _creation(creation)
+      {
+      }
+      clone_or_copy_pipeline(const clone_or_copy_pipeline &) = delete;
+      clone_or_copy_pipeline &operator=(const clone_or_copy_pipeline &) = delete;
+      ~clone_or_copy_pipeline()
+      {
+        // Only reached with files unfinished if the pipeline itself failed, in which case no
+        // blocks are in flight. Remove the partial copies, and restore the sources' multiplexers.
+        while(!_files.empty())
+        {
+          file_state &fs = _files.front();
+          if(!fs.failure && (!fs.begun || fs.inflight > 0 || fs.extent_idx < fs.extents.size()))
+          {
+            fs.failure.emplace(result<void>(errc::operation_canceled).error());
+          }
+          _finish(_files.begin());
+        }
+        for(; _next_request < _requests.size(); _next_request++)
+        {
+          if(_wanted(_requests[_next_request]))
+          {
+            _requests[_next_request].copied = errc::operation_canceled;
+          }
+        }
+      }
+
+    private:
+      // Does everything the single file clone_or_copy() does before it emulates the extents clone.
+      // Returns true if the file's extents need copying by the pipeline.
+      result<bool> _begin(file_state &fs) noexcept
+      {
+        clone_or_copy_request &req = *fs.req;
+        if(req.src == nullptr || req.destdir == nullptr)
+        {
+          return errc::invalid_argument;
+        }
+        path_view destleaf = req.destleaf;
+        if(destleaf.empty())
+        {
+          OUTCOME_TRY(fs.destleaf, req.src->current_path());
+          if(fs.destleaf.empty())
+          {
+            // Source has been deleted, so can't infer leafname
+            return errc::no_such_file_or_directory;
+          }
+          destleaf = fs.destleaf;
+        }
+        OUTCOME_TRY(fs.stat.fill(*req.src));
+        if(_creation != file_handle::creation::always_new)
+        {
+          auto r = file_handle::file(*req.destdir, destleaf, file_handle::mode::attr_read, file_handle::creation::open_existing);
+          if(r)
+          {
+            stat_t deststat(nullptr);
+            OUTCOME_TRY(deststat.fill(r.value()));
+            if((fs.stat.st_type == deststat.st_type) && (fs.stat.st_mtim == deststat.st_mtim) && (fs.stat.st_size == deststat.st_size)
+#ifndef _WIN32
+               && (fs.stat.st_perms == deststat.st_perms) && (fs.stat.st_uid == deststat.st_uid) && (fs.stat.st_gid == deststat.st_gid) &&
+               (fs.stat.st_rdev == deststat.st_rdev)
+#endif
+            )
+            {
+              return false;  // nothing copied
+            }
+          }
+        }
+        OUTCOME_TRY(fs.dest, file_handle::file(*req.destdir, destleaf, file_handle::mode::write, _creation, req.src->kernel_caching(),
+                                                     (_multiplexer != nullptr) ? file_handle::flag::multiplexable : file_handle::flag::none));
+        if(!_force_copy_now)
+        {
+#if LLFIO_LOGGING_LEVEL
+          log_level_guard g(log_level::fatal);
+#endif
+          auto r = req.src->clone_extents_to(fs.dest, {}, _force_copy_now, false);
+          if(r)
+          {
+            fs.copied = r.assume_value().length;
+            return false;
+          }
+        }
+        statfs_t statfs;
+        OUTCOME_TRY(statfs.fill(*req.destdir, statfs_t::want::bavail));
+        if(fs.stat.st_blocks > statfs.f_bavail)
+        {
+          return errc::no_space_on_device;
+        }
+        if(_multiplexer != nullptr)
+        {
+          fs.original_multiplexer = req.src->multiplexer();
+          if(fs.original_multiplexer == _multiplexer || req.src->set_multiplexer(_multiplexer))
+          {
+            if(fs.dest.set_multiplexer(_multiplexer))
+            {
+              fs.multiplexed = true;
+            }
+            else
+            {
+              (void) req.src->set_multiplexer(fs.original_multiplexer);
+            }
+          }
+          if(!fs.multiplexed)
+          {
+            // Can't pipeline this one, so copy it now
+            OUTCOME_TRY(auto &&copied, req.src->clone_extents_to(fs.dest, {}, _force_copy_now, true));
+            fs.copied = copied.length;
+            return false;
+          }
+        }
+        OUTCOME_TRY(fs.extents, req.src->extents());
+        OUTCOME_TRY(fs.dest.truncate(fs.stat.st_size));
+        return true;
+      }
+
+      // Finishes a file, once all its blocks are done
+      void _finish(std::list<file_state>::iterator it) noexcept
+      {
+        file_state &fs = *it;
+        if(fs.multiplexed)
+        {
+          (void) fs.dest.set_multiplexer(nullptr);
+          (void) fs.req->src->set_multiplexer(fs.original_multiplexer);
+        }
+        if(fs.dest.is_valid())
+        {
+          if(fs.failure)
+          {
+            (void) fs.dest.unlink();
+          }
+          else if(_preserve_timestamps)
+          {
+            (void) fs.stat.stamp(fs.dest);
+          }
+          (void) fs.dest.close();
+        }
+        if(fs.failure)
+        {
+          fs.req->copied = std::move(*fs.failure);
+        }
+        else
+        {
+          fs.req->copied = fs.copied;
+          total += fs.copied;
+        }
+        _files.erase(it);
+      }
+
+    public:
+      // Fills in the next block of a begun file, returning false if none has any left to hand out right now
+      bool take_block(block &out) noexcept
+      {
+        // Prefer the most recently begun files, so few destinations are open at once
+        for(auto it = _files.rbegin(); it != _files.rend();)
+        {
+          file_state &fs = *it;
+          if(!fs.begun)
+          {
+            ++it;
+            continue;
+          }
+          while(!fs.failure && fs.extent_idx < fs.extents.size())
+          {
+            const auto &extent = fs.extents[fs.extent_idx];
+            if(fs.extent_offset >= extent.length)
+            {
+              fs.extent_idx++;
+              fs.extent_offset = 0;
+              continue;
+            }
+            out.fs = &fs;
+            out.offset = extent.offset + fs.extent_offset;
+            out.length = (size_t) std::min<file_handle::extent_type>(_blocksize, extent.length - fs.extent_offset);
+            fs.extent_offset += out.length;
+            fs.inflight++;
+            return true;
+          }
+          if(fs.inflight == 0)
+          {
+            // The reverse iterator made from the file after this one continues from the file before it
+            auto cur = std::next(it).base(), after = std::next(cur);
+            _finish(cur);
+            it = std::list<file_state>::reverse_iterator(after);
+            continue;
+          }
+          ++it;
+        }
+        return false;
+      }
+
+      // Claims the next file to begin, returning null if there are none left
+      result<file_state *> claim_file() noexcept
+      {
+        LLFIO_EXCEPTION_TRY
+        {
+          while(_next_request < _requests.size() && !_wanted(_requests[_next_request]))
+          {
+            _next_request++;
+          }
+          if(_next_request == _requests.size())
+          {
+            return nullptr;
+          }
+          _files.emplace_back();
+          file_state &fs = _files.back();
+          fs.req = &_requests[_next_request++];
+          _beginning++;
+          return &fs;
+        }
+        LLFIO_EXCEPTION_CATCH_ALL
+        {
+          return error_from_exception();
+        }
+      }
+
+      // Opens a claimed file and tries to clone it. This touches nothing shared, so needs no lock.
+      result<bool> begin_file(file_state &fs) noexcept { return _begin(fs); }
+
+      // Publishes the outcome of begin_file(), after which blocks of the file may be handed out
+      void file_begun(file_state &fs, result<bool> r) noexcept
+      {
+        _beginning--;
+        fs.begun = true;
+        if(!r)
+        {
+          fs.failure.emplace(std::move(r).error());
+        }
+        else if(!r.value())
+        {
+          fs.extents.clear();
+        }
+      }
+
+      // True if files are claimed but not yet begun, so more blocks may yet become available
+      bool beginning() const noexcept { return _beginning > 0; }
+
+      // Fills in the next block to copy, beginning files as needed, returning false if there are none left
+      result<bool> next_block(block &out) noexcept
+      {
+        for(;;)
+        {
+          if(take_block(out))
+          {
+            return true;
+          }
+          OUTCOME_TRY(auto *fs, claim_file());
+          if(fs == nullptr)
+          {
+            return false;
+          }
+          file_begun(*fs, begin_file(*fs));
+        }
+      }
+
+      // Called when a block has been copied, or failed to copy
+      void block_done(const block &b, result<size_t> written) noexcept
+      {
+        file_state &fs = *b.fs;
+        fs.inflight--;
+        if(!written)
+        {
+          if(!fs.failure)
+          {
+            fs.failure.emplace(std::move(written).error());
+          }
+        }
+        else
+        {
+          fs.copied += written.value();
+        }
+        if(fs.inflight == 0 && (fs.failure || fs.extent_idx >= fs.extents.size()))
+        {
+          for(auto it = _files.begin(); it != _files.end(); ++it)
+          {
+            if(&*it == &fs)
+            {
+              _finish(it);
+              break;
+            }
+          }
+        }
+      }
+    };
+
+    // Pipelines the copy through an i/o multiplexer from the calling kernel thread
+    inline result<void> clone_or_copy_multiplexed(clone_or_copy_pipeline &pipeline, byte_io_multiplexer *multiplexer, size_t blocksize, size_t slots) noexcept
+    {
+      using io_operation_state = byte_io_multiplexer::io_operation_state;
+      struct slot_type
+      {
+        byte *buffer{nullptr};
+        byte *state_storage{nullptr};
+        io_operation_state *state{nullptr};
+        bool writing{false};
+        clone_or_copy_pipeline::block blk;
+        size_t blockdone{0};  // bytes of the block written so far
+        byte_io_multiplexer::buffer_type readbuffer;
+        byte_io_multiplexer::const_buffer_type writebuffer;
+      };
+      const auto staterequirements = multiplexer->io_state_requirements();
+      const size_t statesize = (staterequirements.first + staterequirements.second - 1) & ~(staterequirements.second - 1);
+      std::vector<slot_type> slotsv(slots);
+      std::vector<byte> statestorage(slots * statesize + staterequirements.second);
+      byte *statebase = (byte *) (((uintptr_t) statestorage.data() + staterequirements.second - 1) & ~(uintptr_t)(staterequirements.second - 1));
+      auto unbuffers = make_scope_exit(
+      [&]() noexcept
+      {
+        for(auto &slot : slotsv)
+        {
+          if(slot.state != nullptr)
+          {
+            // Only reached if the multiplexer failed, so cancel whatever is still in flight
+            (void) multiplexer->cancel_io_operation(slot.state, deadline());
+            slot.state->~io_operation_state();
+            slot.state = nullptr;
+          }
+          if(slot.buffer != nullptr)
+          {
+            utils::page_allocator<byte>().deallocate(slot.buffer, blocksize);
+          }
+        }
+      });
+      for(size_t n = 0; n < slots; n++)
+      {
+        slotsv[n].buffer = utils::page_allocator<byte>().allocate(blocksize);
+        slotsv[n].state_storage = statebase + n * statesize;
+      }
+      byte_io_multiplexer::io_operation_state_visitor visitor;  // the results are retrieved from the states once finished
+      // Reads whatever of the block is not yet written
+      auto issue_read = [&](slot_type &slot)
+      {
+        slot.readbuffer = {slot.buffer, slot.blk.length - slot.blockdone};
+        slot.writing = false;
+        slot.state = multiplexer->construct_and_init_io_operation({slot.state_storage, statesize}, slot.blk.fs->req->src, &visitor, {}, {},
+                                                                  byte_io_multiplexer::io_request<byte_io_multiplexer::buffers_type>({&slot.readbuffer, 1}, slot.blk.offset + slot.blockdone));
+      };
+      // Writes whatever of writebuffer is not yet written
+      auto issue_write = [&](slot_type &slot)
+      {
+        slot.writing = true;
+        slot.state = multiplexer->construct_and_init_io_operation({slot.state_storage, statesize}, &slot.blk.fs->dest, &visitor, {}, {},
+                                                                  byte_io_multiplexer::io_request<byte_io_multiplexer::const_buffers_type>({&slot.writebuffer, 1}, slot.blk.offset + slot.blockdone));
+      };
+      bool exhausted = false;
+      for(;;)
+      {
+        size_t active = 0;
+        for(auto &slot : slotsv)
+        {
+          if(slot.state == nullptr && !exhausted)
+          {
+            OUTCOME_TRY(auto &&more, pipeline.next_block(slot.blk));
+            if(!more)
+            {
+              exhausted = true;
+            }
+            else
+            {
+              slot.blockdone = 0;
+              issue_read(slot);
+            }
+          }
+          if(slot.state != nullptr)
+          {
+            active++;
+          }
+        }
+        OUTCOME_TRY(multiplexer->flush_inited_io_operations());
+        if(active == 0)
+        {
+          return success();
+        }
+        // Some i/o completes immediately upon initiation, so only wait if none has finished
+        bool anyfinished = false;
+        for(auto &slot : slotsv)
+        {
+          if(slot.state != nullptr && is_finished(multiplexer->check_io_operation(slot.state)))
+          {
+            anyfinished = true;
+            break;
+          }
+        }
+        if(!anyfinished)
+        {
+          OUTCOME_TRY(multiplexer->check_for_any_completed_io(deadline()));
+        }
+        for(auto &slot : slotsv)
+        {
+          if(slot.state == nullptr || !is_finished(multiplexer->check_io_operation(slot.state)))
+          {
+            continue;
+          }
+          if(!slot.writing)
+          {
+            auto r = std::move(*slot.state).get_completed_read();
+            slot.state->~io_operation_state();
+            slot.state = nullptr;
+            if(!r)
+            {
+              pipeline.block_done(slot.blk, std::move(r).error());
+              continue;
+            }
+            size_t bytesread = 0;
+            for(auto &i : r.value())
+            {
+              bytesread += i.size();
+            }
+            if(bytesread == 0)
+            {
+              // Source shrank
+              pipeline.block_done(slot.blk, slot.blockdone);
+              continue;
+            }
+            // The multiplexer may have returned the data somewhere other than our buffer
+            const byte *data = r.value()[0].data();
+            if(r.value().size() > 1)
+            {
+              size_t offset = 0;
+              for(auto &i : r.value())
+              {
+                memmove(slot.buffer + offset, i.data(), i.size());
+                offset += i.size();
+              }
+              data = slot.buffer;
+            }
+            slot.writebuffer = {data, bytesread};
+            issue_write(slot);
+          }
+          else
+          {
+            auto r = std::move(*slot.state).get_completed_write_or_barrier();
+            slot.state->~io_operation_state();
+            slot.state = nullptr;
+            if(!r)
+            {
+              pipeline.block_done(slot.blk, std::move(r).error());
+              continue;
+            }
+            size_t written = 0;
+            for(auto &i : r.value())
+            {
+              written += i.size();
+            }
+            if(written == 0)
+            {
+              pipeline.block_done(slot.blk, result<size_t>(errc::resource_unavailable_try_again));  // something is wrong
+              continue;
+            }
+            slot.blockdone += written;
+            if(written < slot.writebuffer.size())
+            {
+              // Short write, so write the remainder
+              slot.writebuffer = {slot.writebuffer.data() + written, slot.writebuffer.size() - written};
+              issue_write(slot);
+            }
+            else if(slot.blockdone < slot.blk.length)
+            {
+              // Short read, so read the remainder
+              issue_read(slot);
+            }
+            else
+            {
+              pipeline.block_done(slot.blk, slot.blockdone);
+            }
+          }
+        }
+      }
+    }
+
+    // Pipelines the copy using blocking i/o from many kernel threads
+    inline result<void> clone_or_copy_threaded(clone_or_copy_pipeline &pipeline, size_t blocksize, size_t threads) noexcept
+    {
+      std::mutex lock;
+      std::condition_variable changed;  // signalled when a file has been begun
+      optional<result<void>::error_type> failure;
+      auto worker = [&]
+      {
+        byte *buffer = utils::page_allocator<byte>().allocate(blocksize);
+        auto unbuffer = make_scope_exit([&]() noexcept { utils::page_allocator<byte>().deallocate(buffer, blocksize); });
+        clone_or_copy_pipeline::block blk;
+        std::unique_lock<std::mutex> g(lock);
+        for(;;)
+        {
+          if(failure)
+          {
+            return;
+          }
+          if(!pipeline.take_block(blk))
+          {
+            auto fs = pipeline.claim_file();
+            if(!fs)
+            {
+              failure.emplace(std::move(fs).error());
+              changed.notify_all();
+              return;
+            }
+            if(fs.value() != nullptr)
+            {
+              // Opening and cloning a file can take a while, so don't hold up the other workers
+              g.unlock();
+              auto r = pipeline.begin_file(*fs.value());
+              g.lock();
+              pipeline.file_begun(*fs.value(), std::move(r));
+              changed.notify_all();
+              continue;
+            }
+            if(!pipeline.beginning())
+            {
+              return;
+            }
+            // Another worker is beginning a file which may have blocks to copy
+            changed.wait(g);
+            continue;
+          }
+          g.unlock();
+          // Reads and writes can be short, so loop until the block is done or the source ends
+          size_t blockdone = 0;
+          result<size_t> written((size_t) 0);
+          while(written && blockdone < blk.length)
+          {
+            auto r = blk.fs->req->src->read(blk.offset + blockdone, {{buffer, blk.length - blockdone}});
+            if(!r)
+            {
+              written = std::move(r).error();
+              break;
+            }
+            const size_t bytesread = r.value();
+            if(bytesread == 0)
+            {
+              break;  // source shrank
+            }
+            for(size_t bufferdone = 0; bufferdone < bytesread;)
+            {
+              auto w = blk.fs->dest.write(blk.offset + blockdone, {{buffer + bufferdone, bytesread - bufferdone}});
+              if(!w)
+              {
+                written = std::move(w).error();
+                break;
+              }
+              if(w.value() == 0)
+              {
+                written = errc::resource_unavailable_try_again;  // something is wrong
+                break;
+              }
+              bufferdone += w.value();
+              blockdone += w.value();
+            }
+          }
+          if(written)
+          {
+            written = blockdone;
+          }
+          g.lock();
+          pipeline.block_done(blk, std::move(written));
+        }
+      };
+      LLFIO_EXCEPTION_TRY
+      {
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+        auto joiner = make_scope_exit(
+        [&]() noexcept
+        {
+          for(auto &t : workers)
+          {
+            t.join();
+          }
+        });
+        for(size_t n = 1; n < threads; n++)
+        {
+          workers.emplace_back(worker);
+        }
+        worker();
+      }
+      LLFIO_EXCEPTION_CATCH_ALL
+      {
+        return error_from_exception();
+      }
+      if(failure)
+      {
+        return std::move(*failure);
+      }
+      return success();
+    }
+  }  // namespace detail
+
+  LLFIO_HEADERS_ONLY_FUNC_SPEC result<file_handle::extent_type> clone_or_copy(span<clone_or_copy_request> requests, size_t inflight_bytes,
+                                                                              byte_io_multiplexer *multiplexer, bool preserve_timestamps, bool force_copy_now,
+                                                                              file_handle::creation creation) noexcept
+  {
+    LLFIO_EXCEPTION_TRY
+    {
+      LLFIO_LOG_FUNCTION_CALL(nullptr);
+      const size_t blocksize = utils::file_buffer_default_size();
+      const size_t slots = std::max(inflight_bytes / blocksize, (size_t) 1);
+      const size_t threads = std::min<size_t>(slots, std::max<size_t>(std::thread::hardware_concurrency(), 1) * 4);
+      // Sources not opened multiplexable cannot join a multiplexer, so are copied by blocking i/o from many kernel threads
+      bool any_multiplexable = false, any_unmultiplexable = false;
+      for(auto &req : requests)
+      {
+        if(req.src != nullptr && !req.src->is_multiplexable())
+        {
+          any_unmultiplexable = true;
+        }
+        else
+        {
+          any_multiplexable = true;
+        }
+      }
+      if(multiplexer == nullptr)
+      {
+        multiplexer = this_thread::multiplexer();
+      }
+      byte_io_multiplexer_ptr ourmultiplexer;
+#ifdef __linux__
+      if(multiplexer == nullptr && any_multiplexable)
+      {
+        auto r = multiplexer_linux_io_uring(1, false);
+        if(r)
+        {
+          ourmultiplexer = std::move(r).value();
+          multiplexer = ourmultiplexer.get();
+        }
+      }
+#endif
+      if(multiplexer == nullptr)
+      {
+        detail::clone_or_copy_pipeline pipeline(requests, blocksize, nullptr, detail::clone_or_copy_pipeline::sources::all, preserve_timestamps, force_copy_now,
+                                                creation);
+        OUTCOME_TRY(detail::clone_or_copy_threaded(pipeline, blocksize, threads));
+        return pipeline.total;
+      }
+      // Must be destroyed before ourmultiplexer, as it restores the sources' original multiplexers
+      detail::clone_or_copy_pipeline pipeline(requests, blocksize, multiplexer, detail::clone_or_copy_pipeline::sources::multiplexable, preserve_timestamps,
+                                              force_copy_now, creation);
+      detail::clone_or_copy_pipeline threadedpipeline(requests, blocksize, nullptr, detail::clone_or_copy_pipeline::sources::unmultiplexable,
+                                                      preserve_timestamps, force_copy_now, creation);
+      if(any_unmultiplexable)
+      {
+        OUTCOME_TRY(detail::clone_or_copy_threaded(threadedpipeline, blocksize, threads));
+      }
+      OUTCOME_TRY(detail::clone_or_copy_multiplexed(pipeline, multiplexer, blocksize, slots));
+      return pipeline.total + threadedpipeline.total;
+    }
+    LLFIO_EXCEPTION_CATCH_ALL
+    {
+      return error_from_exception();
+    }
+  }
+
 }  // namespace algorithm
 
 LLFIO_V2_NAMESPACE_END
@@ -44,6 +44,7 @@ Distributed under the Boost Software License, Version 1.0.
 #include <threadpoolapiset.h>
 #elif defined(__linux__) && !LLFIO_DYNAMIC_THREAD_POOL_GROUP_USING_GCD
 #include <dirent.h> /* Defines DT_* constants */
+#include <sched.h>
 #include <sys/syscall.h>
 
 #include <condition_variable>
@@ -256,7 +257,8 @@ namespace detail
     }
 
 #if !LLFIO_DYNAMIC_THREAD_POOL_GROUP_USING_GCD && !defined(_WIN32)
-    static constexpr unsigned TOTAL_NEXTACTIVES = 1;
+    // One queue of active work items per NUMA node, with NUMA nodes beyond this sharing queues
+    static constexpr unsigned TOTAL_NEXTACTIVES = 8;
     struct next_active_base_t
     {
       std::atomic<unsigned> count{0};
@@ -278,55 +280,13 @@ namespace detail
     static_assert(sizeof(next_active_work_t) == 64, "next_active_work_t is not a cacheline");
     next_active_base_t next_timer_relative, next_timer_absolute;
 
-    dynamic_thread_pool_group::work_item *next_active(unsigned &count, size_t threadidx)
+    // Takes from the queue for the caller's NUMA node first, then steals from the queues of the other NUMA nodes
+    dynamic_thread_pool_group::work_item *next_active(unsigned &count, unsigned queue, unsigned queues)
     {
-      if(TOTAL_NEXTACTIVES > 1)
+      queue %= queues;
+      for(unsigned n = 0; n < queues; n++)
       {
-        threadidx &= (TOTAL_NEXTACTIVES - 1);
-        const size_t original_threadidx = threadidx;
-        bool all_empty = true;
-        for(;;)
-        {
-          next_active_base_t &x = next_actives[threadidx];
-          if(x.count.load(std::memory_order_relaxed) > 0)
-          {
-            all_empty = false;
-            if(x.lock.try_lock())
-            {
-              auto *ret = x.front;
-              if(ret != nullptr)
-              {
-                x.front = ret->_next_scheduled;
-                count = x.count.fetch_sub(1, std::memory_order_relaxed);
-                if(x.front == nullptr)
-                {
-                  assert(x.back == ret);
-                  x.back = nullptr;
-                }
-                ret->_next_scheduled = nullptr;
-                x.lock.unlock();
-                return ret;
-              }
-              x.lock.unlock();
-            }
-          }
-          if(++threadidx >= TOTAL_NEXTACTIVES)
-          {
-            threadidx = 0;
-          }
-          if(threadidx == original_threadidx)
-          {
-            if(all_empty)
-            {
-              return nullptr;
-            }
-            all_empty = true;
-          }
-        }
-      }
-      else
-      {
-        next_active_base_t &x = next_actives[0];
+        next_active_base_t &x = next_actives[queue];
         if(x.count.load(std::memory_order_relaxed) > 0)
         {
           x.lock.lock();
@@ -346,15 +306,26 @@ namespace detail
           }
           x.lock.unlock();
         }
+        if(++queue >= queues)
+        {
+          queue = 0;
+        }
       }
       return nullptr;
     }
 
   private:
-    next_active_base_t &_choose_next_active()
+    // Returns the queue LOCKED. A queue of -1 means no NUMA node preference, so choose the least loaded.
+    next_active_base_t &_choose_next_active(unsigned queue, unsigned queues)
     {
+      if(queue != (unsigned) -1)
+      {
+        next_active_base_t &x = next_actives[queue % queues];
+        x.lock.lock();
+        return x;
+      }
       unsigned idx = (unsigned) -1, max_count = (unsigned) -1;
-      for(unsigned n = 0; n < TOTAL_NEXTACTIVES; n++)
+      for(unsigned n = 0; n < queues; n++)
       {
         auto c = next_actives[n].count.load(std::memory_order_relaxed);
         if(c < max_count)
@@ -369,7 +340,7 @@ namespace detail
         {
           return next_actives[idx];
         }
-        if(++idx >= TOTAL_NEXTACTIVES)
+        if(++idx >= queues)
         {
           idx = 0;
         }
@@ -377,9 +348,9 @@ namespace detail
     }
 
   public:
-    void append_active(dynamic_thread_pool_group::work_item *p)
+    void append_active(dynamic_thread_pool_group::work_item *p, unsigned queue, unsigned queues)
     {
-      next_active_base_t &x = _choose_next_active();
+      next_active_base_t &x = _choose_next_active(queue, queues);
       x.count.fetch_add(1, std::memory_order_relaxed);
       if(x.back == nullptr)
       {
@@ -393,9 +364,9 @@ namespace detail
       x.back = p;
       x.lock.unlock();
     }
-    void prepend_active(dynamic_thread_pool_group::work_item *p)
+    void prepend_active(dynamic_thread_pool_group::work_item *p, unsigned queue, unsigned queues)
     {
-      next_active_base_t &x = _choose_next_active();
+      next_active_base_t &x = _choose_next_active(queue, queues);
       x.count.fetch_add(1, std::memory_order_relaxed);
       if(x.front == nullptr)
       {
@@ -585,6 +556,7 @@ namespace detail
       std::condition_variable cond;
       std::chrono::steady_clock::time_point last_did_work;
       std::atomic<int> state{0};  // <0 = dead, 0 = sleeping/please die, 1 = busy
+      unsigned numa_node{0};      // index into numa_topology
     };
     struct threads_t
     {
@@ -594,6 +566,17 @@ namespace detail
     std::atomic<size_t> total_submitted_workitems{0}, threadpool_threads{0};
     std::atomic<uint32_t> ms_sleep_for_more_work{20000};
 
+    // Empty unless there are two or more NUMA nodes with CPUs we may run upon
+    struct numa_node_t
+    {
+      unsigned id{0};  // as numbered by the system
+      size_t cpus{0};  // CPUs within this node we may run upon
+      cpu_set_t cpuset;
+    };
+    std::vector<numa_node_t> numa_topology;
+    std::vector<unsigned> numa_node_of_cpu;  // index into numa_topology, or -1
+    unsigned numa_queues{1};
+
     std::mutex threadmetrics_lock;
     struct threadmetrics_guard : std::unique_lock<std::mutex>
     {
@@ -666,6 +649,7 @@ namespace detail
     global_dynamic_thread_pool_impl()
     {
 #if !LLFIO_DYNAMIC_THREAD_POOL_GROUP_USING_GCD && !defined(_WIN32)
+      _discover_numa_topology();
       populate_threadmetrics(std::chrono::steady_clock::now());
 #endif
     }
@@ -737,13 +721,142 @@ namespace detail
 
 #if !LLFIO_DYNAMIC_THREAD_POOL_GROUP_USING_GCD && !defined(_WIN32)
     inline void _execute_work(thread_t *self);
+    inline unsigned _numa_node_for(const dynamic_thread_pool_group::work_item *workitem) const noexcept;
 
-    void _add_thread(threadpool_guard & /*unused*/)
+    void _discover_numa_topology()
+    {
+      LLFIO_EXCEPTION_TRY
+      {
+        // Calls f for every number in a sysfs list such as "0-7,16-23"
+        auto read_list = [](const char *path, auto &&f) -> bool {
+          int fd = ::open(path, O_RDONLY);
+          if(-1 == fd)
+          {
+            return false;
+          }
+          char buffer[4096];
+          auto bytesread = ::read(fd, buffer, sizeof(buffer) - 1);
+          ::close(fd);
+          if(bytesread <= 0)
+          {
+            return false;
+          }
+          buffer[bytesread] = 0;
+          for(char *p = buffer; *p >= '0' && *p <= '9';)
+          {
+            unsigned long first = strtoul(p, &p, 10), last = first;
+            if(*p == '-')
+            {
+              last = strtoul(p + 1, &p, 10);
+            }
+            for(; first <= last; first++)
+            {
+              f((unsigned) first);
+            }
+            if(*p == ',')
+            {
+              ++p;
+            }
+          }
+          return true;
+        };
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if(-1 == ::sched_getaffinity(0, sizeof(allowed), &allowed))
+        {
+          return;
+        }
+        std::vector<unsigned> nodes;
+        if(!read_list("/sys/devices/system/node/online", [&](unsigned node) { nodes.push_back(node); }))
+        {
+          return;
+        }
+        for(auto node : nodes)
+        {
+          char path[64];
+          snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+          numa_node_t item;
+          item.id = node;
+          CPU_ZERO(&item.cpuset);
+          read_list(path, [&](unsigned cpu) {
+            if(cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+            {
+              CPU_SET(cpu, &item.cpuset);
+              item.cpus++;
+              if(numa_node_of_cpu.size() <= cpu)
+              {
+                numa_node_of_cpu.resize(cpu + 1, (unsigned) -1);
+              }
+              numa_node_of_cpu[cpu] = (unsigned) numa_topology.size();
+            }
+          });
+          if(item.cpus > 0)
+          {
+            numa_topology.push_back(item);
+          }
+        }
+        if(numa_topology.size() < 2)
+        {
+          // Not NUMA, or we are confined to a single NUMA node, so don't bother
+          numa_topology.clear();
+          numa_node_of_cpu.clear();
+          return;
+        }
+        numa_queues = (unsigned) std::min(numa_topology.size(), (size_t) global_dynamic_thread_pool_impl_workqueue_item::TOTAL_NEXTACTIVES);
+      }
+      LLFIO_EXCEPTION_CATCH_ALL
+      {
+        numa_topology.clear();
+        numa_node_of_cpu.clear();
+        numa_queues = 1;
+      }
+    }
+
+    // Choose the NUMA node a new thread ought to run upon, which if there is no preference,
+    // is the node with the fewest threads for its CPUs. Must hold threadpool_lock.
+    unsigned _choose_numa_node_for_new_thread(unsigned preferred) const noexcept
+    {
+      if(numa_topology.empty())
+      {
+        return 0;
+      }
+      if(preferred < numa_topology.size())
+      {
+        return preferred;
+      }
+      auto threads_on = [&](unsigned node) {
+        size_t ret = 0;
+        for(auto *t = threadpool_active.front; t != nullptr; t = t->_next)
+        {
+          ret += (t->numa_node == node);
+        }
+        for(auto *t = threadpool_sleeping.front; t != nullptr; t = t->_next)
+        {
+          ret += (t->numa_node == node);
+        }
+        return ret;
+      };
+      unsigned ret = 0;
+      size_t ret_threads = threads_on(0);
+      for(unsigned node = 1; node < numa_topology.size(); node++)
+      {
+        const size_t threads = threads_on(node);
+        if(threads * numa_topology[ret].cpus < ret_threads * numa_topology[node].cpus)
+        {
+          ret = node;
+          ret_threads = threads;
+        }
+      }
+      return ret;
+    }
+
+    void _add_thread(threadpool_guard & /*unused*/, unsigned numa_node = (unsigned) -1)
     {
       thread_t *p = nullptr;
       LLFIO_EXCEPTION_TRY
       {
         p = new thread_t;
+        p->numa_node = _choose_numa_node_for_new_thread(numa_node);
         _append_to_list(threadpool_active, p);
         p->thread = std::thread([this, p] { _execute_work(p); });
       }
@@ -1228,6 +1341,7 @@ namespace detail
     dynamic_thread_pool_group::work_item *workitem{nullptr};
     global_dynamic_thread_pool_impl::threadh_type current_callback_instance{nullptr};
     size_t nesting_level{0};
+    unsigned numa_node{(unsigned) -1};  // index into numa_topology if a Linux native pool thread
   };
   LLFIO_HEADERS_ONLY_FUNC_SPEC global_dynamic_thread_pool_impl_thread_local_state_t &global_dynamic_thread_pool_thread_local_state() noexcept
   {
@@ -1422,6 +1536,28 @@ LLFIO_HEADERS_ONLY_MEMFUNC_SPEC dynamic_thread_pool_group::work_item *dynamic_th
   return detail::global_dynamic_thread_pool_thread_local_state().workitem;
 }
 
+LLFIO_HEADERS_ONLY_MEMFUNC_SPEC size_t dynamic_thread_pool_group::numa_nodes() noexcept
+{
+#if !LLFIO_DYNAMIC_THREAD_POOL_GROUP_USING_GCD && !defined(_WIN32)
+  return std::max((size_t) 1, detail::global_dynamic_thread_pool().numa_topology.size());
+#else
+  return 1;
+#endif
+}
+
+LLFIO_HEADERS_ONLY_MEMFUNC_SPEC unsigned dynamic_thread_pool_group::current_numa_node() noexcept
+{
+#if !LLFIO_DYNAMIC_THREAD_POOL_GROUP_USING_GCD && !defined(_WIN32)
+  auto &impl = detail::global_dynamic_thread_pool();
+  const int cpu = ::sched_getcpu();
+  if(cpu >= 0 && (size_t) cpu < impl.numa_node_of_cpu.size() && impl.numa_node_of_cpu[cpu] != (unsigned) -1)
+  {
+    return impl.numa_topology[impl.numa_node_of_cpu[cpu]].id;
+  }
+#endif
+  return 0;
+}
+
 LLFIO_HEADERS_ONLY_MEMFUNC_SPEC uint32_t dynamic_thread_pool_group::ms_sleep_for_more_work() noexcept
 {
 #if !LLFIO_DYNAMIC_THREAD_POOL_GROUP_USING_GCD && !defined(_WIN32)
@@ -1463,12 +1599,42 @@ LLFIO_HEADERS_ONLY_FUNC_SPEC result<dynamic_thread_pool_group_ptr> make_dynamic_
 namespace detail
 {
 #if !LLFIO_DYNAMIC_THREAD_POOL_GROUP_USING_GCD && !defined(_WIN32)
+  inline unsigned global_dynamic_thread_pool_impl::_numa_node_for(const dynamic_thread_pool_group::work_item *workitem) const noexcept
+  {
+    if(numa_topology.empty())
+    {
+      return (unsigned) -1;
+    }
+    if(workitem->_cpu_affinity < numa_node_of_cpu.size() && numa_node_of_cpu[workitem->_cpu_affinity] != (unsigned) -1)
+    {
+      return numa_node_of_cpu[workitem->_cpu_affinity];
+    }
+    if(workitem->_numa_node_affinity != (unsigned) -1)
+    {
+      for(unsigned n = 0; n < numa_topology.size(); n++)
+      {
+        if(numa_topology[n].id == workitem->_numa_node_affinity)
+        {
+          return n;
+        }
+      }
+    }
+    // No preference, so prefer the NUMA node of the submitting pool thread, if any
+    return global_dynamic_thread_pool_thread_local_state().numa_node;
+  }
+
   inline void global_dynamic_thread_pool_impl::_execute_work(thread_t *self)
   {
     pthread_setname_np(pthread_self(), "LLFIO DYN TPG");
+    if(!numa_topology.empty())
+    {
+      // Confine ourselves to the CPUs of our NUMA node, so work items preferring this node run close to their memory
+      pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &numa_topology[self->numa_node].cpuset);
+      global_dynamic_thread_pool_thread_local_state().numa_node = self->numa_node;
+    }
     self->last_did_work = std::chrono::steady_clock::now();
     self->state.fetch_add(1, std::memory_order_release);  // busy
-    const unsigned mythreadidx = threadpool_threads.fetch_add(1, std::memory_order_release);
+    threadpool_threads.fetch_add(1, std::memory_order_release);
 #if LLFIO_DYNAMIC_THREAD_POOL_GROUP_PRINTING
     std::cout << "*** DTP " << self << " begins." << std::endl;
 #endif
@@ -1526,7 +1692,7 @@ namespace detail
             wq.next_timer_absolute.lock.unlock();
           }
           unsigned count = 0;
-          return wq.next_active(count, mythreadidx);
+          return wq.next_active(count, self->numa_node, numa_queues);
         };
         workitem = examine_wq(first_execute);
         if(workitem == nullptr)
@@ -1679,6 +1845,9 @@ namespace detail
     if(nextwork != -1)
     {
       auto *parent = workitem->_parent.load(std::memory_order_relaxed);
+#if !LLFIO_DYNAMIC_THREAD_POOL_GROUP_USING_GCD && !defined(_WIN32)
+      const unsigned numa_node = _numa_node_for(workitem);
+#endif
       // If no work item for now, or there is a delay, schedule a timer
       if(nextwork == 0 || workitem->_has_timer_set())
       {
@@ -1809,7 +1978,7 @@ namespace detail
         if(submit_into_highest_priority)
         {
           // TODO: It would be super nice if we prepended this instead if it came from a timer
-          first_execute.append_active(workitem);
+          first_execute.append_active(workitem, numa_node, numa_queues);
           // std::cout << "append_active _nesting_level = " << parent->_nesting_level << std::endl;
         }
         else
@@ -1819,7 +1988,7 @@ namespace detail
             if(p->nesting_level == parent->_nesting_level)
             {
               // TODO: It would be super nice if we prepended this instead if it came from a timer
-              p->append_active(workitem);
+              p->append_active(workitem, numa_node, numa_queues);
               // std::cout << "append_active _nesting_level = " << parent->_nesting_level << std::endl;
               break;
             }
@@ -1839,18 +2008,36 @@ namespace detail
           threadpool_guard gg(threadpool_lock);
           if(threadpool_active.count == 0 && threadpool_sleeping.count == 0)
           {
-            _add_thread(gg);
+            _add_thread(gg, numa_node);
           }
           else if(threadpool_sleeping.count > 0 && active_work_items > threadpool_active.count)
           {
-            // Try to wake the most recently slept first
-            auto *t = threadpool_sleeping.back;
             auto now = std::chrono::steady_clock::now();
-            for(size_t n = std::min(active_work_items - threadpool_active.count, threadpool_sleeping.count); n > 0; n--)
+            size_t n = std::min(active_work_items - threadpool_active.count, threadpool_sleeping.count);
+            thread_t *woken = nullptr;
+            if(numa_node != (unsigned) -1)
             {
+              // Try to wake the most recently slept on the work item's NUMA node first
+              for(woken = threadpool_sleeping.back; woken != nullptr && woken->numa_node != numa_node; woken = woken->_prev)
+              {
+              }
+              if(woken != nullptr)
+              {
+                woken->last_did_work = now;  // prevent reap
+                woken->cond.notify_one();
+                n--;
+              }
+            }
+            // Try to wake the most recently slept first
+            for(auto *t = threadpool_sleeping.back; n > 0 && t != nullptr; t = t->_prev)
+            {
+              if(t == woken)
+              {
+                continue;
+              }
               t->last_did_work = now;  // prevent reap
               t->cond.notify_one();
-              t = t->_prev;
+              n--;
             }
           }
         }
@@ -25,8 +25,13 @@ Distributed under the Boost Software License, Version 1.0.
 #include "../../map_handle.hpp"
 #include "../../utils.hpp"
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 #include <quickcpplib/algorithm/bitwise_trie.hpp>
 
@@ -34,6 +39,22 @@ LLFIO_V2_NAMESPACE_BEGIN
 
 namespace detail
 {
+  struct map_handle_cache_item_t;
+  // Indexes cached regions by their start or end address, so adjacent regions can be coalesced
+  struct map_handle_cache_addr_link_t
+  {
+    map_handle_cache_addr_link_t *trie_parent{nullptr};
+    map_handle_cache_addr_link_t *trie_child[2];
+    map_handle_cache_addr_link_t *trie_sibling[2];
+    uintptr_t trie_key{0};
+    map_handle_cache_item_t *item{nullptr};
+  };
+  struct map_handle_cache_addr_base_t
+  {
+    size_t trie_count{0};
+    map_handle_cache_addr_link_t *trie_children[8 * sizeof(uintptr_t)];
+    bool trie_nobbledir{0};
+  };
   struct map_handle_cache_item_t
   {
     map_handle_cache_item_t *trie_parent{nullptr};
@@ -43,12 +64,14 @@ namespace detail
     size_t page_size{0};
     void *addr{nullptr};
     std::chrono::steady_clock::time_point when_added{std::chrono::steady_clock::now()};
+    map_handle_cache_addr_link_t by_start, by_end;
 
     map_handle_cache_item_t(size_t key, size_t _page_size, void *_addr)
         : trie_key(key)
         , page_size(_page_size)
         , addr(_addr)
     {
+      by_start.item = by_end.item = this;
     }
   };
   struct map_handle_cache_base_t
@@ -56,78 +79,166 @@ namespace detail
     mutable std::mutex lock;
     size_t trie_count{0};
     map_handle_cache_item_t *trie_children[8 * sizeof(size_t)];
-    bool trie_nobbledir{0}, disabled{false};
-    size_t bytes_in_cache{0}, hits{0}, misses{0};
+    bool trie_nobbledir{0};
+    size_t bytes_in_cache{0}, hits{0}, misses{0}, steals{0}, splits{0}, coalesces{0};
   };
   inline size_t page_size_shift()
   {
     static size_t v = [] { return QUICKCPPLIB_NAMESPACE::algorithm::bitwise_trie::detail::bitscanr(utils::page_size()); }();
     return v;
   }
-  class map_handle_cache_t : protected QUICKCPPLIB_NAMESPACE::algorithm::bitwise_trie::bitwise_trie<map_handle_cache_base_t, map_handle_cache_item_t>
+  inline void map_handle_cache_release(void *addr, size_t bytes)
+  {
+#ifdef _WIN32
+    if(!win32_release_nonfile_allocations((byte *) addr, bytes, MEM_RELEASE))
+#else
+    if(-1 == ::munmap(addr, bytes))
+#endif
+    {
+      // fprintf(stderr, "munmap failed with %s. addr was %p bytes was %zu. page_size_shift was %zu\n", strerror(errno), addr, bytes,
+      // page_size_shift);
+      LLFIO_LOG_FATAL(nullptr,
+                      "FATAL: map_handle cache failed to trim a map! If on Linux, you may have exceeded the "
+                      "64k VMA process limit, set the LLFIO_DEBUG_LINUX_MUNMAP macro at the top of posix/map_handle.ipp to cause dumping of VMAs to "
+                      "/tmp/llfio_unmap_debug_smaps.txt, and combine with strace to figure it out.");
+      abort();
+    }
+  }
+  // One shard of the cache. Threads are spread across shards, so each shard gets its own cache lines.
+  class alignas(64) map_handle_cache_shard_t
+      : protected QUICKCPPLIB_NAMESPACE::algorithm::bitwise_trie::bitwise_trie<map_handle_cache_base_t, map_handle_cache_item_t>
   {
+    friend class map_handle_cache_t;
     using _base = QUICKCPPLIB_NAMESPACE::algorithm::bitwise_trie::bitwise_trie<map_handle_cache_base_t, map_handle_cache_item_t>;
-    using _lock_guard = std::unique_lock<std::mutex>;
+    using _addr_trie = QUICKCPPLIB_NAMESPACE::algorithm::bitwise_trie::bitwise_trie<map_handle_cache_addr_base_t, map_handle_cache_addr_link_t>;
 
-  public:
-#ifdef __linux__
-    std::atomic<unsigned> do_not_store_failed_count{0};
+    /* Windows can only release a VirtualAlloc() allocation as a whole from its base address,
+    so there regions are never split nor coalesced, and a bigger region is only returned if it
+    is within the slack bound.
+    */
+#ifdef _WIN32
+    static constexpr bool _can_split = false;
+#else
+    static constexpr bool _can_split = true;
+    _addr_trie _by_start, _by_end;
 #endif
+    // How far to search amongst equally sized regions for a specific one before giving up on coalescing it
+    static constexpr size_t _erase_search_max = 16;
 
-    ~map_handle_cache_t() { trim_cache(std::chrono::steady_clock::now(), (size_t) -1); }
-
-    bool is_disabled() const noexcept
+    // All these require the lock to be held
+    void _insert(map_handle_cache_item_t *p)
+    {
+      _base::insert(p);
+      _base::bytes_in_cache += p->trie_key << page_size_shift();
+#ifndef _WIN32
+      p->by_start.trie_key = reinterpret_cast<uintptr_t>(p->addr);
+      p->by_end.trie_key = p->by_start.trie_key + (p->trie_key << page_size_shift());
+      _by_start.insert(&p->by_start);
+      _by_end.insert(&p->by_end);
+#endif
+    }
+    void _erase(_base::iterator it)
     {
-      _lock_guard g(lock);
-      return _base::disabled;
+      map_handle_cache_item_t *p = &*it;
+      _base::erase(it);
+      _base::bytes_in_cache -= p->trie_key << page_size_shift();
+#ifndef _WIN32
+      _by_start.erase(_by_start.find(p->by_start.trie_key));
+      _by_end.erase(_by_end.find(p->by_end.trie_key));
+#endif
     }
-
-    using _base::size;
-    void *get(size_t bytes, size_t page_size)
+    bool _erase(map_handle_cache_item_t *p)
     {
-      const auto _bytes = bytes >> page_size_shift();
-      _lock_guard g(lock);
-      // TODO: Consider finding slightly bigger, and returning a length shorter than reservation?
-      auto it = _base::find(_bytes);
-      for(; it != _base::end() && page_size != it->page_size && _bytes == it->trie_key; ++it)
+      auto it = _base::find(p->trie_key);
+      for(size_t n = 0; it != _base::end() && &*it != p; ++it)
       {
+        if(++n == _erase_search_max)
+        {
+          return false;
+        }
+      }
+      if(it == _base::end())
+      {
+        return false;
+      }
+      _erase(it);
+      return true;
+    }
+    /* Returns a region of at least `_bytes` pages, setting `_bytes` to its actual size. The
+    region is the first of the right page size found amongst those of the seven nearest
+    larger or equal sizes, which is approximately but not exactly the best fit, as an exact
+    search of the trie costs far more. It is returned whole only if it exceeds `_bytes` by
+    less than `_bytes`, and by no more than `_slack` pages. Otherwise it is split and the
+    remainder stays in the cache, so a request is never handed twice or more the memory it
+    asked for.
+    */
+    void *_take(size_t &_bytes, size_t page_size, size_t _slack, map_handle_cache_item_t *&todelete)
+    {
+      if(_base::trie_count == 0)
+      {
+        return nullptr;
       }
-      if(it == _base::end() || page_size != it->page_size || _bytes != it->trie_key)
+      auto it = _base::find_equal_or_larger(_bytes, 7 /* 99% close to the key after page size shift */);
+      for(; it != _base::end() && page_size != it->page_size; ++it)
+      {
+      }
+      if(it == _base::end() || page_size != it->page_size)
       {
-        misses++;
         return nullptr;
       }
-      hits++;
       map_handle_cache_item_t *p = &*it;
-      _base::erase(it);
-      _base::bytes_in_cache -= bytes;
-      assert(bytes == p->trie_key << page_size_shift());
-      // std::cout << "map_handle::get(" << p->addr << ", " << bytes << "). Index item was " << p << std::endl;
-      g.unlock();
       void *ret = p->addr;
-      delete p;
+      const size_t excess = p->trie_key - _bytes;
+      if(excess == 0 || (excess < _bytes && excess <= _slack))
+      {
+        _erase(it);
+        _bytes = p->trie_key;
+        todelete = p;
+        return ret;
+      }
+      if(!_can_split)
+      {
+        return nullptr;
+      }
+      // Split off the front of the region, leaving the remainder in the cache
+      _erase(it);
+      p->addr = static_cast<byte *>(p->addr) + (_bytes << page_size_shift());
+      p->trie_key -= _bytes;
+      _insert(p);
+      _base::splits++;
       return ret;
     }
-    bool add(size_t bytes, size_t page_size, void *addr)
+    void _add(map_handle_cache_item_t *p, map_handle_cache_item_t *(&todelete)[2])
     {
-      const auto _bytes = bytes >> page_size_shift();
-      if(_bytes == 0)
+#ifndef _WIN32
+      // Merge with any region immediately after this one
+      auto sit = _by_start.find(reinterpret_cast<uintptr_t>(p->addr) + (p->trie_key << page_size_shift()));
+      map_handle_cache_item_t *next = (sit != _by_start.end()) ? sit->item : nullptr;
+      if(next != nullptr && next->page_size == p->page_size && _erase(next))
       {
-        return false;
+        p->trie_key += next->trie_key;
+        todelete[0] = next;
+        _base::coalesces++;
       }
-      auto *p = new map_handle_cache_item_t(_bytes, page_size, addr);
-      _lock_guard g(lock);
-      // std::cout << "map_handle::add(" << addr << ", " << bytes << "). Index item was " << p << ". Trie key is " << _bytes << std::endl;
-      _base::insert(p);
-      _base::bytes_in_cache += bytes;
-      return true;
+      // Merge with any region immediately before this one
+      auto eit = _by_end.find(reinterpret_cast<uintptr_t>(p->addr));
+      map_handle_cache_item_t *prev = (eit != _by_end.end()) ? eit->item : nullptr;
+      if(prev != nullptr && prev->page_size == p->page_size && _erase(prev))
+      {
+        prev->trie_key += p->trie_key;
+        prev->when_added = p->when_added;
+        todelete[1] = p;
+        p = prev;
+        _base::coalesces++;
+      }
+#else
+      (void) todelete;
+#endif
+      _insert(p);
     }
-    map_handle::cache_statistics trim_cache(std::chrono::steady_clock::time_point older_than, size_t max_items)
+    void _trim(map_handle::cache_statistics &ret, std::chrono::steady_clock::time_point older_than, size_t &max_items)
     {
-      _lock_guard g(lock);
-      map_handle::cache_statistics ret;
-
-      if(older_than != std::chrono::steady_clock::time_point() && max_items > 0)
+      if(older_than != std::chrono::steady_clock::time_point() && max_items > 0 && _base::trie_count > 0)
       {
         // Prefer bigger items to trim than smaller ones
         for(auto it = --_base::end(); it != _base::end() && max_items > 0;)
@@ -135,24 +246,10 @@ namespace detail
           if(it->when_added <= older_than)
           {
             map_handle_cache_item_t *p = &*it;
-            _base::erase(it--);
+            _erase(it--);
             const auto _bytes = p->trie_key << page_size_shift();
             // std::cout << "map_handle::trim_cache(" << p->addr << ", " << _bytes << "). Index item was " << p << ". Trie key is " << p->trie_key << std::endl;
-#ifdef _WIN32
-            if(!win32_release_nonfile_allocations((byte *) p->addr, _bytes, MEM_RELEASE))
-#else
-            if(-1 == ::munmap(p->addr, _bytes))
-#endif
-            {
-              // fprintf(stderr, "munmap failed with %s. addr was %p bytes was %zu. page_size_shift was %zu\n", strerror(errno), p->addr, _bytes,
-              // page_size_shift);
-              LLFIO_LOG_FATAL(nullptr,
-                              "FATAL: map_handle cache failed to trim a map! If on Linux, you may have exceeded the "
-                              "64k VMA process limit, set the LLFIO_DEBUG_LINUX_MUNMAP macro at the top of posix/map_handle.ipp to cause dumping of VMAs to "
-                              "/tmp/llfio_unmap_debug_smaps.txt, and combine with strace to figure it out.");
-              abort();
-            }
-            _base::bytes_in_cache -= _bytes;
+            map_handle_cache_release(p->addr, _bytes);
             ret.bytes_just_trimmed += _bytes;
             ret.items_just_trimmed++;
             max_items--;
@@ -164,19 +261,319 @@ namespace detail
           }
         }
       }
-      ret.items_in_cache = _base::size();
-      ret.bytes_in_cache = _base::bytes_in_cache;
-      ret.hits = _base::hits;
-      ret.misses = _base::misses;
+      ret.items_in_cache += _base::size();
+      ret.bytes_in_cache += _base::bytes_in_cache;
+      ret.hits += _base::hits;
+      ret.misses += _base::misses;
+      ret.steals += _base::steals;
+      ret.splits += _base::splits;
+      ret.coalesces += _base::coalesces;
+    }
+  };
+  /* The cache is split into a power of two number of shards, up to one per CPU. Each thread
+  is assigned a shard on first use, and adds to and gets from that shard. Only that shard's
+  lock is ever waited upon, so threads on different shards never serialise upon one another.
+  If the thread's shard cannot satisfy a request, it tries to steal from the other shards,
+  skipping any whose lock is currently held by somebody else.
+  */
+  class map_handle_cache_t
+  {
+    using _lock_guard = std::unique_lock<std::mutex>;
+
+    std::unique_ptr<map_handle_cache_shard_t[]> _shards;
+    size_t _shards_mask{0};
+    std::atomic<size_t> _next_shard{0};
+    std::atomic<bool> _disabled{false};
+    std::atomic<size_t> _slack{65536};
+
+    /* Pools of prefaulted regions of a single size, one per page size. Unlike the shards,
+    regions in a pool are never decommitted, so handing one out is O(1) and touching it
+    does not fault. A background thread refills the pools as regions are taken from them.
+    */
+    struct _pool_t
+    {
+      size_t pagesize{0}, bytes{0}, target{0}, refilling{0};
+      section_handle::flag flag{section_handle::flag::none};
+      std::vector<void *> regions;
+      size_t hits{0}, misses{0};
+    };
+    std::atomic<bool> _pools_configured{false};
+    std::mutex _pools_lock;
+    std::condition_variable _pools_cond;
+    _pool_t _pools[4];
+    std::thread _pools_thread;
+    bool _pools_stop{false};
+
+    void _pools_refill()
+    {
+      _lock_guard g(_pools_lock);
+      while(!_pools_stop)
+      {
+        _pool_t *p = nullptr;
+        for(auto &i : _pools)
+        {
+          if(i.regions.size() + i.refilling < i.target)
+          {
+            p = &i;
+            break;
+          }
+        }
+        if(p == nullptr)
+        {
+          _pools_cond.wait(g);
+          continue;
+        }
+        const auto bytes = p->bytes;
+        const auto flag = p->flag;
+        p->refilling++;
+        g.unlock();
+        // zeroed = true always gets fresh pages from the kernel, bypassing this cache
+        auto r = map_handle::map(bytes, true, flag | section_handle::flag::prefault);
+        g.lock();
+        p->refilling--;
+        if(!r)
+        {
+          // Probably out of large pages, so try again later rather than spin
+          _pools_cond.wait_for(g, std::chrono::seconds(1));
+          continue;
+        }
+        // Capacity was reserved when the pool was configured, so this cannot throw
+        if(p->bytes == bytes && p->flag == flag && p->regions.size() < p->target)
+        {
+          p->regions.push_back(r.assume_value().address());
+          r.assume_value().release();
+          continue;
+        }
+        // The pool was reconfigured in the meantime
+        g.unlock();
+        (void) r.assume_value().close();
+        g.lock();
+      }
+    }
+
+    size_t _my_shard_index() noexcept
+    {
+      static thread_local size_t idx = _next_shard.fetch_add(1, std::memory_order_relaxed);
+      return idx & _shards_mask;
+    }
+
+  public:
+#ifdef __linux__
+    std::atomic<unsigned> do_not_store_failed_count{0};
+#endif
+
+    map_handle_cache_t()
+    {
+      size_t shards = 1;
+      const size_t cpus = std::thread::hardware_concurrency();
+      while(shards < cpus && shards < 64)
+      {
+        shards <<= 1;
+      }
+      _shards.reset(new map_handle_cache_shard_t[shards]);
+      _shards_mask = shards - 1;
+    }
+    ~map_handle_cache_t()
+    {
+      if(_pools_thread.joinable())
+      {
+        {
+          _lock_guard g(_pools_lock);
+          _pools_stop = true;
+        }
+        _pools_cond.notify_all();
+        _pools_thread.join();
+      }
+      for(auto &p : _pools)
+      {
+        for(auto *addr : p.regions)
+        {
+          map_handle_cache_release(addr, p.bytes);
+        }
+      }
+      trim_cache(std::chrono::steady_clock::now(), (size_t) -1);
+    }
+
+    bool is_disabled() const noexcept { return _disabled.load(std::memory_order_relaxed); }
+
+    // Sets `bytes` to the size of the region returned, which may be bigger than requested
+    void *get(size_t &bytes, size_t page_size)
+    {
+      auto _bytes = bytes >> page_size_shift();
+      const auto _slackpages = _slack.load(std::memory_order_relaxed) >> page_size_shift();
+      const auto myidx = _my_shard_index();
+      auto &mine = _shards[myidx];
+      map_handle_cache_item_t *todelete = nullptr;
+      _lock_guard g(mine.lock);
+      void *ret = mine._take(_bytes, page_size, _slackpages, todelete);
+      for(size_t n = 1; ret == nullptr && n <= _shards_mask; n++)
+      {
+        // try_lock only, so a thief never waits upon nor deadlocks with another shard's owner
+        auto &other = _shards[(myidx + n) & _shards_mask];
+        _lock_guard g2(other.lock, std::try_to_lock);
+        if(g2.owns_lock())
+        {
+          ret = other._take(_bytes, page_size, _slackpages, todelete);
+          if(ret != nullptr)
+          {
+            mine.steals++;
+          }
+        }
+      }
+      if(ret == nullptr)
+      {
+        mine.misses++;
+        return nullptr;
+      }
+      mine.hits++;
+      g.unlock();
+      assert(bytes <= _bytes << page_size_shift());
+      bytes = _bytes << page_size_shift();
+      // std::cout << "map_handle::get(" << ret << ", " << bytes << "). Index item was " << todelete << std::endl;
+      delete todelete;
       return ret;
     }
-    bool set_cache_disabled(bool v)
+    bool add(size_t bytes, size_t page_size, void *addr)
+    {
+      const auto _bytes = bytes >> page_size_shift();
+      if(_bytes == 0)
+      {
+        return false;
+      }
+      auto *p = new map_handle_cache_item_t(_bytes, page_size, addr);
+      map_handle_cache_item_t *todelete[2] = {nullptr, nullptr};
+      auto &mine = _shards[_my_shard_index()];
+      _lock_guard g(mine.lock);
+      // std::cout << "map_handle::add(" << addr << ", " << bytes << "). Index item was " << p << ". Trie key is " << _bytes << std::endl;
+      mine._add(p, todelete);
+      g.unlock();
+      delete todelete[0];
+      delete todelete[1];
+      return true;
+    }
+    map_handle::cache_statistics trim_cache(std::chrono::steady_clock::time_point older_than, size_t max_items)
     {
-      _lock_guard g(lock);
-      bool ret = _base::disabled;
-      _base::disabled = v;
+      map_handle::cache_statistics ret;
+      for(size_t n = 0; n <= _shards_mask; n++)
+      {
+        auto &shard = _shards[n];
+        _lock_guard g(shard.lock);
+        shard._trim(ret, older_than, max_items);
+      }
+      if(_pools_configured.load(std::memory_order_relaxed))
+      {
+        _lock_guard g(_pools_lock);
+        for(auto &p : _pools)
+        {
+          ret.items_in_pools += p.regions.size();
+          ret.bytes_in_pools += p.regions.size() * p.bytes;
+          ret.pool_hits += p.hits;
+          ret.pool_misses += p.misses;
+        }
+      }
       return ret;
     }
+    bool set_cache_disabled(bool v) { return _disabled.exchange(v, std::memory_order_relaxed); }
+    size_t set_cache_slack(size_t v) { return _slack.exchange(v, std::memory_order_relaxed); }
+
+    // Returns a prefaulted region of exactly `bytes` if a matching pool has one
+    void *get_pooled(size_t bytes, size_t pagesize, section_handle::flag flag)
+    {
+      if(!_pools_configured.load(std::memory_order_relaxed))
+      {
+        return nullptr;
+      }
+      flag &= ~section_handle::flag::prefault;
+      _lock_guard g(_pools_lock);
+      for(auto &p : _pools)
+      {
+        if(p.target > 0 && p.pagesize == pagesize && p.bytes == bytes && p.flag == flag)
+        {
+          if(p.regions.empty())
+          {
+            p.misses++;
+            return nullptr;
+          }
+          void *ret = p.regions.back();
+          p.regions.pop_back();
+          p.hits++;
+          g.unlock();
+          _pools_cond.notify_one();
+          return ret;
+        }
+      }
+      return nullptr;
+    }
+    // Returns a region to its pool without decommitting it, if the pool has room
+    bool add_pooled(size_t bytes, size_t pagesize, section_handle::flag flag, void *addr)
+    {
+      if(!_pools_configured.load(std::memory_order_relaxed))
+      {
+        return false;
+      }
+      flag &= ~section_handle::flag::prefault;
+      _lock_guard g(_pools_lock);
+      for(auto &p : _pools)
+      {
+        if(p.target > 0 && p.pagesize == pagesize && p.bytes == bytes && p.flag == flag && p.regions.size() < p.target)
+        {
+          p.regions.push_back(addr);
+          return true;
+        }
+      }
+      return false;
+    }
+    void set_pool(size_t bytes, size_t regions, size_t pagesize, section_handle::flag flag)
+    {
+      flag &= ~section_handle::flag::prefault;
+      std::vector<void *> torelease;
+      size_t toreleasebytes = 0;
+      {
+        _lock_guard g(_pools_lock);
+        _pool_t *p = nullptr;
+        for(auto &i : _pools)
+        {
+          if(i.pagesize == pagesize)
+          {
+            p = &i;
+            break;
+          }
+        }
+        for(auto &i : _pools)
+        {
+          if(p == nullptr && i.pagesize == 0)
+          {
+            p = &i;
+          }
+        }
+        assert(p != nullptr);  // there are never more than four page sizes
+        toreleasebytes = p->bytes;
+        if(p->bytes != bytes || p->flag != flag)
+        {
+          torelease.swap(p->regions);
+        }
+        else if(p->regions.size() > regions)
+        {
+          torelease.assign(p->regions.begin() + regions, p->regions.end());
+          p->regions.resize(regions);
+        }
+        p->regions.reserve(regions);
+        p->pagesize = pagesize;
+        p->bytes = bytes;
+        p->flag = flag;
+        p->target = regions;
+        _pools_configured.store(true, std::memory_order_relaxed);
+        if(regions > 0 && !_pools_thread.joinable())
+        {
+          _pools_thread = std::thread([this] { _pools_refill(); });
+        }
+      }
+      _pools_cond.notify_all();
+      for(auto *addr : torelease)
+      {
+        map_handle_cache_release(addr, toreleasebytes);
+      }
+    }
   };
   extern inline QUICKCPPLIB_SYMBOL_VISIBLE map_handle_cache_t *map_handle_cache()
   {
@@ -210,7 +607,7 @@ result<map_handle> map_handle::_recycled_map(size_type bytes, section_handle::fl
     return errc::argument_out_of_domain;
   }
   auto *c = detail::map_handle_cache();
-  if(c == nullptr || c->is_disabled() || bytes >= (1ULL << 30U) /*1Gb*/)
+  if(c == nullptr || c->is_disabled())
   {
     return _new_map(bytes, false, _flag);
   }
@@ -219,7 +616,29 @@ result<map_handle> map_handle::_recycled_map(size_type bytes, section_handle::fl
   OUTCOME_TRY(auto &&pagesize, detail::pagesize_from_flags(ret.value()._flag));
   bytes = utils::round_up_to_page_size(bytes, pagesize);
   LLFIO_LOG_FUNCTION_CALL(&ret);
-  void *addr = c->get(bytes, pagesize);
+  if(void *addr = c->get_pooled(bytes, pagesize, _flag))
+  {
+    // Pooled regions are already committed and faulted in, so mark this map as prefaulted
+    // which also makes it eligible to be returned to the pool
+    ret.value()._flag |= section_handle::flag::prefault;
+    ret.value()._addr = static_cast<byte *>(addr);
+    ret.value()._reservation = bytes;
+    ret.value()._length = bytes;
+    ret.value()._pagesize = pagesize;
+    nativeh._init = -2;  // otherwise appears closed
+    nativeh.behaviour |= native_handle_type::disposition::allocation | native_handle_type::disposition::seekable | native_handle_type::disposition::readable;
+    if(_flag & section_handle::flag::write)
+    {
+      nativeh.behaviour |= native_handle_type::disposition::writable;
+    }
+    return ret;
+  }
+  if(bytes >= (1ULL << 30U) /*1Gb*/)
+  {
+    return _new_map(bytes, false, _flag);
+  }
+  size_type reservation = bytes;
+  void *addr = c->get(reservation, pagesize);
   if(addr == nullptr)
   {
     return _new_map(bytes, false, _flag);
@@ -262,7 +681,7 @@ result<map_handle> map_handle::_recycled_map(size_type bytes, section_handle::fl
   OUTCOME_TRY(do_mmap(nativeh, addr, flags, nullptr, pagesize, bytes, 0, _flag));
 #endif
   ret.value()._addr = static_cast<byte *>(addr);
-  ret.value()._reservation = bytes;
+  ret.value()._reservation = reservation;
   ret.value()._length = bytes;
   ret.value()._pagesize = pagesize;
   nativeh._init = -2;  // otherwise appears closed
@@ -276,7 +695,17 @@ bool map_handle::_recycle_map() noexcept
   {
     LLFIO_LOG_FUNCTION_CALL(this);
     auto *c = detail::map_handle_cache();
-    if(c == nullptr || c->is_disabled() || _reservation >= (1ULL << 30U) /*1Gb*/)
+    if(c == nullptr || c->is_disabled())
+    {
+      return false;
+    }
+    // Only maps which came from a pool, or which were prefaulted on creation, may go
+    // into a pool, otherwise pool consumers would receive regions which fault
+    if(_length == _reservation && (_flag & section_handle::flag::prefault) && c->add_pooled(_reservation, _pagesize, _flag, _addr))
+    {
+      return true;
+    }
+    if(_reservation >= (1ULL << 30U) /*1Gb*/)
     {
       return false;
     }
@@ -329,4 +758,33 @@ bool map_handle::set_cache_disabled(bool disabled) noexcept
   return (c != nullptr) ? c->set_cache_disabled(disabled) : true;
 }
 
+size_t map_handle::set_cache_slack(size_t bytes) noexcept
+{
+  auto *c = detail::map_handle_cache();
+  return (c != nullptr) ? c->set_cache_slack(bytes) : 0;
+}
+
+result<void> map_handle::set_cache_pool(size_type bytes, size_t regions, section_handle::flag _flag) noexcept
+{
+  auto *c = detail::map_handle_cache();
+  if(c == nullptr)
+  {
+    return errc::operation_not_supported;
+  }
+  if(bytes == 0u)
+  {
+    return errc::argument_out_of_domain;
+  }
+  OUTCOME_TRY(auto &&pagesize, detail::pagesize_from_flags(_flag));
+  LLFIO_EXCEPTION_TRY
+  {
+    c->set_pool(utils::round_up_to_page_size(bytes, pagesize), regions, pagesize, _flag);
+    return success();
+  }
+  LLFIO_EXCEPTION_CATCH_ALL
+  {
+    return error_from_exception();
+  }
+}
+
 LLFIO_V2_NAMESPACE_END
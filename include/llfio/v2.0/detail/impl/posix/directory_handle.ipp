@@ -272,6 +272,16 @@ result<directory_handle::buffers_type> directory_handle::read(io_request<buffers
   {
     return std::move(req.buffers);
   }
+  const bool streaming = !!(req.flags & flags::streaming);
+#if !defined(__linux__) && !defined(__FreeBSD__)
+  if(streaming)
+  {
+    // No d_off in struct dirent to resume from
+    return errc::operation_not_supported;
+  }
+#endif
+  // A buffers_type may be reused across streaming and snapshot reads
+  req.buffers._snapshot = !streaming;
   // Is glob a single entry match? If so, this is really a stat call
   path_view_type::zero_terminated_rendered_path<> zglob(req.glob);
   if(!req.glob.empty() && !req.glob.contains_glob())
@@ -366,10 +376,16 @@ result<directory_handle::buffers_type> directory_handle::read(io_request<buffers
 #endif
   });
 #endif
+  /* A streaming read consumes only as many entries as there are buffers, and anything
+  else the kernel returned gets fetched again by the next read, so for those we ask the
+  kernel for about as many records as there are buffers. Records are variable length,
+  so let's assume the average leafname plus padding will be 32 characters long.
+  */
+  const size_t streamingbytes = (offsetof(dirent, d_name) + 32) * req.buffers.size();
   if(!req.buffers._kernel_buffer && req.kernelbuffer.empty())
   {
     // Let's assume the average leafname will be 64 characters long.
-    size_t toallocate = (sizeof(dirent) + 64) * req.buffers.size();
+    size_t toallocate = streaming ? streamingbytes : (sizeof(dirent) + 64) * req.buffers.size();
     auto *mem = (char *) operator new[](toallocate, std::nothrow);  // don't initialise
     if(mem == nullptr)
     {
@@ -382,40 +398,42 @@ result<directory_handle::buffers_type> directory_handle::read(io_request<buffers
   dirent *buffer;
   size_t bytesavailable, bytes;
   bool done = false;
-  do
+  if(streaming)
   {
-    buffer = req.kernelbuffer.empty() ? reinterpret_cast<dirent *>(req.buffers._kernel_buffer.get()) : reinterpret_cast<dirent *>(req.kernelbuffer.data());
-    bytesavailable = req.kernelbuffer.empty() ? req.buffers._kernel_buffer_size : req.kernelbuffer.size();
-    while(_lock.exchange(1, std::memory_order_relaxed) != 0)
+    /* Fetch exactly one batch from where the cursor says, into a kernel buffer which is only
+    grown if not even a single entry will fit. Leafnames returned point into the kernel buffer,
+    so we cannot refill it until the next call. A kernel buffer left bigger by an earlier
+    snapshot read is only partially used.
+    */
+    size_t wantbytes = streamingbytes;
+    for(;;)
     {
-      std::this_thread::yield();
-    }
-    auto unlock = make_scope_exit([this]() noexcept { _lock.store(0, std::memory_order_release); });
-    (void) unlock;
-// Seek to start
+      buffer = req.kernelbuffer.empty() ? reinterpret_cast<dirent *>(req.buffers._kernel_buffer.get()) : reinterpret_cast<dirent *>(req.kernelbuffer.data());
+      bytesavailable = req.kernelbuffer.empty() ? std::min(req.buffers._kernel_buffer_size, wantbytes) : req.kernelbuffer.size();
+      while(_lock.exchange(1, std::memory_order_relaxed) != 0)
+      {
+        std::this_thread::yield();
+      }
+      auto unlock = make_scope_exit([this]() noexcept { _lock.store(0, std::memory_order_release); });
+      (void) unlock;
 #ifdef __GLIBC__
-    if(-1 == ::lseek64(_v.fd, 0, SEEK_SET))
-    {
-      return posix_error();
-    }
-#else
-    if(-1 == ::lseek(_v.fd, 0, SEEK_SET))
-      return posix_error();
-#endif
-    bytes = 0;
-    int _bytes;
-    do
-    {
-      assert(bytes <= bytesavailable);
-      _bytes = getdents(_v.fd, reinterpret_cast<char *>(buffer) + bytes, bytesavailable - bytes);
-      if(_bytes == 0)
+      if(-1 == ::lseek64(_v.fd, static_cast<off64_t>(req.buffers._cursor), SEEK_SET))
       {
-        done = true;
-        break;
+        return posix_error();
       }
+#else
+      if(-1 == ::lseek(_v.fd, static_cast<off_t>(req.buffers._cursor), SEEK_SET))
+        return posix_error();
+#endif
+      int _bytes = getdents(_v.fd, reinterpret_cast<char *>(buffer), bytesavailable);
       if(req.kernelbuffer.empty() && _bytes == -1 && EINVAL == errno)
       {
-        size_t toallocate = req.buffers._kernel_buffer_size * 2;
+        wantbytes = bytesavailable * 2;
+        if(wantbytes <= req.buffers._kernel_buffer_size)
+        {
+          continue;
+        }
+        size_t toallocate = wantbytes;
         auto *mem = (char *) operator new[](toallocate, std::nothrow);  // don't initialise
         if(mem == nullptr)
         {
@@ -424,20 +442,75 @@ result<directory_handle::buffers_type> directory_handle::read(io_request<buffers
         req.buffers._kernel_buffer.reset();
         req.buffers._kernel_buffer = std::unique_ptr<char[]>(mem);
         req.buffers._kernel_buffer_size = toallocate;
-        // We need to reset and do the whole thing against to ensure single shot atomicity
-        break;
+        continue;
       }
-      else if(_bytes == -1)
+      if(_bytes == -1)
       {
         return posix_error();
       }
-      else
+      bytes = _bytes;
+      break;
+    }
+  }
+  else
+  {
+    do
+    {
+      buffer = req.kernelbuffer.empty() ? reinterpret_cast<dirent *>(req.buffers._kernel_buffer.get()) : reinterpret_cast<dirent *>(req.kernelbuffer.data());
+      bytesavailable = req.kernelbuffer.empty() ? req.buffers._kernel_buffer_size : req.kernelbuffer.size();
+      while(_lock.exchange(1, std::memory_order_relaxed) != 0)
       {
-        assert(_bytes > 0);
-        bytes += _bytes;
+        std::this_thread::yield();
+      }
+      auto unlock = make_scope_exit([this]() noexcept { _lock.store(0, std::memory_order_release); });
+      (void) unlock;
+      // Seek to start
+#ifdef __GLIBC__
+      if(-1 == ::lseek64(_v.fd, 0, SEEK_SET))
+      {
+        return posix_error();
       }
+#else
+      if(-1 == ::lseek(_v.fd, 0, SEEK_SET))
+        return posix_error();
+#endif
+      bytes = 0;
+      int _bytes;
+      do
+      {
+        assert(bytes <= bytesavailable);
+        _bytes = getdents(_v.fd, reinterpret_cast<char *>(buffer) + bytes, bytesavailable - bytes);
+        if(_bytes == 0)
+        {
+          done = true;
+          break;
+        }
+        if(req.kernelbuffer.empty() && _bytes == -1 && EINVAL == errno)
+        {
+          size_t toallocate = req.buffers._kernel_buffer_size * 2;
+          auto *mem = (char *) operator new[](toallocate, std::nothrow);  // don't initialise
+          if(mem == nullptr)
+          {
+            return errc::not_enough_memory;
+          }
+          req.buffers._kernel_buffer.reset();
+          req.buffers._kernel_buffer = std::unique_ptr<char[]>(mem);
+          req.buffers._kernel_buffer_size = toallocate;
+          // We need to reset and do the whole thing against to ensure single shot atomicity
+          break;
+        }
+        else if(_bytes == -1)
+        {
+          return posix_error();
+        }
+        else
+        {
+          assert(_bytes > 0);
+          bytes += _bytes;
+        }
+      } while(!done);
     } while(!done);
-  } while(!done);
+  }
   if(bytes == 0)
   {
     req.buffers._resize(0);
@@ -499,12 +572,18 @@ result<directory_handle::buffers_type> directory_handle::read(io_request<buffers
       n++;
     }
   cont:
+#if defined(__linux__) || defined(__FreeBSD__)
+    if(streaming)
+    {
+      req.buffers._cursor = static_cast<uint64_t>(dent->d_off);
+    }
+#endif
     if((bytes -= dent->d_reclen) <= 0)
     {
-      // Fill is complete
+      // Fill is complete. If streaming, we only know we're done when getdents() returns nothing.
       req.buffers._resize(n);
       req.buffers._metadata = default_stat_contents;
-      req.buffers._done = true;
+      req.buffers._done = !streaming;
       return std::move(req.buffers);
     }
     if(n >= req.buffers.size())
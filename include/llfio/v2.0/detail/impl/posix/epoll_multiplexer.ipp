@@ -0,0 +1,1203 @@
+/* Multiplex socket and pipe i/o using epoll
+(C) 2020 Niall Douglas <http://www.nedproductions.biz/> (9 commits)
+File Created: Nov 2020
+
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License in the accompanying file
+Licence.txt or at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+
+Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file Licence.txt or copy at
+          http://www.boost.org/LICENSE_1_0.txt)
+*/
+
+#include "../../../byte_socket_handle.hpp"
+
+#if !LLFIO_INCLUDED_BY_HEADER || !defined(LLFIO_BYTE_SOCKET_HANDLE_H)
+#error This file should never be included directly
+#endif
+
+#ifndef __linux__
+#error This implementation file is for Linux only
+#endif
+
+#include "import.hpp"
+
+#include <climits>  // for IOV_MAX
+#include <cstdio>   // for sscanf
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <sys/utsname.h>  // for uname
+#include <unistd.h>
+
+#include <unordered_map>
+
+LLFIO_V2_NAMESPACE_BEGIN
+
+/* epoll is a readiness based API, so unlike io_uring or IOCP, the kernel does
+not perform the i/o for us. It also cannot multiplex regular files, which are
+always ready. This multiplexer is therefore for pipes and sockets only.
+
+All file descriptors are registered edge triggered for both read and write
+readiness, so we only hear from epoll when readiness changes. We cache the
+readiness per file descriptor, and clear it only when the syscall returns
+`EAGAIN`. Reads (including accepts) and writes (including connects) upon a file
+descriptor are each queued in order of initiation, and only the head of each
+queue is attempted. Initiated i/o is attempted immediately if its queue is
+empty and the file descriptor is ready, so lightly loaded sockets rarely need
+to wait for epoll at all.
+
+As with the blocking implementation, reads complete as soon as any bytes are
+read, whereas writes complete only once all bytes have been written.
+
+Per-i/o deadlines are converted to absolute steady clock deadlines at initiation,
+and each i/o with a deadline is kept in a list which is scanned when waiting
+for readiness. We expect few i/o with deadlines to be outstanding at once.
+*/
+template <bool is_threadsafe> class linux_epoll_multiplexer final : public byte_io_multiplexer_impl<is_threadsafe>
+{
+  using _base = byte_io_multiplexer_impl<is_threadsafe>;
+  using _multiplexer_lock_guard = typename _base::_lock_guard;
+
+  using path_type = typename _base::path_type;
+  using extent_type = typename _base::extent_type;
+  using size_type = typename _base::size_type;
+  using mode = typename _base::mode;
+  using creation = typename _base::creation;
+  using caching = typename _base::caching;
+  using flag = typename _base::flag;
+  using barrier_kind = typename _base::barrier_kind;
+  using const_buffers_type = typename _base::const_buffers_type;
+  using buffers_type = typename _base::buffers_type;
+  using registered_buffer_type = typename _base::registered_buffer_type;
+  template <class T> using io_request = typename _base::template io_request<T>;
+  template <class T> using io_result = typename _base::template io_result<T>;
+  using implementation_information_t = typename _base::implementation_information_t;
+  using io_operation_state = typename _base::io_operation_state;
+  using io_operation_state_visitor = typename _base::io_operation_state_visitor;
+  using check_for_any_completed_io_statistics = typename _base::check_for_any_completed_io_statistics;
+
+  enum class _op_kind : uint8_t
+  {
+    read,
+    write,
+    barrier,
+    connect,  // a read which completes when the byte_socket_handle has connected
+    accept    // a read which completes when the listening_byte_socket_handle has a new connection
+  };
+  enum class _op_where : uint8_t
+  {
+    none,       // not known to the multiplexer
+    chained,    // waiting for the i/o before it in its chain to complete
+    queued,     // waiting for readiness upon its file descriptor
+    completing  // retired, and about to have its completion dispatched
+  };
+
+  struct _registered_fd;
+  struct _epoll_operation_state final
+      : public std::conditional_t<is_threadsafe, typename _base::_synchronised_io_operation_state, typename _base::_unsynchronised_io_operation_state>
+  {
+    using _impl = std::conditional_t<is_threadsafe, typename _base::_synchronised_io_operation_state, typename _base::_unsynchronised_io_operation_state>;
+
+    _epoll_operation_state *prev{nullptr}, *next{nullptr};              // per-fd queue, or the done list
+    _epoll_operation_state *timed_prev{nullptr}, *timed_next{nullptr};  // list of i/o with deadlines
+    _registered_fd *rfd{nullptr};
+    // The listening socket and request for accepts, as h is a byte_io_handle
+    listening_byte_socket_handle *listening{nullptr};
+    std::pair<byte_socket_handle, ip::address> *accept_req{nullptr};
+    // The address for connects
+    const ip::address *connect_addr{nullptr};
+    // Bytes written so far, as writes may need several attempts
+    size_t transferred{0};
+    std::chrono::steady_clock::time_point deadline_abs;
+    // The errno to complete the i/o with, if any
+    int error{0};
+    // The failure of a connect or accept, if any
+    result<void> socket_result{success()};
+    _op_kind kind{_op_kind::read};
+    _op_where where{_op_where::none};
+    bool has_deadline{false};
+    bool cancel_requested{false};  // cancellation was requested whilst chained
+    // The next i/o in the chain, which is begun when this i/o completes successfully
+    _epoll_operation_state *chain_next{nullptr};
+
+    _epoll_operation_state() = default;
+    // Construct implicitly from the base implementation, see relocate_to()
+    explicit _epoll_operation_state(_impl &&o) noexcept
+        : _impl(std::move(o))
+    {
+    }
+    using _impl::_impl;
+
+    // You will need to reimplement this to relocate any custom state defined
+    // here, and to restamp to vptr with this finalised dynamic type. It is
+    // important to do this, as final-based optimisations compare the vptr
+    // to the finalised vptr and do non-indirect dispatch if they match.
+    virtual io_operation_state *relocate_to(byte *to_) noexcept override
+    {
+      // Only initialised or finished states can be relocated, so the
+      // multiplexer state is always at its defaults except for what
+      // construct() set
+      assert(where == _op_where::none);
+      const auto _kind = kind;
+      auto *_listening = listening;
+      auto *_accept_req = accept_req;
+      auto *_connect_addr = connect_addr;
+      auto *to = _impl::relocate_to(to_);
+      // restamp the vptr with my own
+      auto *ret = new(to) _epoll_operation_state(std::move(*static_cast<_impl *>(to)));
+      ret->kind = _kind;
+      ret->listening = _listening;
+      ret->accept_req = _accept_req;
+      ret->connect_addr = _connect_addr;
+      return ret;
+    }
+
+    bool is_read_kind() const noexcept { return kind == _op_kind::read || kind == _op_kind::accept; }
+  };
+  static_assert(sizeof(_epoll_operation_state) <= byte_io_multiplexer::awaitable<io_result<buffers_type>>::_state_storage_bytes,
+                "_epoll_operation_state does not fit into an awaitable!");
+
+  struct _queue_t
+  {
+    _epoll_operation_state *first{nullptr}, *last{nullptr};
+
+    bool empty() const noexcept { return first == nullptr; }
+  };
+  struct _registered_fd
+  {
+    int fd{-1};
+    // Cached readiness, cleared when a syscall returns EAGAIN
+    bool readable{true}, writable{true};
+    _queue_t reads, writes;
+
+    bool is_idle() const noexcept { return reads.empty() && writes.empty(); }
+  };
+
+  int _wakefd{-1};
+  // Number of wakes posted by wake_check_for_any_completed_io() not yet consumed
+  uint64_t _wakecount{0};
+  // Registered file descriptors. A node based container is used so pointers to
+  // the values remain stable.
+  std::unordered_map<int, _registered_fd> _registered_fds;
+  // i/o with deadlines
+  _epoll_operation_state *_timed_first{nullptr};
+
+  static void _enqueue_to(_queue_t &queue, _epoll_operation_state *state) noexcept
+  {
+    assert(state->prev == nullptr);
+    assert(state->next == nullptr);
+    if(queue.first == nullptr)
+    {
+      queue.first = queue.last = state;
+    }
+    else
+    {
+      state->prev = queue.last;
+      queue.last->next = state;
+      queue.last = state;
+    }
+  }
+  static void _dequeue_from(_queue_t &queue, _epoll_operation_state *state) noexcept
+  {
+    if(state->prev == nullptr)
+    {
+      assert(queue.first == state);
+      queue.first = state->next;
+    }
+    else
+    {
+      state->prev->next = state->next;
+    }
+    if(state->next == nullptr)
+    {
+      assert(queue.last == state);
+      queue.last = state->prev;
+    }
+    else
+    {
+      state->next->prev = state->prev;
+    }
+    state->next = state->prev = nullptr;
+  }
+  void _add_timed(_epoll_operation_state *state) noexcept
+  {
+    state->timed_prev = nullptr;
+    state->timed_next = _timed_first;
+    if(_timed_first != nullptr)
+    {
+      _timed_first->timed_prev = state;
+    }
+    _timed_first = state;
+  }
+  void _remove_timed(_epoll_operation_state *state) noexcept
+  {
+    if(state->timed_prev == nullptr)
+    {
+      assert(_timed_first == state);
+      _timed_first = state->timed_next;
+    }
+    else
+    {
+      state->timed_prev->timed_next = state->timed_next;
+    }
+    if(state->timed_next != nullptr)
+    {
+      state->timed_next->timed_prev = state->timed_prev;
+    }
+    state->timed_next = state->timed_prev = nullptr;
+  }
+  _queue_t &_queue_for(_epoll_operation_state *state) noexcept { return state->is_read_kind() ? state->rfd->reads : state->rfd->writes; }
+  // Deadlines for i/o are relative to when the i/o was initiated
+  static void _set_deadline(_epoll_operation_state *state) noexcept
+  {
+    const deadline d = state->payload.noncompleted.d;
+    if(!d)
+    {
+      return;
+    }
+    if(d.steady)
+    {
+      state->deadline_abs = std::chrono::steady_clock::now() + std::chrono::nanoseconds(d.nsecs);
+    }
+    else
+    {
+      state->deadline_abs = std::chrono::steady_clock::now() + (d.to_time_point() - std::chrono::system_clock::now());
+    }
+    state->has_deadline = true;
+  }
+  // Must be called with the multiplexer lock held. The i/o must not be in its per-fd queue.
+  void _retire(_epoll_operation_state *state, _queue_t &done) noexcept
+  {
+    if(state->has_deadline && state->where == _op_where::queued)
+    {
+      _remove_timed(state);
+    }
+    state->where = _op_where::completing;
+    _enqueue_to(done, state);
+    if(state->chain_next != nullptr)
+    {
+      // Begin the next i/o in the chain, or cancel the rest of the chain if this i/o did not fully succeed
+      auto *next = state->chain_next;
+      state->chain_next = nullptr;
+      if(state->error != 0 || !state->socket_result || !_transferred_all(state) || next->cancel_requested)
+      {
+        next->error = ECANCELED;
+        _retire(next, done);
+      }
+      else
+      {
+        _begin(next, done);
+      }
+    }
+  }
+  template <class BuffersType> static size_t _total_bytes(const io_request<BuffersType> &reqs) noexcept
+  {
+    size_t ret = 0;
+    for(const auto &b : reqs.buffers)
+    {
+      ret += b.size();
+    }
+    return ret;
+  }
+  static bool _transferred_all(const _epoll_operation_state *state) noexcept
+  {
+    switch(state->kind)
+    {
+    case _op_kind::read:
+      return state->transferred == _total_bytes(state->payload.noncompleted.params.read.reqs);
+    case _op_kind::write:
+      return state->transferred == _total_bytes(state->payload.noncompleted.params.write.reqs);
+    default:
+      break;
+    }
+    return true;
+  }
+  // Must be called with the multiplexer lock held. Begins an initiated i/o, attempting
+  // it immediately if nothing is queued before it, else queuing it for readiness.
+  void _begin(_epoll_operation_state *state, _queue_t &done) noexcept
+  {
+    const int fd = (state->kind == _op_kind::accept) ? state->listening->native_handle().fd : state->h->native_handle().fd;
+    auto it = _registered_fds.find(fd);
+    if(it == _registered_fds.end())
+    {
+      // The handle was never registered with this multiplexer
+      state->error = EBADF;
+      _retire(state, done);
+      return;
+    }
+    state->rfd = &it->second;
+    if(state->kind == _op_kind::barrier || (_queue_for(state).empty() && (state->is_read_kind() ? state->rfd->readable : state->rfd->writable)))
+    {
+      if(_attempt(state))
+      {
+        _retire(state, done);
+        return;
+      }
+    }
+    state->where = _op_where::queued;
+    _enqueue_to(_queue_for(state), state);
+    if(state->has_deadline)
+    {
+      _add_timed(state);
+    }
+  }
+
+  /* Attempts the i/o, returning true if it is complete (successfully or not),
+  or false if the file descriptor is not ready. Must be called with the
+  multiplexer lock held.
+  */
+  bool _attempt(_epoll_operation_state *state) noexcept
+  {
+    auto &rfd = *state->rfd;
+    switch(state->kind)
+    {
+    case _op_kind::read:
+    {
+      auto &reqs = state->payload.noncompleted.params.read.reqs;
+      for(;;)
+      {
+        const auto bytes = ::readv(rfd.fd, (const struct iovec *) reqs.buffers.data(), (int) std::min(reqs.buffers.size(), (size_t) IOV_MAX));
+        if(bytes >= 0)
+        {
+          state->transferred = (size_t) bytes;
+          return true;
+        }
+        if(errno == EINTR)
+        {
+          continue;
+        }
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+          rfd.readable = false;
+          return false;
+        }
+        state->error = errno;
+        return true;
+      }
+    }
+    case _op_kind::write:
+    {
+      auto &reqs = state->payload.noncompleted.params.write.reqs;
+      for(;;)
+      {
+        size_t idx = 0, skip = state->transferred;
+        while(idx < reqs.buffers.size() && skip >= reqs.buffers[idx].size())
+        {
+          skip -= reqs.buffers[idx].size();
+          ++idx;
+        }
+        if(idx == reqs.buffers.size())
+        {
+          return true;
+        }
+        ssize_t bytes;
+        if(skip == 0)
+        {
+          bytes = ::writev(rfd.fd, (const struct iovec *) reqs.buffers.data() + idx, (int) std::min(reqs.buffers.size() - idx, (size_t) IOV_MAX));
+        }
+        else
+        {
+          bytes = ::write(rfd.fd, reqs.buffers[idx].data() + skip, reqs.buffers[idx].size() - skip);
+        }
+        if(bytes >= 0)
+        {
+          state->transferred += (size_t) bytes;
+          continue;
+        }
+        if(errno == EINTR)
+        {
+          continue;
+        }
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+          rfd.writable = false;
+          return false;
+        }
+        // An error after some bytes have been written returns the bytes written
+        if(state->transferred == 0)
+        {
+          state->error = errno;
+        }
+        return true;
+      }
+    }
+    case _op_kind::barrier:
+      // Barriers upon pipes and sockets are no-ops, as with blocking i/o
+      return true;
+    case _op_kind::connect:
+    {
+      auto r = this->_do_byte_socket_handle_connect(static_cast<byte_socket_handle *>(state->h), *state->connect_addr, std::chrono::seconds(0));
+      if(r)
+      {
+        return true;
+      }
+      if(r.error() == errc::timed_out)
+      {
+        rfd.writable = false;
+        return false;
+      }
+      state->socket_result = std::move(r);
+      return true;
+    }
+    case _op_kind::accept:
+    {
+      auto r = this->_do_listening_byte_socket_handle_read(state->listening, *state->accept_req, std::chrono::seconds(0));
+      if(r)
+      {
+        return true;
+      }
+      if(r.error() == errc::timed_out)
+      {
+        rfd.readable = false;
+        return false;
+      }
+      state->socket_result = std::move(r);
+      return true;
+    }
+    }
+    return true;
+  }
+
+  // Must be called with the multiplexer lock held. Attempts the i/o queued upon
+  // a file descriptor while it remains ready.
+  size_t _progress(_registered_fd &rfd, _queue_t &done) noexcept
+  {
+    size_t ret = 0;
+    while(rfd.readable && !rfd.reads.empty())
+    {
+      auto *state = rfd.reads.first;
+      if(!_attempt(state))
+      {
+        break;
+      }
+      _dequeue_from(rfd.reads, state);
+      _retire(state, done);
+      ++ret;
+    }
+    while(rfd.writable && !rfd.writes.empty())
+    {
+      auto *state = rfd.writes.first;
+      if(!_attempt(state))
+      {
+        break;
+      }
+      _dequeue_from(rfd.writes, state);
+      _retire(state, done);
+      ++ret;
+    }
+    return ret;
+  }
+
+  // Must be called with the multiplexer lock held. Times out expired i/o,
+  // returning the time until the nearest deadline, or -1 if none.
+  std::chrono::nanoseconds _expire_deadlines(_queue_t &done) noexcept
+  {
+    std::chrono::nanoseconds ret(-1);
+    if(_timed_first == nullptr)
+    {
+      return ret;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    for(auto *state = _timed_first; state != nullptr;)
+    {
+      auto *next = state->timed_next;
+      if(state->deadline_abs <= now)
+      {
+        _dequeue_from(_queue_for(state), state);
+        state->error = ETIMEDOUT;
+        _retire(state, done);
+      }
+      else
+      {
+        const auto togo = std::chrono::duration_cast<std::chrono::nanoseconds>(state->deadline_abs - now);
+        if(ret.count() < 0 || togo < ret)
+        {
+          ret = togo;
+        }
+      }
+      state = next;
+    }
+    return ret;
+  }
+
+  // Must be called WITHOUT the multiplexer lock held. Dispatches the completion of retired i/o.
+  static void _dispatch(_queue_t &done, check_for_any_completed_io_statistics &stats) noexcept
+  {
+    while(!done.empty())
+    {
+      auto *state = done.first;
+      _dequeue_from(done, state);
+      state->where = _op_where::none;
+      switch(state->kind)
+      {
+      case _op_kind::read:
+      {
+        auto &reqs = state->payload.noncompleted.params.read.reqs;
+        io_result<buffers_type> ret(reqs.buffers);
+        if(state->error != 0)
+        {
+          ret = posix_error(state->error);
+        }
+        else
+        {
+          size_t bytes = state->transferred;
+          for(size_t i = 0; i < reqs.buffers.size(); i++)
+          {
+            auto &buffer = reqs.buffers[i];
+            if(buffer.size() <= bytes)
+            {
+              bytes -= buffer.size();
+            }
+            else
+            {
+              buffer = {buffer.data(), (size_type) bytes};
+              reqs.buffers = {reqs.buffers.data(), i + 1};
+              break;
+            }
+          }
+          ret = reqs.buffers;
+        }
+        state->read_completed(std::move(ret));
+        state->read_finished();
+        break;
+      }
+      case _op_kind::connect:
+      case _op_kind::accept:
+      {
+        io_result<buffers_type> ret(buffers_type{});
+        if(state->error != 0)
+        {
+          ret = posix_error(state->error);
+        }
+        else if(!state->socket_result)
+        {
+          ret = std::move(state->socket_result).error();
+        }
+        state->read_completed(std::move(ret));
+        state->read_finished();
+        break;
+      }
+      case _op_kind::write:
+      {
+        auto &reqs = state->payload.noncompleted.params.write.reqs;
+        io_result<const_buffers_type> ret(reqs.buffers);
+        if(state->error != 0)
+        {
+          ret = posix_error(state->error);
+        }
+        else
+        {
+          size_t bytes = state->transferred;
+          for(size_t i = 0; i < reqs.buffers.size(); i++)
+          {
+            auto &buffer = reqs.buffers[i];
+            if(buffer.size() <= bytes)
+            {
+              bytes -= buffer.size();
+            }
+            else
+            {
+              buffer = {buffer.data(), (size_type) bytes};
+              reqs.buffers = {reqs.buffers.data(), i + 1};
+              break;
+            }
+          }
+          ret = reqs.buffers;
+        }
+        state->write_completed(std::move(ret));
+        state->write_or_barrier_finished();
+        break;
+      }
+      case _op_kind::barrier:
+      {
+        auto &reqs = state->payload.noncompleted.params.barrier.reqs;
+        io_result<const_buffers_type> ret(reqs.buffers);
+        if(state->error != 0)
+        {
+          ret = posix_error(state->error);
+        }
+        state->barrier_completed(std::move(ret));
+        state->write_or_barrier_finished();
+        break;
+      }
+      }
+      ++stats.initiated_ios_completed;
+      ++stats.initiated_ios_finished;
+    }
+  }
+
+  // Waits up to the deadline for readiness, attempting any i/o made ready, and
+  // dispatches completions. Returns early upon a wake if consume_wakes is true.
+  result<check_for_any_completed_io_statistics> _pump(deadline d, size_t max_completions, bool consume_wakes) noexcept
+  {
+    LLFIO_DEADLINE_TO_SLEEP_INIT(d);
+    check_for_any_completed_io_statistics ret;
+    _queue_t done;
+    struct epoll_event events[64];
+    bool waited = false;
+    result<void> r = success();
+    _multiplexer_lock_guard g(this->_lock);
+    for(;;)
+    {
+      const auto nearest = _expire_deadlines(done);
+      if(consume_wakes && _wakecount > 0)
+      {
+        --_wakecount;
+        break;
+      }
+      if(!done.empty() || waited)
+      {
+        break;
+      }
+      int timeout = -1;
+      if(d)
+      {
+        std::chrono::nanoseconds ns;
+        LLFIO_DEADLINE_TO_PARTIAL_TIMEOUT(ns, d);
+        timeout = (int) ((ns.count() + 999999) / 1000000);
+      }
+      if(nearest.count() >= 0)
+      {
+        const int nearest_ms = (int) ((nearest.count() + 999999) / 1000000);
+        if(timeout < 0 || nearest_ms < timeout)
+        {
+          timeout = nearest_ms;
+        }
+      }
+      g.unlock();
+      const int count = ::epoll_wait(this->_v.fd, events, (int) std::max((size_t) 1, std::min(max_completions, (size_t) 64)), timeout);
+      g.lock();
+      waited = true;
+      if(count < 0)
+      {
+        if(errno != EINTR)
+        {
+          r = posix_error();
+          break;
+        }
+        continue;
+      }
+      for(int n = 0; n < count; n++)
+      {
+        const int fd = (int) events[n].data.fd;
+        if(fd == _wakefd)
+        {
+          uint64_t v = 0;
+          if(::read(_wakefd, &v, sizeof(v)) == (ssize_t) sizeof(v))
+          {
+            _wakecount += v;
+          }
+          continue;
+        }
+        // The handle may have been deregistered since epoll_wait() returned
+        auto it = _registered_fds.find(fd);
+        if(it == _registered_fds.end())
+        {
+          continue;
+        }
+        auto &rfd = it->second;
+        if(events[n].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        {
+          rfd.readable = true;
+        }
+        if(events[n].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+        {
+          rfd.writable = true;
+        }
+        _progress(rfd, done);
+      }
+    }
+    g.unlock();
+    _dispatch(done, ret);
+    OUTCOME_TRY(std::move(r));
+    return ret;
+  }
+
+  result<uint8_t> _register(int fd) noexcept
+  {
+    LLFIO_EXCEPTION_TRY
+    {
+      _multiplexer_lock_guard g(this->_lock);
+      _registered_fd rfd;
+      rfd.fd = fd;
+      auto it = _registered_fds.emplace(fd, rfd);
+      if(!it.second)
+      {
+        return errc::invalid_argument;
+      }
+      struct epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+      ev.data.fd = fd;
+      if(-1 == ::epoll_ctl(this->_v.fd, EPOLL_CTL_ADD, fd, &ev))
+      {
+        const auto retcode = errno;
+        _registered_fds.erase(it.first);
+        // Regular files and directories cannot be multiplexed by epoll
+        if(retcode == EPERM)
+        {
+          return errc::operation_not_supported;
+        }
+        return posix_error(retcode);
+      }
+      return (uint8_t) 0;
+    }
+    LLFIO_EXCEPTION_CATCH_ALL
+    {
+      return error_from_exception();
+    }
+  }
+  result<void> _deregister(int fd) noexcept
+  {
+    _multiplexer_lock_guard g(this->_lock);
+    auto it = _registered_fds.find(fd);
+    if(it == _registered_fds.end())
+    {
+      return errc::invalid_argument;
+    }
+    if(!it->second.is_idle())
+    {
+      // Can't deregister a handle with i/o in progress
+      return errc::operation_in_progress;
+    }
+    if(-1 == ::epoll_ctl(this->_v.fd, EPOLL_CTL_DEL, fd, nullptr))
+    {
+      return posix_error();
+    }
+    _registered_fds.erase(it);
+    return success();
+  }
+
+  template <class... Args> io_operation_state *_construct(span<byte> storage, Args &&...args) noexcept
+  {
+    assert(storage.size() >= sizeof(_epoll_operation_state));
+    assert(((uintptr_t) storage.data() % alignof(_epoll_operation_state)) == 0);
+    if(storage.size() < sizeof(_epoll_operation_state) || ((uintptr_t) storage.data() % alignof(_epoll_operation_state)) != 0)
+    {
+      return nullptr;
+    }
+    return new(storage.data()) _epoll_operation_state(std::forward<Args>(args)...);
+  }
+
+public:
+  linux_epoll_multiplexer() = default;
+  linux_epoll_multiplexer(const linux_epoll_multiplexer &) = delete;
+  linux_epoll_multiplexer(linux_epoll_multiplexer &&) = delete;
+  linux_epoll_multiplexer &operator=(const linux_epoll_multiplexer &) = delete;
+  linux_epoll_multiplexer &operator=(linux_epoll_multiplexer &&) = delete;
+  virtual ~linux_epoll_multiplexer()
+  {
+    if(this->_v)
+    {
+      (void) linux_epoll_multiplexer::close();
+    }
+  }
+  result<void> init(size_t /*unused*/)
+  {
+    const int fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if(fd < 0)
+    {
+      return posix_error();
+    }
+    this->_v.fd = fd;
+    this->_v.behaviour |= native_handle_type::disposition::multiplexer | native_handle_type::disposition::kernel_handle;
+    _wakefd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(_wakefd < 0)
+    {
+      return posix_error();
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = _wakefd;
+    if(-1 == ::epoll_ctl(fd, EPOLL_CTL_ADD, _wakefd, &ev))
+    {
+      return posix_error();
+    }
+    return success();
+  }
+
+  virtual implementation_information_t implementation_information() const noexcept override
+  {
+    static auto v = []() -> implementation_information_t {
+      implementation_information_t ret;
+      ret.name = "epoll";
+      struct utsname name;
+      if(-1 != ::uname(&name))
+      {
+        unsigned major = 0, minor = 0, patch = 0;
+        if(sscanf(name.release, "%u.%u.%u", &major, &minor, &patch) >= 2)
+        {
+          ret.version.major = (uint16_t) major;
+          ret.version.minor = (uint16_t) minor;
+          ret.version.patch = (uint16_t) patch;
+        }
+      }
+      ret.multiplexes.kernel.file_handle = false;
+      ret.multiplexes.kernel.pipe_handle = true;
+      ret.multiplexes.kernel.byte_socket_handle = true;
+      ret.multiplexes.kernel.listening_byte_socket_handle = true;
+      return ret;
+    }();
+    return v;
+  }
+
+  // These functions are inherited from handle
+  virtual result<path_type> current_path() const noexcept override
+  {
+    // An epoll has no path
+    return success();
+  }
+  virtual result<void> close() noexcept override
+  {
+    if(_wakefd != -1)
+    {
+      (void) ::close(_wakefd);
+      _wakefd = -1;
+    }
+    _registered_fds.clear();
+    _timed_first = nullptr;
+#ifndef NDEBUG
+    if(this->_v)
+    {
+      // Tell handle::close() that we have correctly executed
+      this->_v.behaviour |= native_handle_type::disposition::_child_close_executed;
+    }
+#endif
+    return _base::close();
+  }
+  virtual native_handle_type release() noexcept override
+  {
+    if(_wakefd != -1)
+    {
+      (void) ::close(_wakefd);
+      _wakefd = -1;
+    }
+    _registered_fds.clear();
+    _timed_first = nullptr;
+    return _base::release();
+  }
+
+  virtual result<uint8_t> do_byte_io_handle_register(byte_io_handle *h) noexcept override
+  {
+    const auto &nh = h->native_handle();
+    if(!nh.is_nonblocking())
+    {
+      // Edge triggered readiness requires non-blocking file descriptors
+      return errc::operation_not_supported;
+    }
+    return _register(nh.fd);
+  }
+  virtual result<void> do_byte_io_handle_deregister(byte_io_handle *h) noexcept override { return _deregister(h->native_handle().fd); }
+  virtual result<uint8_t> do_byte_io_handle_register(listening_byte_socket_handle *h) noexcept override
+  {
+    const auto &nh = h->native_handle();
+    if(!nh.is_nonblocking())
+    {
+      return errc::operation_not_supported;
+    }
+    return _register(nh.fd);
+  }
+  virtual result<void> do_byte_io_handle_deregister(listening_byte_socket_handle *h) noexcept override { return _deregister(h->native_handle().fd); }
+
+  virtual size_t do_byte_io_handle_max_buffers(const byte_io_handle * /*unused*/) const noexcept override { return IOV_MAX; }
+
+  virtual std::pair<size_t, size_t> io_state_requirements() noexcept override
+  {
+    return {sizeof(_epoll_operation_state), alignof(_epoll_operation_state)};
+  }
+
+  virtual io_operation_state *construct(span<byte> storage, byte_io_handle *_h, io_operation_state_visitor *_visitor, registered_buffer_type &&b, deadline d,
+                                        io_request<buffers_type> reqs) noexcept override
+  {
+    return _construct(storage, _h, _visitor, std::move(b), d, std::move(reqs));
+  }
+  virtual io_operation_state *construct(span<byte> storage, byte_io_handle *_h, io_operation_state_visitor *_visitor, registered_buffer_type &&b, deadline d,
+                                        io_request<const_buffers_type> reqs) noexcept override
+  {
+    return _construct(storage, _h, _visitor, std::move(b), d, std::move(reqs));
+  }
+  virtual io_operation_state *construct(span<byte> storage, byte_io_handle *_h, io_operation_state_visitor *_visitor, registered_buffer_type &&b, deadline d,
+                                        io_request<const_buffers_type> reqs, barrier_kind kind) noexcept override
+  {
+    return _construct(storage, _h, _visitor, std::move(b), d, std::move(reqs), kind);
+  }
+  virtual io_operation_state *construct(span<byte> storage, byte_socket_handle *_h, io_operation_state_visitor *_visitor, deadline d,
+                                        const ip::address &addr) noexcept override
+  {
+    // Connects are reads of no buffers
+    auto *ret = static_cast<_epoll_operation_state *>(_construct(storage, _h, _visitor, registered_buffer_type(), d, io_request<buffers_type>()));
+    if(ret != nullptr)
+    {
+      ret->kind = _op_kind::connect;
+      ret->connect_addr = &addr;
+    }
+    return ret;
+  }
+  virtual io_operation_state *construct(span<byte> storage, listening_byte_socket_handle *_h, io_operation_state_visitor *_visitor, deadline d,
+                                        std::pair<byte_socket_handle, ip::address> &req) noexcept override
+  {
+    // Accepts are reads of no buffers
+    auto *ret = static_cast<_epoll_operation_state *>(_construct(storage, nullptr, _visitor, registered_buffer_type(), d, io_request<buffers_type>()));
+    if(ret != nullptr)
+    {
+      ret->kind = _op_kind::accept;
+      ret->listening = _h;
+      ret->accept_req = &req;
+    }
+    return ret;
+  }
+
+  // Sets the kind of i/o from an initialised state, returning false if it is not initialised
+  static bool _set_kind(_epoll_operation_state *state, io_operation_state_type s) noexcept
+  {
+    switch(s)
+    {
+    case io_operation_state_type::unknown:
+      abort();
+    case io_operation_state_type::read_initialised:
+      // construct() has already set the kind for connects and accepts
+      return true;
+    case io_operation_state_type::write_initialised:
+      state->kind = _op_kind::write;
+      return true;
+    case io_operation_state_type::barrier_initialised:
+      state->kind = _op_kind::barrier;
+      return true;
+    case io_operation_state_type::read_initiated:
+    case io_operation_state_type::read_completed:
+    case io_operation_state_type::read_finished:
+    case io_operation_state_type::write_initiated:
+    case io_operation_state_type::barrier_initiated:
+    case io_operation_state_type::write_or_barrier_completed:
+    case io_operation_state_type::write_or_barrier_finished:
+      break;
+    }
+    assert(false);
+    return false;
+  }
+  // Moves an i/o to initiated, returning its new state. Must be called WITHOUT the multiplexer lock held.
+  static io_operation_state_type _initiated(_epoll_operation_state *state) noexcept
+  {
+    _set_deadline(state);
+    switch(state->kind)
+    {
+    case _op_kind::read:
+    case _op_kind::connect:
+    case _op_kind::accept:
+      state->read_initiated();
+      return io_operation_state_type::read_initiated;
+    case _op_kind::write:
+      state->write_initiated();
+      return io_operation_state_type::write_initiated;
+    case _op_kind::barrier:
+      break;
+    }
+    state->barrier_initiated();
+    return io_operation_state_type::barrier_initiated;
+  }
+
+  virtual io_operation_state_type init_io_operation(io_operation_state *_op) noexcept override
+  {
+    auto *state = static_cast<_epoll_operation_state *>(_op);
+    auto s = state->current_state();
+    if(!_set_kind(state, s))
+    {
+      return s;
+    }
+    const bool is_read = state->is_read_kind() || state->kind == _op_kind::connect;
+    const auto finished = is_read ? io_operation_state_type::read_finished : io_operation_state_type::write_or_barrier_finished;
+    const int fd = (state->kind == _op_kind::accept) ? state->listening->native_handle().fd : state->h->native_handle().fd;
+    _queue_t done;
+    check_for_any_completed_io_statistics stats;
+    _multiplexer_lock_guard g(this->_lock);
+    auto it = _registered_fds.find(fd);
+    if(it == _registered_fds.end())
+    {
+      g.unlock();
+      // The handle was never registered with this multiplexer
+      if(is_read)
+      {
+        state->read_completed(io_result<buffers_type>(errc::bad_file_descriptor));
+        state->read_finished();
+      }
+      else if(state->kind == _op_kind::write)
+      {
+        state->write_completed(io_result<const_buffers_type>(errc::bad_file_descriptor));
+        state->write_or_barrier_finished();
+      }
+      else
+      {
+        state->barrier_completed(io_result<const_buffers_type>(errc::bad_file_descriptor));
+        state->write_or_barrier_finished();
+      }
+      return finished;
+    }
+    state->rfd = &it->second;
+    if(state->kind == _op_kind::barrier || (_queue_for(state).empty() && (state->is_read_kind() ? state->rfd->readable : state->rfd->writable)))
+    {
+      // Try to complete the i/o immediately
+      if(_attempt(state))
+      {
+        _retire(state, done);
+        g.unlock();
+        _dispatch(done, stats);
+        return finished;
+      }
+    }
+    g.unlock();
+    s = _initiated(state);
+    g.lock();
+    state->where = _op_where::queued;
+    _enqueue_to(_queue_for(state), state);
+    if(state->has_deadline)
+    {
+      _add_timed(state);
+    }
+    // Readiness may have arrived whilst we were not holding the lock
+    _progress(*state->rfd, done);
+    if(state->where == _op_where::completing)
+    {
+      s = finished;
+    }
+    g.unlock();
+    _dispatch(done, stats);
+    return s;
+  }
+
+  virtual result<void> init_io_operation_chain(span<io_operation_state *> states, span<io_operation_state_type> out) noexcept override
+  {
+    assert(out.size() == states.size());
+    if(out.size() != states.size())
+    {
+      return errc::invalid_argument;
+    }
+    if(states.empty())
+    {
+      return success();
+    }
+    // epoll has no notion of dependent i/o, so every i/o is initiated now and each
+    // is begun by the multiplexer when the i/o before it completes
+    for(size_t n = 0; n < states.size(); n++)
+    {
+      auto *state = static_cast<_epoll_operation_state *>(states[n]);
+      auto s = state->current_state();
+      out[n] = _set_kind(state, s) ? _initiated(state) : s;
+    }
+    _queue_t done;
+    check_for_any_completed_io_statistics stats;
+    _multiplexer_lock_guard g(this->_lock);
+    for(size_t n = 1; n < states.size(); n++)
+    {
+      static_cast<_epoll_operation_state *>(states[n - 1])->chain_next = static_cast<_epoll_operation_state *>(states[n]);
+      static_cast<_epoll_operation_state *>(states[n])->where = _op_where::chained;
+    }
+    auto *head = static_cast<_epoll_operation_state *>(states[0]);
+    _begin(head, done);
+    if(head->where == _op_where::queued)
+    {
+      _progress(*head->rfd, done);
+    }
+    for(size_t n = 0; n < states.size(); n++)
+    {
+      auto *state = static_cast<_epoll_operation_state *>(states[n]);
+      if(state->where == _op_where::completing)
+      {
+        out[n] = (state->is_read_kind() || state->kind == _op_kind::connect) ? io_operation_state_type::read_finished :
+                                                                              io_operation_state_type::write_or_barrier_finished;
+      }
+    }
+    g.unlock();
+    _dispatch(done, stats);
+    return success();
+  }
+
+  virtual io_operation_state_type check_io_operation(io_operation_state *_op) noexcept override
+  {
+    auto *state = static_cast<_epoll_operation_state *>(_op);
+    auto s = state->current_state();
+    if(is_initiated(s))
+    {
+      (void) _pump(std::chrono::seconds(0), (size_t) -1, false);
+      s = state->current_state();
+    }
+    return s;
+  }
+
+  virtual result<io_operation_state_type> cancel_io_operation(io_operation_state *_op, deadline /*unused*/ = {}) noexcept override
+  {
+    auto *state = static_cast<_epoll_operation_state *>(_op);
+    _multiplexer_lock_guard g(this->_lock);
+    if(state->where == _op_where::chained)
+    {
+      // Completes with ECANCELED when the i/o before it in the chain completes
+      state->cancel_requested = true;
+      return state->current_state();
+    }
+    if(state->where != _op_where::queued)
+    {
+      return state->current_state();
+    }
+    // Nothing is done by the kernel on our behalf, so cancellation is always immediate
+    _dequeue_from(_queue_for(state), state);
+    state->error = ECANCELED;
+    _queue_t done;
+    _retire(state, done);
+    g.unlock();
+    check_for_any_completed_io_statistics stats;
+    _dispatch(done, stats);
+    return state->current_state();
+  }
+
+  virtual result<check_for_any_completed_io_statistics> check_for_any_completed_io(deadline d = std::chrono::seconds(0),
+                                                                                   size_t max_completions = (size_t) -1) noexcept override
+  {
+    return _pump(d, max_completions, true);
+  }
+
+  virtual result<void> wake_check_for_any_completed_io() noexcept override
+  {
+    const uint64_t v = 1;
+    if(::write(_wakefd, &v, sizeof(v)) < 0)
+    {
+      return posix_error();
+    }
+    return success();
+  }
+};
+
+LLFIO_HEADERS_ONLY_FUNC_SPEC result<byte_io_multiplexer_ptr> multiplexer_linux_epoll(size_t threads) noexcept
+{
+  LLFIO_EXCEPTION_TRY
+  {
+    if(1 == threads)
+    {
+      auto ret = std::make_unique<linux_epoll_multiplexer<false>>();
+      OUTCOME_TRY(ret->init(1));
+      return byte_io_multiplexer_ptr(ret.release());
+    }
+    auto ret = std::make_unique<linux_epoll_multiplexer<true>>();
+    OUTCOME_TRY(ret->init(threads));
+    return byte_io_multiplexer_ptr(ret.release());
+  }
+  LLFIO_EXCEPTION_CATCH_ALL
+  {
+    return error_from_exception();
+  }
+}
+
+LLFIO_V2_NAMESPACE_END
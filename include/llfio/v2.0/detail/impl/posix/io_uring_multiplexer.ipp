@@ -0,0 +1,2345 @@
+/* Multiplex file i/o
+(C) 2020 Niall Douglas <http://www.nedproductions.biz/> (9 commits)
+File Created: May 2019
+
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License in the accompanying file
+Licence.txt or at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+
+Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file Licence.txt or copy at
+          http://www.boost.org/LICENSE_1_0.txt)
+*/
+
+#include "../../../byte_io_handle.hpp"
+
+#if !LLFIO_INCLUDED_BY_HEADER || !defined(LLFIO_IO_HANDLE_H)
+#error This file should never be included directly
+#endif
+
+#ifndef __linux__
+#error This implementation file is for Linux only
+#endif
+
+#include "import.hpp"
+
+#include <algorithm>
+#include <climits>  // for IOV_MAX
+#include <cstdio>   // for sscanf
+#include <cstring>  // for memset
+#include <ctime>    // for clock_gettime
+
+#include <linux/fs.h>
+#include <linux/types.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>  // for _NSIG
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/utsname.h>  // for uname
+#include <unistd.h>
+
+#include <mutex>
+#include <unordered_map>
+
+LLFIO_V2_NAMESPACE_BEGIN
+
+/* io_uring is a bit of an interesting design, so we've ended up with a rather
+unusual i/o multiplexer design, which wasn't anticipated when we began this.
+
+POSIX provides strong read/write concurrency guarantees which are valuable, and
+more importantly, lots of file i/o code hard-assumes (often unintentionally) that
+there is an implicit sequencing of all i/o issued against each inode. This arose,
+historically speaking, because each inode has a read-write mutex, and i/o upon
+that inode therefore was serialised by that mutex in the kernel.
+
+io_uring doesn't expose any of this for file i/o - i/o submitted is immediately
+initiated, and no ordering is implemented at all. i.e. it's on you, the io_uring
+user, to not submit i/o the concurrency of which would be problematic. This even
+extends to IORING_OP_FSYNC, which will complete without reordering constraints to
+any i/o initiated beforehand or afterwards.
+
+What we therefore do is to implement the ordering per file descriptor ourselves:
+
+- For seekable handles, any number of reads may be submitted concurrently, but a
+write or barrier is only submitted once all i/o initiated before it has completed,
+and no i/o initiated after it is submitted until it has completed. This is the
+per-inode read-write mutex semantics of POSIX.
+
+- For non-seekable handles, there is at most one read and one write in flight at
+a time, with all others queued in order of initiation. Reads and writes do not
+block one another, as is the case for pipes and sockets.
+
+Initiated i/o which is permitted by the above rules enters a pending queue from
+which the submission queue is filled as space permits, so a full submission
+queue never loses i/o, it merely delays it. We also never allow more entries to
+be in flight than the completion queue can hold.
+
+io_uring does not hide the syscall semantics of the underlying file descriptor,
+so we have to handle them ourselves:
+
+- A short read or write upon a seekable handle has the remainder resubmitted,
+until end of file or an error, whereupon the partial result is returned.
+
+- A short read upon a non-seekable handle is returned as is, as with `read()`.
+A short write upon a non-seekable handle has the remainder resubmitted, as
+`byte_io_handle::write()` is required to write all bytes.
+
+- `-EAGAIN` from a non-blocking non-seekable handle causes an `IORING_OP_POLL_ADD`
+to be submitted for that file descriptor, and when that completes the i/o is
+resubmitted.
+
+Per-i/o deadlines are implemented by linking an `IORING_OP_LINK_TIMEOUT` with an
+absolute `CLOCK_MONOTONIC` deadline to each submission.
+
+Registered handles are also registered with the kernel as fixed files into a sparse
+table, so the kernel need not look up and reference count the file descriptor per
+i/o. Registered buffers are allocated from a pool which is registered with the
+kernel, so i/o from a single registered buffer uses `IORING_OP_READ_FIXED` or
+`IORING_OP_WRITE_FIXED` and the kernel need not pin the pages per i/o. Both are
+opportunistic: if the kernel refuses either registration (e.g. `RLIMIT_MEMLOCK`),
+i/o proceeds as it would have otherwise.
+
+When polling, the main ring is set up with `IORING_SETUP_SQPOLL` so a kernel thread
+consumes submissions. A ring set up with `IORING_SETUP_IOPOLL` can only perform
+reads and writes upon `O_DIRECT` file descriptors -- no polls, no fsyncs, no
+timeouts -- so reads and writes without deadlines upon `O_DIRECT` handles go to a
+second IOPOLL ring sharing the same fixed file indices, and everything else stays
+on the main ring. As nothing signals completion upon the IOPOLL ring, whilst any
+i/o is in flight upon it we spin reaping both rings rather than sleeping. If the
+device turns out not to support polling, the i/o is resubmitted to the main ring
+and that handle stops using the IOPOLL ring.
+*/
+template <bool is_threadsafe> class linux_io_uring_multiplexer final : public byte_io_multiplexer_impl<is_threadsafe>
+{
+  using _base = byte_io_multiplexer_impl<is_threadsafe>;
+  using _multiplexer_lock_guard = typename _base::_lock_guard;
+
+  using path_type = typename _base::path_type;
+  using extent_type = typename _base::extent_type;
+  using size_type = typename _base::size_type;
+  using mode = typename _base::mode;
+  using creation = typename _base::creation;
+  using caching = typename _base::caching;
+  using flag = typename _base::flag;
+  using barrier_kind = typename _base::barrier_kind;
+  using const_buffers_type = typename _base::const_buffers_type;
+  using buffers_type = typename _base::buffers_type;
+  using registered_buffer_type = typename _base::registered_buffer_type;
+  template <class T> using io_request = typename _base::template io_request<T>;
+  template <class T> using io_result = typename _base::template io_result<T>;
+  using implementation_information_t = typename _base::implementation_information_t;
+  using io_operation_state = typename _base::io_operation_state;
+  using io_operation_state_visitor = typename _base::io_operation_state_visitor;
+  using check_for_any_completed_io_statistics = typename _base::check_for_any_completed_io_statistics;
+
+  // The io_uring kernel submission structure
+  struct _io_uring_sqe
+  {
+    uint8_t opcode;  /* type of operation for this sqe */
+    uint8_t flags;   /* IOSQE_ flags */
+    uint16_t ioprio; /* ioprio for the request */
+    int32_t fd;      /* file descriptor to do IO on */
+    union
+    {
+      uint64_t off; /* offset into file */
+      uint64_t addr2;
+    };
+    union
+    {
+      uint64_t addr; /* pointer to buffer or iovecs */
+      uint64_t splice_off_in;
+    };
+    uint32_t len; /* buffer size or number of iovecs */
+    union
+    {
+      __kernel_rwf_t rw_flags;
+      uint32_t fsync_flags;
+      uint16_t poll_events;
+      uint32_t sync_range_flags;
+      uint32_t msg_flags;
+      uint32_t timeout_flags;
+      uint32_t accept_flags;
+      uint32_t cancel_flags;
+      uint32_t open_flags;
+      uint32_t statx_flags;
+      uint32_t fadvise_advice;
+      uint32_t splice_flags;
+    };
+    uint64_t user_data; /* data to be passed back at completion time */
+    union
+    {
+      struct
+      {
+        /* pack this to avoid bogus arm OABI complaints */
+        union
+        {
+          /* index into fixed buffers, if used */
+          uint16_t buf_index;
+          /* for grouped buffer selection */
+          uint16_t buf_group;
+        } __attribute__((packed));
+        /* personality to use, if used */
+        uint16_t personality;
+        int32_t splice_fd_in;
+      };
+      uint64_t __pad2[3];
+    };
+  };
+  static_assert(sizeof(_io_uring_sqe) == 64, "_io_uring_sqe is not 64 bytes in size!");
+
+  // sqe->flags
+  /* use fixed fileset */
+  static constexpr uint8_t _IOSQE_FIXED_FILE = (1U << 0);
+  /* issue after inflight IO */
+  static constexpr uint8_t _IOSQE_IO_DRAIN = (1U << 1);
+  /* links next sqe */
+  static constexpr uint8_t _IOSQE_IO_LINK = (1U << 2);
+  /* like LINK, but stronger */
+  static constexpr uint8_t _IOSQE_IO_HARDLINK = (1U << 3);
+  /* always go async */
+  static constexpr uint8_t _IOSQE_ASYNC = (1U << 4);
+
+  // io_uring_setup() flags
+  static constexpr uint32_t _IORING_SETUP_IOPOLL = (1U << 0); /* io_context is polled */
+  static constexpr uint32_t _IORING_SETUP_SQPOLL = (1U << 1); /* SQ poll thread */
+  static constexpr uint32_t _IORING_SETUP_SQ_AFF = (1U << 2); /* sq_thread_cpu is valid */
+  static constexpr uint32_t _IORING_SETUP_CQSIZE = (1U << 3); /* app defines CQ size */
+  static constexpr uint32_t _IORING_SETUP_CLAMP = (1U << 4);  /* clamp SQ/CQ ring sizes */
+
+  // sqe->opcode
+  enum
+  {
+    _IORING_OP_NOP,
+    _IORING_OP_READV,
+    _IORING_OP_WRITEV,
+    _IORING_OP_FSYNC,
+    _IORING_OP_READ_FIXED,
+    _IORING_OP_WRITE_FIXED,
+    _IORING_OP_POLL_ADD,
+    _IORING_OP_POLL_REMOVE,
+    _IORING_OP_SYNC_FILE_RANGE,
+    _IORING_OP_SENDMSG,
+    _IORING_OP_RECVMSG,
+    _IORING_OP_TIMEOUT,
+    _IORING_OP_TIMEOUT_REMOVE,
+    _IORING_OP_ACCEPT,
+    _IORING_OP_ASYNC_CANCEL,
+    _IORING_OP_LINK_TIMEOUT,
+    _IORING_OP_CONNECT,
+    _IORING_OP_FALLOCATE,
+    _IORING_OP_OPENAT,
+    _IORING_OP_CLOSE,
+    _IORING_OP_FILES_UPDATE,
+    _IORING_OP_STATX,
+    _IORING_OP_READ,
+    _IORING_OP_WRITE,
+    _IORING_OP_FADVISE,
+    _IORING_OP_MADVISE,
+    _IORING_OP_SEND,
+    _IORING_OP_RECV,
+    _IORING_OP_OPENAT2,
+    _IORING_OP_EPOLL_CTL,
+    _IORING_OP_SPLICE,
+    _IORING_OP_PROVIDE_BUFFERS,
+    _IORING_OP_REMOVE_BUFFERS,
+
+    /* this goes last, obviously */
+    _IORING_OP_LAST,
+  };
+
+  // sqe->fsync_flags
+  static constexpr uint32_t _IORING_FSYNC_DATASYNC = (1U << 0);
+
+  // sqe->timeout_flags
+  static constexpr uint32_t _IORING_TIMEOUT_ABS = (1U << 0);
+
+  // The io_uring kernel completion structure
+  struct _io_uring_cqe
+  {
+    uint64_t user_data; /* sqe->data submission passed back */
+    int32_t res;        /* result code for this event */
+    uint32_t flags;
+  };
+
+  // Magic offsets for the application to mmap the data it needs
+  static constexpr off_t _IORING_OFF_SQ_RING = (off_t) 0;
+  static constexpr off_t _IORING_OFF_CQ_RING = (off_t) 0x8000000;
+  static constexpr off_t _IORING_OFF_SQES = (off_t) 0x10000000;
+
+  // Filled with the offset for mmap(2)
+  struct _io_sqring_offsets
+  {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t ring_mask;
+    uint32_t ring_entries;
+    uint32_t flags;
+    uint32_t dropped;
+    uint32_t array;
+    uint32_t resv1;
+    uint64_t resv2;
+  };
+
+  // sq_ring->flags
+  static constexpr uint32_t _IORING_SQ_NEED_WAKEUP = (1U << 0); /* needs io_uring_enter wakeup */
+
+  struct _io_cqring_offsets
+  {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t ring_mask;
+    uint32_t ring_entries;
+    uint32_t overflow;
+    uint32_t cqes;
+    uint64_t resv[2];
+  };
+
+  // io_uring_enter(2) flags
+  static constexpr uint32_t _IORING_ENTER_GETEVENTS = (1U << 0);
+  static constexpr uint32_t _IORING_ENTER_SQ_WAKEUP = (1U << 1);
+
+  // Passed in for io_uring_setup(2). Copied back with updated info on success
+  struct _io_uring_params
+  {
+    uint32_t sq_entries;
+    uint32_t cq_entries;
+    uint32_t flags;
+    uint32_t sq_thread_cpu;
+    uint32_t sq_thread_idle;
+    uint32_t features;
+    uint32_t wq_fd;
+    uint32_t resv[3];
+    struct _io_sqring_offsets sq_off;
+    struct _io_cqring_offsets cq_off;
+  };
+
+  // io_uring_params->features flags
+  static constexpr uint32_t _IORING_FEAT_SINGLE_MMAP = (1U << 0);
+  static constexpr uint32_t _IORING_FEAT_NODROP = (1U << 1);
+  static constexpr uint32_t _IORING_FEAT_SUBMIT_STABLE = (1U << 2);
+
+  // io_uring_register(2) opcodes
+  static constexpr unsigned _IORING_REGISTER_BUFFERS = 0;
+  static constexpr unsigned _IORING_UNREGISTER_BUFFERS = 1;
+  static constexpr unsigned _IORING_REGISTER_FILES = 2;
+  static constexpr unsigned _IORING_UNREGISTER_FILES = 3;
+  static constexpr unsigned _IORING_REGISTER_FILES_UPDATE = 6;
+
+  struct _io_uring_files_update
+  {
+    uint32_t offset;
+    uint32_t resv;
+    uint64_t fds;
+  };
+
+  // The kernel's timespec for timeouts, which is always 64 bit
+  struct _kernel_timespec
+  {
+    int64_t tv_sec;
+    long long tv_nsec;
+  };
+
+  static int _io_uring_setup(unsigned entries, struct _io_uring_params *p) noexcept
+  {
+#ifdef __alpha__
+    return (int) syscall(535 /*__NR_io_uring_setup*/, entries, p);
+#else
+    return (int) syscall(425 /*__NR_io_uring_setup*/, entries, p);
+#endif
+  }
+  static int _io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) noexcept
+  {
+#ifdef __alpha__
+    return (int) syscall(536 /*__NR_io_uring_enter*/, fd, to_submit, min_complete, flags, nullptr, _NSIG / 8);
+#else
+    return (int) syscall(426 /*__NR_io_uring_enter*/, fd, to_submit, min_complete, flags, nullptr, _NSIG / 8);
+#endif
+  }
+  static int _io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args) noexcept
+  {
+#ifdef __alpha__
+    return (int) syscall(537 /*__NR_io_uring_register*/, fd, opcode, arg, nr_args);
+#else
+    return (int) syscall(427 /*__NR_io_uring_register*/, fd, opcode, arg, nr_args);
+#endif
+  }
+
+  // Special values of user_data. Pointers to i/o states are always at least eight byte aligned.
+  static constexpr uint64_t _wake_user_data = 0;          // a NOP posted by wake_check_for_any_completed_io()
+  static constexpr uint64_t _timeout_user_data = 2;       // an IORING_OP_TIMEOUT bounding a wait for completions
+  static constexpr uint64_t _link_timeout_user_data = 4;  // an IORING_OP_LINK_TIMEOUT implementing a per-i/o deadline
+  static constexpr uint64_t _cancel_user_data = 6;        // an IORING_OP_ASYNC_CANCEL
+  static constexpr uint64_t _poll_user_data_bit = 1;      // set in user_data if the entry is the poll for readiness of an i/o
+
+  enum class _op_kind : uint8_t
+  {
+    read,
+    write,
+    barrier
+  };
+  enum class _op_where : uint8_t
+  {
+    none,        // not known to the multiplexer
+    chained,     // waiting for the i/o before it in its chain to complete
+    waiting,     // queued behind other i/o upon the same file descriptor
+    pending,     // permitted to be submitted, waiting for space in the submission queue
+    inflight,    // submitted to io_uring
+    completing,  // retired, and about to have its completion dispatched
+  };
+
+  struct _registered_fd;
+  struct _io_uring_operation_state final
+      : public std::conditional_t<is_threadsafe, typename _base::_synchronised_io_operation_state, typename _base::_unsynchronised_io_operation_state>
+  {
+    using _impl = std::conditional_t<is_threadsafe, typename _base::_synchronised_io_operation_state, typename _base::_unsynchronised_io_operation_state>;
+
+    _io_uring_operation_state *prev{nullptr}, *next{nullptr};
+    // These are cached here from the handle for performance
+    _registered_fd *rfd{nullptr};
+    // Bytes transferred so far, as the i/o may need to be resubmitted several times
+    size_t transferred{0};
+    // Used to resubmit the remainder of a partially transferred buffer
+    struct iovec partial_iov
+    {
+      nullptr, 0
+    };
+    // The absolute CLOCK_MONOTONIC deadline for this i/o, if has_deadline is true
+    _kernel_timespec deadline_abs{0, 0};
+    // The errno to complete the i/o with, if any
+    int error{0};
+    _op_kind kind{_op_kind::read};
+    _op_where where{_op_where::none};
+    bool is_seekable{false};
+    bool has_deadline{false};
+    bool poll_first{false};         // next submission is the poll for readiness
+    bool in_poll{false};            // the submission in flight is the poll for readiness
+    bool cancel_requested{false};   // cancellation of the submission in flight was requested
+    bool barrier_fallback{false};  // IORING_OP_SYNC_FILE_RANGE failed, use IORING_OP_FSYNC instead
+    bool in_iopoll{false};          // the submission in flight is upon the IOPOLL ring
+    bool chain_linkable{false};     // the rest of the chain may be submitted linked to this i/o
+    bool chain_linked{false};       // the next i/o in the chain is admitted, and will be submitted linked to this
+    // The next i/o in the chain, which is initiated when this i/o completes successfully
+    _io_uring_operation_state *chain_next{nullptr};
+    // The i/o submitted linked before and after this one, until the earlier of them is retired
+    _io_uring_operation_state *linked_prev{nullptr}, *linked_next{nullptr};
+
+    _io_uring_operation_state() = default;
+    // Construct implicitly from the base implementation, see relocate_to()
+    explicit _io_uring_operation_state(_impl &&o) noexcept
+        : _impl(std::move(o))
+    {
+    }
+    using _impl::_impl;
+
+    // You will need to reimplement this to relocate any custom state defined
+    // here, and to restamp to vptr with this finalised dynamic type. It is
+    // important to do this, as final-based optimisations compare the vptr
+    // to the finalised vptr and do non-indirect dispatch if they match.
+    virtual io_operation_state *relocate_to(byte *to_) noexcept override
+    {
+      // Only initialised or finished states can be relocated, so the
+      // multiplexer state is always at its defaults
+      assert(where == _op_where::none);
+      auto *to = _impl::relocate_to(to_);
+      // restamp the vptr with my own
+      return new(to) _io_uring_operation_state(std::move(*static_cast<_impl *>(to)));
+    }
+
+    uint64_t user_data() const noexcept { return (uint64_t)(uintptr_t) this | (in_poll ? _poll_user_data_bit : 0); }
+  };
+  static_assert(sizeof(_io_uring_operation_state) <= byte_io_multiplexer::awaitable<io_result<buffers_type>>::_state_storage_bytes,
+                "_io_uring_operation_state does not fit into an awaitable!");
+
+  struct _queue_t
+  {
+    _io_uring_operation_state *first{nullptr}, *last{nullptr};
+
+    bool empty() const noexcept { return first == nullptr; }
+  };
+  struct _registered_fd
+  {
+    int fd{-1};
+    // Index into the kernel's fixed file table, or -1 if not registered there
+    int fixed_index{-1};
+    bool is_seekable{false};
+    // Whether reads and writes are submitted to the IOPOLL ring
+    bool is_iopoll{false};
+    // Number of reads permitted to be submitted, and not yet retired
+    uint32_t reads_admitted{0};
+    // Number of writes and barriers permitted to be submitted, and not yet retired. Only
+    // i/o submitted linked to one another can have more than one.
+    uint32_t writes_admitted{0};
+    // i/o not yet permitted to be submitted. Seekable handles queue all i/o into
+    // waiting_writes so the order of initiation is preserved.
+    _queue_t waiting_reads, waiting_writes;
+
+    bool is_idle() const noexcept { return reads_admitted == 0 && writes_admitted == 0 && waiting_reads.empty() && waiting_writes.empty(); }
+  };
+
+  /* An io_uring instance. All i/o is submitted to the main ring, except when
+  polling, where reads and writes upon handles opened with `O_DIRECT` are submitted
+  to a second ring set up with `IORING_SETUP_IOPOLL`. Its completions are found by
+  polling the device rather than by interrupt, and so they must be busy polled for.
+  */
+  struct _ring_t
+  {
+    int fd{-1};
+    struct _submission_t
+    {
+      const std::atomic<uint32_t> *head{nullptr}, *flags{nullptr};
+      std::atomic<uint32_t> *tail{nullptr};
+      uint32_t ring_mask{0}, ring_entries{0};
+      uint32_t local_tail{0};  // tail as yet unpublished to the kernel
+      span<byte> region;       // refers to the mmapped region, used to munmap on close
+      span<_io_uring_sqe> entries;
+      uint32_t *array{nullptr};
+    } submission;
+    struct _completion_t
+    {
+      std::atomic<uint32_t> *head{nullptr};
+      const std::atomic<uint32_t> *tail{nullptr};
+      uint32_t ring_mask{0}, ring_entries{0};
+      span<byte> region;  // refers to the mmapped region, used to munmap on close
+      span<_io_uring_cqe> entries;
+    } completion;
+    // Number of submission queue entries whose completion has not been reaped yet
+    uint32_t inflight{0};
+    // Whether a kernel thread polls the submission queue
+    bool is_sqpoll{false};
+    // Whether the registered buffer pool is registered with this ring
+    bool has_buffer_pool{false};
+  };
+  const bool _is_polling{false};
+  _ring_t _ring, _iopoll;
+  // Storage for the timeouts of IORING_OP_TIMEOUT, one per submission queue entry
+  // as with IORING_SETUP_SQPOLL the kernel may read them at any time until consumed
+  std::vector<_kernel_timespec> _timeouts;
+  // Number of wakes posted by wake_check_for_any_completed_io() not yet consumed
+  uint32_t _wakecount{0};
+  // Initiated i/o which may be submitted as soon as there is space
+  _queue_t _pending;
+  // Registered file descriptors. A node based container is used so pointers to
+  // the values remain stable.
+  std::unordered_map<int, _registered_fd> _registered_fds;
+  // Free slots in the kernel's fixed file table, which is empty if fixed files are unavailable
+  static constexpr uint32_t _fixed_files_max = 1024;
+  // The most i/o in a chain which will be submitted linked to one another
+  static constexpr size_t _chain_linked_max = 16;
+  std::vector<uint32_t> _fixed_files_free;
+
+  /* The pool of memory registered with the kernel from which registered buffers
+  are allocated. It is reference counted, as registered buffers may outlive the
+  multiplexer.
+  */
+  struct _buffer_pool_t
+  {
+    span<byte> region;
+    std::mutex lock;
+    // Free extents as (offset, length), sorted by offset
+    std::vector<std::pair<size_t, size_t>> free;
+
+    _buffer_pool_t() = default;
+    _buffer_pool_t(const _buffer_pool_t &) = delete;
+    _buffer_pool_t(_buffer_pool_t &&) = delete;
+    _buffer_pool_t &operator=(const _buffer_pool_t &) = delete;
+    _buffer_pool_t &operator=(_buffer_pool_t &&) = delete;
+    ~_buffer_pool_t()
+    {
+      if(!region.empty())
+      {
+        (void) ::munmap(region.data(), region.size());
+      }
+    }
+
+    bool map(size_t bytes, size_t page_size)
+    {
+      // Allocations are in whole pages, so there can never be more free extents than this
+      free.reserve(bytes / page_size / 2 + 1);
+      auto *p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+      if(p == MAP_FAILED)
+      {
+        return false;
+      }
+      region = {(byte *) p, bytes};
+      free.emplace_back(0, bytes);
+      return true;
+    }
+
+    byte *allocate(size_t bytes) noexcept
+    {
+      std::lock_guard<std::mutex> g(lock);
+      for(auto it = free.begin(); it != free.end(); ++it)
+      {
+        if(it->second >= bytes)
+        {
+          byte *ret = region.data() + it->first;
+          it->first += bytes;
+          it->second -= bytes;
+          if(it->second == 0)
+          {
+            free.erase(it);
+          }
+          return ret;
+        }
+      }
+      return nullptr;
+    }
+    void deallocate(byte *p, size_t bytes) noexcept
+    {
+      std::lock_guard<std::mutex> g(lock);
+      const size_t offset = p - region.data();
+      auto it = std::lower_bound(free.begin(), free.end(), std::pair<size_t, size_t>(offset, 0));
+      // Coalesce with the free extents either side, if adjacent
+      if(it != free.begin() && (it - 1)->first + (it - 1)->second == offset)
+      {
+        --it;
+        it->second += bytes;
+      }
+      else
+      {
+        // Never reallocates, as capacity was reserved for the worst case
+        it = free.emplace(it, offset, bytes);
+      }
+      auto next = it + 1;
+      if(next != free.end() && it->first + it->second == next->first)
+      {
+        it->second += next->second;
+        free.erase(next);
+      }
+    }
+  };
+  static constexpr size_t _buffer_pool_default_bytes = 8 * 1024 * 1024;
+  std::shared_ptr<_buffer_pool_t> _buffer_pool;
+  // The pool region, or empty. Cached here so the hot path doesn't need to chase the pointer.
+  span<byte> _buffer_pool_region;
+  // Whether we have tried to create the pool yet
+  bool _buffer_pool_attempted{false};
+
+  static void _enqueue_to(_queue_t &queue, _io_uring_operation_state *state) noexcept
+  {
+    assert(state->prev == nullptr);
+    assert(state->next == nullptr);
+    assert(queue.first != state);
+    assert(queue.last != state);
+    if(queue.first == nullptr)
+    {
+      queue.first = queue.last = state;
+    }
+    else
+    {
+      assert(queue.last->next == nullptr);
+      state->prev = queue.last;
+      queue.last->next = state;
+      queue.last = state;
+    }
+  }
+  static void _enqueue_front_to(_queue_t &queue, _io_uring_operation_state *state) noexcept
+  {
+    assert(state->prev == nullptr);
+    assert(state->next == nullptr);
+    if(queue.first == nullptr)
+    {
+      queue.first = queue.last = state;
+    }
+    else
+    {
+      assert(queue.first->prev == nullptr);
+      state->next = queue.first;
+      queue.first->prev = state;
+      queue.first = state;
+    }
+  }
+  static void _dequeue_from(_queue_t &queue, _io_uring_operation_state *state) noexcept
+  {
+    if(state->prev == nullptr)
+    {
+      assert(queue.first == state);
+      queue.first = state->next;
+    }
+    else
+    {
+      state->prev->next = state->next;
+    }
+    if(state->next == nullptr)
+    {
+      assert(queue.last == state);
+      queue.last = state->prev;
+    }
+    else
+    {
+      state->next->prev = state->prev;
+    }
+    state->next = state->prev = nullptr;
+  }
+
+  static _kernel_timespec _monotonic_now() noexcept
+  {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return {ts.tv_sec, ts.tv_nsec};
+  }
+  static _kernel_timespec _monotonic_add(_kernel_timespec ts, std::chrono::nanoseconds ns) noexcept
+  {
+    if(ns.count() < 0)
+    {
+      ns = std::chrono::nanoseconds(0);
+    }
+    ts.tv_sec += (int64_t)(ns.count() / 1000000000LL);
+    ts.tv_nsec += (long long) (ns.count() % 1000000000LL);
+    if(ts.tv_nsec >= 1000000000LL)
+    {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000LL;
+    }
+    return ts;
+  }
+  static bool _has_expired(const _kernel_timespec &deadline_abs) noexcept
+  {
+    const auto now = _monotonic_now();
+    return now.tv_sec > deadline_abs.tv_sec || (now.tv_sec == deadline_abs.tv_sec && now.tv_nsec >= deadline_abs.tv_nsec);
+  }
+  // Deadlines for i/o are relative to when the i/o was initiated
+  static void _set_deadline(_io_uring_operation_state *state) noexcept
+  {
+    const deadline d = state->payload.noncompleted.d;
+    if(!d)
+    {
+      return;
+    }
+    std::chrono::nanoseconds ns(0);
+    if(d.steady)
+    {
+      ns = std::chrono::nanoseconds(d.nsecs);
+    }
+    else
+    {
+      ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d.to_time_point() - std::chrono::system_clock::now());
+    }
+    state->deadline_abs = _monotonic_add(_monotonic_now(), ns);
+    state->has_deadline = true;
+  }
+
+  /* Per file descriptor ordering.
+   */
+  static bool _can_admit(const _registered_fd &rfd, _op_kind kind) noexcept
+  {
+    if(rfd.is_seekable)
+    {
+      if(kind == _op_kind::read)
+      {
+        return rfd.writes_admitted == 0;
+      }
+      return rfd.writes_admitted == 0 && rfd.reads_admitted == 0;
+    }
+    if(kind == _op_kind::read)
+    {
+      return rfd.reads_admitted == 0;
+    }
+    return rfd.writes_admitted == 0;
+  }
+  static _queue_t &_waiting_queue(_registered_fd &rfd, _op_kind kind) noexcept
+  {
+    return (rfd.is_seekable || kind != _op_kind::read) ? rfd.waiting_writes : rfd.waiting_reads;
+  }
+  static void _count_admission(_registered_fd &rfd, _op_kind kind) noexcept
+  {
+    if(kind == _op_kind::read)
+    {
+      ++rfd.reads_admitted;
+    }
+    else
+    {
+      ++rfd.writes_admitted;
+    }
+  }
+  /* Whether the rest of the chain after an i/o about to be admitted can be admitted
+  with it. i/o in the chain upon a file descriptor used earlier in the chain is ordered
+  by the kernel after that earlier i/o, so only the first i/o in the chain upon each
+  file descriptor needs to be admissible.
+  */
+  static bool _can_admit_chain(const _io_uring_operation_state *head) noexcept
+  {
+    for(auto *state = head->chain_next; state != nullptr; state = state->chain_next)
+    {
+      bool seen = false;
+      for(auto *prev = head; prev != state && !seen; prev = prev->chain_next)
+      {
+        seen = (prev->rfd == state->rfd);
+      }
+      if(!seen && (!_waiting_queue(*state->rfd, state->kind).empty() || !_can_admit(*state->rfd, state->kind)))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+  void _admit(_registered_fd &rfd, _io_uring_operation_state *state) noexcept
+  {
+    if(state->chain_linkable && _can_admit_chain(state))
+    {
+      // Admit the rest of the chain too, so it is submitted linked to this i/o
+      for(auto *i = state; i->chain_next != nullptr; i = i->chain_next)
+      {
+        i->chain_linked = true;
+        _count_admission(*i->chain_next->rfd, i->chain_next->kind);
+      }
+    }
+    _count_admission(rfd, state->kind);
+    state->where = _op_where::pending;
+    _enqueue_to(_pending, state);
+  }
+  void _admit_waiting(_registered_fd &rfd) noexcept
+  {
+    for(_queue_t *q : {&rfd.waiting_reads, &rfd.waiting_writes})
+    {
+      while(!q->empty() && _can_admit(rfd, q->first->kind))
+      {
+        auto *state = q->first;
+        _dequeue_from(*q, state);
+        _admit(rfd, state);
+      }
+    }
+  }
+  // Must be called with the multiplexer lock held
+  void _initiate(_io_uring_operation_state *state) noexcept
+  {
+    auto &rfd = *state->rfd;
+    auto &q = _waiting_queue(rfd, state->kind);
+    if(q.empty() && _can_admit(rfd, state->kind))
+    {
+      _admit(rfd, state);
+    }
+    else
+    {
+      state->where = _op_where::waiting;
+      _enqueue_to(q, state);
+    }
+  }
+  // Must be called with the multiplexer lock held. Undoes the admission of an i/o.
+  void _unadmit(_io_uring_operation_state *state) noexcept
+  {
+    auto *rfd = state->rfd;
+    if(state->kind == _op_kind::read)
+    {
+      assert(rfd->reads_admitted > 0);
+      --rfd->reads_admitted;
+    }
+    else
+    {
+      assert(rfd->writes_admitted > 0);
+      --rfd->writes_admitted;
+    }
+  }
+  // Must be called with the multiplexer lock held. The i/o must not be in any queue.
+  void _retire(_io_uring_operation_state *state, _queue_t &done, bool was_admitted = true) noexcept
+  {
+    auto *rfd = state->rfd;
+    if(was_admitted)
+    {
+      _unadmit(state);
+    }
+    if(state->linked_next != nullptr)
+    {
+      state->linked_next->linked_prev = nullptr;
+      state->linked_next = nullptr;
+    }
+    if(state->linked_prev != nullptr)
+    {
+      state->linked_prev->linked_next = nullptr;
+      state->linked_prev = nullptr;
+    }
+    state->where = _op_where::completing;
+    _enqueue_to(done, state);
+    if(state->chain_next != nullptr)
+    {
+      _continue_chain(state, done);
+    }
+    if(rfd != nullptr)
+    {
+      _admit_waiting(*rfd);
+    }
+  }
+  // Must be called with the multiplexer lock held. Initiates the next i/o in the chain
+  // of a retired i/o, or cancels the rest of the chain if the i/o did not fully succeed.
+  void _continue_chain(_io_uring_operation_state *state, _queue_t &done) noexcept
+  {
+    auto *next = state->chain_next;
+    state->chain_next = nullptr;
+    if(state->chain_linked)
+    {
+      // The rest of the chain was admitted to be submitted linked to this i/o, which
+      // was retired before it could be submitted
+      state->chain_linked = false;
+      next->error = ECANCELED;
+      _retire(next, done, true);
+      return;
+    }
+    if(state->error != 0 || !_transferred_all(state) || next->cancel_requested)
+    {
+      next->error = ECANCELED;
+      _retire(next, done, false);
+      return;
+    }
+    _attach(next, done);
+  }
+
+  /* Submission queue management.
+   */
+  static uint32_t _sq_space(const _ring_t &ring) noexcept
+  {
+    const uint32_t head = ring.submission.head->load(std::memory_order_acquire);
+    return ring.submission.ring_entries - (ring.submission.local_tail - head);
+  }
+  // Always leave a little space in the completion queue for wakes, timeouts and cancellations
+  static bool _can_submit(const _ring_t &ring, uint32_t count = 1) noexcept
+  {
+    return _sq_space(ring) >= count + 1 && ring.inflight + count + 1 <= ring.completion.ring_entries - 16;
+  }
+  static _io_uring_sqe *_get_sqe(_ring_t &ring) noexcept
+  {
+    if(_sq_space(ring) == 0)
+    {
+      return nullptr;
+    }
+    const uint32_t idx = ring.submission.local_tail & ring.submission.ring_mask;
+    auto *sqe = &ring.submission.entries[idx];
+    memset(sqe, 0, sizeof(_io_uring_sqe));
+    ring.submission.array[idx] = idx;
+    ++ring.submission.local_tail;
+    ++ring.inflight;
+    return sqe;
+  }
+  // Publishes filled submission queue entries to the kernel, returning how many are unsubmitted
+  static uint32_t _publish_sqes(_ring_t &ring) noexcept
+  {
+    ring.submission.tail->store(ring.submission.local_tail, std::memory_order_release);
+    return ring.submission.local_tail - ring.submission.head->load(std::memory_order_acquire);
+  }
+  // Must be called WITHOUT the multiplexer lock held if waiting for completions
+  static result<void> _enter(const _ring_t &ring, uint32_t to_submit, uint32_t min_complete, bool getevents = false) noexcept
+  {
+    unsigned flags = (min_complete > 0 || getevents) ? _IORING_ENTER_GETEVENTS : 0;
+    if(ring.is_sqpoll)
+    {
+      // The kernel thread does submission, unless it has gone to sleep
+      if((ring.submission.flags->load(std::memory_order_acquire) & _IORING_SQ_NEED_WAKEUP) != 0)
+      {
+        flags |= _IORING_ENTER_SQ_WAKEUP;
+      }
+      else if(flags == 0)
+      {
+        return success();
+      }
+      to_submit = 0;
+    }
+    else if(to_submit == 0 && flags == 0)
+    {
+      return success();
+    }
+    if(_io_uring_enter(ring.fd, to_submit, min_complete, flags) < 0)
+    {
+      // EINTR is a spurious wake, EAGAIN and EBUSY mean the completion queue needs reaping first
+      if(errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      {
+        return posix_error();
+      }
+    }
+    return success();
+  }
+  // Must be called with the multiplexer lock held, which is released. Submits all
+  // published submission queue entries to both rings without waiting.
+  result<void> _submit(_multiplexer_lock_guard &g) noexcept
+  {
+    const uint32_t to_submit = _publish_sqes(_ring);
+    const uint32_t to_submit_iopoll = (_iopoll.fd != -1) ? _publish_sqes(_iopoll) : 0;
+    g.unlock();
+    OUTCOME_TRY(_enter(_ring, to_submit, 0));
+    if(to_submit_iopoll > 0)
+    {
+      OUTCOME_TRY(_enter(_iopoll, to_submit_iopoll, 0));
+    }
+    return success();
+  }
+  // Whether the i/o is submitted to the IOPOLL ring. IOPOLL rings can only do reads
+  // and writes, and cannot do linked timeouts or polls for readiness.
+  static bool _is_for_iopoll(const _io_uring_operation_state *state) noexcept
+  {
+    return state->rfd->is_iopoll && state->kind != _op_kind::barrier && !state->has_deadline && !state->poll_first;
+  }
+  _ring_t &_ring_for(const _io_uring_operation_state *state) noexcept { return _is_for_iopoll(state) ? _iopoll : _ring; }
+
+  // Fills in submission queue entries for the i/o. There must be space for two.
+  // If is_linked, the next submission queue entry is linked to this i/o.
+  void _prepare_sqes(_io_uring_operation_state *state, bool is_linked = false) noexcept
+  {
+    auto &ring = _ring_for(state);
+    state->in_iopoll = (&ring == &_iopoll);
+    auto *sqe = _get_sqe(ring);
+    assert(sqe != nullptr);
+    if(state->rfd->fixed_index >= 0)
+    {
+      sqe->fd = state->rfd->fixed_index;
+      sqe->flags |= _IOSQE_FIXED_FILE;
+    }
+    else
+    {
+      sqe->fd = state->rfd->fd;
+    }
+    state->in_poll = state->poll_first;
+    if(state->in_poll)
+    {
+      sqe->opcode = _IORING_OP_POLL_ADD;
+      sqe->poll_events = (state->kind == _op_kind::read) ? POLLIN : POLLOUT;
+    }
+    else
+    {
+      switch(state->kind)
+      {
+      case _op_kind::read:
+        _prepare_io(ring, sqe, _IORING_OP_READV, _IORING_OP_READ_FIXED, state, state->payload.noncompleted.params.read.reqs);
+        break;
+      case _op_kind::write:
+        _prepare_io(ring, sqe, _IORING_OP_WRITEV, _IORING_OP_WRITE_FIXED, state, state->payload.noncompleted.params.write.reqs);
+        break;
+      case _op_kind::barrier:
+      {
+        const auto kind = state->payload.noncompleted.params.barrier.kind;
+        const auto &reqs = state->payload.noncompleted.params.barrier.reqs;
+        if(kind <= barrier_kind::wait_data_only && !state->barrier_fallback)
+        {
+          // empty buffers means bytes = 0 which means sync entire file
+          uint64_t bytes = 0;
+          for(const auto &req : reqs.buffers)
+          {
+            bytes += req.size();
+          }
+          sqe->opcode = _IORING_OP_SYNC_FILE_RANGE;
+          sqe->off = reqs.offset;
+          sqe->len = (bytes > UINT32_MAX) ? 0 : (uint32_t) bytes;
+          sqe->sync_range_flags = SYNC_FILE_RANGE_WRITE;  // start writing all dirty pages in range now
+          if(kind == barrier_kind::wait_data_only)
+          {
+            sqe->sync_range_flags |= SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WAIT_AFTER;  // block until they're on storage
+          }
+        }
+        else
+        {
+          sqe->opcode = _IORING_OP_FSYNC;
+          if(kind <= barrier_kind::wait_data_only)
+          {
+            sqe->fsync_flags = _IORING_FSYNC_DATASYNC;
+          }
+        }
+        break;
+      }
+      }
+    }
+    sqe->user_data = state->user_data();
+    if(state->has_deadline)
+    {
+      sqe->flags |= _IOSQE_IO_LINK;
+      auto *tsqe = _get_sqe(ring);
+      assert(tsqe != nullptr);
+      tsqe->opcode = _IORING_OP_LINK_TIMEOUT;
+      tsqe->fd = -1;
+      tsqe->addr = (uint64_t)(uintptr_t) &state->deadline_abs;
+      tsqe->len = 1;
+      tsqe->timeout_flags = _IORING_TIMEOUT_ABS;
+      tsqe->user_data = _link_timeout_user_data;
+    }
+    else if(is_linked)
+    {
+      sqe->flags |= _IOSQE_IO_LINK;
+    }
+    state->where = _op_where::inflight;
+  }
+  // Reads and writes resume from however many bytes have been transferred so far
+  template <class BuffersType>
+  void _prepare_io(const _ring_t &ring, _io_uring_sqe *sqe, uint8_t opcode, uint8_t fixed_opcode, _io_uring_operation_state *state,
+                   io_request<BuffersType> &reqs) noexcept
+  {
+    size_t idx = 0, skip = state->transferred;
+    while(idx < reqs.buffers.size() && skip >= reqs.buffers[idx].size())
+    {
+      skip -= reqs.buffers[idx].size();
+      ++idx;
+    }
+    sqe->off = state->is_seekable ? (reqs.offset + state->transferred) : 0;
+    if(idx + 1 == reqs.buffers.size() && ring.has_buffer_pool)
+    {
+      // If the remainder is a single buffer within the registered pool, we can use the fixed buffer op
+      const byte *p = reqs.buffers[idx].data() + skip;
+      const size_t len = reqs.buffers[idx].size() - skip;
+      if(p >= _buffer_pool_region.data() && p + len <= _buffer_pool_region.data() + _buffer_pool_region.size())
+      {
+        sqe->opcode = fixed_opcode;
+        sqe->addr = (uint64_t)(uintptr_t) p;
+        sqe->len = (uint32_t) len;
+        sqe->buf_index = 0;
+        return;
+      }
+    }
+    sqe->opcode = opcode;
+    if(skip == 0)
+    {
+      sqe->addr = (uint64_t)(uintptr_t)(reqs.buffers.data() + idx);
+      sqe->len = (uint32_t)(reqs.buffers.size() - idx);
+    }
+    else
+    {
+      state->partial_iov.iov_base = (void *) (reqs.buffers[idx].data() + skip);
+      state->partial_iov.iov_len = reqs.buffers[idx].size() - skip;
+      sqe->addr = (uint64_t)(uintptr_t) &state->partial_iov;
+      sqe->len = 1;
+    }
+  }
+  template <class BuffersType> static size_t _total_bytes(const io_request<BuffersType> &reqs) noexcept
+  {
+    size_t ret = 0;
+    for(const auto &b : reqs.buffers)
+    {
+      ret += b.size();
+    }
+    return ret;
+  }
+  static bool _transferred_all(const _io_uring_operation_state *state) noexcept
+  {
+    switch(state->kind)
+    {
+    case _op_kind::read:
+      return state->transferred == _total_bytes(state->payload.noncompleted.params.read.reqs);
+    case _op_kind::write:
+      return state->transferred == _total_bytes(state->payload.noncompleted.params.write.reqs);
+    case _op_kind::barrier:
+      break;
+    }
+    return true;
+  }
+
+  // Must be called with the multiplexer lock held. Moves pending i/o into the submission queue.
+  void _fill_submission_queue(_queue_t &done) noexcept
+  {
+    while(!_pending.empty())
+    {
+      auto *state = _pending.first;
+      uint32_t count = 1;
+      for(auto *i = state; i->chain_linked; i = i->chain_next)
+      {
+        ++count;
+      }
+      if(!_can_submit(_ring_for(state), count))
+      {
+        return;
+      }
+      _dequeue_from(_pending, state);
+      if(state->has_deadline && _has_expired(state->deadline_abs))
+      {
+        state->error = ETIMEDOUT;
+        _retire(state, done);
+        continue;
+      }
+      // Submit any admitted rest of its chain linked to it, after which the kernel
+      // orders them and each i/o is otherwise independent
+      while(state->chain_linked)
+      {
+        auto *next = state->chain_next;
+        state->chain_next = nullptr;
+        state->chain_linked = false;
+        state->linked_next = next;
+        next->linked_prev = state;
+        _prepare_sqes(state, true);
+        state = next;
+      }
+      _prepare_sqes(state);
+    }
+  }
+
+  // Must be called with the multiplexer lock held. Processes the result of an i/o
+  // submission, either retiring the i/o or making it pending for resubmission.
+  void _process_completion(_io_uring_operation_state *state, bool was_poll, int res, _queue_t &done) noexcept
+  {
+    assert(state->where == _op_where::inflight);
+    state->in_poll = false;
+    auto resubmit = [&] {
+      state->where = _op_where::pending;
+      // To the front, as the i/o retains its place in the per-fd ordering
+      _enqueue_front_to(_pending, state);
+    };
+    auto fail = [&](int errcode) {
+      // An error after some bytes have been transferred returns the bytes transferred
+      if(state->transferred == 0 || state->kind == _op_kind::barrier)
+      {
+        state->error = errcode;
+      }
+      _retire(state, done);
+    };
+    if(res == -ECANCELED && !state->cancel_requested && !state->has_deadline && state->linked_prev != nullptr)
+    {
+      /* The kernel cancelled this i/o because the i/o it was linked to did not fully
+      succeed. That i/o is not yet retired, so it has either not had its completion
+      processed yet, or had its remainder resubmitted after a short transfer. Chain this
+      i/o after it once again, so it is initiated only if that i/o eventually fully
+      succeeds, the same as for an emulated chain.
+      */
+      auto *prev = state->linked_prev;
+      prev->linked_next = nullptr;
+      state->linked_prev = nullptr;
+      _unadmit(state);
+      assert(prev->chain_next == nullptr);
+      prev->chain_next = state;
+      state->where = _op_where::chained;
+      return;
+    }
+    if(res == -ECANCELED)
+    {
+      fail(state->cancel_requested ? ECANCELED : (state->has_deadline ? ETIMEDOUT : ECANCELED));
+      return;
+    }
+    if(state->cancel_requested)
+    {
+      // Cancellation raced completion of the submission, so don't resubmit
+      if(res < 0)
+      {
+        fail(-res);
+      }
+      else if(!was_poll && state->kind != _op_kind::barrier)
+      {
+        state->transferred += (size_t) res;
+        fail(ECANCELED);
+      }
+      else
+      {
+        fail(ECANCELED);
+      }
+      return;
+    }
+    if(res == -EINTR)
+    {
+      resubmit();
+      return;
+    }
+    if(state->in_iopoll && (res == -EOPNOTSUPP || res == -EINVAL))
+    {
+      // The device cannot be polled for completion after all, so use interrupts for this handle
+      state->rfd->is_iopoll = false;
+      resubmit();
+      return;
+    }
+    if(was_poll)
+    {
+      if(res < 0)
+      {
+        fail(-res);
+        return;
+      }
+      // The file descriptor is ready, so retry the i/o
+      state->poll_first = false;
+      resubmit();
+      return;
+    }
+    if(res == -EAGAIN)
+    {
+      if(!state->is_seekable)
+      {
+        // Non-blocking socket or pipe, so wait for readiness
+        state->poll_first = true;
+      }
+      resubmit();
+      return;
+    }
+    if(state->kind == _op_kind::barrier)
+    {
+      if(res == -EINVAL && !state->barrier_fallback && state->payload.noncompleted.params.barrier.kind <= barrier_kind::wait_data_only)
+      {
+        // Some filing systems don't implement sync_file_range(), so fall back to fdatasync()
+        state->barrier_fallback = true;
+        resubmit();
+        return;
+      }
+      if(res < 0)
+      {
+        fail(-res);
+        return;
+      }
+      _retire(state, done);
+      return;
+    }
+    if(res < 0)
+    {
+      fail(-res);
+      return;
+    }
+    state->transferred += (size_t) res;
+    const size_t total = (state->kind == _op_kind::read) ? _total_bytes(state->payload.noncompleted.params.read.reqs) :
+                                                           _total_bytes(state->payload.noncompleted.params.write.reqs);
+    if(res > 0 && state->transferred < total && (state->is_seekable || state->kind == _op_kind::write))
+    {
+      // Short read or write
+      resubmit();
+      return;
+    }
+    _retire(state, done);
+  }
+
+  // Must be called with the multiplexer lock held. Returns the number of i/o retired.
+  size_t _reap_completions(_ring_t &ring, _queue_t &done, size_t max_completions) noexcept
+  {
+    size_t ret = 0;
+    uint32_t head = ring.completion.head->load(std::memory_order_relaxed);
+    const uint32_t tail = ring.completion.tail->load(std::memory_order_acquire);
+    while(head != tail && ret < max_completions)
+    {
+      const _io_uring_cqe &cqe = ring.completion.entries[head & ring.completion.ring_mask];
+      const uint64_t user_data = cqe.user_data;
+      const int res = cqe.res;
+      ++head;
+      --ring.inflight;
+      switch(user_data)
+      {
+      case _wake_user_data:
+        ++_wakecount;
+        break;
+      case _timeout_user_data:
+      case _link_timeout_user_data:
+      case _cancel_user_data:
+        break;
+      default:
+      {
+        auto *state = (_io_uring_operation_state *) (uintptr_t)(user_data & ~_poll_user_data_bit);
+        const auto where = state->where;
+        _process_completion(state, (user_data & _poll_user_data_bit) != 0, res, done);
+        if(state->where == _op_where::completing && where != _op_where::completing)
+        {
+          ++ret;
+        }
+        break;
+      }
+      }
+    }
+    ring.completion.head->store(head, std::memory_order_release);
+    return ret;
+  }
+
+  // Must be called WITHOUT the multiplexer lock held. Dispatches the completion of retired i/o.
+  static void _dispatch(_queue_t &done, check_for_any_completed_io_statistics &stats) noexcept
+  {
+    while(!done.empty())
+    {
+      auto *state = done.first;
+      _dequeue_from(done, state);
+      // The kernel no longer refers to the state, so from here on the state belongs to its owner
+      state->where = _op_where::none;
+      auto fill = [&](auto &reqs) {
+        size_t bytes = state->transferred;
+        for(size_t i = 0; i < reqs.buffers.size(); i++)
+        {
+          auto &buffer = reqs.buffers[i];
+          if(buffer.size() <= bytes)
+          {
+            bytes -= buffer.size();
+          }
+          else
+          {
+            buffer = {buffer.data(), (size_type) bytes};
+            reqs.buffers = {reqs.buffers.data(), i + 1};
+            break;
+          }
+        }
+      };
+      switch(state->kind)
+      {
+      case _op_kind::read:
+      {
+        auto &reqs = state->payload.noncompleted.params.read.reqs;
+        io_result<buffers_type> ret(reqs.buffers);
+        if(state->error != 0)
+        {
+          ret = posix_error(state->error);
+        }
+        else
+        {
+          fill(reqs);
+          ret = reqs.buffers;
+        }
+        state->read_completed(std::move(ret));
+        state->read_finished();
+        break;
+      }
+      case _op_kind::write:
+      {
+        auto &reqs = state->payload.noncompleted.params.write.reqs;
+        io_result<const_buffers_type> ret(reqs.buffers);
+        if(state->error != 0)
+        {
+          ret = posix_error(state->error);
+        }
+        else
+        {
+          fill(reqs);
+          ret = reqs.buffers;
+        }
+        state->write_completed(std::move(ret));
+        state->write_or_barrier_finished();
+        break;
+      }
+      case _op_kind::barrier:
+      {
+        auto &reqs = state->payload.noncompleted.params.barrier.reqs;
+        io_result<const_buffers_type> ret(reqs.buffers);
+        if(state->error != 0)
+        {
+          ret = posix_error(state->error);
+        }
+        state->barrier_completed(std::move(ret));
+        state->write_or_barrier_finished();
+        break;
+      }
+      }
+      ++stats.initiated_ios_completed;
+      ++stats.initiated_ios_finished;
+    }
+  }
+
+  // Submits pending i/o, reaps completions and dispatches them, waiting up
+  // to the deadline for at least one completion if consume_wakes is true.
+  result<check_for_any_completed_io_statistics> _pump(deadline d, size_t max_completions, bool consume_wakes) noexcept
+  {
+    LLFIO_DEADLINE_TO_SLEEP_INIT(d);
+    check_for_any_completed_io_statistics ret;
+    _queue_t done;
+    _multiplexer_lock_guard g(this->_lock);
+    bool waited = false;
+    result<void> r = success();
+    for(;;)
+    {
+      _fill_submission_queue(done);
+      max_completions -= _reap_completions(_ring, done, max_completions);
+      if(_iopoll.fd != -1 && max_completions > 0)
+      {
+        max_completions -= _reap_completions(_iopoll, done, max_completions);
+      }
+      if(consume_wakes && _wakecount > 0)
+      {
+        --_wakecount;
+        break;
+      }
+      if(!done.empty() || waited || max_completions == 0)
+      {
+        break;
+      }
+      if(!_pending.empty() && _can_submit(_ring_for(_pending.first)))
+      {
+        // Completions were reaped which need resubmission
+        continue;
+      }
+      if(d && d.steady && d.nsecs == 0)
+      {
+        break;
+      }
+      if(_iopoll.inflight > 0)
+      {
+        // Completions upon the IOPOLL ring raise no interrupt, so they must be busy
+        // polled for. If the kernel thread polls the ring, this costs no syscalls.
+        if(d)
+        {
+          std::chrono::nanoseconds timeout;
+          LLFIO_DEADLINE_TO_PARTIAL_TIMEOUT(timeout, d);
+          if(timeout.count() == 0)
+          {
+            break;
+          }
+        }
+        const uint32_t to_submit = _publish_sqes(_ring);
+        const uint32_t to_submit_iopoll = _publish_sqes(_iopoll);
+        g.unlock();
+        r = _enter(_ring, to_submit, 0);
+        if(r)
+        {
+          r = _enter(_iopoll, to_submit_iopoll, 0, !_iopoll.is_sqpoll);
+        }
+        g.lock();
+        if(!r)
+        {
+          break;
+        }
+        continue;
+      }
+      if(d)
+      {
+        std::chrono::nanoseconds timeout;
+        LLFIO_DEADLINE_TO_PARTIAL_TIMEOUT(timeout, d);
+        if(timeout.count() == 0)
+        {
+          break;
+        }
+        // Bound the wait with an IORING_OP_TIMEOUT which completes after any other completion, or the timeout
+        if(_sq_space(_ring) == 0)
+        {
+          break;
+        }
+        const uint32_t idx = _ring.submission.local_tail & _ring.submission.ring_mask;
+        auto *sqe = _get_sqe(_ring);
+        _timeouts[idx] = _monotonic_add(_monotonic_now(), timeout);
+        sqe->opcode = _IORING_OP_TIMEOUT;
+        sqe->fd = -1;
+        sqe->addr = (uint64_t)(uintptr_t) &_timeouts[idx];
+        sqe->len = 1;
+        sqe->off = 1;  // complete after one other completion
+        sqe->timeout_flags = _IORING_TIMEOUT_ABS;
+        sqe->user_data = _timeout_user_data;
+      }
+      const uint32_t to_submit = _publish_sqes(_ring);
+      g.unlock();
+      // All threads waiting within io_uring_enter() are woken when a completion
+      // arrives, so it is always safe to return after a single wait
+      r = _enter(_ring, to_submit, 1);
+      g.lock();
+      waited = true;
+      if(!r)
+      {
+        break;
+      }
+    }
+    // Submit whatever is pending without waiting
+    _fill_submission_queue(done);
+    const uint32_t to_submit = _publish_sqes(_ring);
+    uint32_t to_submit_iopoll = 0;
+    bool iopoll_getevents = false;
+    if(_iopoll.fd != -1)
+    {
+      to_submit_iopoll = _publish_sqes(_iopoll);
+      iopoll_getevents = _iopoll.inflight > 0 && !_iopoll.is_sqpoll;
+    }
+    g.unlock();
+    auto r2 = _enter(_ring, to_submit, 0);
+    if(r2 && _iopoll.fd != -1)
+    {
+      r2 = _enter(_iopoll, to_submit_iopoll, 0, iopoll_getevents);
+    }
+    _dispatch(done, ret);
+    OUTCOME_TRY(std::move(r));
+    OUTCOME_TRY(std::move(r2));
+    return ret;
+  }
+
+  // Sets up and maps an io_uring instance into the ring, which is left untouched on failure
+  static result<void> _setup_ring(_ring_t &ring, uint32_t entries, _io_uring_params &params) noexcept
+  {
+    const int fd = _io_uring_setup(entries, &params);
+    if(fd < 0)
+    {
+      return posix_error();
+    }
+    _ring_t newring;
+    newring.fd = fd;
+    auto unmap = make_scope_exit([&]() noexcept {
+      _unmap_ring(newring);
+      ::close(fd);
+    });
+    // We rely on the kernel buffering completions rather than dropping them, and
+    // copying submission state at submission time. Both arrived in Linux 5.5.
+    if((params.features & _IORING_FEAT_NODROP) == 0 || (params.features & _IORING_FEAT_SUBMIT_STABLE) == 0)
+    {
+      return errc::not_supported;
+    }
+    size_t sqring_bytes = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    const size_t cqring_bytes = params.cq_off.cqes + params.cq_entries * sizeof(_io_uring_cqe);
+    const bool single_mmap = (params.features & _IORING_FEAT_SINGLE_MMAP) != 0;
+    if(single_mmap && cqring_bytes > sqring_bytes)
+    {
+      sqring_bytes = cqring_bytes;
+    }
+    {
+      auto *p = ::mmap(nullptr, sqring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, _IORING_OFF_SQ_RING);
+      if(p == MAP_FAILED)
+      {
+        return posix_error();
+      }
+      auto *base = (byte *) p;
+      newring.submission.region = {base, sqring_bytes};
+      newring.submission.head = (const std::atomic<uint32_t> *) (base + params.sq_off.head);
+      newring.submission.tail = (std::atomic<uint32_t> *) (base + params.sq_off.tail);
+      newring.submission.ring_mask = *(const uint32_t *) (base + params.sq_off.ring_mask);
+      newring.submission.ring_entries = *(const uint32_t *) (base + params.sq_off.ring_entries);
+      newring.submission.flags = (const std::atomic<uint32_t> *) (base + params.sq_off.flags);
+      newring.submission.array = (uint32_t *) (base + params.sq_off.array);
+      newring.submission.local_tail = newring.submission.tail->load(std::memory_order_relaxed);
+    }
+    {
+      auto *p = ::mmap(nullptr, params.sq_entries * sizeof(_io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, _IORING_OFF_SQES);
+      if(p == MAP_FAILED)
+      {
+        return posix_error();
+      }
+      newring.submission.entries = {(_io_uring_sqe *) p, params.sq_entries};
+    }
+    {
+      byte *base = newring.submission.region.data();
+      if(!single_mmap)
+      {
+        auto *p = ::mmap(nullptr, cqring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, _IORING_OFF_CQ_RING);
+        if(p == MAP_FAILED)
+        {
+          return posix_error();
+        }
+        base = (byte *) p;
+        newring.completion.region = {base, cqring_bytes};
+      }
+      else
+      {
+        newring.completion.region = newring.submission.region;
+      }
+      newring.completion.head = (std::atomic<uint32_t> *) (base + params.cq_off.head);
+      newring.completion.tail = (const std::atomic<uint32_t> *) (base + params.cq_off.tail);
+      newring.completion.ring_mask = *(const uint32_t *) (base + params.cq_off.ring_mask);
+      newring.completion.ring_entries = *(const uint32_t *) (base + params.cq_off.ring_entries);
+      newring.completion.entries = {(_io_uring_cqe *) (base + params.cq_off.cqes), params.cq_entries};
+    }
+    newring.is_sqpoll = (params.flags & _IORING_SETUP_SQPOLL) != 0;
+    unmap.release();
+    ring = newring;
+    return success();
+  }
+  static void _unmap_ring(_ring_t &ring) noexcept
+  {
+    if(!ring.submission.entries.empty())
+    {
+      (void) ::munmap(ring.submission.entries.data(), ring.submission.entries.size() * sizeof(_io_uring_sqe));
+      ring.submission.entries = {};
+    }
+    if(!ring.completion.region.empty() && ring.completion.region.data() != ring.submission.region.data())
+    {
+      (void) ::munmap(ring.completion.region.data(), ring.completion.region.size());
+    }
+    ring.completion.region = {};
+    if(!ring.submission.region.empty())
+    {
+      (void) ::munmap(ring.submission.region.data(), ring.submission.region.size());
+      ring.submission.region = {};
+    }
+  }
+  void _unmap_rings() noexcept
+  {
+    _unmap_ring(_ring);
+    _unmap_ring(_iopoll);
+    if(_iopoll.fd != -1)
+    {
+      (void) ::close(_iopoll.fd);
+    }
+    // The main ring's fd is closed by handle
+    _ring = {};
+    _iopoll = {};
+  }
+
+public:
+  explicit linux_io_uring_multiplexer(bool is_polling)
+      : _is_polling(is_polling)
+  {
+  }
+  linux_io_uring_multiplexer(const linux_io_uring_multiplexer &) = delete;
+  linux_io_uring_multiplexer(linux_io_uring_multiplexer &&) = delete;
+  linux_io_uring_multiplexer &operator=(const linux_io_uring_multiplexer &) = delete;
+  linux_io_uring_multiplexer &operator=(linux_io_uring_multiplexer &&) = delete;
+  virtual ~linux_io_uring_multiplexer()
+  {
+    if(this->_v)
+    {
+      (void) _close();
+    }
+  }
+  result<void> init(size_t threads)
+  {
+    _io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    if(_is_polling)
+    {
+      params.flags |= _IORING_SETUP_SQPOLL;
+      params.sq_thread_idle = 100;  // 100 milliseconds
+      if(threads == 1)
+      {
+        // Pin kernel submission polling thread to same CPU as I am pinned to, if I am pinned
+        cpu_set_t affinity;
+        CPU_ZERO(&affinity);
+        if(-1 != ::sched_getaffinity(0, sizeof(affinity), &affinity) && CPU_COUNT(&affinity) == 1)
+        {
+          for(size_t n = 0; n < CPU_SETSIZE; n++)
+          {
+            if(CPU_ISSET(n, &affinity))
+            {
+              params.flags |= _IORING_SETUP_SQ_AFF;
+              params.sq_thread_cpu = (uint32_t) n;
+              break;
+            }
+          }
+        }
+      }
+    }
+    // 256 entries is 16Kb of sqe entries, and the completion queue is twice that
+    const uint32_t entries = 256;
+    _io_uring_params iopoll_params = params;
+    OUTCOME_TRY(_setup_ring(_ring, entries, params));
+    const int fd = _ring.fd;
+    this->_v.fd = fd;
+    this->_v.behaviour |= native_handle_type::disposition::multiplexer | native_handle_type::disposition::kernel_handle;
+    _timeouts.resize(params.sq_entries);
+    {
+      // Register a sparse fixed file table, into which handles are registered as they
+      // are registered with us. If this fails, we simply don't use fixed files.
+      std::vector<int> fds(_fixed_files_max, -1);
+      if(_io_uring_register(fd, _IORING_REGISTER_FILES, fds.data(), _fixed_files_max) >= 0)
+      {
+        _fixed_files_free.reserve(_fixed_files_max);
+        for(uint32_t n = _fixed_files_max; n > 0; n--)
+        {
+          _fixed_files_free.push_back(n - 1);
+        }
+      }
+    }
+    if(_is_polling)
+    {
+      // Reads and writes upon handles opened with O_DIRECT go to a second ring whose
+      // completions are found by polling the device. If a kernel thread cannot poll
+      // that ring for us, we poll it ourselves. If neither works, we don't use it.
+      iopoll_params.flags |= _IORING_SETUP_IOPOLL;
+      if(!_setup_ring(_iopoll, entries, iopoll_params))
+      {
+        iopoll_params.flags &= ~(_IORING_SETUP_SQPOLL | _IORING_SETUP_SQ_AFF);
+        (void) _setup_ring(_iopoll, entries, iopoll_params);
+      }
+      if(_iopoll.fd != -1 && !_fixed_files_free.empty())
+      {
+        // Both rings must share the same fixed file indices
+        std::vector<int> fds(_fixed_files_max, -1);
+        if(_io_uring_register(_iopoll.fd, _IORING_REGISTER_FILES, fds.data(), _fixed_files_max) < 0)
+        {
+          _unmap_ring(_iopoll);
+          (void) ::close(_iopoll.fd);
+          _iopoll = {};
+        }
+      }
+    }
+    return success();
+  }
+
+  virtual implementation_information_t implementation_information() const noexcept override
+  {
+    static auto v = []() -> implementation_information_t {
+      implementation_information_t ret;
+      ret.name = "io_uring";
+      struct utsname name;
+      if(-1 != ::uname(&name))
+      {
+        unsigned major = 0, minor = 0, patch = 0;
+        if(sscanf(name.release, "%u.%u.%u", &major, &minor, &patch) >= 2)
+        {
+          ret.version.major = (uint16_t) major;
+          ret.version.minor = (uint16_t) minor;
+          ret.version.patch = (uint16_t) patch;
+        }
+      }
+      ret.multiplexes.kernel.file_handle = true;
+      ret.multiplexes.kernel.pipe_handle = true;
+      ret.multiplexes.kernel.byte_socket_handle = true;
+      ret.multiplexes.kernel.listening_byte_socket_handle = false;
+      return ret;
+    }();
+    return v;
+  }
+
+  // These functions are inherited from handle
+  virtual result<path_type> current_path() const noexcept override
+  {
+    // An io_uring has no path
+    return success();
+  }
+  virtual result<void> close() noexcept override
+  {
+    // The kernel may still be using the buffers of i/o in flight, and their states would never finish
+    if(_ring.inflight > 0 || _iopoll.inflight > 0 || !_pending.empty())
+    {
+      return errc::device_or_resource_busy;
+    }
+    for(auto &i : _registered_fds)
+    {
+      if(!i.second.is_idle())
+      {
+        return errc::device_or_resource_busy;
+      }
+    }
+    return _close();
+  }
+  result<void> _close() noexcept
+  {
+    _unmap_rings();
+    _registered_fds.clear();
+    _fixed_files_free.clear();
+    _pending = {};
+    // Closing the io_uring unregisters the pool, but registered buffers may still be using it
+    _buffer_pool.reset();
+    _buffer_pool_region = {};
+#ifndef NDEBUG
+    if(this->_v)
+    {
+      // Tell handle::close() that we have correctly executed
+      this->_v.behaviour |= native_handle_type::disposition::_child_close_executed;
+    }
+#endif
+    return _base::close();
+  }
+  virtual native_handle_type release() noexcept override
+  {
+    _unmap_rings();
+    _registered_fds.clear();
+    _fixed_files_free.clear();
+    _pending = {};
+    _buffer_pool.reset();
+    _buffer_pool_region = {};
+    return _base::release();
+  }
+
+  virtual result<uint8_t> do_byte_io_handle_register(byte_io_handle *h) noexcept override
+  {
+    LLFIO_EXCEPTION_TRY
+    {
+      _multiplexer_lock_guard g(this->_lock);
+      const auto &nh = h->native_handle();
+      _registered_fd rfd;
+      rfd.fd = nh.fd;
+      rfd.is_seekable = nh.is_seekable();
+      auto it = _registered_fds.emplace(rfd.fd, rfd);
+      if(!it.second)
+      {
+        return errc::invalid_argument;
+      }
+      if(!_fixed_files_free.empty())
+      {
+        const uint32_t idx = _fixed_files_free.back();
+        _io_uring_files_update upd{idx, 0, (uint64_t)(uintptr_t) &rfd.fd};
+        if(_io_uring_register(_ring.fd, _IORING_REGISTER_FILES_UPDATE, &upd, 1) >= 0)
+        {
+          _fixed_files_free.pop_back();
+          it.first->second.fixed_index = (int) idx;
+        }
+      }
+      if(_iopoll.fd != -1 && rfd.is_seekable && h->requires_aligned_io())
+      {
+        // Handles opened with O_DIRECT can have their completions polled for
+        const auto fixed_index = it.first->second.fixed_index;
+        if(fixed_index < 0)
+        {
+          it.first->second.is_iopoll = true;
+        }
+        else
+        {
+          _io_uring_files_update upd{(uint32_t) fixed_index, 0, (uint64_t)(uintptr_t) &rfd.fd};
+          it.first->second.is_iopoll = (_io_uring_register(_iopoll.fd, _IORING_REGISTER_FILES_UPDATE, &upd, 1) >= 0);
+        }
+      }
+      return (uint8_t) 0;
+    }
+    LLFIO_EXCEPTION_CATCH_ALL
+    {
+      return error_from_exception();
+    }
+  }
+  virtual result<void> do_byte_io_handle_deregister(byte_io_handle *h) noexcept override
+  {
+    _multiplexer_lock_guard g(this->_lock);
+    auto it = _registered_fds.find(h->native_handle().fd);
+    if(it == _registered_fds.end())
+    {
+      return errc::invalid_argument;
+    }
+    if(!it->second.is_idle())
+    {
+      // Can't deregister a handle with i/o in progress
+      return errc::operation_in_progress;
+    }
+    if(it->second.fixed_index >= 0)
+    {
+      const int fd = -1;
+      _io_uring_files_update upd{(uint32_t) it->second.fixed_index, 0, (uint64_t)(uintptr_t) &fd};
+      if(_io_uring_register(_ring.fd, _IORING_REGISTER_FILES_UPDATE, &upd, 1) < 0)
+      {
+        return posix_error();
+      }
+      if(_iopoll.fd != -1)
+      {
+        // The slot may not have been used on the IOPOLL ring, which is harmless
+        (void) _io_uring_register(_iopoll.fd, _IORING_REGISTER_FILES_UPDATE, &upd, 1);
+      }
+      // Cannot throw, as capacity for every slot was reserved
+      _fixed_files_free.push_back((uint32_t) it->second.fixed_index);
+    }
+    _registered_fds.erase(it);
+    return success();
+  }
+
+  virtual size_t do_byte_io_handle_max_buffers(const byte_io_handle * /*unused*/) const noexcept override { return IOV_MAX; }
+
+  virtual result<registered_buffer_type> do_byte_io_handle_allocate_registered_buffer(byte_io_handle *h, size_t &bytes) noexcept override
+  {
+    LLFIO_EXCEPTION_TRY
+    {
+      struct registered_buffer_type_indirect : byte_io_multiplexer::_registered_buffer_type
+      {
+        std::shared_ptr<_buffer_pool_t> pool;
+        registered_buffer_type_indirect(span<byte> s, std::shared_ptr<_buffer_pool_t> _pool)
+            : byte_io_multiplexer::_registered_buffer_type(s)
+            , pool(std::move(_pool))
+        {
+        }
+        registered_buffer_type_indirect(const registered_buffer_type_indirect &) = delete;
+        registered_buffer_type_indirect(registered_buffer_type_indirect &&) = delete;
+        registered_buffer_type_indirect &operator=(const registered_buffer_type_indirect &) = delete;
+        registered_buffer_type_indirect &operator=(registered_buffer_type_indirect &&) = delete;
+        ~registered_buffer_type_indirect() { pool->deallocate(this->data(), this->size()); }
+      };
+      const size_t page_size = (size_t) ::sysconf(_SC_PAGESIZE);
+      const size_t rounded = (bytes + page_size - 1) & ~(page_size - 1);
+      std::shared_ptr<_buffer_pool_t> pool;
+      {
+        _multiplexer_lock_guard g(this->_lock);
+        if(!_buffer_pool_attempted)
+        {
+          _buffer_pool_attempted = true;
+          // Registered memory is accounted against RLIMIT_MEMLOCK, so if the kernel
+          // refuses we retry with progressively smaller pools
+          for(size_t pool_bytes = std::max(_buffer_pool_default_bytes, rounded); pool_bytes >= rounded && pool_bytes >= page_size; pool_bytes /= 2)
+          {
+            auto newpool = std::make_shared<_buffer_pool_t>();
+            if(!newpool->map(pool_bytes, page_size))
+            {
+              continue;
+            }
+            struct iovec iov
+            {
+              newpool->region.data(), pool_bytes
+            };
+            if(_io_uring_register(_ring.fd, _IORING_REGISTER_BUFFERS, &iov, 1) >= 0)
+            {
+              _buffer_pool = std::move(newpool);
+              _buffer_pool_region = _buffer_pool->region;
+              _ring.has_buffer_pool = true;
+              if(_iopoll.fd != -1)
+              {
+                _iopoll.has_buffer_pool = (_io_uring_register(_iopoll.fd, _IORING_REGISTER_BUFFERS, &iov, 1) >= 0);
+              }
+              break;
+            }
+          }
+        }
+        pool = _buffer_pool;
+      }
+      if(pool)
+      {
+        byte *p = pool->allocate(rounded);
+        if(p != nullptr)
+        {
+          bytes = rounded;
+          return registered_buffer_type(std::make_shared<registered_buffer_type_indirect>(span<byte>{p, rounded}, std::move(pool)));
+        }
+      }
+      // No pool or the pool is exhausted, so fall back to unregistered memory
+      return _base::do_byte_io_handle_allocate_registered_buffer(h, bytes);
+    }
+    LLFIO_EXCEPTION_CATCH_ALL
+    {
+      return error_from_exception();
+    }
+  }
+
+  virtual std::pair<size_t, size_t> io_state_requirements() noexcept override
+  {
+    return {sizeof(_io_uring_operation_state), alignof(_io_uring_operation_state)};
+  }
+
+  virtual io_operation_state *construct(span<byte> storage, byte_io_handle *_h, io_operation_state_visitor *_visitor, registered_buffer_type &&b, deadline d,
+                                        io_request<buffers_type> reqs) noexcept override
+  {
+    assert(storage.size() >= sizeof(_io_uring_operation_state));
+    assert(((uintptr_t) storage.data() % alignof(_io_uring_operation_state)) == 0);
+    if(storage.size() < sizeof(_io_uring_operation_state) || ((uintptr_t) storage.data() % alignof(_io_uring_operation_state)) != 0)
+    {
+      return nullptr;
+    }
+    return new(storage.data()) _io_uring_operation_state(_h, _visitor, std::move(b), d, std::move(reqs));
+  }
+  virtual io_operation_state *construct(span<byte> storage, byte_io_handle *_h, io_operation_state_visitor *_visitor, registered_buffer_type &&b, deadline d,
+                                        io_request<const_buffers_type> reqs) noexcept override
+  {
+    assert(storage.size() >= sizeof(_io_uring_operation_state));
+    assert(((uintptr_t) storage.data() % alignof(_io_uring_operation_state)) == 0);
+    if(storage.size() < sizeof(_io_uring_operation_state) || ((uintptr_t) storage.data() % alignof(_io_uring_operation_state)) != 0)
+    {
+      return nullptr;
+    }
+    return new(storage.data()) _io_uring_operation_state(_h, _visitor, std::move(b), d, std::move(reqs));
+  }
+  virtual io_operation_state *construct(span<byte> storage, byte_io_handle *_h, io_operation_state_visitor *_visitor, registered_buffer_type &&b, deadline d,
+                                        io_request<const_buffers_type> reqs, barrier_kind kind) noexcept override
+  {
+    assert(storage.size() >= sizeof(_io_uring_operation_state));
+    assert(((uintptr_t) storage.data() % alignof(_io_uring_operation_state)) == 0);
+    if(storage.size() < sizeof(_io_uring_operation_state) || ((uintptr_t) storage.data() % alignof(_io_uring_operation_state)) != 0)
+    {
+      return nullptr;
+    }
+    return new(storage.data()) _io_uring_operation_state(_h, _visitor, std::move(b), d, std::move(reqs), kind);
+  }
+
+  // Moves an initialised i/o to initiated, returning its new state. Must be called WITHOUT the multiplexer lock held.
+  io_operation_state_type _begin_init(_io_uring_operation_state *state) noexcept
+  {
+    auto s = state->current_state();
+    switch(s)
+    {
+    case io_operation_state_type::unknown:
+      abort();
+    case io_operation_state_type::read_initialised:
+      state->kind = _op_kind::read;
+      break;
+    case io_operation_state_type::write_initialised:
+      state->kind = _op_kind::write;
+      break;
+    case io_operation_state_type::barrier_initialised:
+      state->kind = _op_kind::barrier;
+      break;
+    case io_operation_state_type::read_initiated:
+    case io_operation_state_type::read_completed:
+    case io_operation_state_type::read_finished:
+    case io_operation_state_type::write_initiated:
+    case io_operation_state_type::barrier_initiated:
+    case io_operation_state_type::write_or_barrier_completed:
+    case io_operation_state_type::write_or_barrier_finished:
+      assert(false);
+      return s;
+    }
+    if(state->kind == _op_kind::barrier && (state->h->is_pipe() || state->h->is_socket()))
+    {
+      // Barriers upon pipes and sockets are no-ops, as with blocking i/o
+      state->barrier_completed(io_result<const_buffers_type>(const_buffers_type()));
+      state->write_or_barrier_finished();
+      return io_operation_state_type::write_or_barrier_finished;
+    }
+    switch(state->kind)
+    {
+    case _op_kind::read:
+      state->read_initiated();
+      s = io_operation_state_type::read_initiated;
+      break;
+    case _op_kind::write:
+      state->write_initiated();
+      s = io_operation_state_type::write_initiated;
+      break;
+    case _op_kind::barrier:
+      state->barrier_initiated();
+      s = io_operation_state_type::barrier_initiated;
+      break;
+    }
+    _set_deadline(state);
+    return s;
+  }
+  // Must be called with the multiplexer lock held. Queues an initiated i/o for submission.
+  void _attach(_io_uring_operation_state *state, _queue_t &done) noexcept
+  {
+    auto it = _registered_fds.find(state->h->native_handle().fd);
+    if(it == _registered_fds.end())
+    {
+      // The handle was never registered with this multiplexer
+      state->error = EBADF;
+      state->where = _op_where::completing;
+      _enqueue_to(done, state);
+      return;
+    }
+    state->rfd = &it->second;
+    state->is_seekable = state->rfd->is_seekable;
+    _initiate(state);
+  }
+  static io_operation_state_type _finished_state(_io_uring_operation_state *state) noexcept
+  {
+    return (state->kind == _op_kind::read) ? io_operation_state_type::read_finished : io_operation_state_type::write_or_barrier_finished;
+  }
+
+  virtual io_operation_state_type init_io_operation(io_operation_state *_op) noexcept override
+  {
+    auto *state = static_cast<_io_uring_operation_state *>(_op);
+    auto s = _begin_init(state);
+    if(!is_initiated(s))
+    {
+      return s;
+    }
+    _queue_t done;
+    _multiplexer_lock_guard g(this->_lock);
+    _attach(state, done);
+    // Submission to the kernel happens upon flush_inited_io_operations() or the next check for completions
+    _fill_submission_queue(done);
+    if(state->where == _op_where::completing)
+    {
+      // Failed or timed out before it could be submitted
+      s = _finished_state(state);
+    }
+    g.unlock();
+    if(!done.empty())
+    {
+      check_for_any_completed_io_statistics stats;
+      _dispatch(done, stats);
+    }
+    return s;
+  }
+
+  virtual result<void> init_io_operations(span<io_operation_state *> states, span<io_operation_state_type> out) noexcept override
+  {
+    assert(out.size() == states.size());
+    if(out.size() != states.size())
+    {
+      return errc::invalid_argument;
+    }
+    for(size_t n = 0; n < states.size(); n++)
+    {
+      out[n] = _begin_init(static_cast<_io_uring_operation_state *>(states[n]));
+    }
+    // Queue the whole batch under a single lock, and submit it with a single io_uring_enter()
+    _queue_t done;
+    _multiplexer_lock_guard g(this->_lock);
+    for(size_t n = 0; n < states.size(); n++)
+    {
+      if(is_initiated(out[n]))
+      {
+        _attach(static_cast<_io_uring_operation_state *>(states[n]), done);
+      }
+    }
+    _fill_submission_queue(done);
+    for(size_t n = 0; n < states.size(); n++)
+    {
+      auto *state = static_cast<_io_uring_operation_state *>(states[n]);
+      if(is_initiated(out[n]) && state->where == _op_where::completing)
+      {
+        out[n] = _finished_state(state);
+      }
+    }
+    auto r = _submit(g);
+    if(!done.empty())
+    {
+      check_for_any_completed_io_statistics stats;
+      _dispatch(done, stats);
+    }
+    return r;
+  }
+
+  virtual result<void> init_io_operation_chain(span<io_operation_state *> states, span<io_operation_state_type> out) noexcept override
+  {
+    assert(out.size() == states.size());
+    if(out.size() != states.size())
+    {
+      return errc::invalid_argument;
+    }
+    // Barriers upon pipes and sockets complete immediately, and so drop out of the chain
+    for(size_t n = 0; n < states.size(); n++)
+    {
+      out[n] = _begin_init(static_cast<_io_uring_operation_state *>(states[n]));
+    }
+    _queue_t done;
+    _multiplexer_lock_guard g(this->_lock);
+    _io_uring_operation_state *head = nullptr, *last = nullptr;
+    size_t count = 0;
+    // The chain can be linked in the kernel if its i/o is all upon seekable handles, as i/o upon
+    // non-seekable handles may need polling for readiness, and none have deadlines
+    bool linkable = true;
+    for(size_t n = 0; n < states.size(); n++)
+    {
+      if(!is_initiated(out[n]))
+      {
+        continue;
+      }
+      auto *state = static_cast<_io_uring_operation_state *>(states[n]);
+      auto it = _registered_fds.find(state->h->native_handle().fd);
+      if(it != _registered_fds.end())
+      {
+        state->rfd = &it->second;
+        state->is_seekable = state->rfd->is_seekable;
+      }
+      linkable = linkable && state->rfd != nullptr && state->is_seekable && !state->rfd->is_iopoll && !state->has_deadline;
+      if(last == nullptr)
+      {
+        head = state;
+      }
+      else
+      {
+        last->chain_next = state;
+        state->where = _op_where::chained;
+      }
+      last = state;
+      ++count;
+    }
+    if(head != nullptr)
+    {
+      linkable = linkable && count <= _chain_linked_max;
+      for(auto *i = head; i != nullptr; i = i->chain_next)
+      {
+        i->chain_linkable = linkable;
+      }
+      _attach(head, done);
+      _fill_submission_queue(done);
+    }
+    for(size_t n = 0; n < states.size(); n++)
+    {
+      auto *state = static_cast<_io_uring_operation_state *>(states[n]);
+      if(is_initiated(out[n]) && state->where == _op_where::completing)
+      {
+        out[n] = _finished_state(state);
+      }
+    }
+    auto r = _submit(g);
+    if(!done.empty())
+    {
+      check_for_any_completed_io_statistics stats;
+      _dispatch(done, stats);
+    }
+    return r;
+  }
+
+  virtual result<void> flush_inited_io_operations() noexcept override
+  {
+    _multiplexer_lock_guard g(this->_lock);
+    return _submit(g);
+  }
+
+  virtual io_operation_state_type check_io_operation(io_operation_state *_op) noexcept override
+  {
+    auto *state = static_cast<_io_uring_operation_state *>(_op);
+    auto s = state->current_state();
+    if(is_initiated(s))
+    {
+      (void) _pump(std::chrono::seconds(0), (size_t) -1, false);
+      s = state->current_state();
+    }
+    return s;
+  }
+
+  virtual result<io_operation_state_type> cancel_io_operation(io_operation_state *_op, deadline d = {}) noexcept override
+  {
+    LLFIO_DEADLINE_TO_SLEEP_INIT(d);
+    auto *state = static_cast<_io_uring_operation_state *>(_op);
+    {
+      _multiplexer_lock_guard g(this->_lock);
+      switch(state->where)
+      {
+      case _op_where::none:
+      case _op_where::completing:
+        break;
+      case _op_where::chained:
+        // Completes with ECANCELED when the i/o before it in the chain completes
+        state->cancel_requested = true;
+        break;
+      case _op_where::waiting:
+      case _op_where::pending:
+      {
+        // Never submitted, so retire it immediately
+        const bool was_admitted = (state->where == _op_where::pending);
+        _dequeue_from(was_admitted ? _pending : _waiting_queue(*state->rfd, state->kind), state);
+        state->error = ECANCELED;
+        _queue_t done;
+        _retire(state, done, was_admitted);
+        _fill_submission_queue(done);
+        g.unlock();
+        check_for_any_completed_io_statistics stats;
+        _dispatch(done, stats);
+        return state->current_state();
+      }
+      case _op_where::inflight:
+      {
+        if(state->in_iopoll)
+        {
+          // Polled i/o cannot be cancelled, but it completes quickly, so wait for it
+          state->cancel_requested = true;
+        }
+        else if(!state->cancel_requested)
+        {
+          auto *sqe = _get_sqe(_ring);
+          if(sqe == nullptr)
+          {
+            return errc::resource_unavailable_try_again;
+          }
+          state->cancel_requested = true;
+          sqe->opcode = _IORING_OP_ASYNC_CANCEL;
+          sqe->fd = -1;
+          sqe->addr = state->user_data();
+          sqe->user_data = _cancel_user_data;
+          OUTCOME_TRY(_submit(g));
+        }
+        break;
+      }
+      }
+    }
+    for(;;)
+    {
+      auto s = state->current_state();
+      if(is_finished(s))
+      {
+        return s;
+      }
+      deadline nd;
+      LLFIO_DEADLINE_TO_PARTIAL_DEADLINE(nd, d);
+      OUTCOME_TRY(_pump(nd, (size_t) -1, false));
+      LLFIO_DEADLINE_TO_TIMEOUT_LOOP(d);
+    }
+  }
+
+  virtual result<check_for_any_completed_io_statistics> check_for_any_completed_io(deadline d = std::chrono::seconds(0),
+                                                                                   size_t max_completions = (size_t) -1) noexcept override
+  {
+    return _pump(d, max_completions, true);
+  }
+
+  virtual result<void> wake_check_for_any_completed_io() noexcept override
+  {
+    _multiplexer_lock_guard g(this->_lock);
+    auto *sqe = _get_sqe(_ring);
+    if(sqe == nullptr)
+    {
+      return errc::resource_unavailable_try_again;
+    }
+    sqe->opcode = _IORING_OP_NOP;
+    sqe->fd = -1;
+    sqe->user_data = _wake_user_data;
+    const uint32_t to_submit = _publish_sqes(_ring);
+    g.unlock();
+    return _enter(_ring, to_submit, 0);
+  }
+};
+
+LLFIO_HEADERS_ONLY_FUNC_SPEC result<byte_io_multiplexer_ptr> multiplexer_linux_io_uring(size_t threads, bool is_polling) noexcept
+{
+  LLFIO_EXCEPTION_TRY
+  {
+    if(1 == threads)
+    {
+      auto ret = std::make_unique<linux_io_uring_multiplexer<false>>(is_polling);
+      OUTCOME_TRY(ret->init(1));
+      return byte_io_multiplexer_ptr(ret.release());
+    }
+    auto ret = std::make_unique<linux_io_uring_multiplexer<true>>(is_polling);
+    OUTCOME_TRY(ret->init(threads));
+    return byte_io_multiplexer_ptr(ret.release());
+  }
+  LLFIO_EXCEPTION_CATCH_ALL
+  {
+    return error_from_exception();
+  }
+}
+
+LLFIO_V2_NAMESPACE_END
@@ -616,6 +616,8 @@ result<map_handle::size_type> map_handle::truncate(size_type newsize, bool permi
 result<map_handle::buffer_type> map_handle::commit(buffer_type region, section_handle::flag flag) noexcept
 {
   LLFIO_LOG_FUNCTION_CALL(this);
+  // This map no longer has the state a pooled map must have, so it must not go back into a pool
+  _flag &= ~section_handle::flag::prefault;
   if(region.data() == nullptr)
   {
     return errc::invalid_argument;
@@ -636,6 +638,7 @@ result<map_handle::buffer_type> map_handle::commit(buffer_type region, section_h
 result<map_handle::buffer_type> map_handle::decommit(buffer_type region) noexcept
 {
   LLFIO_LOG_FUNCTION_CALL(this);
+  _flag &= ~section_handle::flag::prefault;
   if(region.data() == nullptr)
   {
     return errc::invalid_argument;
@@ -656,6 +659,7 @@ result<map_handle::buffer_type> map_handle::decommit(buffer_type region) noexcep
 result<void> map_handle::zero_memory(buffer_type region) noexcept
 {
   LLFIO_LOG_FUNCTION_CALL(this);
+  _flag &= ~section_handle::flag::prefault;
   if(region.data() == nullptr)
   {
     return errc::invalid_argument;
@@ -704,6 +708,7 @@ result<span<map_handle::buffer_type>> map_handle::prefetch(span<buffer_type> reg
 result<map_handle::buffer_type> map_handle::do_not_store(buffer_type region) noexcept
 {
   LLFIO_LOG_FUNCTION_CALL(0);
+  _flag &= ~section_handle::flag::prefault;
   region = utils::round_to_page_size_larger(region, _pagesize);
   if(region.data() == nullptr)
   {
@@ -23,6 +23,7 @@ Distributed under the Boost Software License, Version 1.0.
 */
 
 #include "../../../handle.hpp"
+#include "../../../path_handle.hpp"
 #include "../../../stat.hpp"
 
 #include <sys/stat.h>
@@ -86,395 +87,432 @@ inline struct timespec from_timepoint(std::chrono::system_clock::time_point time
   return {static_cast<time_t>(duration.count() / STL_TICKS_PER_SEC), static_cast<long int>((duration.count() % STL_TICKS_PER_SEC) * divider / multiplier)};
 }
 
-LLFIO_HEADERS_ONLY_MEMFUNC_SPEC result<size_t> stat_t::fill(const handle &h, stat_t::want wanted) noexcept
+namespace detail
 {
-  LLFIO_LOG_FUNCTION_CALL(&h);
-  size_t ret = 0;
-#if defined(__linux__) && defined(__GLIBC__)  // musl doesn't support syscall 332 for some reason
+#if defined(__linux__) && defined(__GLIBC__)
+  struct statx_timestamp
   {
-    struct statx_timestamp
-    {
-      int64_t tv_sec;   /* Seconds since the Epoch (UNIX time) */
-      uint32_t tv_nsec; /* Nanoseconds since tv_sec */
-      uint32_t __reserved;
-    };
-    struct statx
-    {
-      uint32_t stx_mask;       /* Mask of bits indicating
-                               filled fields */
-      uint32_t stx_blksize;    /* Block size for filesystem I/O */
-      uint64_t stx_attributes; /* Extra file attribute indicators */
-      uint32_t stx_nlink;      /* Number of hard links */
-      uint32_t stx_uid;        /* User ID of owner */
-      uint32_t stx_gid;        /* Group ID of owner */
-      uint16_t stx_mode;       /* File type and mode */
-      uint16_t __spare0[1];
-      uint64_t stx_ino;    /* Inode number */
-      uint64_t stx_size;   /* Total size in bytes */
-      uint64_t stx_blocks; /* Number of 512B blocks allocated */
-      uint64_t stx_attributes_mask;
-      /* Mask to show what's supported
-         in stx_attributes */
+    int64_t tv_sec;   /* Seconds since the Epoch (UNIX time) */
+    uint32_t tv_nsec; /* Nanoseconds since tv_sec */
+    uint32_t __reserved;
+  };
+  struct statx_t
+  {
+    uint32_t stx_mask;       /* Mask of bits indicating
+                             filled fields */
+    uint32_t stx_blksize;    /* Block size for filesystem I/O */
+    uint64_t stx_attributes; /* Extra file attribute indicators */
+    uint32_t stx_nlink;      /* Number of hard links */
+    uint32_t stx_uid;        /* User ID of owner */
+    uint32_t stx_gid;        /* Group ID of owner */
+    uint16_t stx_mode;       /* File type and mode */
+    uint16_t __spare0[1];
+    uint64_t stx_ino;    /* Inode number */
+    uint64_t stx_size;   /* Total size in bytes */
+    uint64_t stx_blocks; /* Number of 512B blocks allocated */
+    uint64_t stx_attributes_mask;
+    /* Mask to show what's supported
+       in stx_attributes */
 
-      /* The following fields are file timestamps */
-      struct statx_timestamp stx_atime; /* Last access */
-      struct statx_timestamp stx_btime; /* Creation */
-      struct statx_timestamp stx_ctime; /* Last status change */
-      struct statx_timestamp stx_mtime; /* Last modification */
+    /* The following fields are file timestamps */
+    statx_timestamp stx_atime; /* Last access */
+    statx_timestamp stx_btime; /* Creation */
+    statx_timestamp stx_ctime; /* Last status change */
+    statx_timestamp stx_mtime; /* Last modification */
 
-      /* If this file represents a device, then the next two
-         fields contain the ID of the device */
-      uint32_t stx_rdev_major; /* Major ID */
-      uint32_t stx_rdev_minor; /* Minor ID */
+    /* If this file represents a device, then the next two
+       fields contain the ID of the device */
+    uint32_t stx_rdev_major; /* Major ID */
+    uint32_t stx_rdev_minor; /* Minor ID */
 
-      /* The next two fields contain the ID of the device
-         containing the filesystem where the file resides */
-      uint32_t stx_dev_major; /* Major ID */
-      uint32_t stx_dev_minor; /* Minor ID */
+    /* The next two fields contain the ID of the device
+       containing the filesystem where the file resides */
+    uint32_t stx_dev_major; /* Major ID */
+    uint32_t stx_dev_minor; /* Minor ID */
 
-      uint64_t __spare2[14];
-    } s;
-    memset(&s, 0, sizeof(s));
+    uint64_t __spare2[14];
+  };
+  // The statx() mask needed for the metadata wanted
+  static inline unsigned statx_mask(stat_t::want wanted) noexcept
+  {
     unsigned mask = 0;
-    if(wanted & want::dev)
+    if(wanted & stat_t::want::dev)
     {
       mask |= 0x0100U /*STATX_INO*/;
     }
-    if(wanted & want::ino)
+    if(wanted & stat_t::want::ino)
     {
       mask |= 0x0100U /*STATX_INO*/;
     }
-    if(wanted & want::type)
+    if(wanted & stat_t::want::type)
     {
       mask |= 0x0001U /*STATX_TYPE*/;
     }
-    if(wanted & want::perms)
+    if(wanted & stat_t::want::perms)
     {
       mask |= 0x0002U /*STATX_MODE*/;
     }
-    if(wanted & want::nlink)
+    if(wanted & stat_t::want::nlink)
     {
       mask |= 0x0004U /*STATX_NLINK*/;
     }
-    if(wanted & want::uid)
+    if(wanted & stat_t::want::uid)
     {
       mask |= 0x0008U /*STATX_UID*/;
     }
-    if(wanted & want::gid)
+    if(wanted & stat_t::want::gid)
     {
       mask |= 0x0010U /*STATX_GID*/;
     }
-    if(wanted & want::rdev)
+    if(wanted & stat_t::want::rdev)
     {
       mask |= 0x0100U /*STATX_INO*/;
     }
-    if(wanted & want::atim)
+    if(wanted & stat_t::want::atim)
     {
       mask |= 0x0020U /*STATX_ATIME*/;
     }
-    if(wanted & want::mtim)
+    if(wanted & stat_t::want::mtim)
     {
       mask |= 0x0040U /*STATX_MTIME*/;
     }
-    if(wanted & want::ctim)
+    if(wanted & stat_t::want::ctim)
     {
       mask |= 0x0080U /*STATX_CTIME*/;
     }
-    if(wanted & want::size)
+    if(wanted & stat_t::want::size)
     {
       mask |= 0x0200U /*STATX_SIZE*/;
     }
-    if(wanted & want::allocated)
+    if(wanted & stat_t::want::allocated)
     {
       mask |= 0x0200U /*STATX_SIZE*/;
     }
-    if(wanted & want::blocks)
+    if(wanted & stat_t::want::blocks)
     {
       mask |= 0x0400U /*STATX_BLOCKS*/;
     }
-    if(wanted & want::blksize)
+    if(wanted & stat_t::want::blksize)
     {
       mask |= 0x0400U /*STATX_BLOCKS*/;
     }
-    if(wanted & want::birthtim)
+    if(wanted & stat_t::want::birthtim)
     {
       mask |= 0x0800U /*STATX_BTIME*/;
     }
-    int flags = AT_EMPTY_PATH | AT_NO_AUTOMOUNT | AT_SYMLINK_NOFOLLOW | 0x0000 /*AT_STATX_SYNC_AS_STAT*/;
-    int fd = h.native_handle().fd;
-    if(
+    return mask;
+  }
+  // Fills from a statx() result, returning the number of items filled
+  static inline size_t stat_from_statx(stat_t &self, const statx_t &s, stat_t::want wanted) noexcept
+  {
+    size_t ret = 0;
+    if(wanted & stat_t::want::dev)
+    {
+      self.st_dev = makedev(s.stx_dev_major, s.stx_dev_minor);
+      ++ret;
+    }
+    if(wanted & stat_t::want::ino)
+    {
+      self.st_ino = s.stx_ino;
+      ++ret;
+    }
+    if(wanted & stat_t::want::type)
+    {
+      self.st_type = to_st_type(s.stx_mode);
+      ++ret;
+    }
+    if(wanted & stat_t::want::perms)
+    {
+      self.st_perms = s.stx_mode & 0xfff;
+      ++ret;
+    }
+    if(wanted & stat_t::want::nlink)
+    {
+      self.st_nlink = s.stx_nlink;
+      ++ret;
+    }
+    if(wanted & stat_t::want::uid)
+    {
+      self.st_uid = s.stx_uid;
+      ++ret;
+    }
+    if(wanted & stat_t::want::gid)
+    {
+      self.st_gid = s.stx_gid;
+      ++ret;
+    }
+    if(wanted & stat_t::want::rdev)
+    {
+      self.st_rdev = makedev(s.stx_rdev_major, s.stx_rdev_minor);
+      ++ret;
+    }
+    if(wanted & stat_t::want::atim)
+    {
+      self.st_atim = to_timepoint(timespec{(time_t) s.stx_atime.tv_sec, (long) s.stx_atime.tv_nsec});
+      ++ret;
+    }
+    if(wanted & stat_t::want::mtim)
+    {
+      self.st_mtim = to_timepoint(timespec{(time_t) s.stx_mtime.tv_sec, (long) s.stx_mtime.tv_nsec});
+      ++ret;
+    }
+    if(wanted & stat_t::want::ctim)
+    {
+      self.st_ctim = to_timepoint(timespec{(time_t) s.stx_ctime.tv_sec, (long) s.stx_ctime.tv_nsec});
+      ++ret;
+    }
+    if(wanted & stat_t::want::size)
+    {
+      self.st_size = s.stx_size;
+      ++ret;
+    }
+    if(wanted & stat_t::want::allocated)
+    {
+      self.st_allocated = static_cast<handle::extent_type>(s.stx_blocks) * 512;
+      ++ret;
+    }
+    if(wanted & stat_t::want::blocks)
+    {
+      self.st_blocks = s.stx_blocks;
+      ++ret;
+    }
+    if(wanted & stat_t::want::blksize)
+    {
+      self.st_blksize = s.stx_blksize;
+      ++ret;
+    }
+    if(wanted & stat_t::want::birthtim)
+    {
+      self.st_birthtim = to_timepoint(timespec{(time_t) s.stx_btime.tv_sec, (long) s.stx_btime.tv_nsec});
+      ++ret;
+    }
+    if(wanted & stat_t::want::sparse)
+    {
+      self.st_sparse = static_cast<unsigned int>((static_cast<handle::extent_type>(s.stx_blocks) * 512) < static_cast<handle::extent_type>(s.stx_size));
+      ++ret;
+    }
+    if(wanted & stat_t::want::compressed)
+    {
+      self.st_compressed = static_cast<unsigned int>(s.stx_attributes & 0x0004 /*STATX_ATTR_COMPRESSED*/);
+      ++ret;
+    }
+    return ret;
+  }
+#endif
+  /* Fills from a statx() or fstatat() of `path` relative to `dirfd`, not following symlinks,
+  or of `dirfd` itself if `path` is empty, in which case `h` is the handle owning `dirfd`.
+  */
+  static inline result<size_t> stat_fill_at(stat_t &self, int dirfd, const char *path, const handle *h, stat_t::want wanted) noexcept
+  {
+    size_t ret = 0;
+#if defined(__linux__) && defined(__GLIBC__)  // musl doesn't support syscall 332 for some reason
+    {
+      statx_t s;
+      memset(&s, 0, sizeof(s));
+      const unsigned mask = statx_mask(wanted);
+      int flags = (path[0] == 0 ? AT_EMPTY_PATH : 0) | AT_NO_AUTOMOUNT | AT_SYMLINK_NOFOLLOW | 0x0000 /*AT_STATX_SYNC_AS_STAT*/;
+      int fd = dirfd;
+      if(
 #if defined __aarch64__
-    syscall(291 /*__NR_statx*/, fd, "", flags, mask, &s)
+      syscall(291 /*__NR_statx*/, fd, path, flags, mask, &s)
 #elif defined __arm__
-    syscall(397 /*__NR_statx*/, fd, "", flags, mask, &s)
+      syscall(397 /*__NR_statx*/, fd, path, flags, mask, &s)
 #elif defined __alpha__
-    syscall(522 /*__NR_statx*/, fd, "", flags, mask, &s)
+      syscall(522 /*__NR_statx*/, fd, path, flags, mask, &s)
 #elif defined __i386__ || defined __powerpc64__
-    syscall(383 /*__NR_statx*/, fd, "", flags, mask, &s)
+      syscall(383 /*__NR_statx*/, fd, path, flags, mask, &s)
 #elif defined __sparc__
-    syscall(360 /*__NR_statx*/, fd, "", flags, mask, &s)
+      syscall(360 /*__NR_statx*/, fd, path, flags, mask, &s)
 #elif defined __x86_64__
-    syscall(332 /*__NR_statx*/, fd, "", flags, mask, &s)
+      syscall(332 /*__NR_statx*/, fd, path, flags, mask, &s)
 #else
 #error Unknown Linux platform
 #endif
-    >= 0)
+      >= 0)
+      {
+        return stat_from_statx(self, s, wanted);
+      }
+      // std::cerr << "statx failed with " << strerror(errno) << std::endl;
+    }
+#endif
     {
-      if(wanted & want::dev)
+      struct stat s
       {
-        st_dev = makedev(s.stx_dev_major, s.stx_dev_minor);
-        ++ret;
+      };
+      memset(&s, 0, sizeof(s));
+
+      if(-1 == (path[0] == 0 ? ::fstat(dirfd, &s) : ::fstatat(dirfd, path, &s, AT_SYMLINK_NOFOLLOW)))
+      {
+        if(h == nullptr || !h->is_symlink() || EBADF != errno)
+        {
+          return posix_error();
+        }
+        // This is a hack, but symlink_handle includes this first so there is a chicken and egg dependency problem
+        OUTCOME_TRY(detail::stat_from_symlink(s, *h));
       }
-      if(wanted & want::ino)
+      if(wanted & stat_t::want::dev)
       {
-        st_ino = s.stx_ino;
+        self.st_dev = s.st_dev;
         ++ret;
       }
-      if(wanted & want::type)
+      if(wanted & stat_t::want::ino)
       {
-        st_type = to_st_type(s.stx_mode);
+        self.st_ino = s.st_ino;
         ++ret;
       }
-      if(wanted & want::perms)
+      if(wanted & stat_t::want::type)
       {
-        st_perms = s.stx_mode & 0xfff;
+        self.st_type = to_st_type(s.st_mode);
         ++ret;
       }
-      if(wanted & want::nlink)
+      if(wanted & stat_t::want::perms)
       {
-        st_nlink = s.stx_nlink;
+        self.st_perms = s.st_mode & 0xfff;
         ++ret;
       }
-      if(wanted & want::uid)
+      if(wanted & stat_t::want::nlink)
       {
-        st_uid = s.stx_uid;
+        self.st_nlink = s.st_nlink;
         ++ret;
       }
-      if(wanted & want::gid)
+      if(wanted & stat_t::want::uid)
       {
-        st_gid = s.stx_gid;
+        self.st_uid = s.st_uid;
         ++ret;
       }
-      if(wanted & want::rdev)
+      if(wanted & stat_t::want::gid)
       {
-        st_rdev = makedev(s.stx_rdev_major, s.stx_rdev_minor);
+        self.st_gid = s.st_gid;
         ++ret;
       }
-      if(wanted & want::atim)
+      if(wanted & stat_t::want::rdev)
       {
-        st_atim = to_timepoint(timespec{(time_t) s.stx_atime.tv_sec, (long) s.stx_atime.tv_nsec});
+        self.st_rdev = s.st_rdev;
         ++ret;
       }
-      if(wanted & want::mtim)
+#ifdef __ANDROID__
+      if(wanted & stat_t::want::atim)
       {
-        st_mtim = to_timepoint(timespec{(time_t) s.stx_mtime.tv_sec, (long) s.stx_mtime.tv_nsec});
+        self.st_atim = to_timepoint(*((struct timespec *) &s.st_atime));
         ++ret;
       }
-      if(wanted & want::ctim)
+      if(wanted & stat_t::want::mtim)
       {
-        st_ctim = to_timepoint(timespec{(time_t) s.stx_ctime.tv_sec, (long) s.stx_ctime.tv_nsec});
+        self.st_mtim = to_timepoint(*((struct timespec *) &s.st_mtime));
         ++ret;
       }
-      if(wanted & want::size)
+      if(wanted & stat_t::want::ctim)
       {
-        st_size = s.stx_size;
+        self.st_ctim = to_timepoint(*((struct timespec *) &s.st_ctime));
         ++ret;
       }
-      if(wanted & want::allocated)
+#elif defined(__APPLE__)
+      if(wanted & stat_t::want::atim)
       {
-        st_allocated = static_cast<handle::extent_type>(s.stx_blocks) * 512;
+        self.st_atim = to_timepoint(s.st_atimespec);
         ++ret;
       }
-      if(wanted & want::blocks)
+      if(wanted & stat_t::want::mtim)
       {
-        st_blocks = s.stx_blocks;
+        self.st_mtim = to_timepoint(s.st_mtimespec);
         ++ret;
       }
-      if(wanted & want::blksize)
+      if(wanted & stat_t::want::ctim)
       {
-        st_blksize = s.stx_blksize;
+        self.st_ctim = to_timepoint(s.st_ctimespec);
         ++ret;
       }
-      if(wanted & want::birthtim)
+#else  // Linux and BSD
+      if(wanted & stat_t::want::atim)
       {
-        st_birthtim = to_timepoint(timespec{(time_t) s.stx_btime.tv_sec, (long) s.stx_btime.tv_nsec});
+        self.st_atim = to_timepoint(s.st_atim);
         ++ret;
       }
-      if(wanted & want::sparse)
+      if(wanted & stat_t::want::mtim)
       {
-        st_sparse = static_cast<unsigned int>((static_cast<handle::extent_type>(s.stx_blocks) * 512) < static_cast<handle::extent_type>(s.stx_size));
+        self.st_mtim = to_timepoint(s.st_mtim);
         ++ret;
       }
-      if(wanted & want::compressed)
+      if(wanted & stat_t::want::ctim)
       {
-        st_compressed = static_cast<unsigned int>(s.stx_attributes & 0x0004 /*STATX_ATTR_COMPRESSED*/);
+        self.st_ctim = to_timepoint(s.st_ctim);
         ++ret;
       }
-      return ret;
-    }
-    // std::cerr << "statx failed with " << strerror(errno) << std::endl;
-  }
 #endif
-  {
-    struct stat s
-    {
-    };
-    memset(&s, 0, sizeof(s));
-
-    if(-1 == ::fstat(h.native_handle().fd, &s))
-    {
-      if(!h.is_symlink() || EBADF != errno)
+      if(wanted & stat_t::want::size)
       {
-        return posix_error();
+        self.st_size = s.st_size;
+        ++ret;
+      }
+      if(wanted & stat_t::want::allocated)
+      {
+        self.st_allocated = static_cast<handle::extent_type>(s.st_blocks) * 512;
+        ++ret;
+      }
+      if(wanted & stat_t::want::blocks)
+      {
+        self.st_blocks = s.st_blocks;
+        ++ret;
+      }
+      if(wanted & stat_t::want::blksize)
+      {
+        self.st_blksize = s.st_blksize;
+        ++ret;
       }
-      // This is a hack, but symlink_handle includes this first so there is a chicken and egg dependency problem
-      OUTCOME_TRY(detail::stat_from_symlink(s, h));
-    }
-    if(wanted & want::dev)
-    {
-      st_dev = s.st_dev;
-      ++ret;
-    }
-    if(wanted & want::ino)
-    {
-      st_ino = s.st_ino;
-      ++ret;
-    }
-    if(wanted & want::type)
-    {
-      st_type = to_st_type(s.st_mode);
-      ++ret;
-    }
-    if(wanted & want::perms)
-    {
-      st_perms = s.st_mode & 0xfff;
-      ++ret;
-    }
-    if(wanted & want::nlink)
-    {
-      st_nlink = s.st_nlink;
-      ++ret;
-    }
-    if(wanted & want::uid)
-    {
-      st_uid = s.st_uid;
-      ++ret;
-    }
-    if(wanted & want::gid)
-    {
-      st_gid = s.st_gid;
-      ++ret;
-    }
-    if(wanted & want::rdev)
-    {
-      st_rdev = s.st_rdev;
-      ++ret;
-    }
-#ifdef __ANDROID__
-    if(wanted & want::atim)
-    {
-      st_atim = to_timepoint(*((struct timespec *) &s.st_atime));
-      ++ret;
-    }
-    if(wanted & want::mtim)
-    {
-      st_mtim = to_timepoint(*((struct timespec *) &s.st_mtime));
-      ++ret;
-    }
-    if(wanted & want::ctim)
-    {
-      st_ctim = to_timepoint(*((struct timespec *) &s.st_ctime));
-      ++ret;
-    }
-#elif defined(__APPLE__)
-    if(wanted & want::atim)
-    {
-      st_atim = to_timepoint(s.st_atimespec);
-      ++ret;
-    }
-    if(wanted & want::mtim)
-    {
-      st_mtim = to_timepoint(s.st_mtimespec);
-      ++ret;
-    }
-    if(wanted & want::ctim)
-    {
-      st_ctim = to_timepoint(s.st_ctimespec);
-      ++ret;
-    }
-#else  // Linux and BSD
-    if(wanted & want::atim)
-    {
-      st_atim = to_timepoint(s.st_atim);
-      ++ret;
-    }
-    if(wanted & want::mtim)
-    {
-      st_mtim = to_timepoint(s.st_mtim);
-      ++ret;
-    }
-    if(wanted & want::ctim)
-    {
-      st_ctim = to_timepoint(s.st_ctim);
-      ++ret;
-    }
-#endif
-    if(wanted & want::size)
-    {
-      st_size = s.st_size;
-      ++ret;
-    }
-    if(wanted & want::allocated)
-    {
-      st_allocated = static_cast<handle::extent_type>(s.st_blocks) * 512;
-      ++ret;
-    }
-    if(wanted & want::blocks)
-    {
-      st_blocks = s.st_blocks;
-      ++ret;
-    }
-    if(wanted & want::blksize)
-    {
-      st_blksize = s.st_blksize;
-      ++ret;
-    }
 #ifdef HAVE_STAT_FLAGS
-    if(wanted & want::flags)
-    {
-      st_flags = s.st_flags;
-      ++ret;
-    }
+      if(wanted & stat_t::want::flags)
+      {
+        self.st_flags = s.st_flags;
+        ++ret;
+      }
 #endif
 #ifdef HAVE_STAT_GEN
-    if(wanted & want::gen)
-    {
-      st_gen = s.st_gen;
-      ++ret;
-    }
+      if(wanted & stat_t::want::gen)
+      {
+        self.st_gen = s.st_gen;
+        ++ret;
+      }
 #endif
 #ifdef HAVE_BIRTHTIMESPEC
 #if defined(__APPLE__)
-    if(wanted & want::birthtim)
-    {
-      st_birthtim = to_timepoint(s.st_birthtimespec);
-      ++ret;
-    }
+      if(wanted & stat_t::want::birthtim)
+      {
+        self.st_birthtim = to_timepoint(s.st_birthtimespec);
+        ++ret;
+      }
 #else
-    if(wanted & want::birthtim)
-    {
-      st_birthtim = to_timepoint(s.st_birthtim);
-      ++ret;
-    }
+      if(wanted & stat_t::want::birthtim)
+      {
+        self.st_birthtim = to_timepoint(s.st_birthtim);
+        ++ret;
+      }
 #endif
 #endif
-    if(wanted & want::sparse)
-    {
-      st_sparse = static_cast<unsigned int>((static_cast<handle::extent_type>(s.st_blocks) * 512) < static_cast<handle::extent_type>(s.st_size));
-      ++ret;
+      if(wanted & stat_t::want::sparse)
+      {
+        self.st_sparse = static_cast<unsigned int>((static_cast<handle::extent_type>(s.st_blocks) * 512) < static_cast<handle::extent_type>(s.st_size));
+        ++ret;
+      }
+      return ret;
     }
-    return ret;
   }
+}  // namespace detail
+
+LLFIO_HEADERS_ONLY_MEMFUNC_SPEC result<size_t> stat_t::fill(const handle &h, stat_t::want wanted) noexcept
+{
+  LLFIO_LOG_FUNCTION_CALL(&h);
+  return detail::stat_fill_at(*this, h.native_handle().fd, "", &h, wanted);
+}
+
+LLFIO_HEADERS_ONLY_MEMFUNC_SPEC result<size_t> stat_t::fill(const path_handle &base, path_view leaf, stat_t::want wanted) noexcept
+{
+  LLFIO_LOG_FUNCTION_CALL(&base);
+  if(leaf.empty())
+  {
+    return errc::invalid_argument;
+  }
+  path_view::zero_terminated_rendered_path<> zpath(leaf);
+  return detail::stat_fill_at(*this, base.native_handle().fd, zpath.c_str(), nullptr, wanted);
 }
 
 LLFIO_HEADERS_ONLY_MEMFUNC_SPEC result<stat_t::want> stat_t::stamp(handle &h, stat_t::want wanted) noexcept
@@ -24,12 +24,19 @@ Distributed under the Boost Software License, Version 1.0.
 
 #include "../../algorithm/reduce.hpp"
 
+#include "../../statfs.hpp"
+
 #ifdef _WIN32
 #include "windows/import.hpp"
 #else
 #include "posix/import.hpp"
 #endif
 
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 LLFIO_V2_NAMESPACE_BEGIN
 
 namespace algorithm
@@ -264,13 +271,255 @@ namespace algorithm
       const directory_handle &topdirh;
       reduce_visitor *visitor{nullptr};
       std::atomic<size_t> items_removed{0}, directory_open_failed{0}, failed_to_remove{0}, failed_to_rename{0};
+      size_t max_unlink_threads{1};  // one means the filing system won't benefit from concurrent unlinking within a directory
+      // Additional kernel threads which may yet be started to unlink within a directory, shared by all of traverse()'s threads
+      std::atomic<size_t> unlink_threads_available{0};
+
+      std::mutex rates_lock;
+      std::vector<std::pair<std::thread::id, reduce_visitor::unlink_rate>> rates;
+      std::vector<reduce_visitor::unlink_rate> rates_reported;
 
       reduction_state(const directory_handle &_topdirh, reduce_visitor *_visitor)
           : topdirh(_topdirh)
           , visitor(_visitor)
       {
       }
+
+      // Accumulates the unlink rate of the calling kernel thread for this round
+      void add_rate(size_t items_unlinked, std::chrono::steady_clock::duration busy) noexcept
+      {
+        if(items_unlinked == 0)
+        {
+          return;
+        }
+        const auto mythreadid = std::this_thread::get_id();
+        std::lock_guard<std::mutex> g(rates_lock);
+        for(auto &i : rates)
+        {
+          if(i.first == mythreadid)
+          {
+            i.second.items_unlinked += items_unlinked;
+            i.second.busy += busy;
+            return;
+          }
+        }
+        LLFIO_EXCEPTION_TRY
+        {
+          rates.emplace_back(mythreadid, reduce_visitor::unlink_rate{items_unlinked, busy});
+        }
+        LLFIO_EXCEPTION_CATCH_ALL
+        {
+          // Statistics are best effort
+        }
+      }
+      // Claims up to `wanted` additional unlinking kernel threads from the budget, returning how many were claimed
+      size_t claim_unlink_threads(size_t wanted) noexcept
+      {
+        size_t available = unlink_threads_available.load(std::memory_order_relaxed), claimed;
+        do
+        {
+          claimed = std::min(wanted, available);
+          if(claimed == 0)
+          {
+            return 0;
+          }
+        } while(!unlink_threads_available.compare_exchange_weak(available, available - claimed, std::memory_order_relaxed));
+        return claimed;
+      }
+      void release_unlink_threads(size_t count) noexcept { unlink_threads_available.fetch_add(count, std::memory_order_relaxed); }
+      // Returns the unlink rates for the round just completed, and resets them for the next round
+      span<const reduce_visitor::unlink_rate> take_rates() noexcept
+      {
+        rates_reported.clear();
+        LLFIO_EXCEPTION_TRY
+        {
+          rates_reported.reserve(rates.size());
+          for(auto &i : rates)
+          {
+            rates_reported.push_back(i.second);
+          }
+        }
+        LLFIO_EXCEPTION_CATCH_ALL
+        {
+          rates_reported.clear();
+        }
+        rates.clear();
+        return {rates_reported.data(), rates_reported.size()};
+      }
     };
+
+    // Unlinks a non-directory entry, returning whether it was removed
+    inline result<bool> unlink_entry(reduction_state *state, const directory_handle &dirh, directory_entry &entry, size_t depth) noexcept
+    {
+      auto r = detail::remove(dirh, entry.leafname, false);
+      if(!r)
+      {
+        OUTCOME_TRY(auto &&success, state->visitor->unlink_failed(state, std::move(r).error(), dirh, entry, depth));
+        if(success)
+        {
+          state->items_removed.fetch_add(1, std::memory_order_relaxed);
+          return true;
+        }
+        state->failed_to_remove.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      state->items_removed.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+
+    /* Unlinks all the non-directory entries in contents using an adaptively chosen number of
+    kernel threads, returning whether all of them were removed.
+
+    Entries are handed out in chunks of consecutive enumerated order. The calling kernel
+    thread also measures the aggregate unlink rate every sampling window, doubling the number
+    of kernel threads for as long as that improves the rate by more than 10%, and retiring
+    the most recently added kernel threads as soon as it does not. Additional kernel threads
+    are claimed from the budget shared with every other directory being unlinked concurrently,
+    and returned to it as soon as they exit.
+    */
+    inline result<bool> parallel_unlink(reduction_state *state, const directory_handle &dirh, directory_handle::buffers_type &contents, size_t depth) noexcept
+    {
+      static constexpr size_t chunk_size = 256;
+      static constexpr std::chrono::milliseconds sampling_window(10);
+      const size_t count = contents.size();
+      std::atomic<size_t> next{0}, done{0}, target{1};
+      std::atomic<bool> removed_everything{true}, failed{false};
+      std::mutex errorlock;
+      optional<result<void>::error_type> error;
+
+      auto worker = [&](size_t id, const std::function<void()> &adapt) {
+        const auto begin = std::chrono::steady_clock::now();
+        size_t unlinked = 0;
+        while(id < target.load(std::memory_order_relaxed) && !failed.load(std::memory_order_relaxed))
+        {
+          const size_t i = next.fetch_add(chunk_size, std::memory_order_relaxed);
+          if(i >= count)
+          {
+            break;
+          }
+          const size_t end = std::min(i + chunk_size, count);
+          for(size_t n = i; n < end; n++)
+          {
+            auto &entry = contents[n];
+            if(entry.stat.st_type == filesystem::file_type::directory)
+            {
+              continue;
+            }
+            auto r = unlink_entry(state, dirh, entry, depth);
+            if(!r)
+            {
+              std::lock_guard<std::mutex> g(errorlock);
+              if(!error)
+              {
+                error.emplace(std::move(r).error());
+              }
+              failed.store(true, std::memory_order_relaxed);
+              break;
+            }
+            if(r.value())
+            {
+              unlinked++;
+            }
+            else
+            {
+              removed_everything.store(false, std::memory_order_relaxed);
+            }
+          }
+          done.fetch_add(end - i, std::memory_order_relaxed);
+          if(adapt)
+          {
+            adapt();
+          }
+        }
+        state->add_rate(unlinked, std::chrono::steady_clock::now() - begin);
+        if(id > 0)
+        {
+          state->release_unlink_threads(1);
+        }
+      };
+
+      std::vector<std::thread> threads;
+      bool growing = true;
+      size_t best_threads = 1;
+      double best_rate = 0;
+      auto window_begin = std::chrono::steady_clock::now();
+      size_t window_done = 0;
+      const std::function<void()> nothing;
+      std::function<void()> adapt;
+      LLFIO_EXCEPTION_TRY
+      {
+        threads.reserve(state->max_unlink_threads - 1);
+        adapt = [&] {
+          const auto now = std::chrono::steady_clock::now();
+          if(!growing || now - window_begin < sampling_window)
+          {
+            return;
+          }
+          const size_t d = done.load(std::memory_order_relaxed);
+          const double rate = (d - window_done) / std::chrono::duration_cast<std::chrono::duration<double>>(now - window_begin).count();
+          window_begin = now;
+          window_done = d;
+          const size_t current = target.load(std::memory_order_relaxed);
+          if(rate > best_rate * 1.1)
+          {
+            best_rate = rate;
+            best_threads = current;
+            size_t desired = std::min(current * 2, state->max_unlink_threads);
+            if(desired == current || next.load(std::memory_order_relaxed) >= count)
+            {
+              growing = false;
+              return;
+            }
+            const size_t claimed = state->claim_unlink_threads(desired - current);
+            if(claimed == 0)
+            {
+              // Other directories are using the whole budget
+              growing = false;
+              return;
+            }
+            desired = current + claimed;
+            target.store(desired, std::memory_order_relaxed);
+            size_t started = 0;
+            LLFIO_EXCEPTION_TRY
+            {
+              for(size_t id = current; id < desired; id++)
+              {
+                threads.emplace_back(worker, id, std::cref(nothing));
+                started++;
+              }
+            }
+            LLFIO_EXCEPTION_CATCH_ALL
+            {
+              // Could not create any more kernel threads, so make do with those we have
+              state->release_unlink_threads(claimed - started);
+              target.store(1 + threads.size(), std::memory_order_relaxed);
+              growing = false;
+            }
+          }
+          else
+          {
+            // More kernel threads didn't help, so retire the ones just added
+            target.store(best_threads, std::memory_order_relaxed);
+            growing = false;
+          }
+        };
+      }
+      LLFIO_EXCEPTION_CATCH_ALL
+      {
+        adapt = nullptr;
+      }
+      // This kernel thread is never retired, so it keeps going until every chunk has been claimed
+      worker(0, adapt);
+      for(auto &t : threads)
+      {
+        t.join();
+      }
+      if(error)
+      {
+        return std::move(*error);
+      }
+      return removed_everything.load(std::memory_order_relaxed);
+    }
   }  // namespace detail
 
   LLFIO_HEADERS_ONLY_MEMFUNC_SPEC result<directory_handle>
@@ -293,6 +542,15 @@ namespace algorithm
   {
     auto *state = (detail::reduction_state *) data;
     bool removed_everything = true;
+    const bool parallel = state->max_unlink_threads > 1 && contents.size() >= state->visitor->parallel_unlink_threshold;
+    if(parallel)
+    {
+      // Unlink all the non-directories first, as removing a directory below prevents its traversal by changing its type
+      OUTCOME_TRY(auto &&all_unlinked, detail::parallel_unlink(state, dirh, contents, depth));
+      removed_everything = all_unlinked;
+    }
+    const auto begin = std::chrono::steady_clock::now();
+    size_t unlinked = 0;
     for(auto &entry : contents)
     {
       switch(entry.stat.st_type)
@@ -306,6 +564,7 @@ namespace algorithm
         if(r)
         {
           state->items_removed.fetch_add(1, std::memory_order_relaxed);
+          unlinked++;
           entry.stat = stat_t(nullptr);  // prevent traversal
         }
         else
@@ -317,28 +576,24 @@ namespace algorithm
       }
       default:
       {
-        auto r = detail::remove(dirh, entry.leafname, false);
-        if(!r)
+        if(parallel)
         {
-          OUTCOME_TRY(auto &&success, state->visitor->unlink_failed(data, std::move(r).error(), dirh, entry, depth));
-          if(success)
-          {
-            state->items_removed.fetch_add(1, std::memory_order_relaxed);
-          }
-          else
-          {
-            state->failed_to_remove.fetch_add(1, std::memory_order_relaxed);
-            removed_everything = false;
-          }
+          break;  // already done
+        }
+        OUTCOME_TRY(auto &&success, detail::unlink_entry(state, dirh, entry, depth));
+        if(success)
+        {
+          unlinked++;
         }
         else
         {
-          state->items_removed.fetch_add(1, std::memory_order_relaxed);
+          removed_everything = false;
         }
         break;
       }
       }
     }
+    state->add_rate(unlinked, std::chrono::steady_clock::now() - begin);
     // Tail call optimisation
     if(removed_everything)
     {
@@ -394,9 +649,20 @@ namespace algorithm
     }
     size_t round = 0;
     detail::reduction_state state(topdirh, visitor);
+    {
+      // Only some filing systems can unlink many entries within the same directory concurrently
+      statfs_t sfs;
+      auto r = sfs.fill(topdirh, statfs_t::want::fstypename);
+      if(r && (sfs.f_fstypename == "xfs" || sfs.f_fstypename == "ext4" || sfs.f_fstypename == "btrfs" || sfs.f_fstypename == "zfs"))
+      {
+        state.max_unlink_threads = (threads != 0) ? threads : std::max(std::thread::hardware_concurrency(), 1U);
+        state.unlink_threads_available.store(state.max_unlink_threads - 1, std::memory_order_relaxed);
+      }
+    }
     OUTCOME_TRY(traverse(topdirh, visitor, threads, &state, force_slow_path));
     auto not_removed = state.directory_open_failed.load(std::memory_order_relaxed) + state.failed_to_remove.load(std::memory_order_relaxed) +
                        state.failed_to_rename.load(std::memory_order_relaxed);
+    OUTCOME_TRY(visitor->reduction_round_unlink_rates(&state, round, state.take_rates()));
     OUTCOME_TRY(visitor->reduction_round(&state, round++, state.items_removed.load(std::memory_order_relaxed), not_removed));
     while(not_removed > 0)
     {
@@ -406,6 +672,7 @@ namespace algorithm
       OUTCOME_TRY(traverse(topdirh, visitor, (round > 16) ? 1 : threads, &state, force_slow_path));
       not_removed = state.directory_open_failed.load(std::memory_order_relaxed) + state.failed_to_remove.load(std::memory_order_relaxed) +
                     state.failed_to_rename.load(std::memory_order_relaxed);
+      OUTCOME_TRY(visitor->reduction_round_unlink_rates(&state, round, state.take_rates()));
       OUTCOME_TRY(visitor->reduction_round(&state, round++, state.items_removed.load(std::memory_order_relaxed), not_removed));
     }
     OUTCOME_TRY(topdirh.unlink());
@@ -0,0 +1,508 @@
+/* A filesystem algorithm which fetches the metadata of many directory entries at once
+(C) 2026 agent <agent@local>
+File Created: Oct 2026
+
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License in the accompanying file
+Licence.txt or at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+
+Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file Licence.txt or copy at
+          http://www.boost.org/LICENSE_1_0.txt)
+*/
+
+#include "../../algorithm/stat_batch.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) && defined(__GLIBC__)
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+LLFIO_V2_NAMESPACE_BEGIN
+
+namespace algorithm
+{
+  namespace detail
+  {
+    // Below this many entries, the cost of setting up threads or a ring exceeds the gain
+    static constexpr size_t stat_batch_minimum = 32;
+    // How many entries each fallback thread claims at a time
+    static constexpr size_t stat_batch_chunk = 64;
+
+    inline size_t stat_batch_serial(const path_handle &base, span<directory_entry> entries, stat_t::want wanted, span<bool> filled) noexcept
+    {
+      size_t ret = 0;
+      for(size_t n = 0; n < entries.size(); n++)
+      {
+        const bool ok = !!entries[n].stat.fill(base, entries[n].leafname, wanted);
+        if(!filled.empty())
+        {
+          filled[n] = ok;
+        }
+        ret += ok;
+      }
+      return ret;
+    }
+
+    inline result<size_t> stat_batch_threaded(const path_handle &base, span<directory_entry> entries, stat_t::want wanted, span<bool> filled,
+                                              size_t threads) noexcept
+    {
+      if(threads == 0)
+      {
+        threads = std::thread::hardware_concurrency();
+      }
+      threads = std::min(threads, (entries.size() + stat_batch_chunk - 1) / stat_batch_chunk);
+      if(threads <= 1 || entries.size() < stat_batch_minimum)
+      {
+        return stat_batch_serial(base, entries, wanted, filled);
+      }
+      LLFIO_EXCEPTION_TRY
+      {
+        std::atomic<size_t> next(0), count(0);
+        auto worker = [&]() noexcept
+        {
+          for(;;)
+          {
+            const size_t begin = next.fetch_add(stat_batch_chunk, std::memory_order_relaxed);
+            if(begin >= entries.size())
+            {
+              return;
+            }
+            const size_t end = std::min(begin + stat_batch_chunk, entries.size());
+            count.fetch_add(stat_batch_serial(base, entries.subspan(begin, end - begin), wanted, filled.empty() ? filled : filled.subspan(begin, end - begin)),
+                            std::memory_order_relaxed);
+          }
+        };
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+        struct join_on_exit
+        {
+          std::vector<std::thread> &workers;
+          ~join_on_exit()
+          {
+            for(auto &i : workers)
+            {
+              i.join();
+            }
+          }
+        } joiner{workers};
+        for(size_t n = 1; n < threads; n++)
+        {
+          workers.emplace_back(worker);
+        }
+        worker();
+        for(auto &i : workers)
+        {
+          i.join();
+        }
+        workers.clear();
+        return count.load(std::memory_order_relaxed);
+      }
+      LLFIO_EXCEPTION_CATCH_ALL
+      {
+        return error_from_exception();
+      }
+    }
+
+#if defined(__linux__) && defined(__GLIBC__)
+    /* A minimal io_uring sufficient for issuing IORING_OP_STATX. The definitions in
+    io_uring_multiplexer.ipp are private to that multiplexer, and it does not implement
+    statx in any case. Setting up and tearing down a ring costs far more than the statx
+    of a typical directory, so there is one per thread which is reused, see
+    `stat_batch_thread_ring()`.
+    */
+    struct stat_batch_uring
+    {
+      struct sqe
+      {
+        uint8_t opcode;
+        uint8_t flags;
+        uint16_t ioprio;
+        int32_t fd;
+        uint64_t off;
+        uint64_t addr;
+        uint32_t len;
+        uint32_t statx_flags;
+        uint64_t user_data;
+        uint64_t __pad2[3];
+      };
+      static_assert(sizeof(sqe) == 64, "sqe is not 64 bytes in size!");
+      struct cqe
+      {
+        uint64_t user_data;
+        int32_t res;
+        uint32_t flags;
+      };
+      struct params
+      {
+        uint32_t sq_entries;
+        uint32_t cq_entries;
+        uint32_t flags;
+        uint32_t sq_thread_cpu;
+        uint32_t sq_thread_idle;
+        uint32_t features;
+        uint32_t wq_fd;
+        uint32_t resv[3];
+        struct
+        {
+          uint32_t head, tail, ring_mask, ring_entries, flags, dropped, array, resv1;
+          uint64_t resv2;
+        } sq_off;
+        struct
+        {
+          uint32_t head, tail, ring_mask, ring_entries, overflow, cqes;
+          uint64_t resv[2];
+        } cq_off;
+      };
+      static constexpr uint8_t IORING_OP_STATX = 21;
+      static constexpr uint32_t IORING_ENTER_GETEVENTS = (1U << 0);
+      static constexpr uint32_t IORING_FEAT_SINGLE_MMAP = (1U << 0);
+      static constexpr unsigned depth = 256;
+
+      struct slot_t
+      {
+        LLFIO_V2_NAMESPACE::detail::statx_t buffer;
+        char path[256];  // NAME_MAX plus the zero terminator. Longer paths are stat()ed without the ring.
+        size_t idx;
+      };
+
+      int fd{-1};
+      int init_errcode{0};  // if set, the ring is unusable upon this thread, so don't try again
+      // Sized up front so nothing needs allocating while the kernel owns any of the slots
+      std::unique_ptr<slot_t[]> slots;
+      std::unique_ptr<uint32_t[]> freeslots;
+      void *sq_ring{MAP_FAILED}, *cq_ring{MAP_FAILED};
+      sqe *sqes{(sqe *) MAP_FAILED};
+      size_t sq_ring_bytes{0}, cq_ring_bytes{0}, sqes_bytes{0};
+      uint32_t *sq_head{nullptr}, *sq_tail{nullptr}, *sq_array{nullptr}, *cq_head{nullptr}, *cq_tail{nullptr};
+      uint32_t sq_mask{0}, cq_mask{0}, entries{0};
+      cqe *cqes{nullptr};
+
+      stat_batch_uring() = default;
+      stat_batch_uring(const stat_batch_uring &) = delete;
+      stat_batch_uring &operator=(const stat_batch_uring &) = delete;
+      ~stat_batch_uring() { reset(); }
+
+      // Tears down the ring. The kernel must own no buffers of ours.
+      void reset() noexcept
+      {
+        if(sqes != MAP_FAILED)
+        {
+          ::munmap(sqes, sqes_bytes);
+          sqes = (sqe *) MAP_FAILED;
+        }
+        if(cq_ring != MAP_FAILED && cq_ring != sq_ring)
+        {
+          ::munmap(cq_ring, cq_ring_bytes);
+        }
+        cq_ring = MAP_FAILED;
+        if(sq_ring != MAP_FAILED)
+        {
+          ::munmap(sq_ring, sq_ring_bytes);
+          sq_ring = MAP_FAILED;
+        }
+        if(fd != -1)
+        {
+          ::close(fd);
+          fd = -1;
+        }
+      }
+
+      result<void> init() noexcept
+      {
+        if(fd != -1)
+        {
+          return success();
+        }
+        if(init_errcode != 0)
+        {
+          return posix_error(init_errcode);
+        }
+        auto r = _init();
+        if(!r)
+        {
+          init_errcode = errno;
+          if(init_errcode == 0)
+          {
+            init_errcode = ENOSYS;
+          }
+          reset();
+        }
+        return r;
+      }
+
+      result<void> _init() noexcept
+      {
+        params p;
+        memset(&p, 0, sizeof(p));
+#ifdef __alpha__
+        fd = (int) syscall(535 /*__NR_io_uring_setup*/, depth, &p);
+#else
+        fd = (int) syscall(425 /*__NR_io_uring_setup*/, depth, &p);
+#endif
+        if(fd < 0)
+        {
+          fd = -1;
+          return posix_error();
+        }
+        entries = p.sq_entries;
+        sq_ring_bytes = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+        cq_ring_bytes = p.cq_off.cqes + p.cq_entries * sizeof(cqe);
+        if(p.features & IORING_FEAT_SINGLE_MMAP)
+        {
+          sq_ring_bytes = cq_ring_bytes = std::max(sq_ring_bytes, cq_ring_bytes);
+        }
+        sq_ring = ::mmap(nullptr, sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, (off_t) 0 /*IORING_OFF_SQ_RING*/);
+        if(MAP_FAILED == sq_ring)
+        {
+          return posix_error();
+        }
+        if(p.features & IORING_FEAT_SINGLE_MMAP)
+        {
+          cq_ring = sq_ring;
+        }
+        else
+        {
+          cq_ring = ::mmap(nullptr, cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, (off_t) 0x8000000 /*IORING_OFF_CQ_RING*/);
+          if(MAP_FAILED == cq_ring)
+          {
+            return posix_error();
+          }
+        }
+        sqes_bytes = p.sq_entries * sizeof(sqe);
+        sqes = (sqe *) ::mmap(nullptr, sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, (off_t) 0x10000000 /*IORING_OFF_SQES*/);
+        if(MAP_FAILED == (void *) sqes)
+        {
+          return posix_error();
+        }
+        auto *sqb = (char *) sq_ring, *cqb = (char *) cq_ring;
+        sq_head = (uint32_t *) (sqb + p.sq_off.head);
+        sq_tail = (uint32_t *) (sqb + p.sq_off.tail);
+        sq_mask = *(uint32_t *) (sqb + p.sq_off.ring_mask);
+        sq_array = (uint32_t *) (sqb + p.sq_off.array);
+        cq_head = (uint32_t *) (cqb + p.cq_off.head);
+        cq_tail = (uint32_t *) (cqb + p.cq_off.tail);
+        cq_mask = *(uint32_t *) (cqb + p.cq_off.ring_mask);
+        cqes = (cqe *) (cqb + p.cq_off.cqes);
+        slots.reset(new(std::nothrow) slot_t[entries]);
+        freeslots.reset(new(std::nothrow) uint32_t[entries]);
+        if(!slots || !freeslots)
+        {
+          errno = ENOMEM;
+          return errc::not_enough_memory;
+        }
+        return success();
+      }
+
+      int enter(unsigned to_submit, unsigned min_complete) noexcept
+      {
+#ifdef __alpha__
+        return (int) syscall(536 /*__NR_io_uring_enter*/, fd, to_submit, min_complete, IORING_ENTER_GETEVENTS, nullptr, _NSIG / 8);
+#else
+        return (int) syscall(426 /*__NR_io_uring_enter*/, fd, to_submit, min_complete, IORING_ENTER_GETEVENTS, nullptr, _NSIG / 8);
+#endif
+      }
+    };
+
+    inline stat_batch_uring &stat_batch_thread_ring() noexcept
+    {
+      static thread_local stat_batch_uring ring;
+      return ring;
+    }
+
+    /* Returns the number of entries filled, or failure in which case the caller ought to
+    fill all the entries some other way. Entries the ring failed to stat, or could not be
+    given to the ring, are filled with stat_t::fill(), so it can fall back to fstatat() if
+    needs be. Nothing in here can throw or allocate, so there is no path out of this
+    function which leaves completions of ours on the thread's ring.
+    */
+    inline result<size_t> stat_batch_io_uring(const path_handle &base, span<directory_entry> entries, stat_t::want wanted, span<bool> filled) noexcept
+    {
+      stat_batch_uring &ring = stat_batch_thread_ring();
+      OUTCOME_TRY(ring.init());
+      const unsigned mask = LLFIO_V2_NAMESPACE::detail::statx_mask(wanted);
+      auto *slots = ring.slots.get();
+      auto *freeslots = ring.freeslots.get();
+      uint32_t freecount;
+      for(freecount = 0; freecount < ring.entries; freecount++)
+      {
+        freeslots[freecount] = ring.entries - 1 - freecount;
+      }
+      size_t next = 0, inflight = 0, ret = 0;
+      unsigned pending = 0;  // in the submission queue, but not yet consumed by the kernel
+      bool unsupported = false;
+      uint32_t tail = *ring.sq_tail;
+      auto fill_serially = [&](size_t idx) noexcept
+      { ret += stat_batch_serial(base, entries.subspan(idx, 1), wanted, filled.empty() ? filled : filled.subspan(idx, 1)); };
+      // Reaps whatever has completed, returning how many did
+      auto reap = [&]() noexcept -> size_t {
+        size_t reaped = 0;
+        uint32_t head = *ring.cq_head;
+        const uint32_t cqtail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for(; head != cqtail; head++)
+        {
+          const auto &c = ring.cqes[head & ring.cq_mask];
+          const auto s = (uint32_t) c.user_data;
+          auto &slot = slots[s];
+          if(c.res >= 0)
+          {
+            LLFIO_V2_NAMESPACE::detail::stat_from_statx(entries[slot.idx].stat, slot.buffer, wanted);
+            if(!filled.empty())
+            {
+              filled[slot.idx] = true;
+            }
+            ret++;
+          }
+          else
+          {
+            // Kernels before 5.6 reject the opcode with EINVAL, so stop using the ring
+            if(c.res == -EINVAL)
+            {
+              unsupported = true;
+            }
+            fill_serially(slot.idx);
+          }
+          freeslots[freecount++] = s;
+          inflight--;
+          reaped++;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+        return reaped;
+      };
+      while((next < entries.size() && !unsupported) || inflight > 0)
+      {
+        while(next < entries.size() && !unsupported && freecount > 0)
+        {
+          const uint32_t s = freeslots[freecount - 1];
+          auto &slot = slots[s];
+          slot.idx = next++;
+          bool staged = false;
+          LLFIO_EXCEPTION_TRY
+          {
+            // Rendering only allocates or throws for leafnames needing conversion, or too long for the slot anyway
+            path_view::zero_terminated_rendered_path<> zpath(entries[slot.idx].leafname);
+            if(zpath.size() < sizeof(slot.path))
+            {
+              memcpy(slot.path, zpath.c_str(), zpath.size() + 1);
+              staged = true;
+            }
+          }
+          LLFIO_EXCEPTION_CATCH_ALL
+          {
+          }
+          if(!staged)
+          {
+            fill_serially(slot.idx);
+            continue;
+          }
+          freecount--;
+          memset(&slot.buffer, 0, sizeof(slot.buffer));
+          auto &e = ring.sqes[tail & ring.sq_mask];
+          memset(&e, 0, sizeof(e));
+          e.opcode = stat_batch_uring::IORING_OP_STATX;
+          e.fd = base.native_handle().fd;
+          e.addr = (uint64_t) (uintptr_t) slot.path;
+          e.len = mask;
+          e.off = (uint64_t) (uintptr_t) &slot.buffer;
+          e.statx_flags = AT_NO_AUTOMOUNT | AT_SYMLINK_NOFOLLOW;
+          e.user_data = s;
+          ring.sq_array[tail & ring.sq_mask] = tail & ring.sq_mask;
+          tail++;
+          pending++;
+          inflight++;
+        }
+        if(inflight == 0)
+        {
+          break;
+        }
+        __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+        const int submitted = ring.enter(pending, 1);
+        if(submitted >= 0)
+        {
+          pending -= (unsigned) submitted;
+        }
+        else if(errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+          const int errcode = errno;
+          // Take back what the kernel has not consumed
+          tail -= pending;
+          inflight -= pending;
+          pending = 0;
+          __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+          // The kernel owns the buffers of everything it has consumed, so wait for it
+          // to be done with them before giving up on this ring
+          while(inflight > 0)
+          {
+            if(reap() == 0 && ring.enter(0, 1) < 0)
+            {
+              std::this_thread::yield();
+            }
+          }
+          ring.reset();
+          ring.init_errcode = errcode;  // don't keep retrying a ring which is failing
+          return posix_error(errcode);
+        }
+        reap();
+      }
+      if(unsupported)
+      {
+        // Nothing is in flight now. Remember for this thread that the kernel lacks statx
+        // on io_uring, so later calls go straight to the fallback instead of probing again.
+        ring.reset();
+        ring.init_errcode = EINVAL;
+      }
+      if(next < entries.size())
+      {
+        ret += stat_batch_serial(base, entries.subspan(next), wanted, filled.empty() ? filled : filled.subspan(next));
+      }
+      return ret;
+    }
+#endif
+  }  // namespace detail
+
+  LLFIO_HEADERS_ONLY_FUNC_SPEC result<size_t> stat_batch(const path_handle &base, span<directory_entry> entries, stat_t::want wanted, span<bool> filled,
+                                                         size_t threads) noexcept
+  {
+    LLFIO_LOG_FUNCTION_CALL(&base);
+    if(!filled.empty() && filled.size() != entries.size())
+    {
+      return errc::invalid_argument;
+    }
+    if(entries.empty())
+    {
+      return 0;
+    }
+#if defined(__linux__) && defined(__GLIBC__)
+    if(entries.size() >= detail::stat_batch_minimum)
+    {
+      auto r = detail::stat_batch_io_uring(base, entries, wanted, filled);
+      if(r)
+      {
+        return r;
+      }
+    }
+#endif
+    return detail::stat_batch_threaded(base, entries, wanted, filled, threads);
+  }
+}  // namespace algorithm
+
+LLFIO_V2_NAMESPACE_END
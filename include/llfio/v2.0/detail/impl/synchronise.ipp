@@ -0,0 +1,449 @@
+/* A filesystem algorithm which makes one directory tree identical to another
+(C) 2026 agent <agent@local>
+File Created: Oct 2026
+
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License in the accompanying file
+Licence.txt or at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+
+Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file Licence.txt or copy at
+          http://www.boost.org/LICENSE_1_0.txt)
+*/
+
+#include "../../algorithm/synchronise.hpp"
+
+#include "../../symlink_handle.hpp"
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+LLFIO_V2_NAMESPACE_BEGIN
+
+namespace algorithm
+{
+  namespace detail
+  {
+    struct synchronisation_state
+    {
+      const path_handle &destdirh;
+      synchronise_visitor *visitor{nullptr};
+      filesystem::path::string_type srcroot;
+      std::atomic<size_t> entries_unchanged{0}, entries_created{0}, entries_updated{0}, entries_removed{0}, entries_skipped{0};
+      std::atomic<file_handle::extent_type> bytes_compared{0}, bytes_copied{0};
+
+      synchronisation_state(const path_handle &_destdirh, synchronise_visitor *_visitor)
+          : destdirh(_destdirh)
+          , visitor(_visitor)
+      {
+      }
+    };
+
+    // The metadata needed to decide whether entries differ
+    static constexpr stat_t::want synchronise_metadata =
+    stat_t::want::type | stat_t::want::size | stat_t::want::mtim | stat_t::want::perms | stat_t::want::uid | stat_t::want::gid;
+
+    // Fetches any missing metadata, marking entries which have since vanished to be ignored
+    inline result<void> synchronise_fill(const directory_handle &dirh, span<directory_entry> entries, stat_t::want have)
+    {
+      if((have & synchronise_metadata) == synchronise_metadata || entries.empty())
+      {
+        return success();
+      }
+      // We are already running within traverse()'s threads.
+      std::unique_ptr<bool[]> filled(new(std::nothrow) bool[entries.size()]);
+      if(!filled)
+      {
+        return errc::not_enough_memory;
+      }
+      OUTCOME_TRY(stat_batch(dirh, entries, synchronise_metadata & ~have, {filled.get(), entries.size()}, 1));
+      for(size_t n = 0; n < entries.size(); n++)
+      {
+        if(!filled[n])
+        {
+          entries[n].stat = stat_t(nullptr);
+        }
+      }
+      return success();
+    }
+
+    inline bool synchronise_noncontent_differs(const stat_t &src, const stat_t &dest) noexcept
+    {
+#ifndef _WIN32
+      return (src.st_perms != dest.st_perms) || (src.st_uid != dest.st_uid) || (src.st_gid != dest.st_gid);
+#else
+      (void) src;
+      (void) dest;
+      return false;
+#endif
+    }
+
+    // Removes a destination entry, returning the number of entries removed
+    inline result<size_t> synchronise_remove(const directory_handle &destdirh, const directory_entry &entry)
+    {
+      if(entry.stat.st_type == filesystem::file_type::directory)
+      {
+        OUTCOME_TRY(auto &&dirh, directory_handle::directory(destdirh, entry.leafname, directory_handle::mode::write, directory_handle::creation::open_existing));
+        return reduce(std::move(dirh), nullptr, 1);
+      }
+      OUTCOME_TRY(detail::remove(destdirh, entry.leafname, false));
+      return 1;
+    }
+
+    /* Tries to make the destination share all the extents of the source. Unlike
+    clone_extents_to(), this never copies bytes, which is what the delta compare avoids.
+    */
+    inline bool synchronise_reflink(file_handle &srcfh, file_handle &destfh) noexcept
+    {
+#ifdef _WIN32
+      // Without emulation, this is FSCTL_DUPLICATE_EXTENTS only
+#if LLFIO_LOGGING_LEVEL
+      log_level_guard g(log_level::fatal);
+#endif
+      return !!srcfh.clone_extents_to(destfh, {}, false, false);
+#elif defined(__linux__) && defined(FICLONE)
+      // clone_extents_to() would fall back to copy_file_range(), which copies bytes on most filing systems
+      return -1 != ::ioctl(destfh.native_handle().fd, FICLONE, srcfh.native_handle().fd);
+#else
+      (void) srcfh;
+      (void) destfh;
+      return false;
+#endif
+    }
+
+    /* Makes the content of an existing destination file identical to the source, writing only
+    the blocks which differ if the extents cannot be reflinked.
+    */
+    inline result<void> synchronise_delta(synchronisation_state *state, file_handle &srcfh, file_handle &destfh, const stat_t &srcstat)
+    {
+      OUTCOME_TRY(destfh.truncate(srcstat.st_size));
+      if(state->visitor->reflink_changed_files && synchronise_reflink(srcfh, destfh))
+      {
+        state->bytes_copied.fetch_add(srcstat.st_size, std::memory_order_relaxed);
+        return success();
+      }
+      OUTCOME_TRY(auto &&srcextents, srcfh.extents());
+      OUTCOME_TRY(auto &&destextents, destfh.extents());
+      // Deallocate whatever is allocated in the destination but not in the source
+      size_t s = 0;
+      for(auto &extent : destextents)
+      {
+        for(auto offset = extent.offset, end = extent.offset + extent.length; offset < end;)
+        {
+          while(s < srcextents.size() && srcextents[s].offset + srcextents[s].length <= offset)
+          {
+            s++;
+          }
+          if(s == srcextents.size() || srcextents[s].offset >= end)
+          {
+            OUTCOME_TRY(destfh.zero({offset, end - offset}));
+            break;
+          }
+          if(srcextents[s].offset > offset)
+          {
+            OUTCOME_TRY(destfh.zero({offset, srcextents[s].offset - offset}));
+          }
+          offset = srcextents[s].offset + srcextents[s].length;
+        }
+      }
+      // Compare the allocated extents of the source block by block, writing only those which differ
+      const size_t blocksize = utils::file_buffer_default_size();
+      byte *srcbuffer = utils::page_allocator<byte>().allocate(blocksize * 2);
+      auto unbuffer = make_scope_exit([&]() noexcept { utils::page_allocator<byte>().deallocate(srcbuffer, blocksize * 2); });
+      byte *destbuffer = srcbuffer + blocksize;
+      file_handle::extent_type compared = 0, copied = 0;
+      for(auto &extent : srcextents)
+      {
+        const auto end = std::min<file_handle::extent_type>(extent.offset + extent.length, srcstat.st_size);
+        for(auto offset = extent.offset; offset < end;)
+        {
+          const auto length = (size_t) std::min<file_handle::extent_type>(blocksize, end - offset);
+          OUTCOME_TRY(auto &&srcread, srcfh.read(offset, {{srcbuffer, length}}));
+          if(srcread == 0)
+          {
+            break;  // source shrank
+          }
+          OUTCOME_TRY(auto &&destread, destfh.read(offset, {{destbuffer, srcread}}));
+          compared += srcread;
+          if(destread != srcread || 0 != memcmp(srcbuffer, destbuffer, srcread))
+          {
+            OUTCOME_TRY(destfh.write(offset, {{srcbuffer, srcread}}));
+            copied += srcread;
+          }
+          offset += srcread;
+        }
+      }
+      state->bytes_compared.fetch_add(compared, std::memory_order_relaxed);
+      state->bytes_copied.fetch_add(copied, std::memory_order_relaxed);
+      return success();
+    }
+
+    // Resolves any difference between a source entry and the destination entry of the same name, if any
+    inline result<void> synchronise_entry(synchronise_visitor *visitor, synchronisation_state *state, const directory_handle &dirh,
+                                          const directory_handle &destdirh, directory_entry &entry, const directory_entry *destentry, size_t depth)
+    {
+      using difference_type = synchronise_visitor::difference_type;
+      const auto type = entry.stat.st_type;
+      if(type != filesystem::file_type::regular && type != filesystem::file_type::directory && type != filesystem::file_type::symlink)
+      {
+        state->entries_skipped.fetch_add(1, std::memory_order_relaxed);
+        return success();
+      }
+      auto skip = [&]
+      {
+        state->entries_skipped.fetch_add(1, std::memory_order_relaxed);
+        if(destentry == nullptr)
+        {
+          // Don't traverse into a directory which is not in the destination
+          entry.stat = stat_t(nullptr);
+        }
+        return success();
+      };
+      if(destentry != nullptr && destentry->stat.st_type != type)
+      {
+        OUTCOME_TRY(auto &&go, visitor->difference(state, dirh, destdirh, &entry, destentry, difference_type::entry_kind, depth));
+        if(!go)
+        {
+          destentry = nullptr;
+          return skip();
+        }
+        OUTCOME_TRY(auto &&removed, synchronise_remove(destdirh, *destentry));
+        state->entries_removed.fetch_add(removed, std::memory_order_relaxed);
+        destentry = nullptr;
+      }
+      else if(destentry == nullptr)
+      {
+        OUTCOME_TRY(auto &&go, visitor->difference(state, dirh, destdirh, &entry, nullptr, difference_type::entry_added, depth));
+        if(!go)
+        {
+          return skip();
+        }
+      }
+      if(destentry == nullptr)
+      {
+        if(type == filesystem::file_type::directory)
+        {
+          OUTCOME_TRY(auto &&newdirh,
+                      directory_handle::directory(destdirh, entry.leafname, directory_handle::mode::write, directory_handle::creation::if_needed));
+          (void) entry.stat.stamp(newdirh, stat_t::want::perms | stat_t::want::uid | stat_t::want::gid);
+        }
+        else if(type == filesystem::file_type::symlink)
+        {
+          OUTCOME_TRY(auto &&srclh, symlink_handle::symlink(dirh, entry.leafname));
+          OUTCOME_TRY(auto &&srclink, srclh.read());
+          OUTCOME_TRY(auto &&destlh, symlink_handle::symlink(destdirh, entry.leafname, symlink_handle::mode::write, symlink_handle::creation::always_new));
+          OUTCOME_TRY(destlh.write({symlink_handle::const_buffers_type(srclink.path(), srclink.type())}));
+        }
+        else
+        {
+          OUTCOME_TRY(auto &&srcfh, file_handle::file(dirh, entry.leafname, file_handle::mode::read));
+          OUTCOME_TRY(auto &&copied, clone_or_copy(srcfh, destdirh, entry.leafname));
+          state->bytes_copied.fetch_add(copied, std::memory_order_relaxed);
+        }
+        state->entries_created.fetch_add(1, std::memory_order_relaxed);
+        return success();
+      }
+      if(type == filesystem::file_type::symlink)
+      {
+        OUTCOME_TRY(auto &&srclh, symlink_handle::symlink(dirh, entry.leafname));
+        OUTCOME_TRY(auto &&srclink, srclh.read());
+        OUTCOME_TRY(auto &&destlh, symlink_handle::symlink(destdirh, entry.leafname, symlink_handle::mode::write));
+        OUTCOME_TRY(auto &&destlink, destlh.read());
+        if(srclink.type() == destlink.type() && 0 == srclink.path().compare<>(destlink.path()))
+        {
+          state->entries_unchanged.fetch_add(1, std::memory_order_relaxed);
+          return success();
+        }
+        OUTCOME_TRY(auto &&go, visitor->difference(state, dirh, destdirh, &entry, destentry, difference_type::content_metadata, depth));
+        if(!go)
+        {
+          return skip();
+        }
+        OUTCOME_TRY(destlh.write({symlink_handle::const_buffers_type(srclink.path(), srclink.type())}));
+        state->entries_updated.fetch_add(1, std::memory_order_relaxed);
+        return success();
+      }
+      const bool content_differs = (type == filesystem::file_type::regular) &&
+                                   ((entry.stat.st_size != destentry->stat.st_size) || (entry.stat.st_mtim != destentry->stat.st_mtim));
+      if(!content_differs && !synchronise_noncontent_differs(entry.stat, destentry->stat))
+      {
+        state->entries_unchanged.fetch_add(1, std::memory_order_relaxed);
+        return success();
+      }
+      OUTCOME_TRY(auto &&go, visitor->difference(state, dirh, destdirh, &entry, destentry,
+                                                 content_differs ? difference_type::content_metadata : difference_type::noncontent_metadata, depth));
+      if(!go)
+      {
+        return skip();
+      }
+      if(type == filesystem::file_type::directory)
+      {
+        OUTCOME_TRY(auto &&destsubdirh,
+                    directory_handle::directory(destdirh, entry.leafname, directory_handle::mode::write, directory_handle::creation::open_existing));
+        (void) entry.stat.stamp(destsubdirh, stat_t::want::perms | stat_t::want::uid | stat_t::want::gid);
+      }
+      else if(!content_differs)
+      {
+        OUTCOME_TRY(auto &&destfh, file_handle::file(destdirh, entry.leafname, file_handle::mode::attr_write, file_handle::creation::open_existing));
+        (void) entry.stat.stamp(destfh, stat_t::want::perms | stat_t::want::uid | stat_t::want::gid);
+      }
+      else
+      {
+        OUTCOME_TRY(auto &&srcfh, file_handle::file(dirh, entry.leafname, file_handle::mode::read));
+        if(entry.stat.st_size < visitor->delta_threshold)
+        {
+          OUTCOME_TRY(auto &&copied, clone_or_copy(srcfh, destdirh, entry.leafname, true, false, file_handle::creation::truncate_existing));
+          state->bytes_copied.fetch_add(copied, std::memory_order_relaxed);
+        }
+        else
+        {
+          stat_t srcstat(nullptr);
+          OUTCOME_TRY(srcstat.fill(srcfh));
+          OUTCOME_TRY(auto &&destfh, file_handle::file(destdirh, entry.leafname, file_handle::mode::write, file_handle::creation::open_existing,
+                                                       srcfh.kernel_caching()));
+          OUTCOME_TRY(synchronise_delta(state, srcfh, destfh, srcstat));
+          (void) srcstat.stamp(destfh);
+        }
+      }
+      state->entries_updated.fetch_add(1, std::memory_order_relaxed);
+      return success();
+    }
+  }  // namespace detail
+
+  LLFIO_HEADERS_ONLY_MEMFUNC_SPEC result<void> synchronise_visitor::post_enumeration(void *data, const directory_handle &dirh,
+                                                                                     directory_handle::buffers_type &contents, size_t depth) noexcept
+  {
+    LLFIO_EXCEPTION_TRY
+    {
+      auto *state = (detail::synchronisation_state *) data;
+      // Traversal is breadth first, so the corresponding destination directory already exists
+      filesystem::path relpath;
+      if(depth > 0)
+      {
+        OUTCOME_TRY(auto &&dirpath, dirh.current_path());
+        const auto &native = dirpath.native();
+        if(native.size() <= state->srcroot.size() || 0 != native.compare(0, state->srcroot.size(), state->srcroot))
+        {
+          // The source directory was moved out of the source tree during the synchronisation
+          return errc::no_such_file_or_directory;
+        }
+        auto idx = state->srcroot.size();
+        while(idx < native.size() && (native[idx] == '/' || native[idx] == filesystem::path::preferred_separator))
+        {
+          idx++;
+        }
+        relpath = native.substr(idx);
+      }
+      OUTCOME_TRY(auto &&destdirh,
+                  directory_handle::directory(state->destdirh, relpath, directory_handle::mode::write, directory_handle::creation::open_existing));
+      std::vector<directory_entry> destentries(std::max(contents.size(), (size_t) 64));
+      directory_handle::buffers_type destcontents;
+      for(;;)
+      {
+        destcontents = {destentries, std::move(destcontents)};
+        OUTCOME_TRY(destcontents, destdirh.read({std::move(destcontents), {}, directory_handle::filter::none}));
+        if(destcontents.done())
+        {
+          break;
+        }
+        destentries.resize(destentries.size() << 1);
+      }
+      OUTCOME_TRY(detail::synchronise_fill(dirh, contents, contents.metadata()));
+      OUTCOME_TRY(detail::synchronise_fill(destdirh, destcontents, destcontents.metadata()));
+
+      std::unordered_map<filesystem::path::string_type, const directory_entry *> destmap;
+      destmap.reserve(destcontents.size());
+      for(auto &entry : destcontents)
+      {
+        if(entry.stat.st_type != filesystem::file_type::unknown)
+        {
+          destmap.emplace(entry.leafname.path().native(), &entry);
+        }
+      }
+      for(auto &entry : contents)
+      {
+        if(entry.stat.st_type == filesystem::file_type::unknown)
+        {
+          continue;
+        }
+        const directory_entry *destentry = nullptr;
+        auto it = destmap.find(entry.leafname.path().native());
+        if(it != destmap.end())
+        {
+          destentry = it->second;
+          destmap.erase(it);
+        }
+        OUTCOME_TRY(detail::synchronise_entry(this, state, dirh, destdirh, entry, destentry, depth));
+      }
+      // Whatever remains is not in the source
+      for(auto &i : destmap)
+      {
+        OUTCOME_TRY(auto &&go, difference(data, dirh, destdirh, nullptr, i.second, difference_type::entry_removed, depth));
+        if(!go)
+        {
+          state->entries_skipped.fetch_add(1, std::memory_order_relaxed);
+          continue;
+        }
+        OUTCOME_TRY(auto &&removed, detail::synchronise_remove(destdirh, *i.second));
+        state->entries_removed.fetch_add(removed, std::memory_order_relaxed);
+      }
+      return success();
+    }
+    LLFIO_EXCEPTION_CATCH_ALL
+    {
+      return error_from_exception();
+    }
+  }
+
+  LLFIO_HEADERS_ONLY_FUNC_SPEC result<synchronise_summary> synchronise(const path_handle &srcdirh, const path_handle &destdirh, synchronise_visitor *visitor,
+                                                                       size_t threads, bool force_slow_path) noexcept
+  {
+    LLFIO_EXCEPTION_TRY
+    {
+      LLFIO_LOG_FUNCTION_CALL(&srcdirh);
+      synchronise_visitor default_visitor;
+      if(visitor == nullptr)
+      {
+        visitor = &default_visitor;
+      }
+      detail::synchronisation_state state(destdirh, visitor);
+      OUTCOME_TRY(auto &&srcroot, srcdirh.current_path());
+      state.srcroot = srcroot.native();
+      OUTCOME_TRY(traverse(srcdirh, visitor, threads, &state, force_slow_path));
+      synchronise_summary ret;
+      ret.entries_unchanged = state.entries_unchanged.load(std::memory_order_relaxed);
+      ret.entries_created = state.entries_created.load(std::memory_order_relaxed);
+      ret.entries_updated = state.entries_updated.load(std::memory_order_relaxed);
+      ret.entries_removed = state.entries_removed.load(std::memory_order_relaxed);
+      ret.entries_skipped = state.entries_skipped.load(std::memory_order_relaxed);
+      ret.bytes_compared = state.bytes_compared.load(std::memory_order_relaxed);
+      ret.bytes_copied = state.bytes_copied.load(std::memory_order_relaxed);
+      return ret;
+    }
+    LLFIO_EXCEPTION_CATCH_ALL
+    {
+      return error_from_exception();
+    }
+  }
+
+}  // namespace algorithm
+
+LLFIO_V2_NAMESPACE_END
@@ -27,6 +27,7 @@ Distributed under the Boost Software License, Version 1.0.
 #include <atomic>
 #include <condition_variable>
 #include <iostream>
+#include <iterator>
 #include <list>
 #include <memory>
 #include <mutex>
@@ -84,10 +85,18 @@ namespace algorithm
           }
         }
 #endif
+        if(0 == threads)
+        {
+          // Filesystems are generally only concurrent to the real CPU count
+          threads = std::thread::hardware_concurrency() / 2;
+          if(threads < 4)
+          {
+            threads = 4;
+          }
+        }
         struct state_t
         {
-          std::mutex lock;
-          size_t max_sso_path_size;
+          std::atomic<size_t> max_sso_path_size;
           traverse_visitor *visitor{nullptr};
 #if 0
         struct workitem
@@ -201,58 +210,166 @@ namespace algorithm
             path_view leaf() const noexcept { return using_sso ? path_view(_sso, _sso_length, path_view::zero_terminated) : path_view(_alloc); }
           };
 #endif
-          std::vector<std::list<workitem>> workqueue;
-          size_t workqueue_base{0};
-          size_t dirs_processed{0}, known_dirs_remaining{0}, depth_processed{0}, threads_sleeping{0}, threads_running{0};
+          /* Each worker owns a stack of lists, one per hierarchy depth level, and always takes
+          the least deep item from its own stack. Workers with nothing to do steal half of the
+          least deep level of another worker's stack, so the traversal stays mostly breadth
+          first without every worker contending on a single lock.
+          */
+          struct alignas(64) workqueue_t
+          {
+            std::mutex lock;
+            std::vector<std::list<workitem>> levels;
+            size_t base{0};  // no level below this has items
+          };
+          std::unique_ptr<workqueue_t[]> workqueues;
+          const size_t workqueues_count;
+          // known_dirs_remaining counts items queued plus items being processed, queued only those queued
+          std::atomic<size_t> dirs_processed{0}, known_dirs_remaining{0}, depth_processed{0}, known_depth{0}, queued{0}, threads_sleeping{0};
+          std::atomic<bool> done{false};
+          std::mutex sleep_lock;
+          std::condition_variable sleep_cond;
 
-          explicit state_t(size_t _max_sso_path_size, traverse_visitor *_visitor)
+          explicit state_t(size_t _max_sso_path_size, traverse_visitor *_visitor, size_t threads)
               : max_sso_path_size(_max_sso_path_size)
               , visitor(_visitor)
+              , workqueues(new workqueue_t[threads])
+              , workqueues_count(threads)
+          {
+          }
+
+          // Appends items to a level of a worker's stack. Does not adjust any counts.
+          void push(size_t idx, size_t level, std::list<workitem> &&items)
+          {
+            auto &q = workqueues[idx];
+            std::lock_guard<std::mutex> g(q.lock);
+            while(q.levels.size() < level + 1)
+            {
+              q.levels.emplace_back();
+            }
+            q.levels[level].splice(q.levels[level].end(), std::move(items));
+            if(level < q.base)
+            {
+              q.base = level;
+            }
+          }
+          // Appends newly discovered items, waking any sleeping workers
+          void push_new(size_t idx, size_t level, std::list<workitem> &&items)
+          {
+            const auto count = items.size();
+            if(count == 0)
+            {
+              return;
+            }
+            push(idx, level, std::move(items));
+            known_dirs_remaining.fetch_add(count);
+            queued.fetch_add(count);
+            for(auto d = known_depth.load(std::memory_order_relaxed); d < level + 1 && !known_depth.compare_exchange_weak(d, level + 1, std::memory_order_relaxed);)
+            {
+            }
+            if(threads_sleeping.load() > 0)
+            {
+              std::lock_guard<std::mutex> g(sleep_lock);
+              sleep_cond.notify_all();
+            }
+          }
+          // Retires an item previously popped, waking all workers if it was the last
+          void retire()
           {
+            if(1 == known_dirs_remaining.fetch_sub(1))
+            {
+              std::lock_guard<std::mutex> g(sleep_lock);
+              sleep_cond.notify_all();
+            }
           }
-        } state(use_slow_path ? size_t(-1) : LLFIO_ALGORITHM_TRAVERSE_MAX_SSO_PATH_SIZE, visitor);
+          // Takes the least deep item from a worker's own stack, else steals from another's
+          bool pop(size_t idx, workitem &item, size_t &level)
+          {
+            if(queued.load(std::memory_order_relaxed) == 0)
+            {
+              return false;
+            }
+            {
+              auto &q = workqueues[idx];
+              std::lock_guard<std::mutex> g(q.lock);
+              for(; q.base < q.levels.size(); q.base++)
+              {
+                auto &l = q.levels[q.base];
+                if(!l.empty())
+                {
+                  item = std::move(l.front());
+                  l.pop_front();
+                  level = q.base;
+                  queued.fetch_sub(1);
+                  return true;
+                }
+              }
+            }
+            for(size_t m = 1; m < workqueues_count; m++)
+            {
+              auto &victim = workqueues[(idx + m) % workqueues_count];
+              std::list<workitem> stolen;
+              {
+                std::unique_lock<std::mutex> g(victim.lock, std::try_to_lock);
+                if(!g.owns_lock())
+                {
+                  continue;
+                }
+                for(size_t n = victim.base; n < victim.levels.size(); n++)
+                {
+                  auto &l = victim.levels[n];
+                  if(!l.empty())
+                  {
+                    // Steal the back half, leaving the victim the items it would process next
+                    auto it = l.begin();
+                    std::advance(it, l.size() / 2);
+                    stolen.splice(stolen.end(), l, it, l.end());
+                    level = n;
+                    break;
+                  }
+                }
+              }
+              if(!stolen.empty())
+              {
+                item = std::move(stolen.front());
+                stolen.pop_front();
+                queued.fetch_sub(1);
+                if(!stolen.empty())
+                {
+                  push(idx, level, std::move(stolen));
+                }
+                return true;
+              }
+            }
+            return false;
+          }
+        } state(use_slow_path ? size_t(-1) : LLFIO_ALGORITHM_TRAVERSE_MAX_SSO_PATH_SIZE, visitor, threads);
         struct worker
         {
           state_t *state{nullptr};
+          size_t idx{0};
           std::vector<directory_handle::buffer_type> entries{4096};
           directory_handle::buffers_type buffers;
 
-          explicit worker(state_t *_state)
+          explicit worker(state_t *_state, size_t _idx)
               : state(_state)
+              , idx(_idx)
           {
           }
 
-          result<void> run(std::unique_lock<std::mutex> &g, void *data)
+          // Returns false if there was no work to be found
+          result<bool> run(void *data)
           {
             typename state_t::workitem mywork;
             size_t mylevel = 0;
-            assert(g.owns_lock());
-            for(size_t n = state->workqueue_base; n < state->workqueue.size(); n++)
-            {
-              if(!state->workqueue[n].empty())
-              {
-                mywork = std::move(state->workqueue[n].front());
-                state->workqueue[n].pop_front();
-                mylevel = n;
-                if(mylevel != state->depth_processed)
-                {
-                  state->depth_processed = mylevel;
-                }
-                break;
-              }
-            }
-            if(!mywork.dirh)
-            {
-              return success();
-            }
-            if(mylevel > state->workqueue_base)
+            if(!state->pop(idx, mywork, mylevel))
             {
-              state->workqueue_base = mylevel;
+              return false;
             }
-            state->dirs_processed++;
-            state->known_dirs_remaining--;
-            const auto max_sso_path_size = state->max_sso_path_size;
-            g.unlock();
+            auto retire = make_scope_exit([this]() noexcept { state->retire(); });
+            (void) retire;
+            state->depth_processed.store(mylevel, std::memory_order_relaxed);
+            state->dirs_processed.fetch_add(1, std::memory_order_relaxed);
+            const size_t max_sso_path_size = state->max_sso_path_size.load(std::memory_order_relaxed);
             std::shared_ptr<directory_handle> mydirh;
             if(mywork.leaf().empty())
             {
@@ -407,23 +524,16 @@ namespace algorithm
                     }
                   }
                 }
-                g.lock();
-                state->known_dirs_remaining += newwork.size();
-                if(state->workqueue.size() < mylevel + 2)
-                {
-                  state->workqueue.emplace_back();
-                }
-                state->workqueue[mylevel + 1].splice(state->workqueue[mylevel + 1].end(), std::move(newwork));
-                if(mylevel + 1 < state->workqueue_base)
-                {
-                  state->workqueue_base = mylevel + 1;
-                }
-                size_t dirs_processed = state->dirs_processed, known_dirs_remaining = state->known_dirs_remaining, depth_processed = state->depth_processed,
-                       known_depth_remaining = state->workqueue.size();
+                state->push_new(idx, mylevel + 1, std::move(newwork));
+                // Not counting the directory just processed, which retires on exit
+                const size_t dirs_processed = state->dirs_processed.load(std::memory_order_relaxed),
+                             known_dirs_remaining = state->known_dirs_remaining.load(std::memory_order_relaxed) - 1,
+                             depth_processed = state->depth_processed.load(std::memory_order_relaxed),
+                             known_depth_remaining = state->known_depth.load(std::memory_order_relaxed);
 #ifndef _WIN32
                 if(max_sso_path_size < size_t(-1) && rlimit_maxfd > 0 && rlimit_maxfd - mydirh->native_handle().fd < 65536)
                 {
-                  state->max_sso_path_size = size_t(-1);
+                  state->max_sso_path_size.store(size_t(-1), std::memory_order_relaxed);
 #ifndef NDEBUG
                   std::cerr << "WARNING: llfio::traverse() is falling back to slow path due to " << (rlimit_maxfd - mydirh->native_handle().fd)
                             << " unused file descriptors remaining! Raise the limit using setrlimit(RLIMIT_NOFILE) if your application is > 1024 fd count safe."
@@ -431,65 +541,48 @@ namespace algorithm
 #endif
                 }
 #endif
-                g.unlock();
                 OUTCOME_TRY(state->visitor->stack_updated(data, dirs_processed, known_dirs_remaining, depth_processed, known_depth_remaining));
               }
             }
-            return success();
+            return true;
           }
         };
-        state.workqueue.emplace_back();
-        state.workqueue.front().push_back(state_t::workitem(topdirh, {}));
-        state.known_dirs_remaining = 1;
-        worker firstworker(&state);
         {
-          std::unique_lock<std::mutex> g(state.lock);
-          for(size_t n = 0; state.known_dirs_remaining > 0 && (threads == 1 || n < 4); n++)
+          std::list<state_t::workitem> topwork;
+          topwork.push_back(state_t::workitem(topdirh, {}));
+          state.push_new(0, 0, std::move(topwork));
+        }
+        std::vector<worker> workers;
+        workers.reserve(threads);
+        workers.push_back(worker(&state, 0));
+        // Do the first few directories in this thread, so small hierarchies don't pay for a threadpool
+        for(size_t n = 0; state.known_dirs_remaining.load(std::memory_order_relaxed) > 0 && (threads == 1 || n < 4); n++)
+        {
+          OUTCOME_TRY(auto &&did_work, workers.front().run(data));
+          if(!did_work)
           {
-            if(!g.owns_lock())
-            {
-              g.lock();
-            }
-            OUTCOME_TRY(firstworker.run(g, data));
+            break;
           }
         }
-        if(state.known_dirs_remaining > 0)
+        if(state.known_dirs_remaining.load(std::memory_order_relaxed) > 0)
         {
           // Fire up the threadpool
-          if(0 == threads)
-          {
-            // Filesystems are generally only concurrent to the real CPU count
-            threads = std::thread::hardware_concurrency() / 2;
-            if(threads < 4)
-            {
-              threads = 4;
-            }
-          }
-          std::vector<worker> workers;
-          workers.reserve(threads);
-          workers.push_back(std::move(firstworker));
           for(size_t n = 1; n < threads; n++)
           {
-            workers.push_back(worker(&state));
+            workers.push_back(worker(&state, n));
           }
           std::vector<std::thread> workerthreads;
           workerthreads.reserve(threads);
-          std::condition_variable cond, maincond;
-          bool done = false;
           optional<result<void>::error_type> run_error;
           {
             auto handle_failure = make_scope_fail(
             [&]() noexcept
             {
-              std::unique_lock<std::mutex> g(state.lock);
-              done = true;
-              while(state.threads_running > 0)
               {
-                g.unlock();
-                cond.notify_all();
-                g.lock();
+                std::lock_guard<std::mutex> g(state.sleep_lock);
+                state.done = true;
+                state.sleep_cond.notify_all();
               }
-              g.unlock();
               for(auto &i : workerthreads)
               {
                 i.join();
@@ -500,63 +593,47 @@ namespace algorithm
               workerthreads.push_back(std::thread(
               [&](worker *w)
               {
-                std::unique_lock<std::mutex> g(state.lock);
-                state.threads_running++;
-                while(!done)
+                while(!state.done.load(std::memory_order_relaxed))
                 {
-                  if(state.known_dirs_remaining == 0)
+                  auto r = w->run(data);
+                  if(!r)
                   {
-                    // sleep
-                    state.threads_sleeping++;
-                    maincond.notify_all();
-                    cond.wait(g);
-                    state.threads_sleeping--;
-                    if(done)
+                    std::lock_guard<std::mutex> g(state.sleep_lock);
+                    if(!run_error)
                     {
-                      break;
+                      run_error = std::move(r).error();
                     }
+                    state.done = true;
+                    state.sleep_cond.notify_all();
+                    break;
                   }
-                  else
+                  if(r.value())
                   {
-                    // wake everybody
-                    cond.notify_all();
+                    continue;
                   }
-                  auto r = w->run(g, data);
-                  if(!g.owns_lock())
+                  if(state.known_dirs_remaining.load() == 0)
                   {
-                    g.lock();
+                    break;
                   }
-                  if(!r)
+                  if(state.queued.load() > 0)
                   {
-                    done = true;
-                    if(!run_error)
-                    {
-                      run_error = std::move(r).error();
-                    }
-                    break;
+                    // Some other worker is mid steal
+                    std::this_thread::yield();
+                    continue;
+                  }
+                  // sleep
+                  std::unique_lock<std::mutex> g(state.sleep_lock);
+                  state.threads_sleeping++;
+                  while(!state.done && state.queued.load() == 0 && state.known_dirs_remaining.load() > 0)
+                  {
+                    state.sleep_cond.wait(g);
                   }
+                  state.threads_sleeping--;
                 }
-                state.threads_sleeping++;
-                state.threads_running--;
-                maincond.notify_all();
               },
               &workers[n]));
             }
           }
-          {
-            std::unique_lock<std::mutex> g(state.lock);
-            while(state.threads_sleeping < threads && !done)
-            {
-              maincond.wait(g);
-            }
-            done = true;
-            while(state.threads_running > 0)
-            {
-              g.unlock();
-              cond.notify_all();
-              g.lock();
-            }
-          }
           for(auto &i : workerthreads)
           {
             i.join();
@@ -567,9 +644,12 @@ namespace algorithm
           }
         }
 #ifndef NDEBUG
-        for(auto &i : state.workqueue)
+        for(size_t n = 0; n < state.workqueues_count; n++)
         {
-          assert(i.empty());
+          for(auto &i : state.workqueues[n].levels)
+          {
+            assert(i.empty());
+          }
         }
 #endif
         return state.dirs_processed;
@@ -307,6 +307,11 @@ result<directory_handle::buffers_type> directory_handle::read(io_request<buffers
   {
     return std::move(req.buffers);
   }
+  if(req.flags & flags::streaming)
+  {
+    // NtQueryDirectoryFile() has no seekable cursor to resume from
+    return errc::operation_not_supported;
+  }
   UNICODE_STRING _glob{};
   memset(&_glob, 0, sizeof(_glob));
   path_view_type::not_zero_terminated_rendered_path<> zglob(req.glob);
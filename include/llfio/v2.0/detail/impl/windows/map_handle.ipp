@@ -884,6 +884,8 @@ result<map_handle::size_type> map_handle::truncate(size_type newsize, bool /* un
 result<map_handle::buffer_type> map_handle::commit(buffer_type region, section_handle::flag flag) noexcept
 {
   LLFIO_LOG_FUNCTION_CALL(this);
+  // This map no longer has the state a pooled map must have, so it must not go back into a pool
+  _flag &= ~section_handle::flag::prefault;
   if(region.data() == nullptr)
   {
     return errc::invalid_argument;
@@ -930,6 +932,7 @@ result<map_handle::buffer_type> map_handle::commit(buffer_type region, section_h
 result<map_handle::buffer_type> map_handle::decommit(buffer_type region) noexcept
 {
   LLFIO_LOG_FUNCTION_CALL(this);
+  _flag &= ~section_handle::flag::prefault;
   if(region.data() == nullptr)
   {
     return errc::invalid_argument;
@@ -944,6 +947,7 @@ result<void> map_handle::zero_memory(buffer_type region) noexcept
   windows_nt_kernel::init();
   using namespace windows_nt_kernel;
   LLFIO_LOG_FUNCTION_CALL(this);
+  _flag &= ~section_handle::flag::prefault;
   if(region.data() == nullptr)
   {
     return errc::invalid_argument;
@@ -1010,6 +1014,7 @@ result<map_handle::buffer_type> map_handle::do_not_store(buffer_type region) noe
   windows_nt_kernel::init();
   using namespace windows_nt_kernel;
   LLFIO_LOG_FUNCTION_CALL(0);
+  _flag &= ~section_handle::flag::prefault;
   region = utils::round_to_page_size_larger(region, _pagesize);
   if(region.data() == nullptr)
   {
@@ -23,6 +23,7 @@ Distributed under the Boost Software License, Version 1.0.
 */
 
 #include "../../../handle.hpp"
+#include "../../../path_handle.hpp"
 #include "../../../stat.hpp"
 #include "import.hpp"
 
@@ -381,6 +382,44 @@ LLFIO_HEADERS_ONLY_MEMFUNC_SPEC result<size_t> stat_t::fill(const handle &h, sta
   return ret;
 }
 
+LLFIO_HEADERS_ONLY_MEMFUNC_SPEC result<size_t> stat_t::fill(const path_handle &base, path_view leaf, stat_t::want wanted) noexcept
+{
+  LLFIO_LOG_FUNCTION_CALL(&base);
+  windows_nt_kernel::init();
+  using namespace windows_nt_kernel;
+  if(leaf.empty())
+  {
+    return errc::invalid_argument;
+  }
+  // NT cannot query metadata relative to a directory handle, so open the entry for attributes only
+  path_view::not_zero_terminated_rendered_path<> zpath(leaf);
+  UNICODE_STRING _path{};
+  _path.Buffer = const_cast<wchar_t *>(zpath.data());
+  _path.MaximumLength = (_path.Length = static_cast<USHORT>(zpath.size() * sizeof(wchar_t))) + sizeof(wchar_t);
+  OBJECT_ATTRIBUTES oa{};
+  memset(&oa, 0, sizeof(oa));
+  oa.Length = sizeof(OBJECT_ATTRIBUTES);
+  oa.ObjectName = &_path;
+  oa.RootDirectory = base.native_handle().h;
+  IO_STATUS_BLOCK isb = make_iostatus();
+  LARGE_INTEGER AllocationSize{};
+  memset(&AllocationSize, 0, sizeof(AllocationSize));
+  native_handle_type nativeh;
+  nativeh.behaviour |= native_handle_type::disposition::file | native_handle_type::disposition::kernel_handle;
+  NTSTATUS ntstat = NtCreateFile(&nativeh.h, FILE_READ_ATTRIBUTES | SYNCHRONIZE, &oa, &isb, &AllocationSize, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                 0x00000001 /*FILE_OPEN*/, 0x00200000 /*FILE_OPEN_REPARSE_POINT*/ | 0x00004000 /*FILE_OPEN_FOR_BACKUP_INTENT*/, nullptr, 0);
+  if(STATUS_PENDING == ntstat)
+  {
+    ntstat = ntwait(nativeh.h, isb, deadline());
+  }
+  if(ntstat < 0)
+  {
+    return ntkernel_error(ntstat);
+  }
+  handle h(nativeh);
+  return fill(h, wanted);
+}
+
 LLFIO_HEADERS_ONLY_MEMFUNC_SPEC result<stat_t::want> stat_t::stamp(handle &h, stat_t::want wanted) noexcept
 {
   LLFIO_LOG_FUNCTION_CALL(&h);
@@ -117,6 +117,12 @@ public:
     bool done() const noexcept { return _done; }
     //! Whether the enumeration is an atomically consistent snapshot or not
     bool is_snapshot() const noexcept { return _snapshot; }
+    /*! For `flags::streaming` reads, an opaque kernel cookie for where in the directory the next
+    read will resume. Zero means the start of the directory.
+    */
+    uint64_t cursor() const noexcept { return _cursor; }
+    //! Sets where the next `flags::streaming` read will resume, zero meaning the start of the directory.
+    void set_cursor(uint64_t v) noexcept { _cursor = v; }
 
   private:
     struct _implict_span_constructor_tag
@@ -140,6 +146,7 @@ public:
         , _kernel_buffer_size(o._kernel_buffer_size)
         , _metadata(o._metadata)
         , _done(o._done)
+        , _cursor(o._cursor)
     {
       static_cast<_base &>(o) = {};
       o._kernel_buffer_size = 0;
@@ -152,6 +159,7 @@ public:
         , _kernel_buffer_size(o._kernel_buffer_size)
         , _metadata(o._metadata)
         , _done(o._done)
+        , _cursor(o._cursor)
     {
       static_cast<_base &>(o) = {};
       o._kernel_buffer_size = 0;
@@ -188,11 +196,13 @@ public:
     stat_t::want _metadata{stat_t::want::none};
     bool _done{false};
     bool _snapshot{true};
+    uint64_t _cursor{0};
   };
   //! Flags for how to enumerate directory entries
   QUICKCPPLIB_BITFIELD_BEGIN_T(flags, uint8_t){
   none = 0u,                      //!< No flags
-  permit_racy_reads = (1u << 0u)  //!< Do not error out if a atomic snapshot cannot be performed
+  permit_racy_reads = (1u << 0u),  //!< Do not error out if a atomic snapshot cannot be performed
+  streaming = (1u << 1u)           //!< Resume from `buffers_type::cursor()` using a fixed size kernel buffer, never a snapshot
   } QUICKCPPLIB_BITFIELD_END(flags) using _flags_type = flags;
   //! How to do deleted file elimination on Windows
   enum class filter : uint8_t
@@ -421,6 +431,16 @@ public:
   If unset, at least one memory allocation, possibly more is performed. MAKE SURE you reuse the
   `buffers_type` across calls once you are no longer using the buffers filled (simply restamp
   its span range, the internal kernel buffer will then get reused).
+
+  If `flags::streaming` is set, the enumeration instead resumes from the position in
+  `buffers_type::cursor()` of the buffers supplied, which starts at zero and is advanced past every
+  entry returned, and exactly one batch is fetched from the kernel into a kernel buffer sized to the
+  buffers supplied. Memory use is therefore bounded by the number of buffers, and enumerating a
+  directory of millions of entries costs a single linear pass, at the cost of the results not being a
+  snapshot: entries added or removed during the enumeration may or may not be seen. `.done()` becomes
+  true once a read finds no further entries, which may therefore be an empty batch. Reuse the same
+  `buffers_type` across calls to carry the cursor forward. Streaming is implemented on Linux and
+  FreeBSD; elsewhere it fails with `errc::operation_not_supported`.
   */
   LLFIO_MAKE_FREE_FUNCTION
   LLFIO_HEADERS_ONLY_VIRTUAL_SPEC result<buffers_type> read(io_request<buffers_type> req, deadline d = std::chrono::seconds(30)) const noexcept;
@@ -179,6 +179,17 @@ occurs in the initial `make_dynamic_thread_pool_group()` and per thread
 creation, but otherwise the implementation does not perform dynamic memory
 allocations.
 
+On NUMA systems, the kernel threads are divided across the NUMA nodes in
+proportion to the CPUs of each node we may run upon, and each is confined to
+the CPUs of its node. Each NUMA node has its own queue of work items, with
+kernel threads executing work items from the queue for their own node first,
+and only taking work from the queues of other nodes when their own is empty.
+Work items can express a preference for a NUMA node or CPU using
+`work_item::set_numa_node_affinity()` and `work_item::set_cpu_affinity()`,
+otherwise they prefer the NUMA node of the kernel thread submitting them.
+Work items touching memory local to a NUMA node therefore mostly execute
+on that node.
+
 After multiple rewrites, eventually I got this custom userspace implementation
 to have superior performance to both ASIO and libdispatch. For larger work
 items the difference is meaningless between all three, however for smaller
@@ -207,6 +218,7 @@ public:
     std::chrono::steady_clock::time_point _timepoint1;
     std::chrono::system_clock::time_point _timepoint2;
     int _internalworkh_inuse{0};
+    unsigned _numa_node_affinity{(unsigned) -1}, _cpu_affinity{(unsigned) -1};
 
   protected:
     constexpr bool _has_timer_set_relative() const noexcept { return _timepoint1 != std::chrono::steady_clock::time_point(); }
@@ -226,6 +238,8 @@ public:
         , _timepoint1(o._timepoint1)
         , _timepoint2(o._timepoint2)
         , _internalworkh_inuse(o._internalworkh_inuse)
+        , _numa_node_affinity(o._numa_node_affinity)
+        , _cpu_affinity(o._cpu_affinity)
     {
       assert(o._parent.load(std::memory_order_relaxed) == nullptr);
       assert(o._internalworkh == nullptr);
@@ -264,6 +278,28 @@ public:
     //! Returns the parent work group between successful submission and just before `group_complete()`.
     dynamic_thread_pool_group *parent() const noexcept { return reinterpret_cast<dynamic_thread_pool_group *>(_parent.load(std::memory_order_relaxed)); }
 
+    //! Returns the NUMA node, as numbered by the system, this work item prefers to execute upon, or `(unsigned) -1` if no preference.
+    unsigned numa_node_affinity() const noexcept { return _numa_node_affinity; }
+    /*! \brief Sets the NUMA node, as numbered by the system, this work item prefers to execute upon,
+    or `(unsigned) -1` for no preference.
+
+    This is a hint only, and is currently only acted upon by the Linux native implementation.
+    Work items preferring a NUMA node are queued for the kernel threads confined to that
+    node, and only execute elsewhere if all those kernel threads are busy whilst kernel
+    threads on other NUMA nodes are idle. Work items without a preference prefer the NUMA
+    node of the kernel thread which submitted them. Call this before submission, or from
+    within `next()` or the call operator.
+    */
+    void set_numa_node_affinity(unsigned node) noexcept { _numa_node_affinity = node; }
+    //! Returns the CPU this work item prefers to execute upon, or `(unsigned) -1` if no preference.
+    unsigned cpu_affinity() const noexcept { return _cpu_affinity; }
+    /*! \brief Sets the CPU this work item prefers to execute upon, or `(unsigned) -1` for no preference.
+
+    This is a hint only. The Linux native implementation acts upon it at the granularity of
+    the NUMA node containing that CPU, and it overrides any NUMA node affinity set.
+    */
+    void set_cpu_affinity(unsigned cpu) noexcept { _cpu_affinity = cpu; }
+
     /*! Invoked by the i/o thread pool to determine if this work item
     has more work to do.
 
@@ -500,6 +536,13 @@ public:
   static LLFIO_HEADERS_ONLY_MEMFUNC_SPEC size_t current_nesting_level() noexcept;
   //! Returns the work item the calling thread is running within, if any.
   static LLFIO_HEADERS_ONLY_MEMFUNC_SPEC work_item *current_work_item() noexcept;
+  /*! \brief Returns the number of NUMA nodes which work items are scheduled across.
+  Note that this will be one on all but on Linux if using our local thread pool
+  implementation, on a NUMA system where we may run upon more than one node.
+  */
+  static LLFIO_HEADERS_ONLY_MEMFUNC_SPEC size_t numa_nodes() noexcept;
+  //! Returns the NUMA node, as numbered by the system, of the CPU the calling thread is currently running upon, or zero if unknown.
+  static LLFIO_HEADERS_ONLY_MEMFUNC_SPEC unsigned current_numa_node() noexcept;
   /*! \brief Returns the number of milliseconds that a thread is without work before it is shut down.
   Note that this will be zero on all but on Linux if using our local thread pool
   implementation, because the system controls this value on Windows, Grand Central
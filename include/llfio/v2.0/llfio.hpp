@@ -86,10 +86,13 @@ import LLFIO_MODULE_NAME;
 #include "algorithm/shared_fs_mutex/byte_ranges.hpp"
 #include "algorithm/shared_fs_mutex/lock_files.hpp"
 #include "algorithm/shared_fs_mutex/safe_byte_ranges.hpp"
+#include "algorithm/stat_batch.hpp"
 #include "algorithm/summarize.hpp"
+#include "algorithm/synchronise.hpp"
 
 #ifndef LLFIO_EXCLUDE_MAPPED_FILE_HANDLE
 #include "algorithm/handle_adapter/xor.hpp"
+#include "algorithm/readahead.hpp"
 #include "algorithm/shared_fs_mutex/memory_map.hpp"
 #include "algorithm/trivial_vector.hpp"
 #include "mapped.hpp"
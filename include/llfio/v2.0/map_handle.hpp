@@ -394,6 +394,20 @@ low per-process VMA limit typically 64k regions on most installs. Therefore, if
 overcommit, you will also need to substantially raise the maximum per process VMA limit as now LLFIO
 will strictly decommit memory, which prevents VMA coalescing and thus generates lots more VMAs.
 
+Requests are satisfied from the first cached region found amongst the seven nearest sizes at
+least as big as requested, which approximates a best fit, splitting it if it is much bigger
+(see `map_handle::set_cache_slack()`). Regions added to the cache are coalesced with any adjacent
+cached regions (except on Windows), so split regions are reassembled when returned.
+
+The cache is sharded, with up to one shard per CPU. Each thread is assigned a shard, and
+maps released by that thread are added to its shard. If a thread's shard cannot satisfy a request,
+the other shards are searched, skipping any currently in use by another thread. Threads
+therefore rarely serialise upon one another when allocating and releasing maps.
+
+Latency sensitive code which cannot afford to page fault upon first touch can additionally ask
+for pools of prefaulted regions of a given size and page size to be kept ready, see
+`map_handle::set_cache_pool()`. These are refilled by a background thread.
+
 The process local map handle cache does not self trim over time, so if you wish to reclaim virtual
 address space you need to manually call `map_handle::trim_cache()` from time to time.
 
@@ -454,6 +468,9 @@ Almost all distributions enable opt-in transparent huge pages, where you can exp
 within a region of memory transparently use huge pages as much as possible. LLFIO does not expose such
 facilities, you will need to manually invoke `madvise(MADV_HUGEPAGE)` on the region desired.
 
+Explicit huge pages are faulted in upon first touch like any other page, which costs far more per page.
+`map_handle::set_cache_pool()` can keep a pool of prefaulted huge page regions ready for `map_handle::map()`.
+
 ### FreeBSD:
 
 FreeBSD has no support for failing if large pages cannot be used for a specific `mmap()`. The best you can do is to ask for
@@ -702,8 +719,16 @@ public:
     size_t items_just_trimmed{0};
     size_t bytes_just_trimmed{0};
     size_t hits{0}, misses{0};
+    size_t steals{0};     //!< How many of the hits were satisfied from another thread's shard
+    size_t splits{0};     //!< How many of the hits were satisfied by splitting a bigger region
+    size_t coalesces{0};  //!< How many regions were merged with an adjacent region when added
+    size_t items_in_pools{0};  //!< Prefaulted regions currently in the pools configured by `set_cache_pool()`
+    size_t bytes_in_pools{0};
+    size_t pool_hits{0}, pool_misses{0};
   };
   /*! Get statistics about the map handle cache, optionally trimming the least recently used maps.
+  Statistics are summed across all shards of the cache. Trimming visits each shard in turn,
+  and prefers bigger items within each shard.
    */
   static LLFIO_HEADERS_ONLY_MEMFUNC_SPEC cache_statistics trim_cache(std::chrono::steady_clock::time_point older_than = {},
                                                                      size_t max_items = (size_t) -1) noexcept;
@@ -711,6 +736,38 @@ public:
   wish to explicitly trim the cache.
   */
   static LLFIO_HEADERS_ONLY_MEMFUNC_SPEC bool set_cache_disabled(bool disabled) noexcept;
+  /*! Set how many bytes bigger than requested a cached region may be before it is split,
+  returning the previous setting. The default is 64Kb.
+
+  A request is satisfied by the first cached region found amongst the seven nearest sizes which
+  are at least as big, which approximates but does not guarantee the best fit. If that
+  region is no more than `bytes` bigger, and is less than twice the size of the request, it is
+  returned whole, and the map handle's reservation will exceed its length. Otherwise the request
+  is split off the front of the region, and the remainder stays in the cache. Setting zero always
+  splits. On Windows regions cannot be split, so bigger regions are only returned when within
+  these bounds.
+  */
+  static LLFIO_HEADERS_ONLY_MEMFUNC_SPEC size_t set_cache_slack(size_t bytes) noexcept;
+  /*! Keep a pool of `regions` prefaulted regions of `bytes` each, for maps created with `_flag`.
+
+  A `map()` with `zeroed = false` whose `bytes` and `_flag` (ignoring `flag::prefault`) exactly match
+  a pool is satisfied from that pool in O(1), without a syscall, and touching the returned memory will
+  not page fault. When closed, such a map is returned to its pool without being decommitted, as is a map
+  of the same `bytes` and `_flag` created with `flag::prefault`, if the pool has room. Maps which were not
+  prefaulted, or on which `commit()`, `decommit()`, `zero_memory()` or `do_not_store()` was called,
+  go into the rest of the cache instead. A background thread refills the pools with newly
+  allocated prefaulted regions as they are taken.
+
+  This is mainly intended for large pages i.e. `_flag` with `flag::page_sizes_1` etc, where faulting
+  in a page on first touch is particularly expensive. There is one pool per page size, so
+  configuring a pool replaces any previous pool for the same page size. Setting `regions` to zero
+  releases the pool. `trim_cache()` does not trim pools.
+
+  \note Pool regions consume RAM (or large pages) all the time, unlike the rest of the cache.
+  */
+  static LLFIO_HEADERS_ONLY_MEMFUNC_SPEC result<void> set_cache_pool(size_type bytes, size_t regions,
+                                                                     section_handle::flag _flag = section_handle::flag::readwrite |
+                                                                                                  section_handle::flag::page_sizes_1) noexcept;
 
   //! The memory section this handle is using
   section_handle *section() const noexcept { return _section; }
@@ -44,6 +44,8 @@ Distributed under the Boost Software License, Version 1.0.
 LLFIO_V2_NAMESPACE_EXPORT_BEGIN
 
 class handle;
+class path_handle;
+class path_view;
 
 /*! \struct stat_t
 \brief Metadata about a directory entry
@@ -319,6 +321,17 @@ struct LLFIO_DECL stat_t  // NOLINT
   to detect which items were filled in, and which not (those not may be all bits zero).
   */
   LLFIO_HEADERS_ONLY_MEMFUNC_SPEC result<size_t> fill(const handle &h, want wanted = want::all) noexcept;
+  /*! Fills the structure with metadata about `leaf` relative to `base`, without opening it.
+  Symbolic links are not followed.
+
+  This is considerably faster than opening a handle to the entry, filling from that, and closing
+  it, as is the file descriptor churn avoided. On Linux it is a single `statx()`, elsewhere on POSIX
+  a single `fstatat()`. On Windows the entry must still be opened for attribute access only, as NT
+  has no API to query metadata relative to a directory handle without opening the entry.
+
+  \return The number of items filled in.
+  */
+  LLFIO_HEADERS_ONLY_MEMFUNC_SPEC result<size_t> fill(const path_handle &base, path_view leaf, want wanted = want::all) noexcept;
   /*! Stamps the handle with the metadata in the structure, returning the metadata written.
 
   The following want bits are always ignored, and are cleared in the want bits returned:
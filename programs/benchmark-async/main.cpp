@@ -372,6 +372,7 @@ completion i/o min 1300 max 1.40714e+06 mean 23037 stddev 15035.4
 #include <chrono>
 #include <cmath>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <thread>
 #include <typeinfo>
@@ -1136,6 +1137,95 @@ struct benchmark_asio_pipe
 };
 #endif
 
+#ifdef __linux__
+/* Measures the latency of random 4Kb reads from a caching::none (O_DIRECT) file, one
+at a time, so that interrupt driven and busy polled completion can be compared.
+Polled completion only helps on devices with poll queues configured, e.g. NVMe with
+`nvme.poll_queues` set, otherwise the multiplexer falls back to interrupts.
+*/
+void benchmark_direct_file_latency(llfio::path_view csv, const char *desc, llfio::byte_io_multiplexer_ptr (*make_multiplexer)())
+{
+  static constexpr size_t FILE_SIZE = 64 * 1024 * 1024;
+  static constexpr size_t BLOCK_SIZE = 4096;
+  std::cout << "\nBenchmarking " << desc << " with random " << BLOCK_SIZE << " byte reads ..." << std::endl;
+  auto fh_ = llfio::file_handle::temp_inode(llfio::path_discovery::storage_backed_temporary_files_directory(), llfio::file_handle::mode::write,
+                                            llfio::file_handle::caching::none);
+  if(!fh_)
+  {
+    std::cout << "   Skipped, could not open a temporary file with caching::none due to " << fh_.error().message() << std::endl;
+    return;
+  }
+  llfio::file_handle fh = std::move(fh_).value();
+  auto multiplexer = make_multiplexer();
+  fh.set_multiplexer(multiplexer.get()).value();
+  {
+    // Write real data, so the reads go to the device rather than a hole
+    size_t bytes = 1024 * 1024;
+    auto buffer = fh.allocate_registered_buffer(bytes).value();
+    memset(buffer->data(), 0x78, bytes);
+    for(size_t offset = 0; offset < FILE_SIZE; offset += bytes)
+    {
+      fh.write(offset, {{buffer->data(), bytes}}).value();
+    }
+    fh.barrier().value();
+  }
+  size_t bytes = BLOCK_SIZE;
+  auto buffer = fh.allocate_registered_buffer(bytes).value();
+  QUICKCPPLIB_NAMESPACE::algorithm::small_prng::small_prng rand;
+  std::vector<uint64_t> latencies;
+  latencies.reserve(8 * 1024 * 1024);
+  const auto begin = std::chrono::steady_clock::now();
+  for(size_t n = 0;; n++)
+  {
+    const llfio::file_handle::extent_type offset = (rand() % (FILE_SIZE / BLOCK_SIZE)) * BLOCK_SIZE;
+    const auto start = std::chrono::steady_clock::now();
+    fh.read(offset, {{buffer->data(), BLOCK_SIZE}}).value();
+    const auto end = std::chrono::steady_clock::now();
+    latencies.push_back((uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    if((n & 1023) == 0 && end - begin > std::chrono::seconds(BENCHMARK_DURATION))
+    {
+      break;
+    }
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) { return latencies[(size_t)((latencies.size() - 1) * p)]; };
+  std::cout << "   latency ns min " << latencies.front() << " max " << latencies.back();
+  std::cout << "\n             @ 50% " << percentile(0.5) << " @ 99% " << percentile(0.99) << " @ 99.9% " << percentile(0.999) << " @ 99.99% "
+            << percentile(0.9999) << " @ 99.999% " << percentile(0.99999);
+  // Power of two histogram
+  std::vector<size_t> histogram(64);
+  for(auto latency : latencies)
+  {
+    size_t bucket = 0;
+    while((latency >> (bucket + 1)) != 0)
+    {
+      ++bucket;
+    }
+    ++histogram[bucket];
+  }
+  for(size_t bucket = 0; bucket < histogram.size(); bucket++)
+  {
+    if(histogram[bucket] > 0)
+    {
+      std::cout << "\n   " << std::setw(12) << (1ULL << bucket) << " ns " << std::setw(10) << histogram[bucket] << " "
+                << std::string((size_t)(60.0 * histogram[bucket] / latencies.size()) + 1, '*');
+    }
+  }
+  std::cout << "\n   total results collected = " << latencies.size() << std::endl;
+  std::ofstream of(csv.path());
+  of << "\"Latency 50%\"," << percentile(0.5) << "\n\"Latency 99%\"," << percentile(0.99) << "\n\"Latency 99.9%\"," << percentile(0.999)
+     << "\n\"Latency 99.99%\"," << percentile(0.9999) << "\n\"Latency 99.999%\"," << percentile(0.99999) << "\n";
+  of << "\n\"Histogram ns\",\"Count\"\n";
+  for(size_t bucket = 0; bucket < histogram.size(); bucket++)
+  {
+    if(histogram[bucket] > 0)
+    {
+      of << (1ULL << bucket) << "," << histogram[bucket] << "\n";
+    }
+  }
+}
+#endif
+
 int main(void)
 {
   std::cout << "Warming up ..." << std::endl;
@@ -1155,6 +1245,28 @@ int main(void)
   // Locking enabled, disable IOCP immediate completions so it's a fair comparison with ASIO
   benchmark<benchmark_llfio<llfio::pipe_handle>>("llfio-pipe-handle-synchronised.csv", 64, "llfio::pipe_handle and IOCP synchronised",  //
                                                  []() -> llfio::byte_io_multiplexer_ptr { return llfio::test::multiplexer_win_iocp(2, true).value(); });
+#elif defined(__linux__)
+  std::cout << "\nWarming up ..." << std::endl;
+  do_benchmark<benchmark_llfio<llfio::pipe_handle>>(-1,  //
+                                                    []() -> llfio::byte_io_multiplexer_ptr { return llfio::multiplexer_linux_epoll(2).value(); });
+  benchmark<benchmark_llfio<llfio::pipe_handle>>("llfio-pipe-handle-epoll-unsynchronised.csv", 64, "llfio::pipe_handle and epoll unsynchronised",  //
+                                                 []() -> llfio::byte_io_multiplexer_ptr { return llfio::multiplexer_linux_epoll(1).value(); });
+  benchmark<benchmark_llfio<llfio::pipe_handle>>("llfio-pipe-handle-epoll-synchronised.csv", 64, "llfio::pipe_handle and epoll synchronised",  //
+                                                 []() -> llfio::byte_io_multiplexer_ptr { return llfio::multiplexer_linux_epoll(2).value(); });
+  if(llfio::multiplexer_linux_io_uring(1, false))
+  {
+    benchmark<benchmark_llfio<llfio::pipe_handle>>("llfio-pipe-handle-io_uring-unsynchronised.csv", 64, "llfio::pipe_handle and io_uring unsynchronised",  //
+                                                   []() -> llfio::byte_io_multiplexer_ptr { return llfio::multiplexer_linux_io_uring(1, false).value(); });
+    benchmark<benchmark_llfio<llfio::pipe_handle>>("llfio-pipe-handle-io_uring-synchronised.csv", 64, "llfio::pipe_handle and io_uring synchronised",  //
+                                                   []() -> llfio::byte_io_multiplexer_ptr { return llfio::multiplexer_linux_io_uring(2, false).value(); });
+    benchmark_direct_file_latency("llfio-direct-file-io_uring-interrupt.csv", "caching::none file_handle and io_uring interrupt driven completion",  //
+                                  []() -> llfio::byte_io_multiplexer_ptr { return llfio::multiplexer_linux_io_uring(1, false).value(); });
+    if(llfio::multiplexer_linux_io_uring(1, true))
+    {
+      benchmark_direct_file_latency("llfio-direct-file-io_uring-polled.csv", "caching::none file_handle and io_uring busy polled completion",  //
+                                    []() -> llfio::byte_io_multiplexer_ptr { return llfio::multiplexer_linux_io_uring(1, true).value(); });
+    }
+  }
 #endif
 
 #if ENABLE_ASIO
@@ -28,6 +28,8 @@ static constexpr unsigned BENCHMARK_DURATION = 10;
 static constexpr unsigned MAX_WORK_ITEMS = 1024;
 // Size of buffer to SHA256
 static constexpr unsigned SHA256_BUFFER_SIZE = 4096;
+// Size of buffer per work item to sum in the NUMA benchmark
+static constexpr size_t NUMA_BUFFER_SIZE = 16 * 1024 * 1024;
 
 #include "../../include/llfio/llfio.hpp"
 
@@ -36,8 +38,11 @@ static constexpr unsigned SHA256_BUFFER_SIZE = 4096;
 #include <cfloat>
 #include <chrono>
 #include <cmath>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <thread>
 #include <tuple>
 #include <vector>
@@ -218,12 +223,127 @@ template <class Runner> void benchmark(const char *name)
   out << std::endl;
 }
 
+/* Each work item repeatedly sums a buffer which it first touched, and which the
+kernel therefore allocated within the NUMA node it was then running upon. Compares
+throughput, and how much of the memory summed was remote to the NUMA node summing
+it, when work items tell the pool their NUMA node affinity and when they do not.
+*/
+// The system ids of the online NUMA nodes with CPUs, which need not be numbered contiguously
+std::vector<unsigned> online_numa_nodes()
+{
+  std::vector<unsigned> ret;
+  std::ifstream ifs("/sys/devices/system/node/online");
+  std::string list;
+  if(!std::getline(ifs, list))
+  {
+    return ret;
+  }
+  // A list such as "0-1,4"
+  for(const char *p = list.c_str(); *p >= '0' && *p <= '9';)
+  {
+    char *e;
+    unsigned long first = strtoul(p, &e, 10), last = first;
+    if(*e == '-')
+    {
+      last = strtoul(e + 1, &e, 10);
+    }
+    for(; first <= last; first++)
+    {
+      std::ifstream cpus("/sys/devices/system/node/node" + std::to_string(first) + "/cpulist");
+      std::string cpulist;
+      if(std::getline(cpus, cpulist) && !cpulist.empty())
+      {
+        ret.push_back((unsigned) first);
+      }
+    }
+    p = (*e == ',') ? e + 1 : e;
+  }
+  return ret;
+}
+
+void benchmark_numa()
+{
+  const auto nodes = llfio::dynamic_thread_pool_group::numa_nodes();
+  std::cout << "\nBenchmarking llfio NUMA affinity across " << nodes << " NUMA nodes ..." << std::endl;
+  if(nodes < 2)
+  {
+    std::cout << "   This system is not NUMA, or this process is confined to a single NUMA node, skipping." << std::endl;
+    return;
+  }
+  // Affinities are system NUMA node ids, not indices
+  const auto node_ids = online_numa_nodes();
+  if(node_ids.size() < 2)
+  {
+    std::cout << "   Could not read the online NUMA nodes, skipping." << std::endl;
+    return;
+  }
+  struct worker
+  {
+    std::unique_ptr<uint64_t[]> buffer;
+    unsigned home_node{0};
+    uint64_t sum{0}, count{0}, remote{0};
+
+    void operator()()
+    {
+      const auto node = llfio::dynamic_thread_pool_group::current_numa_node();
+      if(!buffer)
+      {
+        buffer.reset(new uint64_t[NUMA_BUFFER_SIZE / sizeof(uint64_t)]);
+        for(size_t n = 0; n < NUMA_BUFFER_SIZE / sizeof(uint64_t); n++)
+        {
+          buffer[n] = n;
+        }
+        home_node = node;
+        return;
+      }
+      uint64_t ret = 0;
+      for(size_t n = 0; n < NUMA_BUFFER_SIZE / sizeof(uint64_t); n++)
+      {
+        ret += buffer[n];
+      }
+      sum += ret;
+      count++;
+      if(node != home_node)
+      {
+        remote++;
+      }
+    }
+  };
+  std::vector<worker> workers(std::thread::hardware_concurrency());
+  auto run = [&](bool use_affinity) {
+    llfio_runner runner;
+    for(size_t n = 0; n < workers.size(); n++)
+    {
+      auto &i = workers[n];
+      i.count = i.remote = 0;
+      runner.add_workitem([&] { i(); });
+      if(use_affinity)
+      {
+        // The first run places the buffers, so prefer where they were placed thereafter
+        runner.workitems.back()->set_numa_node_affinity(i.buffer ? i.home_node : node_ids[n % node_ids.size()]);
+      }
+    }
+    auto duration = runner.run(BENCHMARK_DURATION);
+    uint64_t total = 0, remote = 0;
+    for(auto &i : workers)
+    {
+      total += i.count;
+      remote += i.remote;
+    }
+    std::cout << "   " << (use_affinity ? "With" : "Without") << " NUMA node affinity got " << (double) total * NUMA_BUFFER_SIZE / duration.count() / 1000.0
+              << " GB/sec summed of which " << (total ? 100.0 * remote / total : 0.0) << "% was remote memory." << std::endl;
+  };
+  run(true);
+  run(false);
+}
+
 int main(void)
 {
   std::string llfio_name("llfio (");
   llfio_name.append(llfio::dynamic_thread_pool_group::implementation_description());
   llfio_name.push_back(')');
   benchmark<llfio_runner>(llfio_name.c_str());
+  benchmark_numa();
 
 #if ENABLE_ASIO
   benchmark<asio_runner>("asio");
@@ -98,11 +98,112 @@ static void child_unlocks(size_t id)
   *shared_memory = (size_t) -1;
 }
 
+/* Single process, uncontended lock and unlock throughput of memory_map by the number
+of entities locked at once, which is dominated by hashing the entities and eliding
+collisions between them.
+*/
+template <class MemoryMap> static int benchmark_memory_map_entities()
+{
+  auto v = MemoryMap::fs_mutex_map({}, "lockfile");
+  if(v.has_error())
+  {
+    std::cerr << "ERROR: Creation of lock algorithm returns " << v.error().message() << std::endl;
+    return 1;
+  }
+  auto &algorithm = v.value();
+  std::cout << "Entities, lock+unlocks/sec, entities/sec" << std::endl;
+  for(size_t count : {1, 4, 16, 64, 128, 256, 1024})
+  {
+    std::vector<llfio::algorithm::shared_fs_mutex::shared_fs_mutex::entity_type> entities(count);
+    for(size_t n = 0; n < count; n++)
+    {
+      entities[n].value = (n * 2654435761ULL) & ((1ULL << 48) - 1);
+      entities[n].exclusive = (n & 1) != 0;
+    }
+    size_t ops = 0;
+    auto begin = std::chrono::steady_clock::now(), end = begin;
+    do
+    {
+      for(size_t n = 0; n < 64; n++)
+      {
+        auto guard = algorithm.lock(entities, llfio::deadline(), true).value();
+        guard.unlock();
+      }
+      ops += 64;
+      end = std::chrono::steady_clock::now();
+    } while(end - begin < std::chrono::seconds(1));
+    auto secs = std::chrono::duration_cast<std::chrono::duration<double>>(end - begin).count();
+    std::cout << count << ", " << (unsigned long long) (ops / secs) << ", " << (unsigned long long) (ops * count / secs) << std::endl;
+  }
+  return 0;
+}
+
+/* Single process soak of atomic_append, reporting lock latency and lock file size
+each second so that any growth over long uptimes is visible.
+*/
+static int benchmark_atomic_append_soak(size_t seconds)
+{
+  auto v = llfio::algorithm::shared_fs_mutex::atomic_append::fs_mutex_append({}, "lockfile");
+  if(v.has_error())
+  {
+    std::cerr << "ERROR: Creation of lock algorithm returns " << v.error().message() << std::endl;
+    return 1;
+  }
+  auto &algorithm = v.value();
+  std::vector<llfio::algorithm::shared_fs_mutex::shared_fs_mutex::entity_type> entities(4);
+  for(size_t n = 0; n < entities.size(); n++)
+  {
+    entities[n].value = n;
+    entities[n].exclusive = true;
+  }
+  std::cout << "Second, lock+unlocks, mean latency ns, max latency ns, lock file length, lock file allocated" << std::endl;
+  unsigned long long total = 0;
+  for(size_t sec = 1; sec <= seconds; sec++)
+  {
+    unsigned long long ops = 0, maxns = 0;
+    auto begin = std::chrono::steady_clock::now(), end = begin;
+    do
+    {
+      auto s = std::chrono::steady_clock::now();
+      {
+        auto guard = algorithm.lock(entities, llfio::deadline(), false).value();
+      }
+      end = std::chrono::steady_clock::now();
+      maxns = std::max(maxns, (unsigned long long) std::chrono::duration_cast<std::chrono::nanoseconds>(end - s).count());
+      ++ops;
+    } while(end - begin < std::chrono::seconds(1));
+    total += ops;
+    llfio::stat_t st(nullptr);
+    st.fill(algorithm.handle(), llfio::stat_t::want::size | llfio::stat_t::want::allocated).value();
+    std::cout << sec << ", " << ops << ", " << (std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() / ops) << ", " << maxns << ", " << st.st_size << ", "
+              << st.st_allocated << std::endl;
+  }
+  std::cout << "Total: " << total << " lock+unlocks" << std::endl;
+  return 0;
+}
+
 int main(int argc, char *argv[])
 {
+  if(argc == 2 && !strcmp(argv[1], "memory_map_entities"))
+  {
+    std::cout << "Packed hash index:" << std::endl;
+    if(benchmark_memory_map_entities<llfio::algorithm::shared_fs_mutex::memory_map<>>())
+    {
+      return 1;
+    }
+    std::cout << "\nCache line padded hash index:" << std::endl;
+    return benchmark_memory_map_entities<llfio::algorithm::shared_fs_mutex::memory_map<QUICKCPPLIB_NAMESPACE::algorithm::hash::fnv1a_hash, 65536,
+                                                                                        QUICKCPPLIB_NAMESPACE::configurable_spinlock::shared_spinlock<>, true>>();
+  }
+  if(argc == 3 && !strcmp(argv[1], "atomic_append_soak"))
+  {
+    return benchmark_atomic_append_soak(atoi(argv[2]));
+  }
   if(argc < 4)
   {
-    std::cerr << "Usage: " << argv[0] << " [!]<atomic_append|byte_ranges|lock_files|memory_map> <entities> <no of waiters>" << std::endl;
+    std::cerr << "Usage: " << argv[0] << " [!]<atomic_append|byte_ranges|lock_files|memory_map|memory_map_padded> <entities> <no of waiters>" << std::endl;
+    std::cerr << "       " << argv[0] << " memory_map_entities" << std::endl;
+    std::cerr << "       " << argv[0] << " atomic_append_soak <seconds>" << std::endl;
     return 1;
   }
   initialise_shared_memory();
@@ -114,7 +215,7 @@ int main(int argc, char *argv[])
     size_t waiters = atoi(argv[3]);
     if(!waiters || !atoi(argv[2]))
     {
-      std::cerr << "Usage: " << argv[0] << " [!]<atomic_append|byte_ranges|lock_files|memory_map> <entities> <no of waiters>" << std::endl;
+      std::cerr << "Usage: " << argv[0] << " [!]<atomic_append|byte_ranges|lock_files|memory_map|memory_map_padded> <entities> <no of waiters>" << std::endl;
       return 1;
     }
 
@@ -234,7 +335,8 @@ int main(int argc, char *argv[])
     atomic_append,
     byte_ranges,
     lock_files,
-    memory_map
+    memory_map,
+    memory_map_padded
   } test = lock_algorithm::unknown;
   bool contended = true;
   if(!strcmp(argv[2], "atomic_append"))
@@ -245,6 +347,8 @@ int main(int argc, char *argv[])
     test = lock_algorithm::lock_files;
   else if(!strcmp(argv[2], "memory_map"))
     test = lock_algorithm::memory_map;
+  else if(!strcmp(argv[2], "memory_map_padded"))
+    test = lock_algorithm::memory_map_padded;
   else if(!strcmp(argv[2], "!atomic_append"))
   {
     test = lock_algorithm::atomic_append;
@@ -265,6 +369,11 @@ int main(int argc, char *argv[])
     test = lock_algorithm::memory_map;
     contended = false;
   }
+  else if(!strcmp(argv[2], "!memory_map_padded"))
+  {
+    test = lock_algorithm::memory_map_padded;
+    contended = false;
+  }
   if(test == lock_algorithm::unknown)
   {
     std::cerr << "ERROR: unknown test requested" << std::endl;
@@ -330,6 +439,20 @@ int main(int argc, char *argv[])
       algorithm = std::make_unique<llfio::algorithm::shared_fs_mutex::memory_map<QUICKCPPLIB_NAMESPACE::algorithm::hash::passthru_hash>>(std::move(v.value()));
       break;
     }
+    case lock_algorithm::memory_map_padded:
+    {
+      // Same number of buckets as memory_map above, but each on its own cache line
+      using padded_type = llfio::algorithm::shared_fs_mutex::memory_map<QUICKCPPLIB_NAMESPACE::algorithm::hash::passthru_hash, 4096 / sizeof(QUICKCPPLIB_NAMESPACE::configurable_spinlock::shared_spinlock<>) * 64,
+                                                                        QUICKCPPLIB_NAMESPACE::configurable_spinlock::shared_spinlock<>, true>;
+      auto v = padded_type::fs_mutex_map({}, "lockfile");
+      if(v.has_error())
+      {
+        std::cerr << "ERROR: Creation of lock algorithm returns " << v.error().message() << std::endl;
+        return;
+      }
+      algorithm = std::make_unique<padded_type>(std::move(v.value()));
+      break;
+    }
     case lock_algorithm::unknown:
       break;
     }
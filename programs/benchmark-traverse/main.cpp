@@ -0,0 +1,164 @@
+/* Test the scaling of algorithm::traverse() with thread count
+(C) 2026 agent <agent@local>
+File Created: Oct 2026
+
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License in the accompanying file
+Licence.txt or at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+
+Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file Licence.txt or copy at
+          http://www.boost.org/LICENSE_1_0.txt)
+*/
+
+//! Directories to create in the synthetic hierarchy if no path is given
+#define SYNTHETIC_DIRECTORIES 100000
+
+//! Files to create in each synthetic directory
+#define SYNTHETIC_FILES_PER_DIRECTORY 8
+
+//! Maximum thread count to test
+#define MAX_THREADS 64
+
+//! Times to repeat each thread count, keeping the best
+#define REPEATS 3
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include "../../include/llfio/llfio.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace llfio = LLFIO_V2_NAMESPACE;
+
+struct counting_visitor final : llfio::algorithm::traverse_visitor
+{
+  std::atomic<size_t> items_enumerated{0};
+
+  virtual llfio::result<llfio::directory_handle> directory_open_failed(void * /*unused*/, llfio::result<void>::error_type &&error,
+                                                                      const llfio::directory_handle & /*unused*/, llfio::path_view /*unused*/,
+                                                                      size_t /*unused*/) noexcept override
+  {
+    if(error == llfio::errc::too_many_files_open)
+    {
+      return std::move(error);
+    }
+    return llfio::success();
+  }
+  virtual llfio::result<void> post_enumeration(void * /*unused*/, const llfio::directory_handle & /*unused*/, llfio::directory_handle::buffers_type &contents,
+                                               size_t /*unused*/) noexcept override
+  {
+    items_enumerated.fetch_add(contents.size(), std::memory_order_relaxed);
+    return llfio::success();
+  }
+};
+
+// Create a hierarchy breadth first, each directory with between one and eight subdirectories
+static void make_synthetic_hierarchy(const llfio::directory_handle &base)
+{
+  std::vector<llfio::directory_handle> level, nextlevel;
+  level.push_back(base.reopen().value());
+  size_t created = 0, rand = 78901;
+  while(created < SYNTHETIC_DIRECTORIES)
+  {
+    for(auto &dirh : level)
+    {
+      rand = rand * 1103515245 + 12345;
+      const size_t subdirs = 1 + ((rand >> 16) & 7);
+      for(size_t n = 0; n < subdirs && created < SYNTHETIC_DIRECTORIES; n++, created++)
+      {
+        nextlevel.push_back(llfio::directory_handle::directory(dirh, "dir" + std::to_string(n), llfio::directory_handle::mode::write,
+                                                               llfio::directory_handle::creation::if_needed)
+                            .value());
+      }
+      for(size_t n = 0; n < SYNTHETIC_FILES_PER_DIRECTORY; n++)
+      {
+        llfio::file_handle::file(dirh, "file" + std::to_string(n), llfio::file_handle::mode::write, llfio::file_handle::creation::if_needed).value();
+      }
+    }
+    level = std::move(nextlevel);
+    nextlevel.clear();
+  }
+}
+
+int main(int argc, char *argv[])
+{
+#ifndef _WIN32
+  {
+    struct rlimit r
+    {
+      1024 * 1024, 1024 * 1024
+    };
+    setrlimit(RLIMIT_NOFILE, &r);
+  }
+#endif
+  llfio::directory_handle synthetic;
+  llfio::path_handle root;
+  if(argc > 1)
+  {
+    root = llfio::path_handle::path(argv[1]).value();
+  }
+  else
+  {
+    std::cout << "Creating a synthetic hierarchy of " << SYNTHETIC_DIRECTORIES << " directories ..." << std::endl;
+    synthetic = llfio::directory_handle::temp_directory().value();
+    make_synthetic_hierarchy(synthetic);
+    root = llfio::path_handle::path(synthetic.current_path().value()).value();
+  }
+  std::cout << "Traversing " << root.current_path().value() << " (the first run warms the kernel caches) ...\n" << std::endl;
+  {
+    counting_visitor visitor;
+    llfio::algorithm::traverse(root, &visitor).value();
+  }
+  std::cout << "threads,directories,entries,seconds,directories/sec,speedup" << std::endl;
+  double single_threaded = 0;
+  for(size_t threads = 1; threads <= MAX_THREADS; threads <<= 1)
+  {
+    double best = 1e99;
+    size_t dirs = 0, entries = 0;
+    for(size_t n = 0; n < REPEATS; n++)
+    {
+      counting_visitor visitor;
+      auto begin = std::chrono::steady_clock::now();
+      dirs = llfio::algorithm::traverse(root, &visitor, threads).value();
+      auto end = std::chrono::steady_clock::now();
+      entries = visitor.items_enumerated;
+      const double secs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() / 1000000000.0;
+      if(secs < best)
+      {
+        best = secs;
+      }
+    }
+    if(threads == 1)
+    {
+      single_threaded = best;
+    }
+    std::cout << threads << "," << dirs << "," << entries << "," << std::fixed << std::setprecision(3) << best << "," << std::setprecision(0) << (dirs / best)
+              << "," << std::setprecision(2) << (single_threaded / best) << std::endl;
+  }
+  if(synthetic.is_valid())
+  {
+    std::cout << "\nRemoving the synthetic hierarchy ..." << std::endl;
+    llfio::algorithm::reduce(std::move(synthetic)).value();
+  }
+  return 0;
+}
@@ -28,6 +28,12 @@ Distributed under the Boost Software License, Version 1.0.
 #include "../../../include/llfio/llfio.hpp"
 #include "quickcpplib/algorithm/open_hash_index.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace key_value_store
@@ -167,8 +173,28 @@ namespace key_value_store
     } _smallfiles;
     optional<index::open_hash_index> _index;
     index::index *_indexheader{nullptr};
+    // Concurrently committing transactions queue here, and whichever is the
+    // group leader appends the values of everything queued in one go
     std::mutex _commitlock;
+    std::condition_variable _commitcond;
+    std::vector<transaction *> _commitqueue;
+    bool _commitleader{false};
+    // Where the values of each transaction which has appended them to my smallfile, but not
+    // yet updated the index to refer to them, begin. Protected by _commitlock.
+    std::vector<llfio::file_handle::extent_type> _commitsindexing;
     size_t _mmap_over_extension{0};
+    // Free space consolidation of my smallfile
+    struct
+    {
+      std::mutex passlock;     // held for the duration of a compaction pass
+      llfio::file_handle fh;   // non-append handle to my smallfile, for reading and hole punching
+      llfio::file_handle::extent_type compacted_until{64}, punched_until{64}, live_bytes{0};
+      std::thread thread;
+      std::mutex lock;  // protects stop and failure
+      std::condition_variable cond;
+      bool stop{false};
+      std::exception_ptr failure;
+    } _compactor;
 
     static constexpr llfio::file_handle::extent_type _indexinuseoffset = INT64_MAX;
     static constexpr uint64_t _goodmagic = 0x3130564b4f494641;  // "AFIOKV01"
@@ -179,6 +205,249 @@ namespace key_value_store
       // We append a value_tail record and round up to 64 byte multiple
       return (length + sizeof(index::value_tail) + 63) & ~63;
     }
+    // Become the group commit leader, so nobody else appends to my smallfile until I end leadership
+    void _begin_commit_leadership()
+    {
+      std::unique_lock<decltype(_commitlock)> commitlockguard(_commitlock);
+      _commitcond.wait(commitlockguard, [this] { return !_commitleader; });
+      _commitleader = true;
+    }
+    void _end_commit_leadership()
+    {
+      std::lock_guard<decltype(_commitlock)> commitlockguard(_commitlock);
+      _commitleader = false;
+      _commitcond.notify_all();
+    }
+    // Sleeps for the duration, returning false if the compactor was asked to stop meanwhile
+    bool _compactor_sleep(std::chrono::microseconds duration)
+    {
+      std::unique_lock<std::mutex> g(_compactor.lock);
+      return !_compactor.cond.wait_for(g, duration, [this] { return _compactor.stop; });
+    }
+    void _stop_compactor() noexcept
+    {
+      {
+        std::lock_guard<std::mutex> g(_compactor.lock);
+        _compactor.stop = true;
+        _compactor.cond.notify_all();
+      }
+      if(_compactor.thread.joinable())
+      {
+        _compactor.thread.join();
+      }
+    }
+    /* Copy the live records of my smallfile between the last compaction and its current end
+    to the end of my smallfile, repoint the index at the copies, and then punch holes over the
+    old range. Returns the number of bytes reclaimed. Does nothing if my smallfile has not grown
+    by at least `min_growth` since the last compaction.
+    */
+    llfio::file_handle::extent_type _compact(size_t bytes_per_second, std::chrono::milliseconds grace, llfio::file_handle::extent_type min_growth,
+                                             bool background)
+    {
+      using extent_type = llfio::file_handle::extent_type;
+      if(!_mysmallfile.is_valid())
+      {
+        return 0;  // read only
+      }
+      std::lock_guard<std::mutex> passguard(_compactor.passlock);
+      if(!_compactor.fh.is_valid())
+      {
+        // My smallfile is append only, and we need to punch holes without risking a fallback write of zeros being appended
+        _compactor.fh = _mysmallfile.reopen(llfio::file_handle::mode::write, llfio::file_handle::caching::all).value();
+        if(_compactor.fh.is_append_only())
+        {
+          _compactor.fh.set_append_only(false).value();
+        }
+      }
+      /* The current end of my smallfile is only a record boundary when nobody is appending.
+      Values appended by transactions which have not yet updated the index to refer to them
+      would look unreferenced, so stop short of the earliest of those. They will be scanned
+      next time.
+      */
+      const extent_type begin = _compactor.compacted_until;
+      extent_type end;
+      _begin_commit_leadership();
+      {
+        auto leadershipguard = make_scope_exit([this]() noexcept { _end_commit_leadership(); });
+        end = _mysmallfile.maximum_extent().value();
+        std::lock_guard<decltype(_commitlock)> commitlockguard(_commitlock);
+        for(auto offset : _commitsindexing)
+        {
+          end = std::min(end, offset);
+        }
+      }
+      if(end <= begin || end - begin < std::max(min_growth, 2 * _compactor.live_bytes))
+      {
+        return 0;
+      }
+
+      // Only the background compactor can be asked to stop
+      auto pause_for = [&](std::chrono::microseconds duration) {
+        if(background)
+        {
+          return _compactor_sleep(duration);
+        }
+        std::this_thread::sleep_for(duration);
+        return true;
+      };
+      // Pace all reads, writes and hole punches to bytes_per_second, so the foreground is not starved of i/o
+      const auto pace_begin = std::chrono::steady_clock::now();
+      extent_type paced_bytes = 0;
+      auto pace = [&](extent_type bytes) {
+        paced_bytes += bytes;
+        if(bytes_per_second == 0)
+        {
+          return pause_for(std::chrono::microseconds(0));
+        }
+        auto due = pace_begin + std::chrono::microseconds((paced_bytes * 1000000) / bytes_per_second);
+        auto now = std::chrono::steady_clock::now();
+        return pause_for((due > now) ? std::chrono::duration_cast<std::chrono::microseconds>(due - now) : std::chrono::microseconds(0));
+      };
+
+      // Live records found are copied here, and appended to my smallfile in one go per chunk
+      struct relocation_type
+      {
+        key_type key;
+        uint64_t transaction_counter;
+        extent_type old_end;
+        size_t new_end;  // offset of the record's end within copies
+      };
+      std::vector<llfio::byte> copies;
+      std::vector<relocation_type> relocations;
+      extent_type live = 0;
+      auto relocate = [&] {
+        if(copies.empty())
+        {
+          return;
+        }
+        extent_type new_offset;
+        _begin_commit_leadership();
+        {
+          auto leadershipguard = make_scope_exit([this]() noexcept { _end_commit_leadership(); });
+          new_offset = _mysmallfile.maximum_extent().value();
+          assert((new_offset % 64) == 0);
+          llfio::file_handle::const_buffer_type req{copies.data(), copies.size()};
+          _mysmallfile.write({{&req, 1}, 0}).value();
+        }
+        // Repoint the index at the copies, unless the records have since been superseded
+        _indexheader->writes_occurring[_mysmallfileidx].fetch_add(1);
+        auto writesguard = make_scope_exit([this]() noexcept { _indexheader->writes_occurring[_mysmallfileidx].fetch_sub(1); });
+        for(const auto &r : relocations)
+        {
+          auto it = _index->find_exclusive(r.key);
+          if(it != _index->end())
+          {
+            for(auto &h : it->second.history)
+            {
+              if(h.transaction_counter == r.transaction_counter && h.value_identifier == _mysmallfileidx && h.value_offset == r.old_end / 64)
+              {
+                h.value_offset = (new_offset + r.new_end) / 64;
+              }
+            }
+          }
+        }
+        live += copies.size();
+        copies.clear();
+        relocations.clear();
+      };
+
+      // Records can only be walked backwards from a known record boundary, as the tail is at the end of each record
+      std::vector<llfio::byte> buffer(1024 * 1024), bigrecord;
+      extent_type pos = end;
+      while(pos > begin)
+      {
+        const extent_type bufstart = (pos - begin > buffer.size()) ? (pos - buffer.size()) : begin;
+        _compactor.fh.read(bufstart, {{buffer.data(), (size_t)(pos - bufstart)}}).value();
+        extent_type e = pos;
+        while(e > bufstart)
+        {
+          const llfio::byte *recordend = buffer.data() + (e - bufstart);
+          const index::value_tail *vt = reinterpret_cast<const index::value_tail *>(recordend - sizeof(index::value_tail));
+          if(vt->transaction_counter == 0)
+          {
+            // Previously punched hole
+            e -= 64;
+            continue;
+          }
+          const bool removal = (vt->length == (uint64_t) -1);
+          const size_t recordlength = removal ? 64 : _pad_length(vt->length);
+          if(recordlength > e - begin)
+          {
+            _indexheader->magic = _badmagic;
+            throw corrupted_store();
+          }
+          const llfio::byte *record = recordend - recordlength;
+          if(e - recordlength < bufstart)
+          {
+            if(e != pos)
+            {
+              // Reread with this record at the top of the buffer
+              break;
+            }
+            // Record is bigger than the buffer
+            bigrecord.resize(recordlength);
+            _compactor.fh.read(e - recordlength, {{bigrecord.data(), recordlength}}).value();
+            record = bigrecord.data();
+          }
+          if(!removal)
+          {
+            // Is this record still referenced by any revision of its key?
+            bool referenced = false;
+            auto it = _index->find_shared(vt->key);
+            if(it != _index->end())
+            {
+              for(const auto &h : it->second.history)
+              {
+                if(h.transaction_counter == vt->transaction_counter && h.value_identifier == _mysmallfileidx && h.value_offset == e / 64)
+                {
+                  referenced = true;
+                  break;
+                }
+              }
+            }
+            if(referenced)
+            {
+              copies.insert(copies.end(), record, record + recordlength);
+              relocations.push_back({vt->key, vt->transaction_counter, e, copies.size()});
+            }
+          }
+          e -= recordlength;
+        }
+        const extent_type scanned = pos - e;
+        pos = e;
+        if(copies.size() >= buffer.size() || pos == begin)
+        {
+          relocate();
+        }
+        if(!pace(scanned))
+        {
+          // Asked to stop. Anything relocated is referenced at its new location, and the old range will be scanned again next time.
+          relocate();
+          return 0;
+        }
+      }
+      _compactor.compacted_until = end;
+      _compactor.live_bytes = live;
+
+      // Values fetched via mmaps refer directly to the old range, so give them a grace period before punching it
+      if(grace.count() > 0 && !pause_for(grace))
+      {
+        return end - begin - live;
+      }
+      while(_compactor.punched_until < _compactor.compacted_until)
+      {
+        // Punch in 1Mb aligned chunks
+        extent_type chunkend = std::min(_compactor.compacted_until, (_compactor.punched_until + 1024 * 1024) & ~(extent_type)(1024 * 1024 - 1));
+        _compactor.fh.zero({_compactor.punched_until, chunkend - _compactor.punched_until}).value();
+        extent_type punched = chunkend - _compactor.punched_until;
+        _compactor.punched_until = chunkend;
+        if(!pace(punched))
+        {
+          break;
+        }
+      }
+      return end - begin - live;
+    }
     void _openfiles(const llfio::path_handle &dir, llfio::file_handle::mode mode, llfio::file_handle::caching caching)
     {
       const llfio::file_handle::mode smallfilemode =
@@ -357,6 +626,7 @@ namespace key_value_store
     }
     ~basic_key_value_store()
     {
+      _stop_compactor();
       // Release my smallfile
       _smallfileguard.unlock();
       _mysmallfile.close().value();
@@ -396,6 +666,64 @@ namespace key_value_store
       _mmap_over_extension = overextension;
     }
 
+    /*! \brief Reclaims the space in my smallfile used by values no longer referenced by any revision
+    of any key, returning the number of bytes reclaimed.
+
+    Values still referenced which were appended since the last compaction are copied to the end of
+    my smallfile, the index is atomically repointed at the copies, and then holes are punched over
+    the old range using `file_handle::zero()`. All reading, copying and hole punching is paced
+    to `bytes_per_second` (zero means unlimited) so foreground transactions are not starved of i/o,
+    and the copies are appended as the group commit leader so they never interleave with a commit.
+    Holes are only punched once `grace` has passed, as any `keyvalue_info` fetched via mmaps refers
+    directly to the old values. Values appended by transactions still updating the index are left
+    for the next compaction. Does nothing if the store was opened read only.
+    */
+    llfio::file_handle::extent_type compact(size_t bytes_per_second = 0, std::chrono::milliseconds grace = std::chrono::milliseconds(0))
+    {
+      return _compact(bytes_per_second, grace, 0, false);
+    }
+    /*! \brief Starts a background thread which calls `compact()` whenever my smallfile has grown by
+    at least `min_growth`, or twice the live values copied by the previous compaction if that is more,
+    so each value is copied an amortised constant number of times.
+
+    Any exception thrown by the background compaction stops the thread, and is rethrown by `stop_compactor()`.
+    */
+    void start_compactor(size_t bytes_per_second = 64 * 1024 * 1024, std::chrono::milliseconds grace = std::chrono::seconds(1),
+                         llfio::file_handle::extent_type min_growth = 64 * 1024 * 1024)
+    {
+      if(_compactor.thread.joinable() || !_mysmallfile.is_valid())
+      {
+        return;
+      }
+      _compactor.stop = false;
+      _compactor.failure = nullptr;
+      _compactor.thread = std::thread([this, bytes_per_second, grace, min_growth] {
+        try
+        {
+          while(_compactor_sleep(std::chrono::seconds(1)))
+          {
+            _compact(bytes_per_second, grace, min_growth, true);
+          }
+        }
+        catch(...)
+        {
+          std::lock_guard<std::mutex> g(_compactor.lock);
+          _compactor.failure = std::current_exception();
+        }
+      });
+    }
+    //! Stops the background compactor, waiting for any compaction in progress to pause
+    void stop_compactor()
+    {
+      _stop_compactor();
+      if(_compactor.failure)
+      {
+        std::exception_ptr failure(std::move(_compactor.failure));
+        _compactor.failure = nullptr;
+        std::rethrow_exception(failure);
+      }
+    }
+
     //! Retrieve when keys were last updated by setting the second to the latest transaction counter.
     //! Note that counter will be `(uint64_t)-1` for any unknown keys. Never throws exceptions.
     void last_updated(span<std::pair<key_type, uint64_t>> keys) noexcept
@@ -579,6 +907,213 @@ namespace key_value_store
       }
     };
     std::vector<_item> _items;
+    // The update list, filled in as commit progresses
+    struct _toupdate_type
+    {
+      const key_type key;
+      const uint64_t old_transaction_counter;
+      const bool insertion, update, removal;
+      index::value_history::item history_item{};
+      index::open_hash_index::iterator it{};
+      _toupdate_type(key_type _key, uint64_t _old_transaction_counter, bool _insertion, bool _update, bool _removal)
+          : key(_key)
+          , old_transaction_counter(_old_transaction_counter)
+          , insertion(_insertion)
+          , update(_update)
+          , removal(_removal)
+      {
+      }
+    };
+    std::vector<_toupdate_type> _toupdate;
+    // Group commit state, protected by the parent's _commitlock
+    bool _values_written{false};
+    std::exception_ptr _values_write_failure;
+    llfio::file_handle::extent_type _values_offset{0};  // where the group's values begin in my smallfile
+
+    // Called by the group leader to append the values of every transaction in the group to my smallfile,
+    // returning where they begin
+    static llfio::file_handle::extent_type _write_values(basic_key_value_store *parent, span<transaction *> group)
+    {
+      // Atomically increment the transaction counter once per transaction in the group
+      for(transaction *tr : group)
+      {
+        uint64_t old_transaction_counter;
+        union
+        {
+          struct
+          {
+            uint64_t values_updated : 16;
+            uint64_t counter : 48;
+          };
+          uint64_t this_transaction_counter;
+        } _;
+        do
+        {
+          _.this_transaction_counter = old_transaction_counter = parent->_indexheader->transaction_counter.load(std::memory_order_acquire);
+          // Increment bottom 48 bits, letting it wrap if necessary
+          _.counter++;
+          _.values_updated = tr->_items.size();
+        } while(!parent->_indexheader->transaction_counter.compare_exchange_weak(old_transaction_counter, _.this_transaction_counter, std::memory_order_release,
+                                                                                 std::memory_order_relaxed));
+        for(auto &thisupdate : tr->_toupdate)
+        {
+          thisupdate.history_item.transaction_counter = _.this_transaction_counter;
+        }
+      }
+
+      if(!parent->_smallfiles.mapped.empty())
+      {
+        llfio::file_handle::extent_type original_length = parent->_mysmallfile.maximum_extent().value();
+        // How big does this map need to be?
+        size_t totalcommitsize = 0;
+        for(transaction *tr : group)
+        {
+          for(size_t n = 0; n < tr->_items.size(); n++)
+          {
+            totalcommitsize += tr->_toupdate[n].removal ? 64 : parent->_pad_length(tr->_items[n].towrite->size());
+          }
+        }
+        if(totalcommitsize >= 4096)
+        {
+          auto &mfh = parent->_smallfiles.mapped[parent->_mysmallfileidx];
+          llfio::file_handle::extent_type new_length = original_length + totalcommitsize;
+          if(new_length > mfh.capacity())
+          {
+            mfh.reserve(new_length + parent->_mmap_over_extension).value();
+          }
+          mfh.truncate(new_length).value();
+          llfio::byte *value = mfh.address() + original_length;
+          llfio::file_handle::extent_type value_offset = original_length;
+          for(transaction *tr : group)
+          {
+            for(size_t n = 0; n < tr->_items.size(); n++)
+            {
+              _toupdate_type &thisupdate = tr->_toupdate[n];
+              const transaction::_item &item = tr->_items[n];
+              const uint64_t this_transaction_counter = thisupdate.history_item.transaction_counter;
+              size_t totalwrite = 0;
+              if(thisupdate.removal)
+              {
+                totalwrite = 64;
+              }
+              else
+              {
+                memcpy(value, item.towrite->data(), item.towrite->size());
+                totalwrite = parent->_pad_length(item.towrite->size());
+              }
+              index::value_tail *vt = reinterpret_cast<index::value_tail *>(value + totalwrite - sizeof(index::value_tail));
+              vt->key = thisupdate.key;
+              vt->transaction_counter = this_transaction_counter;
+              if(thisupdate.removal)
+              {
+                vt->length = (uint64_t) -1;  // this key is being deleted
+                memset(&thisupdate.history_item, 0, sizeof(thisupdate.history_item));
+              }
+              else
+              {
+                vt->length = item.towrite->size();
+                index::value_history::item &history_item = thisupdate.history_item;
+                history_item.value_offset = (value_offset + totalwrite) / 64;
+                history_item.value_identifier = parent->_mysmallfileidx;
+                history_item.length = vt->length;
+              }
+              if(parent->_indexheader->contents_hashed)
+              {
+                vt->hash = QUICKCPPLIB_NAMESPACE::algorithm::hash::fast_hash::hash((char *) value, totalwrite);
+              }
+              value += totalwrite;
+              value_offset += totalwrite;
+            }
+          }
+          // Stores into the map are not durable until flushed, so issue one barrier for the whole group
+          if(parent->_mysmallfile.are_writes_durable())
+          {
+            mfh.barrier(llfio::file_handle::barrier_kind::wait_all).value();
+          }
+          return original_length;
+        }
+      }
+
+      // Gather append write all the group's items to my smallfile
+      const llfio::file_handle::extent_type original_length = parent->_mysmallfile.maximum_extent().value();
+      llfio::file_handle::extent_type value_offset = original_length;
+      assert((value_offset % 64) == 0);
+      // Issue as many gather buffers per syscall as the platform allows. POSIX guarantees at least 16.
+      // With tails, that's half that many items per syscall.
+      const size_t items_per_write = std::max(parent->_mysmallfile.max_buffers(), (size_t) 16) / 2;
+      size_t totalitems = 0;
+      for(transaction *tr : group)
+      {
+        totalitems += tr->_items.size();
+      }
+      std::vector<llfio::file_handle::const_buffer_type> reqs;
+      reqs.reserve(2 * std::min(totalitems, items_per_write));
+      std::vector<llfio::byte> tailbuffers(128 * std::min(totalitems, items_per_write));
+      size_t items_in_write = 0;
+      for(transaction *tr : group)
+      {
+        for(size_t n = 0; n < tr->_items.size(); n++)
+        {
+          llfio::byte *tailbuffer = tailbuffers.data() + 128 * items_in_write;
+          index::value_tail *vt = reinterpret_cast<index::value_tail *>(tailbuffer + 128 - sizeof(index::value_tail));
+          _toupdate_type &thisupdate = tr->_toupdate[n];
+          const transaction::_item &item = tr->_items[n];
+          vt->key = thisupdate.key;
+          vt->transaction_counter = thisupdate.history_item.transaction_counter;
+          size_t totalwrite = 0;
+          if(thisupdate.removal)
+          {
+            vt->length = (uint64_t) -1;  // this key is being deleted
+            totalwrite = 64;
+            reqs.push_back({tailbuffer + 64, 64});
+            if(parent->_indexheader->contents_hashed)
+            {
+              QUICKCPPLIB_NAMESPACE::algorithm::hash::fast_hash hasher;
+              memset(&vt->hash, 0, sizeof(vt->hash));
+              hasher.add((const char *) reqs.back().data(), reqs.back().size());
+              vt->hash = hasher.finalise();
+            }
+            memset(&thisupdate.history_item, 0, sizeof(thisupdate.history_item));
+          }
+          else
+          {
+            vt->length = item.towrite->size();
+            totalwrite = parent->_pad_length(item.towrite->size());
+            size_t tailbytes = totalwrite - item.towrite->size();
+            assert(tailbytes < 128);
+            reqs.push_back({(llfio::byte *) item.towrite->data(), item.towrite->size()});
+            reqs.push_back({tailbuffer + 128 - tailbytes, tailbytes});
+            if(parent->_indexheader->contents_hashed)
+            {
+              QUICKCPPLIB_NAMESPACE::algorithm::hash::fast_hash hasher;
+              memset(&vt->hash, 0, sizeof(vt->hash));
+              auto rit = reqs.end();
+              rit -= 2;
+              hasher.add((char *) rit->data(), rit->size());
+              ++rit;
+              hasher.add((char *) rit->data(), rit->size());
+              vt->hash = hasher.finalise();
+            }
+            index::value_history::item &history_item = thisupdate.history_item;
+            history_item.value_offset = (value_offset + totalwrite) / 64;
+            history_item.value_identifier = parent->_mysmallfileidx;
+            history_item.length = vt->length;
+          }
+          value_offset += totalwrite;
+          if(++items_in_write == items_per_write)
+          {
+            parent->_mysmallfile.write({reqs, 0}).value();
+            reqs.clear();
+            items_in_write = 0;
+          }
+        }
+      }
+      if(!reqs.empty())
+      {
+        parent->_mysmallfile.write({reqs, 0}).value();
+      }
+      return original_length;
+    }
 
   public:
     //! Start a new transaction
@@ -688,29 +1223,11 @@ namespace key_value_store
       _items.erase(std::remove_if(_items.begin(), _items.end(), [](const auto &item) { return !item.towrite.has_value() && !item.remove; }), _items.end());
       std::sort(_items.begin(), _items.end(), [](const _item &a, const _item &b) { return a.kvi.key < b.kvi.key; });
 
-      // The update list, filled in as we progress
-      struct toupdate_type
-      {
-        const key_type key;
-        const uint64_t old_transaction_counter;
-        const bool insertion, update, removal;
-        index::value_history::item history_item{};
-        index::open_hash_index::iterator it{};
-        toupdate_type(key_type _key, uint64_t _old_transaction_counter, bool _insertion, bool _update, bool _removal)
-            : key(_key)
-            , old_transaction_counter(_old_transaction_counter)
-            , insertion(_insertion)
-            , update(_update)
-            , removal(_removal)
-        {
-        }
-      };
-      std::vector<toupdate_type> toupdate;
-      toupdate.reserve(_items.size());
-      // Serialise multiple threads issuing commit using the same store
-      std::lock_guard<decltype(_parent->_commitlock)> commitlockguard(_parent->_commitlock);
-
       // Take out shared locks on all the items in my commit with existing values, early checking if we will abort
+      _toupdate.clear();
+      _toupdate.reserve(_items.size());
+      // The update list holds the exclusive locks taken below, so it must not outlive this commit
+      auto cleartoupdate = make_scope_exit([this]() noexcept { _toupdate.clear(); });
       std::vector<index::open_hash_index::const_iterator> shared_locks;
       shared_locks.reserve(_items.size());
       for(const auto &item : _items)
@@ -736,167 +1253,75 @@ namespace key_value_store
           }
         }
         assert(insertion + update + removal == 1);
-        toupdate.emplace_back(item.kvi.key, item.kvi.transaction_counter, insertion, update, removal);
-      }
-      // Atomically increment the transaction counter to set this latest transaction
-      uint64_t this_transaction_counter = 0;
-      {
-        uint64_t old_transaction_counter;
-        union
-        {
-          struct
-          {
-            uint64_t values_updated : 16;
-            uint64_t counter : 48;
-          };
-          uint64_t this_transaction_counter;
-        } _;
-        do
-        {
-          _.this_transaction_counter = old_transaction_counter = _parent->_indexheader->transaction_counter.load(std::memory_order_acquire);
-          // Increment bottom 48 bits, letting it wrap if necessary
-          _.counter++;
-          _.values_updated = _items.size();
-        } while(!_parent->_indexheader->transaction_counter.compare_exchange_weak(old_transaction_counter, _.this_transaction_counter,
-                                                                                  std::memory_order_release, std::memory_order_relaxed));
-        this_transaction_counter = _.this_transaction_counter;
+        _toupdate.emplace_back(item.kvi.key, item.kvi.transaction_counter, insertion, update, removal);
       }
 
-      bool items_written = false;
-      if(!_parent->_smallfiles.mapped.empty())
+      // Group commit. Join the queue of transactions waiting to append their values
+      // to my smallfile. If nobody is currently appending, become the group leader
+      // and append the values of everybody queued so far in a single gather write,
+      // so concurrent commits from many threads cost one write (and one barrier
+      // if durable) per group rather than one per transaction.
       {
-        llfio::file_handle::extent_type original_length = _parent->_mysmallfile.maximum_extent().value();
-        // How big does this map need to be?
-        size_t totalcommitsize = 0;
-        for(size_t n = 0; n < _items.size(); n++)
+        std::unique_lock<decltype(_parent->_commitlock)> commitlockguard(_parent->_commitlock);
+        _values_written = false;
+        _values_write_failure = nullptr;
+        _parent->_commitqueue.push_back(this);
+        while(!_values_written)
         {
-          toupdate_type &thisupdate = toupdate[n];
-          const transaction::_item &item = _items[n];
-          totalcommitsize += thisupdate.removal ? 64 : _parent->_pad_length(item.towrite->size());
-        }
-        if(totalcommitsize >= 4096)
-        {
-          auto &mfh = _parent->_smallfiles.mapped[_parent->_mysmallfileidx];
-          llfio::file_handle::extent_type new_length = original_length + totalcommitsize;
-          if(new_length > mfh.capacity())
-          {
-            mfh.reserve(new_length + _parent->_mmap_over_extension).value();
-          }
-          mfh.truncate(new_length).value();
-          llfio::byte *value = mfh.address() + original_length;
-          llfio::file_handle::extent_type value_offset = original_length;
-          for(size_t n = 0; n < _items.size(); n++)
+          if(!_parent->_commitleader)
           {
-            toupdate_type &thisupdate = toupdate[n];
-            const transaction::_item &item = _items[n];
-            size_t totalwrite = 0;
-            if(thisupdate.removal)
-            {
-              totalwrite = 64;
-            }
-            else
-            {
-              memcpy(value, item.towrite->data(), item.towrite->size());
-              totalwrite = _parent->_pad_length(item.towrite->size());
-            }
-            index::value_tail *vt = reinterpret_cast<index::value_tail *>(value + totalwrite - sizeof(index::value_tail));
-            vt->key = thisupdate.key;
-            vt->transaction_counter = this_transaction_counter;
-            if(thisupdate.removal)
+            _parent->_commitleader = true;
+            std::vector<transaction *> group;
+            group.swap(_parent->_commitqueue);
+            commitlockguard.unlock();
+            std::exception_ptr failure;
+            llfio::file_handle::extent_type values_offset = 0;
+            try
             {
-              vt->length = (uint64_t) -1;  // this key is being deleted
-              memset(&thisupdate.history_item, 0, sizeof(thisupdate.history_item));
+              values_offset = _write_values(_parent, group);
             }
-            else
+            catch(...)
             {
-              vt->length = item.towrite->size();
-              index::value_history::item &history_item = thisupdate.history_item;
-              history_item.transaction_counter = this_transaction_counter;
-              history_item.value_offset = (value_offset + totalwrite) / 64;
-              history_item.value_identifier = _parent->_mysmallfileidx;
-              history_item.length = vt->length;
+              failure = std::current_exception();
             }
-            if(_parent->_indexheader->contents_hashed)
+            commitlockguard.lock();
+            for(transaction *tr : group)
             {
-              vt->hash = QUICKCPPLIB_NAMESPACE::algorithm::hash::fast_hash::hash((char *) value, totalwrite);
-            }
-            value += totalwrite;
-            value_offset += totalwrite;
-          }
-          items_written = true;
-        }
-      }
-      if(!items_written)
-      {
-        // Gather append write all my items to my smallfile
-        llfio::file_handle::extent_type value_offset = _parent->_mysmallfile.maximum_extent().value();
-        assert((value_offset % 64) == 0);
-        // POSIX guarantees that at least 16 gather buffers can be written in a single shot
-        std::vector<llfio::file_handle::const_buffer_type> reqs;
-        reqs.reserve(16);
-        // With tails, that's eight items per syscall
-        llfio::byte tailbuffers[8][128];
-        memset(tailbuffers, 0, sizeof(tailbuffers));
-        for(size_t n = 0; n < _items.size(); n++)
-        {
-          llfio::byte *tailbuffer = tailbuffers[n % 8];
-          index::value_tail *vt = reinterpret_cast<index::value_tail *>(tailbuffer + 128 - sizeof(index::value_tail));
-          toupdate_type &thisupdate = toupdate[n];
-          const transaction::_item &item = _items[n];
-          vt->key = thisupdate.key;
-          vt->transaction_counter = this_transaction_counter;
-          size_t totalwrite = 0;
-          if(thisupdate.removal)
-          {
-            vt->length = (uint64_t) -1;  // this key is being deleted
-            totalwrite = 64;
-            reqs.push_back({tailbuffer + 64, 64});
-            if(_parent->_indexheader->contents_hashed)
-            {
-              QUICKCPPLIB_NAMESPACE::algorithm::hash::fast_hash hasher;
-              memset(&vt->hash, 0, sizeof(vt->hash));
-              hasher.add((const char *) reqs.back().data(), reqs.back().size());
-              vt->hash = hasher.finalise();
+              tr->_values_write_failure = failure;
+              tr->_values_written = true;
+              if(!failure)
+              {
+                // Keep the compactor away from these values until this transaction has updated the index
+                tr->_values_offset = values_offset;
+                _parent->_commitsindexing.push_back(values_offset);
+              }
             }
-            memset(&thisupdate.history_item, 0, sizeof(thisupdate.history_item));
+            _parent->_commitleader = false;
+            // Wake the group, and anybody who queued meanwhile so one of them can lead the next group
+            _parent->_commitcond.notify_all();
           }
           else
           {
-            vt->length = item.towrite->size();
-            totalwrite = _parent->_pad_length(item.towrite->size());
-            size_t tailbytes = totalwrite - item.towrite->size();
-            assert(tailbytes < 128);
-            reqs.push_back({(llfio::byte *) item.towrite->data(), item.towrite->size()});
-            reqs.push_back({tailbuffer + 128 - tailbytes, tailbytes});
-            if(_parent->_indexheader->contents_hashed)
-            {
-              QUICKCPPLIB_NAMESPACE::algorithm::hash::fast_hash hasher;
-              memset(&vt->hash, 0, sizeof(vt->hash));
-              auto rit = reqs.end();
-              rit -= 2;
-              hasher.add((char *) rit->data(), rit->size());
-              ++rit;
-              hasher.add((char *) rit->data(), rit->size());
-              vt->hash = hasher.finalise();
-            }
-            index::value_history::item &history_item = thisupdate.history_item;
-            history_item.transaction_counter = this_transaction_counter;
-            history_item.value_offset = (value_offset + totalwrite) / 64;
-            history_item.value_identifier = _parent->_mysmallfileidx;
-            history_item.length = vt->length;
-          }
-          value_offset += totalwrite;
-          if((n % 8) == 7)
-          {
-            _parent->_mysmallfile.write({reqs, 0}).value();
-            reqs.clear();
+            _parent->_commitcond.wait(commitlockguard);
           }
         }
-        if(!reqs.empty())
+        if(_values_write_failure)
         {
-          _parent->_mysmallfile.write({reqs, 0}).value();
+          std::rethrow_exception(_values_write_failure);
         }
       }
+      // However we leave, we are done with the index, so the compactor may scan my values
+      auto indexingguard = make_scope_exit([this]() noexcept {
+        std::lock_guard<decltype(_parent->_commitlock)> commitlockguard(_parent->_commitlock);
+        auto &commitsindexing = _parent->_commitsindexing;
+        auto it = std::find(commitsindexing.begin(), commitsindexing.end(), _values_offset);
+        assert(it != commitsindexing.end());
+        if(it != commitsindexing.end())
+        {
+          commitsindexing.erase(it);
+        }
+      });
+      auto &toupdate = _toupdate;
 
       // Release all the shared locks on the existing items we are about to update
       shared_locks.clear();
@@ -905,7 +1330,7 @@ namespace key_value_store
         throw corrupted_store();
       // Remove any newly inserted keys if we abort
       auto removeinserted = make_scope_exit([this, &toupdate]() noexcept {
-        for(auto updit = toupdate.rend(); updit != toupdate.rbegin(); ++updit)
+        for(auto updit = toupdate.rbegin(); updit != toupdate.rend(); ++updit)
         {
           if(updit->insertion && updit->it != _parent->_index->end())
           {
@@ -914,12 +1339,14 @@ namespace key_value_store
         }
       });
       // Take exclusive locks on all items in this transaction, inserting new keys if necessary
-      for(toupdate_type &item : toupdate)
+      for(_toupdate_type &item : toupdate)
       {
         auto it = _parent->_index->find_exclusive(item.key);
         if(it != _parent->_index->end())
         {
-          if(item.insertion || (item.update && it->second.history[0].transaction_counter != item.old_transaction_counter))
+          // Unsafe updates have no base revision to compare against
+          if(item.insertion ||
+             (item.update && item.old_transaction_counter != (uint64_t) -1 && it->second.history[0].transaction_counter != item.old_transaction_counter))
           {
             // Item has changed since transaction begun
             throw transaction_aborted(item.key);
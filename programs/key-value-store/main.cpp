@@ -24,7 +24,9 @@ Distributed under the Boost Software License, Version 1.0.
 
 #include "include/key_value_store.hpp"
 
+#include <atomic>
 #include <iostream>
+#include <thread>
 
 namespace stackoverflow
 {
@@ -89,10 +91,8 @@ namespace stackoverflow
   }
 }  // namespace stackoverflow
 
-void benchmark(key_value_store::basic_key_value_store &store, const char *desc)
+static const std::vector<std::pair<uint64_t, std::string>> &benchmark_values()
 {
-  std::cout << "\n" << desc << ":" << std::endl;
-  // Write 1M values and see how long it takes
   static std::vector<std::pair<uint64_t, std::string>> values;
   if(values.empty())
   {
@@ -103,6 +103,14 @@ void benchmark(key_value_store::basic_key_value_store &store, const char *desc)
       values.push_back({100 + n, randomvalue});
     }
   }
+  return values;
+}
+
+void benchmark(key_value_store::basic_key_value_store &store, const char *desc)
+{
+  std::cout << "\n" << desc << ":" << std::endl;
+  // Write 1M values and see how long it takes
+  auto &values = benchmark_values();
   std::cout << "  Inserting 1M key-value pairs ..." << std::endl;
   {
     auto begin = std::chrono::high_resolution_clock::now();
@@ -143,6 +151,177 @@ void benchmark(key_value_store::basic_key_value_store &store, const char *desc)
   }
 }
 
+// Insert 1M values from many threads at once, which exercises group commit
+void benchmark_concurrent(key_value_store::basic_key_value_store &store, const char *desc, size_t threads)
+{
+  std::cout << "\n" << desc << " with " << threads << " threads:" << std::endl;
+  auto &values = benchmark_values();
+  std::cout << "  Inserting 1M key-value pairs ..." << std::endl;
+  auto begin = std::chrono::high_resolution_clock::now();
+  std::vector<std::thread> workers;
+  for(size_t t = 0; t < threads; t++)
+  {
+    workers.emplace_back([&, t] {
+      // Each thread inserts every threads-th block of 1024 values
+      for(size_t n = t * 1024; n < values.size(); n += threads * 1024)
+      {
+        key_value_store::transaction tr(store);
+        for(size_t m = 0; m < 1024; m++)
+        {
+          if(n + m >= values.size())
+            break;
+          auto &i = values[n + m];
+          tr.update_unsafe(i.first, i.second);
+        }
+        tr.commit();
+      }
+    });
+  }
+  for(auto &i : workers)
+  {
+    i.join();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+  std::cout << "  Inserted at " << (1000000000ULL / diff) << " items per sec" << std::endl;
+  for(auto &i : values)
+  {
+    if(!store.find(i.first))
+    {
+      std::cerr << "FAILURE: Key " << i.first << " was not found!" << std::endl;
+      abort();
+    }
+  }
+}
+
+// Many threads increment the same counter, retrying when their transaction aborts.
+// If conflict detection works, no increments are lost.
+void test_concurrent_updates(key_value_store::basic_key_value_store &store, size_t threads, size_t increments)
+{
+  {
+    key_value_store::transaction tr(store);
+    tr.update_unsafe(77, "0");
+    tr.commit();
+  }
+  std::vector<std::thread> workers;
+  for(size_t t = 0; t < threads; t++)
+  {
+    workers.emplace_back([&] {
+      for(size_t n = 0; n < increments; n++)
+      {
+        for(;;)
+        {
+          key_value_store::transaction tr(store);
+          auto v = tr.fetch(77);
+          std::string value = std::to_string(std::stoull(std::string(v.data(), v.size())) + 1);
+          tr.update(77, value);
+          try
+          {
+            tr.commit();
+            break;
+          }
+          catch(const key_value_store::transaction_aborted &)
+          {
+          }
+        }
+      }
+    });
+  }
+  for(auto &i : workers)
+  {
+    i.join();
+  }
+  auto kvi = store.find(77);
+  std::string value(kvi.value.data(), kvi.value.size());
+  if(value != std::to_string(threads * increments))
+  {
+    std::cerr << "FAILURE: Key 77 has value " << value << " after " << (threads * increments) << " concurrent increments!" << std::endl;
+  }
+  else
+  {
+    std::cout << "Key 77 has value " << value << " after " << (threads * increments) << " concurrent increments" << std::endl;
+  }
+}
+
+// Repeatedly update the same keys, then check they survive compaction
+void test_compaction()
+{
+  key_value_store::basic_key_value_store store("teststore", 10000);
+  std::vector<std::string> latest(1000);
+  for(size_t round = 0; round < 20; round++)
+  {
+    key_value_store::transaction tr(store);
+    for(size_t n = 0; n < latest.size(); n++)
+    {
+      latest[n] = LLFIO_V2_NAMESPACE::utils::random_string(512 / 2);
+      tr.update_unsafe(1000 + n, latest[n]);
+    }
+    tr.commit();
+  }
+  auto reclaimed = store.compact();
+  for(size_t n = 0; n < latest.size(); n++)
+  {
+    auto kvi = store.find(1000 + n);
+    if(!kvi || std::string(kvi.value.data(), kvi.value.size()) != latest[n])
+    {
+      std::cerr << "FAILURE: Key " << (1000 + n) << " has the wrong value after compaction!" << std::endl;
+      return;
+    }
+  }
+  std::cout << "Compaction reclaimed " << reclaimed << " bytes" << std::endl;
+}
+
+// Many threads commit while others compact, then check every key has its latest value
+void test_concurrent_compaction(size_t threads, size_t rounds)
+{
+  key_value_store::basic_key_value_store store("teststore", 10000);
+  const size_t keys_per_thread = 100;
+  std::vector<std::vector<std::string>> latest(threads, std::vector<std::string>(keys_per_thread));
+  std::atomic<bool> done(false);
+  std::thread compactor([&] {
+    while(!done)
+    {
+      store.compact();
+    }
+  });
+  std::vector<std::thread> workers;
+  for(size_t t = 0; t < threads; t++)
+  {
+    workers.emplace_back([&, t] {
+      for(size_t round = 0; round < rounds; round++)
+      {
+        key_value_store::transaction tr(store);
+        for(size_t n = 0; n < keys_per_thread; n++)
+        {
+          latest[t][n] = LLFIO_V2_NAMESPACE::utils::random_string(256 / 2);
+          tr.update_unsafe(2000 + t * keys_per_thread + n, latest[t][n]);
+        }
+        tr.commit();
+      }
+    });
+  }
+  for(auto &i : workers)
+  {
+    i.join();
+  }
+  done = true;
+  compactor.join();
+  store.compact();
+  for(size_t t = 0; t < threads; t++)
+  {
+    for(size_t n = 0; n < keys_per_thread; n++)
+    {
+      auto kvi = store.find(2000 + t * keys_per_thread + n);
+      if(!kvi || std::string(kvi.value.data(), kvi.value.size()) != latest[t][n])
+      {
+        std::cerr << "FAILURE: Key " << (2000 + t * keys_per_thread + n) << " has the wrong value after concurrent compaction!" << std::endl;
+        return;
+      }
+    }
+  }
+  std::cout << "All " << (threads * keys_per_thread) << " keys have their latest value after concurrent compaction" << std::endl;
+}
+
 int main()
 {
 #ifdef _WIN32
@@ -215,6 +394,11 @@ int main()
         }
       }
     }
+    // test concurrent users
+    {
+      key_value_store::basic_key_value_store store("teststore", 10);
+      test_concurrent_updates(store, 4, 1000);
+    }
     // test read only
     {
       key_value_store::basic_key_value_store store("teststore");
@@ -233,6 +417,16 @@ int main()
       std::error_code ec;
       LLFIO_V2_NAMESPACE::filesystem::remove_all("teststore", ec);
     }
+    test_compaction();
+    {
+      std::error_code ec;
+      LLFIO_V2_NAMESPACE::filesystem::remove_all("teststore", ec);
+    }
+    test_concurrent_compaction(4, 50);
+    {
+      std::error_code ec;
+      LLFIO_V2_NAMESPACE::filesystem::remove_all("teststore", ec);
+    }
     {
       key_value_store::basic_key_value_store store("teststore", 2000000);
       benchmark(store, "no integrity, no durability, read + append");
@@ -241,6 +435,14 @@ int main()
       std::error_code ec;
       LLFIO_V2_NAMESPACE::filesystem::remove_all("teststore", ec);
     }
+    {
+      key_value_store::basic_key_value_store store("teststore", 2000000);
+      benchmark_concurrent(store, "no integrity, no durability, read + append", std::max(std::thread::hardware_concurrency(), 2u));
+    }
+    {
+      std::error_code ec;
+      LLFIO_V2_NAMESPACE::filesystem::remove_all("teststore", ec);
+    }
     {
       key_value_store::basic_key_value_store store("teststore", 2000000, true);
       benchmark(store, "integrity, no durability, read + append");
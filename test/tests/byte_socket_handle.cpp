@@ -514,7 +514,7 @@ static inline void TestNonBlockingSocketHandles()
 #endif
 }
 
-#if LLFIO_ENABLE_TEST_IO_MULTIPLEXERS
+#if LLFIO_ENABLE_TEST_IO_MULTIPLEXERS || defined(__linux__)
 static inline void TestMultiplexedSocketHandles()
 {
 #ifndef LLFIO_EXCLUDE_NETWORKING
@@ -698,6 +698,21 @@ static inline void TestMultiplexedSocketHandles()
   test_multiplexer(llfio::test::multiplexer_win_iocp(2, false).value());
   std::cout << "\nMultithreaded IOCP, reactor completions:\n";
   test_multiplexer(llfio::test::multiplexer_win_iocp(2, true).value());
+#elif defined(__linux__)
+  std::cout << "\nSingle threaded epoll:\n";
+  test_multiplexer(llfio::multiplexer_linux_epoll(1).value());
+  std::cout << "\nMultithreaded epoll:\n";
+  test_multiplexer(llfio::multiplexer_linux_epoll(2).value());
+  auto multiplexer = llfio::multiplexer_linux_io_uring(1, false);
+  if(!multiplexer)
+  {
+    std::cout << "\nNOTE: io_uring is not available on this kernel, skipping this test." << std::endl;
+    return;
+  }
+  std::cout << "\nSingle threaded io_uring:\n";
+  test_multiplexer(std::move(multiplexer).value());
+  std::cout << "\nMultithreaded io_uring:\n";
+  test_multiplexer(llfio::multiplexer_linux_io_uring(2, false).value());
 #else
 #error Not implemented yet
 #endif
@@ -832,6 +847,21 @@ static inline void TestCoroutinedSocketHandles()
   test_multiplexer(llfio::test::multiplexer_win_iocp(2, false).value());
   std::cout << "\nMultithreaded IOCP, reactor completions:\n";
   test_multiplexer(llfio::test::multiplexer_win_iocp(2, true).value());
+#elif defined(__linux__)
+  std::cout << "\nSingle threaded epoll:\n";
+  test_multiplexer(llfio::multiplexer_linux_epoll(1).value());
+  std::cout << "\nMultithreaded epoll:\n";
+  test_multiplexer(llfio::multiplexer_linux_epoll(2).value());
+  auto multiplexer = llfio::multiplexer_linux_io_uring(1, false);
+  if(!multiplexer)
+  {
+    std::cout << "\nNOTE: io_uring is not available on this kernel, skipping this test." << std::endl;
+    return;
+  }
+  std::cout << "\nSingle threaded io_uring:\n";
+  test_multiplexer(std::move(multiplexer).value());
+  std::cout << "\nMultithreaded io_uring:\n";
+  test_multiplexer(llfio::multiplexer_linux_io_uring(2, false).value());
 #else
 #error Not implemented yet
 #endif
@@ -1009,7 +1039,7 @@ KERNELTEST_TEST_KERNEL(integration, llfio, socket_handle, blocking, "Tests that
                        TestBlockingSocketHandles())
 KERNELTEST_TEST_KERNEL(integration, llfio, socket_handle, nonblocking, "Tests that nonblocking llfio::byte_socket_handle works as expected",
                        TestNonBlockingSocketHandles())
-#if LLFIO_ENABLE_TEST_IO_MULTIPLEXERS
+#if LLFIO_ENABLE_TEST_IO_MULTIPLEXERS || defined(__linux__)
 KERNELTEST_TEST_KERNEL(integration, llfio, socket_handle, multiplexed, "Tests that multiplexed llfio::byte_socket_handle works as expected",
                        TestMultiplexedSocketHandles())
 #if LLFIO_ENABLE_COROUTINES
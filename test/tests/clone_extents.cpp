@@ -214,6 +214,115 @@ static inline void TestCloneOrCopyFileWhole()
   }
 }
 
+static inline void TestCloneOrCopyPipelined()
+{
+  static constexpr size_t files = 32;
+  static constexpr size_t max_file_extent = (size_t) 8 * 1024 * 1024;
+  namespace llfio = LLFIO_V2_NAMESPACE;
+  using QUICKCPPLIB_NAMESPACE::algorithm::small_prng::small_prng;
+  const auto &tempdirh = llfio::path_discovery::storage_backed_temporary_files_directory();
+  small_prng rand;
+  std::vector<llfio::mapped_file_handle> srcfhs;
+  std::vector<std::string> destleafs;
+  std::vector<llfio::algorithm::clone_or_copy_request> requests;
+  for(size_t n = 0; n < files; n++)
+  {
+    // Half the sources are multiplexable, the other half are copied by kernel threads
+    srcfhs.push_back(llfio::mapped_file_handle::mapped_uniquely_named_file(0, tempdirh, llfio::mapped_file_handle::mode::write,
+                                                                           llfio::mapped_file_handle::caching::all,
+                                                                           llfio::mapped_file_handle::flag::unlink_on_first_close |
+                                                                           ((n & 1) ? llfio::mapped_file_handle::flag::multiplexable : llfio::mapped_file_handle::flag::none))
+                     .value());
+    auto &srcfh = srcfhs.back();
+    auto maximum_extent = rand() % max_file_extent;
+    srcfh.truncate(maximum_extent).value();
+    // Leave holes in some of the sources
+    for(size_t offset = 0; offset < maximum_extent; offset += 65536)
+    {
+      if((n & 2) && (rand() & 3) == 0)
+      {
+        continue;
+      }
+      llfio::byte buffer[65536];
+      memset(&buffer, (int) (n + offset / 65536) | 1, sizeof(buffer));
+      srcfh.write(offset, {{buffer, std::min(sizeof(buffer), (size_t) (maximum_extent - offset))}}).value();
+    }
+    destleafs.push_back(llfio::utils::random_string(32) + ".random");
+  }
+  for(size_t n = 0; n < files; n++)
+  {
+    requests.push_back({&srcfhs[n], &tempdirh, destleafs[n]});
+  }
+  // Force the copy, else the pipeline is bypassed on filing systems which can clone
+  auto total = llfio::algorithm::clone_or_copy(requests, 4 * 1024 * 1024, nullptr, true, true).value();
+  llfio::file_handle::extent_type expected = 0;
+  for(size_t n = 0; n < files; n++)
+  {
+    BOOST_REQUIRE(requests[n].copied);
+    expected += requests[n].copied.value();
+    BOOST_CHECK(srcfhs[n].multiplexer() == nullptr);
+    auto destfh = llfio::mapped_file_handle::mapped_file(tempdirh, destleafs[n], llfio::mapped_file_handle::mode::write,
+                                                         llfio::mapped_file_handle::creation::open_existing, llfio::mapped_file_handle::caching::all,
+                                                         llfio::mapped_file_handle::flag::unlink_on_first_close)
+                  .value();
+    const auto maximum_extent = srcfhs[n].maximum_extent().value();
+    BOOST_REQUIRE(maximum_extent == destfh.maximum_extent().value());
+    BOOST_CHECK(0 == memcmp(srcfhs[n].address(), destfh.address(), (size_t) maximum_extent));
+  }
+  BOOST_CHECK(total == expected);
+  std::cout << "Pipelined copy of " << files << " files copied " << total << " bytes." << std::endl;
+}
+
+static inline void TestParallelCloneExtents()
+{
+  static constexpr size_t rounds = 8;
+  static constexpr size_t max_file_extent = (size_t) 100 * 1024 * 1024;
+  namespace llfio = LLFIO_V2_NAMESPACE;
+  using QUICKCPPLIB_NAMESPACE::algorithm::small_prng::small_prng;
+  const auto &tempdirh = llfio::path_discovery::storage_backed_temporary_files_directory();
+  small_prng rand;
+  for(size_t round = 0; round < rounds; round++)
+  {
+    llfio::mapped_file_handle handles[2];
+    llfio::mapped_file_handle::extent_type maximum_extents[2];
+    for(size_t h = 0; h < 2; h++)
+    {
+      handles[h] =
+      llfio::mapped_file_handle::mapped_uniquely_named_file(0, tempdirh, llfio::mapped_file_handle::mode::write, llfio::mapped_file_handle::caching::all,
+                                                            llfio::mapped_file_handle::flag::unlink_on_first_close)
+      .value();
+      maximum_extents[h] = max_file_extent / 2 + rand() % (max_file_extent / 2);
+      handles[h].truncate(maximum_extents[h]).value();
+      // Sparsely allocate both, so the destination has data where the source has holes
+      for(llfio::file_handle::extent_type offset = 0; offset < maximum_extents[h]; offset += 1024 * 1024)
+      {
+        if(rand() & 1)
+        {
+          continue;
+        }
+        llfio::byte buffer[65536];
+        memset(buffer, (int) (h * 128 + (offset >> 20)) | 1, sizeof(buffer));
+        handles[h].write(offset, {{buffer, (size_t) std::min<llfio::file_handle::extent_type>(sizeof(buffer), maximum_extents[h] - offset)}}).value();
+      }
+    }
+    const auto threads = (size_t) 1 << (round % 4);
+    std::cout << "\nRound " << (round + 1) << ": Cloning " << maximum_extents[0] << " bytes into a file of " << maximum_extents[1] << " bytes using "
+              << threads << " threads ..." << std::endl;
+    auto cloned =
+    llfio::algorithm::parallel_clone_extents_to(handles[0], {0, maximum_extents[0]}, handles[1], 0, threads, 4 * 1024 * 1024, {}, (round & 1) != 0).value();
+    BOOST_CHECK(cloned.offset == 0);
+    BOOST_CHECK(cloned.length == maximum_extents[0]);
+    BOOST_REQUIRE(handles[1].maximum_extent().value() == std::max(maximum_extents[0], maximum_extents[1]));
+    llfio::stat_t src_stat(nullptr), dest_stat(nullptr);
+    src_stat.fill(handles[0]).value();
+    dest_stat.fill(handles[1]).value();
+    std::cout << "   Source file has " << src_stat.st_blocks << " blocks allocated. Destination file has " << dest_stat.st_blocks << " blocks allocated."
+              << std::endl;
+    handles[1].update_map().value();
+    BOOST_CHECK(0 == memcmp(handles[0].address(), handles[1].address(), (size_t) maximum_extents[0]));
+  }
+}
+
 #if 0
 static inline void TestCloneOrCopyTree()
 {
@@ -306,3 +415,7 @@ KERNELTEST_TEST_KERNEL(integration, llfio, algorithm, clone_extents, "Tests that
                        TestCloneExtents())
 KERNELTEST_TEST_KERNEL(integration, llfio, algorithm, clone_or_copy_file_whole,
                        "Tests that llfio::algorithm::clone_or_copy(file_handle) of whole files works as expected", TestCloneOrCopyFileWhole())
+KERNELTEST_TEST_KERNEL(integration, llfio, algorithm, clone_or_copy_pipelined,
+                       "Tests that llfio::algorithm::clone_or_copy() of many files through the copy pipeline works as expected", TestCloneOrCopyPipelined())
+KERNELTEST_TEST_KERNEL(integration, llfio, algorithm, parallel_clone_extents,
+                       "Tests that llfio::algorithm::parallel_clone_extents_to() works as expected", TestParallelCloneExtents())
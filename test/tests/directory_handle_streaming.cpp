@@ -0,0 +1,90 @@
+/* Integration test kernel for whether streaming directory enumeration works
+(C) 2026 agent <agent@local>
+File Created: Oct 2026
+
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License in the accompanying file
+Licence.txt or at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+
+Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file Licence.txt or copy at
+          http://www.boost.org/LICENSE_1_0.txt)
+*/
+
+#include "../test_kernel_decl.hpp"
+
+#include <unordered_set>
+
+static inline void TestDirectoryHandleStreaming()
+{
+  using namespace LLFIO_V2_NAMESPACE;
+  static constexpr size_t ENTRIES = 10000;
+  auto dirh = directory_handle::temp_directory().value();
+  for(size_t n = 0; n < ENTRIES; n++)
+  {
+    auto leaf = std::to_string(n);
+    file_handle::file(dirh, leaf, file_handle::mode::write, file_handle::creation::if_needed).value();
+  }
+  std::vector<directory_entry> entries(37);
+  directory_handle::buffers_type buffers(entries);
+  auto r = dirh.read({std::move(buffers), directory_handle::flags::streaming});
+  if(!r && r.error() == errc::operation_not_supported)
+  {
+    std::cout << "Streaming directory enumeration is not supported on this platform, skipping." << std::endl;
+    (void) algorithm::reduce(std::move(dirh)).value();
+    return;
+  }
+  buffers = std::move(r).value();
+  std::unordered_set<std::string> seen;
+  size_t batches = 0, duplicates = 0;
+  for(;;)
+  {
+    batches++;
+    BOOST_CHECK(!buffers.is_snapshot());
+    BOOST_CHECK(buffers.size() <= entries.size());
+    for(auto &i : buffers)
+    {
+      if(!seen.insert(i.leafname.path().string()).second)
+      {
+        duplicates++;
+      }
+    }
+    if(buffers.done())
+    {
+      break;
+    }
+    // Reuse the same buffers, which carries the cursor and kernel buffer forwards
+    buffers = dirh.read({directory_handle::buffers_type(entries, std::move(buffers)), directory_handle::flags::streaming}).value();
+  }
+  std::cout << "Streamed " << seen.size() << " entries in " << batches << " batches with " << duplicates << " duplicates." << std::endl;
+  BOOST_CHECK(seen.size() == ENTRIES);
+  BOOST_CHECK(duplicates == 0);
+  BOOST_CHECK(batches >= ENTRIES / entries.size());
+
+  // Resetting the cursor restarts the enumeration
+  buffers.set_cursor(0);
+  buffers = dirh.read({directory_handle::buffers_type(entries, std::move(buffers)), directory_handle::flags::streaming}).value();
+  BOOST_CHECK(buffers.size() == entries.size());
+  BOOST_CHECK(!buffers.done());
+  BOOST_CHECK(buffers.cursor() != 0);
+
+  // Reusing the buffers for a snapshot read reports a snapshot again
+  buffers = dirh.read({directory_handle::buffers_type(entries, std::move(buffers))}).value();
+  BOOST_CHECK(buffers.is_snapshot());
+
+  (void) algorithm::reduce(std::move(dirh)).value();
+}
+
+KERNELTEST_TEST_KERNEL(integration, llfio, directory_handle, streaming, "Tests that directory_handle::read() with flags::streaming works as expected",
+                       TestDirectoryHandleStreaming())
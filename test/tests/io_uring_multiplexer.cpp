@@ -0,0 +1,105 @@
+/* Integration test kernel for whether the io_uring multiplexer works
+(C) 2026 agent <agent@local>
+File Created: Oct 2026
+
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License in the accompanying file
+Licence.txt or at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+
+Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file Licence.txt or copy at
+          http://www.boost.org/LICENSE_1_0.txt)
+*/
+
+#include "../test_kernel_decl.hpp"
+
+#ifdef __linux__
+#include <signal.h>
+#include <sys/resource.h>
+#endif
+
+static inline void TestIoUringShortWriteInChain()
+{
+#ifdef __linux__
+  static constexpr size_t file_size_limit = 65536;
+  namespace llfio = LLFIO_V2_NAMESPACE;
+  auto multiplexer = llfio::multiplexer_linux_io_uring(1, false);
+  if(!multiplexer)
+  {
+    std::cout << "\nNOTE: io_uring is not available on this kernel, skipping this test." << std::endl;
+    return;
+  }
+  auto fh = llfio::file_handle::temp_inode(llfio::path_discovery::storage_backed_temporary_files_directory(), llfio::file_handle::mode::write,
+                                           llfio::file_handle::caching::temporary, llfio::file_handle::flag::multiplexable)
+            .value();
+  fh.set_multiplexer(multiplexer.value().get()).value();
+  const auto state_bytes = multiplexer.value()->io_state_requirements().first;
+  auto write_storage = std::make_unique<llfio::byte[]>(state_bytes), barrier_storage = std::make_unique<llfio::byte[]>(state_bytes);
+  std::vector<llfio::byte> buffer(file_size_limit * 2, llfio::to_byte('a'));
+
+  // Writes past RLIMIT_FSIZE are short, with the remainder failing with EFBIG
+  struct rlimit oldlimit, newlimit;
+  BOOST_REQUIRE(-1 != ::getrlimit(RLIMIT_FSIZE, &oldlimit));
+  newlimit = oldlimit;
+  newlimit.rlim_cur = file_size_limit;
+  auto oldsighandler = ::signal(SIGXFSZ, SIG_IGN);
+  BOOST_REQUIRE(-1 != ::setrlimit(RLIMIT_FSIZE, &newlimit));
+  auto unlimit = llfio::make_scope_exit([&]() noexcept {
+    ::setrlimit(RLIMIT_FSIZE, &oldlimit);
+    ::signal(SIGXFSZ, oldsighandler);
+  });
+
+  // A chain without deadlines upon a seekable handle is linked in the kernel, whereas
+  // one with deadlines is emulated. Both must complete the same way.
+  for(bool emulated : {false, true})
+  {
+    std::cout << "\nShort write in a chain " << (emulated ? "emulated" : "linked in the kernel") << " ..." << std::endl;
+    fh.truncate(0).value();
+    const llfio::deadline d = emulated ? llfio::deadline(std::chrono::seconds(30)) : llfio::deadline();
+    llfio::file_handle::const_buffer_type wbuf(buffer.data(), buffer.size());
+    auto *write_state = multiplexer.value()->construct({write_storage.get(), state_bytes}, &fh, nullptr, {}, d,
+                                                       llfio::file_handle::io_request<llfio::file_handle::const_buffers_type>({&wbuf, 1}, 0));
+    auto *barrier_state = multiplexer.value()->construct({barrier_storage.get(), state_bytes}, &fh, nullptr, {}, d,
+                                                         llfio::file_handle::io_request<llfio::file_handle::const_buffers_type>({}, 0),
+                                                         llfio::byte_io_multiplexer::barrier_kind::wait_data_only);
+    std::vector<llfio::byte_io_multiplexer::io_operation_state *> chain_states{write_state, barrier_state};
+    std::vector<llfio::io_operation_state_type> chain_out(2);
+    multiplexer.value()->init_io_operation_chain(chain_states, chain_out).value();
+    size_t finished = 0;
+    const auto chain_began = std::chrono::steady_clock::now();
+    while(finished < 2 && std::chrono::steady_clock::now() - chain_began < std::chrono::seconds(10))
+    {
+      multiplexer.value()->check_io_operations(chain_states, chain_out, std::chrono::seconds(1)).value();
+      finished = is_finished(chain_out[0]) + is_finished(chain_out[1]);
+    }
+    BOOST_REQUIRE(finished == 2);
+    auto written = std::move(*write_state).get_completed_write_or_barrier();
+    auto barriered = std::move(*barrier_state).get_completed_write_or_barrier();
+    BOOST_REQUIRE(written);
+    size_t bytes = 0;
+    for(auto &i : written.value())
+    {
+      bytes += i.size();
+    }
+    BOOST_CHECK(bytes == file_size_limit);
+    BOOST_REQUIRE(!barriered);
+    BOOST_CHECK(barriered.error() == llfio::errc::operation_canceled);
+    write_state->~io_operation_state();
+    barrier_state->~io_operation_state();
+  }
+#endif
+}
+
+KERNELTEST_TEST_KERNEL(integration, llfio, io_uring_multiplexer, short_write_in_chain,
+                       "Tests that a short write in a chain completes the same whether linked in the kernel or emulated", TestIoUringShortWriteInChain())
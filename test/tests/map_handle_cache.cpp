@@ -26,6 +26,7 @@ Distributed under the Boost Software License, Version 1.0.
 
 #include <deque>
 #include <list>
+#include <thread>
 
 inline QUICKCPPLIB_NOINLINE void fault(LLFIO_V2_NAMESPACE::map_handle &mh)
 {
@@ -92,7 +93,7 @@ static inline void TestMapHandleCache()
       auto stats = llfio::map_handle::trim_cache();
       auto usage = llfio::utils::current_process_memory_usage().value();
       std::cout << "\n\nIn the map_handle cache after churn there are " << (stats.bytes_in_cache / 1024.0 / 1024.0) << " Mb in the cache in "
-                << stats.items_in_cache << " items. There were " << stats.hits << " hits and " << stats.misses
+                << stats.items_in_cache << " items. There were " << stats.hits << " hits (" << stats.steals << " stolen) and " << stats.misses
                 << " misses. Process virtual address space used is " << (usage.total_address_space_in_use / 1024.0 / 1024.0 / 1024.0)
                 << " Gb and commit charge is " << (usage.private_committed / 1024.0 / 1024.0) << " Mb." << std::endl;
     }
@@ -116,4 +117,168 @@ static inline void TestMapHandleCache()
   test();
 }
 
+static inline void TestMapHandleCacheSplit()
+{
+  namespace llfio = LLFIO_V2_NAMESPACE;
+  const auto pagesize = llfio::utils::page_size();
+  (void) llfio::map_handle::trim_cache(std::chrono::steady_clock::now());
+  const auto oldslack = llfio::map_handle::set_cache_slack(0);
+  llfio::map_handle::map(64 * pagesize).value().close().value();
+  auto before = llfio::map_handle::trim_cache();
+  BOOST_REQUIRE(before.items_in_cache == 1);
+#ifndef _WIN32
+  {
+    // A smaller request should be split off the cached region
+    auto mh = llfio::map_handle::map(pagesize).value();
+    fault(mh);
+    auto stats = llfio::map_handle::trim_cache();
+    BOOST_CHECK(stats.hits == before.hits + 1);
+    BOOST_CHECK(stats.splits == before.splits + 1);
+    BOOST_CHECK(mh.capacity() == pagesize);
+    BOOST_CHECK(stats.bytes_in_cache == 63 * pagesize);
+    before = stats;
+  }
+  {
+    // Which when returned, is coalesced back into the region it came from
+    auto stats = llfio::map_handle::trim_cache();
+    BOOST_CHECK(stats.coalesces == before.coalesces + 1);
+    BOOST_CHECK(stats.items_in_cache == 1);
+    BOOST_CHECK(stats.bytes_in_cache == 64 * pagesize);
+    before = stats;
+  }
+  {
+    // A region twice or more the size of the request is split, whatever the slack
+    llfio::map_handle::set_cache_slack(64 * pagesize);
+    auto mh = llfio::map_handle::map(16 * pagesize).value();
+    fault(mh);
+    BOOST_CHECK(mh.capacity() == 16 * pagesize);
+    auto stats = llfio::map_handle::trim_cache();
+    BOOST_CHECK(stats.hits == before.hits + 1);
+    BOOST_CHECK(stats.splits == before.splits + 1);
+    before = stats;
+  }
+#endif
+  {
+    // Within the slack bound, and less than twice the request, the whole region is returned
+    llfio::map_handle::set_cache_slack(64 * pagesize);
+    auto mh = llfio::map_handle::map(48 * pagesize).value();
+    fault(mh);
+    BOOST_CHECK(mh.length() == 48 * pagesize);
+    BOOST_CHECK(mh.capacity() == 64 * pagesize);
+    auto stats = llfio::map_handle::trim_cache();
+    BOOST_CHECK(stats.hits == before.hits + 1);
+    BOOST_CHECK(stats.splits == before.splits);
+    BOOST_CHECK(stats.items_in_cache == 0);
+  }
+  llfio::map_handle::set_cache_slack(oldslack);
+  (void) llfio::map_handle::trim_cache(std::chrono::steady_clock::now());
+}
+
+static inline void TestMapHandleCachePool()
+{
+  namespace llfio = LLFIO_V2_NAMESPACE;
+  const auto &pagesizes = llfio::utils::page_sizes();
+  // Use large pages if this system has them, otherwise a pool of normal pages works the same way
+  const auto flag = (pagesizes.size() > 1) ? (llfio::section_handle::flag::readwrite | llfio::section_handle::flag::page_sizes_1) :
+                                             llfio::section_handle::flag::readwrite;
+  const auto pagesize = pagesizes[(pagesizes.size() > 1) ? 1 : 0];
+  llfio::map_handle::set_cache_pool(pagesize, 4, flag).value();
+  auto stats = llfio::map_handle::trim_cache();
+  for(size_t n = 0; n < 500 && stats.items_in_pools < 4; n++)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    stats = llfio::map_handle::trim_cache();
+  }
+  if(stats.items_in_pools < 4)
+  {
+    BOOST_TEST_MESSAGE("The map handle cache pool did not fill, probably because there are insufficient large pages free. So skipping this test.");
+    llfio::map_handle::set_cache_pool(pagesize, 0, flag).value();
+    return;
+  }
+  BOOST_CHECK(stats.bytes_in_pools == 4 * pagesize);
+  {
+    auto mh = llfio::map_handle::map(pagesize, false, flag).value();
+    BOOST_CHECK(mh.page_size() == pagesize);
+    BOOST_CHECK(mh.length() == pagesize);
+    fault(mh);
+    auto stats2 = llfio::map_handle::trim_cache();
+    BOOST_CHECK(stats2.pool_hits == stats.pool_hits + 1);
+    BOOST_CHECK(stats2.items_in_pools <= 4);
+  }
+  // Other sizes are not satisfied from the pool
+  {
+    auto mh = llfio::map_handle::map(2 * pagesize, false, flag).value();
+    auto stats2 = llfio::map_handle::trim_cache();
+    BOOST_CHECK(stats2.pool_hits == stats.pool_hits + 1);
+  }
+  llfio::map_handle::set_cache_pool(pagesize, 0, flag).value();
+  stats = llfio::map_handle::trim_cache(std::chrono::steady_clock::now());
+  BOOST_CHECK(stats.items_in_pools == 0);
+}
+
+static inline void TestMapHandleCacheThreaded()
+{
+  static constexpr size_t ITEMS_COUNT = 1000;
+  namespace llfio = LLFIO_V2_NAMESPACE;
+  (void) llfio::map_handle::trim_cache(std::chrono::steady_clock::now());
+  const auto before = llfio::map_handle::trim_cache();
+  // Maps released by one thread must be reusable by another
+  std::vector<llfio::map_handle> maps;
+  for(size_t n = 0; n < ITEMS_COUNT; n++)
+  {
+    maps.push_back(llfio::map_handle::map(65536).value());
+  }
+  for(auto &i : maps)
+  {
+    i.close().value();
+  }
+  std::thread([&] {
+    for(auto &i : maps)
+    {
+      i = llfio::map_handle::map(65536).value();
+      fault(i);
+    }
+  }).join();
+  auto stats = llfio::map_handle::trim_cache();
+  BOOST_CHECK(stats.hits - before.hits == ITEMS_COUNT);
+  BOOST_CHECK(stats.items_in_cache == 0);
+  maps.clear();
+  // Many threads churning concurrently
+  std::vector<std::thread> threads;
+  for(unsigned t = 0; t < std::max(4U, std::thread::hardware_concurrency()); t++)
+  {
+    threads.emplace_back([t] {
+      QUICKCPPLIB_NAMESPACE::algorithm::small_prng::small_prng rand(t);
+      std::vector<llfio::map_handle> mine(ITEMS_COUNT / 10);
+      for(size_t n = 0; n < ITEMS_COUNT * 10; n++)
+      {
+        auto v = rand();
+        auto &mh = mine[n % mine.size()];
+        if(v & 1)
+        {
+          mh.close().value();
+        }
+        else
+        {
+          fault((mh = llfio::map_handle::map(((v >> 2) & 15) * 4096 + 4096).value()));
+        }
+      }
+    });
+  }
+  for(auto &t : threads)
+  {
+    t.join();
+  }
+  stats = llfio::map_handle::trim_cache(std::chrono::steady_clock::now());
+  std::cout << "\nAfter threaded churn there were " << (stats.hits - before.hits) << " hits (" << (stats.steals - before.steals) << " stolen) and "
+            << (stats.misses - before.misses) << " misses. " << stats.items_just_trimmed << " items were trimmed." << std::endl;
+  BOOST_CHECK(stats.bytes_in_cache == 0);
+  BOOST_CHECK(stats.items_in_cache == 0);
+}
+
 KERNELTEST_TEST_KERNEL(integration, llfio, map_handle, cache, "Tests that the map_handle cache works as expected", TestMapHandleCache())
+KERNELTEST_TEST_KERNEL(integration, llfio, map_handle, cache_split, "Tests that the map_handle cache splits and coalesces regions", TestMapHandleCacheSplit())
+KERNELTEST_TEST_KERNEL(integration, llfio, map_handle, cache_pool, "Tests that the map_handle cache pools of prefaulted regions work as expected",
+                       TestMapHandleCachePool())
+KERNELTEST_TEST_KERNEL(integration, llfio, map_handle, cache_threaded, "Tests that the map_handle cache works as expected when used by many threads",
+                       TestMapHandleCacheThreaded())
@@ -121,9 +121,91 @@ static inline void TestMappedFileHandleSubsets()
     BOOST_CHECK(0 == memcmp(reference.data(), mf1.address(), DATA_SIZE));
   }
 }
+static inline void TestMappedFileHandleReadahead()
+{
+  namespace llfio = LLFIO_V2_NAMESPACE;
+  static constexpr size_t READAHEAD_SIZE = 16 * 1024 * 1024;
+  auto mf1 = llfio::mapped_file_handle::mapped_temp_inode(READAHEAD_SIZE).value();
+  mf1.truncate(READAHEAD_SIZE).value();
+  for(bool asynchronous : {false, true})
+  {
+    llfio::algorithm::mapped_file_readahead::config c;
+    c.max_window = 1024 * 1024;
+    c.asynchronous = asynchronous;
+    std::cout << "\nasynchronous = " << asynchronous << std::endl;
+    {
+      // Sequential forwards
+      llfio::algorithm::mapped_file_readahead ra(mf1, c);
+      size_t sum = 0;
+      for(size_t offset = 0; offset < READAHEAD_SIZE; offset += 4096)
+      {
+        ra.access(offset, 4096);
+        sum += (size_t) mf1.address()[offset];
+      }
+      auto stats = ra.statistics();
+      std::cout << "Sequential: " << stats.accesses << " accesses, " << stats.hits << " hits, " << stats.misses << " misses, " << stats.prefetches
+                << " prefetches of " << stats.bytes_prefetched << " bytes, " << stats.prefetches_dropped << " dropped. Sum " << sum << std::endl;
+      BOOST_CHECK(stats.accesses == READAHEAD_SIZE / 4096);
+      BOOST_CHECK(stats.misses == c.confirmations + 1);
+      BOOST_CHECK(stats.hits == stats.accesses - stats.misses);
+      BOOST_CHECK(stats.pattern_changes == 0);
+      if(!asynchronous)
+      {
+        BOOST_CHECK(stats.prefetches > 0);
+        BOOST_CHECK(stats.bytes_prefetched >= READAHEAD_SIZE - 3 * 4096);
+      }
+    }
+    {
+      // Strided backwards, then breaking the pattern
+      llfio::algorithm::mapped_file_readahead ra(mf1, c);
+      size_t sum = 0, count = 0;
+      for(size_t offset = READAHEAD_SIZE - 256; offset >= 65536; offset -= 65536, count++)
+      {
+        ra.access(offset, 256);
+        sum += (size_t) mf1.address()[offset];
+      }
+      ra.access(7, 13);
+      count++;
+      auto stats = ra.statistics();
+      std::cout << "Strided: " << stats.accesses << " accesses, " << stats.hits << " hits, " << stats.misses << " misses, " << stats.prefetches
+                << " prefetches of " << stats.bytes_prefetched << " bytes, " << stats.prefetches_dropped << " dropped. Sum " << sum << std::endl;
+      BOOST_CHECK(stats.accesses == count);
+      BOOST_CHECK(stats.pattern_changes == 1);
+      BOOST_CHECK(stats.hits > 0);
+      if(!asynchronous)
+      {
+        BOOST_CHECK(stats.misses == c.confirmations + 2);
+        BOOST_CHECK(stats.prefetches > 0);
+      }
+    }
+    {
+      // Random access should never prefetch, but will_need() always does
+      llfio::algorithm::mapped_file_readahead ra(mf1, c);
+      QUICKCPPLIB_NAMESPACE::algorithm::small_prng::small_prng rand;
+      for(size_t n = 0; n < 1000; n++)
+      {
+        ra.access((rand() % (READAHEAD_SIZE / 4096)) * 4096, 4096);
+      }
+      BOOST_CHECK(ra.statistics().hits == 0);
+      ra.will_need(0, 65536);
+      ra.access(4096, 4096);
+      BOOST_CHECK(ra.statistics().hits == 1);
+      ra.reset();
+      ra.access(4096, 4096);
+      BOOST_CHECK(ra.statistics().hits == 1);
+      if(!asynchronous)
+      {
+        BOOST_CHECK(ra.statistics().prefetches == 1);
+      }
+    }
+  }
+}
 
 
 KERNELTEST_TEST_KERNEL(integration, llfio, mapped_file_handle, cache, "Tests that the mapped_file_handle works as expected", TestMappedFileHandle())
 
 KERNELTEST_TEST_KERNEL(integration, llfio, mapped_file_handle, subsets, "Tests that the mapped_file_handle subsets works as expected",
                        TestMappedFileHandleSubsets())
+
+KERNELTEST_TEST_KERNEL(integration, llfio, mapped_file_handle, readahead, "Tests that algorithm::mapped_file_readahead works as expected",
+                       TestMappedFileHandleReadahead())
@@ -94,7 +94,7 @@ static inline void TestNonBlockingPipeHandle()
   reader.close().value();
 }
 
-#if LLFIO_ENABLE_TEST_IO_MULTIPLEXERS
+#if LLFIO_ENABLE_TEST_IO_MULTIPLEXERS || defined(__linux__)
 static inline void TestMultiplexedPipeHandle()
 {
   static constexpr size_t MAX_PIPES = 64;
@@ -239,6 +239,108 @@ static inline void TestMultiplexedPipeHandle()
       }
     }
     writerthread.get();
+
+    // Round trip through buffers allocated by the multiplexer
+    write_pipes[0].set_multiplexer(multiplexer.get()).value();
+    size_t bytes = 4096;
+    auto wbuffer = write_pipes[0].allocate_registered_buffer(bytes).value();
+    BOOST_REQUIRE(bytes >= 4096);
+    BOOST_REQUIRE(wbuffer->size() >= 4096);
+    auto rbuffer = read_pipes[0].allocate_registered_buffer(bytes).value();
+    BOOST_REQUIRE(rbuffer->size() >= 4096);
+    BOOST_CHECK(rbuffer->data() != wbuffer->data());
+    memset(wbuffer->data(), 78, 4096);
+    memset(rbuffer->data(), 0, 4096);
+    write_pipes[0].write(0, {{wbuffer->data(), 4096}}).value();
+    auto read = read_pipes[0].read(0, {{rbuffer->data(), 4096}}).value();
+    BOOST_CHECK(read == 4096);
+    BOOST_CHECK(0 == memcmp(rbuffer->data(), wbuffer->data(), 4096));
+
+    // Scatter a read to every pipe as a single batch, and gather the completions in bulk
+    const auto state_bytes = multiplexer->io_state_requirements().first;
+    std::vector<std::unique_ptr<llfio::byte[]>> batch_storage;
+    std::vector<size_t> batch_values(MAX_PIPES, (size_t) -1);
+    std::vector<llfio::pipe_handle::buffer_type> batch_buffers;
+    std::vector<llfio::byte_io_multiplexer::io_operation_state *> batch_states;
+    std::vector<llfio::io_operation_state_type> batch_out(MAX_PIPES);
+    batch_buffers.reserve(MAX_PIPES);
+    for(size_t n = 0; n < MAX_PIPES; n++)
+    {
+      batch_storage.push_back(std::make_unique<llfio::byte[]>(state_bytes));
+      batch_buffers.emplace_back((llfio::byte *) &batch_values[n], sizeof(size_t));
+      batch_states.push_back(multiplexer->construct({batch_storage.back().get(), state_bytes}, &read_pipes[n], nullptr, {}, {},
+                                                    llfio::pipe_handle::io_request<llfio::pipe_handle::buffers_type>({&batch_buffers[n], 1}, 0)));
+      BOOST_REQUIRE(batch_states.back() != nullptr);
+    }
+    multiplexer->init_io_operations(batch_states, batch_out).value();
+    for(size_t n = 0; n < MAX_PIPES; n++)
+    {
+      BOOST_CHECK(is_initiated(batch_out[n]));
+      write_pipes[n].write(0, {{(llfio::byte *) &n, sizeof(n)}}).value();
+    }
+    size_t finished = 0;
+    const auto batch_began = std::chrono::steady_clock::now();
+    while(finished < MAX_PIPES && std::chrono::steady_clock::now() - batch_began < std::chrono::seconds(10))
+    {
+      finished = multiplexer->check_io_operations(batch_states, batch_out, std::chrono::seconds(1)).value();
+    }
+    BOOST_REQUIRE(finished == MAX_PIPES);
+    for(size_t n = 0; n < MAX_PIPES; n++)
+    {
+      BOOST_CHECK(is_finished(batch_out[n]));
+      auto r = std::move(*batch_states[n]).get_completed_read();
+      BOOST_REQUIRE(r);
+      BOOST_CHECK(r.value().size() == 1);
+      BOOST_CHECK(batch_values[n] == n);
+      batch_states[n]->~io_operation_state();
+    }
+
+    // Chain a write to a pipe with a read from it, and then a timed out read with a write
+    // which must therefore be cancelled
+    write_pipes[1].set_multiplexer(multiplexer.get()).value();
+    for(bool read_times_out : {false, true})
+    {
+      size_t value = 78, received = 0;
+      llfio::pipe_handle::const_buffer_type wbuf((const llfio::byte *) &value, sizeof(value));
+      llfio::pipe_handle::buffer_type rbuf((llfio::byte *) &received, sizeof(received));
+      auto *write_state = multiplexer->construct({batch_storage[0].get(), state_bytes}, &write_pipes[1], nullptr, {}, {},
+                                                 llfio::pipe_handle::io_request<llfio::pipe_handle::const_buffers_type>({&wbuf, 1}, 0));
+      auto *read_state = multiplexer->construct({batch_storage[1].get(), state_bytes}, &read_pipes[1], nullptr, {},
+                                                read_times_out ? llfio::deadline(std::chrono::milliseconds(100)) : llfio::deadline(),
+                                                llfio::pipe_handle::io_request<llfio::pipe_handle::buffers_type>({&rbuf, 1}, 0));
+      std::vector<llfio::byte_io_multiplexer::io_operation_state *> chain_states{write_state, read_state};
+      if(read_times_out)
+      {
+        std::swap(chain_states[0], chain_states[1]);
+      }
+      std::vector<llfio::io_operation_state_type> chain_out(2);
+      multiplexer->init_io_operation_chain(chain_states, chain_out).value();
+      finished = 0;
+      const auto chain_began = std::chrono::steady_clock::now();
+      while(finished < 2 && std::chrono::steady_clock::now() - chain_began < std::chrono::seconds(10))
+      {
+        multiplexer->check_io_operations(chain_states, chain_out, std::chrono::seconds(1)).value();
+        finished = is_finished(chain_out[0]) + is_finished(chain_out[1]);
+      }
+      BOOST_REQUIRE(finished == 2);
+      auto chain_written = std::move(*write_state).get_completed_write_or_barrier();
+      auto chain_read = std::move(*read_state).get_completed_read();
+      if(read_times_out)
+      {
+        BOOST_REQUIRE(!chain_read);
+        BOOST_CHECK(chain_read.error() == llfio::errc::timed_out);
+        BOOST_REQUIRE(!chain_written);
+        BOOST_CHECK(chain_written.error() == llfio::errc::operation_canceled);
+      }
+      else
+      {
+        BOOST_CHECK(chain_written);
+        BOOST_REQUIRE(chain_read);
+        BOOST_CHECK(received == value);
+      }
+      write_state->~io_operation_state();
+      read_state->~io_operation_state();
+    }
   };
 #ifdef _WIN32
   std::cout << "\nSingle threaded IOCP, immediate completions:\n";
@@ -249,6 +351,21 @@ static inline void TestMultiplexedPipeHandle()
   test_multiplexer(llfio::test::multiplexer_win_iocp(2, false).value());
   std::cout << "\nMultithreaded IOCP, reactor completions:\n";
   test_multiplexer(llfio::test::multiplexer_win_iocp(2, true).value());
+#elif defined(__linux__)
+  std::cout << "\nSingle threaded epoll:\n";
+  test_multiplexer(llfio::multiplexer_linux_epoll(1).value());
+  std::cout << "\nMultithreaded epoll:\n";
+  test_multiplexer(llfio::multiplexer_linux_epoll(2).value());
+  auto multiplexer = llfio::multiplexer_linux_io_uring(1, false);
+  if(!multiplexer)
+  {
+    std::cout << "\nNOTE: io_uring is not available on this kernel, skipping this test." << std::endl;
+    return;
+  }
+  std::cout << "\nSingle threaded io_uring:\n";
+  test_multiplexer(std::move(multiplexer).value());
+  std::cout << "\nMultithreaded io_uring:\n";
+  test_multiplexer(llfio::multiplexer_linux_io_uring(2, false).value());
 #else
 #error Not implemented yet
 #endif
@@ -360,6 +477,21 @@ static inline void TestCoroutinedPipeHandle()
   test_multiplexer(llfio::test::multiplexer_win_iocp(2, false).value());
   std::cout << "\nMultithreaded IOCP, reactor completions:\n";
   test_multiplexer(llfio::test::multiplexer_win_iocp(2, true).value());
+#elif defined(__linux__)
+  std::cout << "\nSingle threaded epoll:\n";
+  test_multiplexer(llfio::multiplexer_linux_epoll(1).value());
+  std::cout << "\nMultithreaded epoll:\n";
+  test_multiplexer(llfio::multiplexer_linux_epoll(2).value());
+  auto multiplexer = llfio::multiplexer_linux_io_uring(1, false);
+  if(!multiplexer)
+  {
+    std::cout << "\nNOTE: io_uring is not available on this kernel, skipping this test." << std::endl;
+    return;
+  }
+  std::cout << "\nSingle threaded io_uring:\n";
+  test_multiplexer(std::move(multiplexer).value());
+  std::cout << "\nMultithreaded io_uring:\n";
+  test_multiplexer(llfio::multiplexer_linux_io_uring(2, false).value());
 #else
 #error Not implemented yet
 #endif
@@ -369,7 +501,7 @@ static inline void TestCoroutinedPipeHandle()
 
 KERNELTEST_TEST_KERNEL(integration, llfio, pipe_handle, blocking, "Tests that blocking llfio::pipe_handle works as expected", TestBlockingPipeHandle())
 KERNELTEST_TEST_KERNEL(integration, llfio, pipe_handle, nonblocking, "Tests that nonblocking llfio::pipe_handle works as expected", TestNonBlockingPipeHandle())
-#if LLFIO_ENABLE_TEST_IO_MULTIPLEXERS
+#if LLFIO_ENABLE_TEST_IO_MULTIPLEXERS || defined(__linux__)
 KERNELTEST_TEST_KERNEL(integration, llfio, pipe_handle, multiplexed, "Tests that multiplexed llfio::pipe_handle works as expected", TestMultiplexedPipeHandle())
 #if LLFIO_ENABLE_COROUTINES
 KERNELTEST_TEST_KERNEL(integration, llfio, pipe_handle, coroutined, "Tests that coroutined llfio::pipe_handle works as expected", TestCoroutinedPipeHandle())
@@ -127,4 +127,61 @@ static inline void TestReduce()
   }
 }
 
+static inline void TestReduceLargeDirectory()
+{
+#if defined(_WIN32) || defined(__APPLE__)
+  static constexpr size_t total_entries = 10000;  // create 10,000 files in a single directory
+#else
+  static constexpr size_t total_entries = 100000;  // create 100,000 files in a single directory
+#endif
+  using namespace LLFIO_V2_NAMESPACE;
+  using LLFIO_V2_NAMESPACE::file_handle;
+  using QUICKCPPLIB_NAMESPACE::algorithm::string::to_hex_string;
+  struct rates_visitor final : public algorithm::reduce_visitor
+  {
+    size_t items_unlinked_by_threads{0}, threads_used{0};
+
+    virtual result<void> reduction_round_unlink_rates(void *data, size_t round_completed, span<const unlink_rate> rates) noexcept override
+    {
+      for(const auto &rate : rates)
+      {
+        std::cout << "  Kernel thread unlinked " << rate.items_unlinked << " entries at " << rate.per_second() << " entries/sec" << std::endl;
+        items_unlinked_by_threads += rate.items_unlinked;
+      }
+      threads_used = std::max(threads_used, rates.size());
+      return algorithm::reduce_visitor::reduction_round_unlink_rates(data, round_completed, rates);
+    }
+  };
+  auto dirh = directory_handle::temp_directory().value();
+  auto dirhpath = dirh.current_path().value();
+  std::cout << "\n\nCreating " << total_entries << " files in the single directory " << dirhpath << " ..." << std::endl;
+  for(size_t n = 0; n < total_entries; n++)
+  {
+    filesystem::path::value_type buffer[10];
+    auto c = (uint32_t) n;
+    buffer[0] = 'f';
+    to_hex_string(buffer + 1, 8, (const char *) &c, 4);
+    buffer[9] = 0;
+    file_handle::file(dirh, path_view(buffer, 9, path_view::zero_terminated), file_handle::mode::write, file_handle::creation::if_needed).value();
+  }
+  std::cout << "\nCalling llfio::algorithm::reduce() on that directory ..." << std::endl;
+  rates_visitor visitor;
+  auto begin = std::chrono::high_resolution_clock::now();
+  auto entries_removed = algorithm::reduce(std::move(dirh), &visitor).value();
+  auto end = std::chrono::high_resolution_clock::now();
+  BOOST_CHECK(entries_removed == total_entries + 1);
+  BOOST_CHECK(visitor.items_unlinked_by_threads == total_entries);
+  std::cout << "Reduced " << entries_removed << " filesystem entries using " << visitor.threads_used << " kernel threads in "
+            << (std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() / 1000000.0) << " seconds (which is "
+            << (entries_removed / (std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() / 1000000.0)) << " entries/sec).\n";
+
+#if LLFIO_LOGGING_LEVEL
+  log_level_guard g(log_level::fatal);
+#endif
+  auto r = directory_handle::directory({}, dirhpath);
+  BOOST_REQUIRE(!r && r.error() == errc::no_such_file_or_directory);
+}
+
 KERNELTEST_TEST_KERNEL(integration, llfio, algorithm, reduce, "Tests that llfio::algorithm::reduce() works as expected", TestReduce())
+KERNELTEST_TEST_KERNEL(integration, llfio, algorithm, reduce_large_directory,
+                       "Tests that llfio::algorithm::reduce() of a single very large directory works as expected", TestReduceLargeDirectory())
@@ -33,6 +33,7 @@ KERNELTEST_TEST_KERNEL(unit, llfio, shared_fs_mutex, entity_endian, "Tests that
 
 #include <codecvt>
 #include <condition_variable>
+#include <ctime>
 #include <future>
 #include <unordered_map>
 
@@ -570,6 +571,112 @@ static auto TestSharedFSMutexConstructDestructChildWorker = KERNELTEST_V1_NAMESP
 
 KERNELTEST_TEST_KERNEL(integration, llfio, shared_fs_mutex_memory_map, construct_destruct, "Tests that llfio::algorithm::shared_fs_mutex::memory_map constructor and destructor are race free", [] { TestSharedFSMutexConstructDestruct(shared_memory::memory_map); }())
 
+static void TestMemoryMapContention()
+{
+  namespace llfio = LLFIO_V2_NAMESPACE;
+  using entity_type = llfio::algorithm::shared_fs_mutex::shared_fs_mutex::entity_type;
+  static constexpr size_t THREADS = 8, ITERATIONS = 50;
+  auto lock = llfio::algorithm::shared_fs_mutex::memory_map<>::fs_mutex_map({}, "lockfile").value();
+  std::atomic<unsigned> inside(0), violations(0), failures(0);
+  size_t counter = 0;  // only ever modified with the lock held
+  const auto cpu_begin = std::clock();
+  const auto wall_begin = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for(size_t n = 0; n < THREADS; n++)
+  {
+    threads.emplace_back([&] {
+      for(size_t i = 0; i < ITERATIONS; i++)
+      {
+        auto h = lock.lock(entity_type(78, true));
+        if(!h)
+        {
+          failures++;
+          continue;
+        }
+        if(inside.fetch_add(1) != 0)
+        {
+          violations++;
+        }
+        counter++;
+        // Hold the lock long enough that every waiter exhausts its spins and goes to sleep
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        inside.fetch_sub(1);
+      }
+    });
+  }
+  for(auto &i : threads)
+  {
+    i.join();
+  }
+  const double cpu_secs = double(std::clock() - cpu_begin) / CLOCKS_PER_SEC;
+  const double wall_secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_begin).count();
+  std::cout << THREADS << " threads contending on one memory_map entity took " << wall_secs << " seconds and " << cpu_secs << " seconds of CPU." << std::endl;
+  BOOST_CHECK(failures == 0);
+  BOOST_CHECK(violations == 0);
+  BOOST_CHECK(counter == THREADS * ITERATIONS);
+  // If unlocks did not wake the sleepers, every handoff would wait out the maximum sleep of 100ms
+  BOOST_CHECK(wall_secs < THREADS * ITERATIONS * 0.05);
+#ifdef __linux__
+  // Spinning waiters would consume nearly all of the wall clock time of every waiting thread
+  BOOST_CHECK(cpu_secs < wall_secs * (THREADS - 1) / 2);
+#endif
+}
+
+KERNELTEST_TEST_KERNEL(integration, llfio, shared_fs_mutex_memory_map, contention, "Tests that llfio::algorithm::shared_fs_mutex::memory_map sleeps and wakes waiters under contention", TestMemoryMapContention())
+
+template <bool PadToCacheLine> static void TestMemoryMapEntityCollisions()
+{
+  namespace llfio = LLFIO_V2_NAMESPACE;
+  using entity_type = llfio::algorithm::shared_fs_mutex::shared_fs_mutex::entity_type;
+  using spinlock_type = QUICKCPPLIB_NAMESPACE::configurable_spinlock::shared_spinlock<>;
+  // The padded layout gets the same number of buckets, each upon its own cache line
+  static constexpr size_t buckets = 4096 / sizeof(spinlock_type);
+  using lock_type = llfio::algorithm::shared_fs_mutex::memory_map<QUICKCPPLIB_NAMESPACE::algorithm::hash::passthru_hash,
+                                                                  PadToCacheLine ? buckets * 64 : 4096, spinlock_type, PadToCacheLine>;
+  // With the identity hash, entities whose values differ by the number of buckets collide
+  auto lock = lock_type::fs_mutex_map({}, "lockfile").value();
+  // Four entities upon each of slots 1 to 6, too many for the linear search for collisions.
+  // Slot 1 is exclusively locked only by its last entity, and slot 2 is only ever shared.
+  std::vector<entity_type> entities;
+  for(size_t k = 0; k < 24; k++)
+  {
+    const size_t slot = 1 + k % 6, round = k / 6;
+    entities.emplace_back(slot + round * buckets, slot != 2 && round == 3);
+  }
+  {
+    // If collisions were not elided, locking a slot a second time would never succeed
+    auto h = lock.lock(entities, llfio::deadline(std::chrono::seconds(5)));
+    BOOST_REQUIRE(h);
+    BOOST_CHECK(!lock.try_lock(entity_type(1, false)));
+    BOOST_CHECK(!lock.try_lock(entity_type(6 + buckets, false)));
+    BOOST_CHECK(!lock.try_lock(entity_type(2, true)));
+    BOOST_CHECK(lock.try_lock(entity_type(2 + 3 * buckets, false)));
+  }
+  // Every slot was released
+  BOOST_CHECK(lock.try_lock(entities));
+}
+
+KERNELTEST_TEST_KERNEL(integration, llfio, shared_fs_mutex_memory_map, collisions, "Tests that llfio::algorithm::shared_fs_mutex::memory_map elides many colliding entities", TestMemoryMapEntityCollisions<false>())
+KERNELTEST_TEST_KERNEL(integration, llfio, shared_fs_mutex_memory_map, padded, "Tests that llfio::algorithm::shared_fs_mutex::memory_map with cache line padded buckets locks the right buckets", TestMemoryMapEntityCollisions<true>())
+
+static void TestAtomicAppendCompaction()
+{
+  namespace llfio = LLFIO_V2_NAMESPACE;
+  auto lock = llfio::algorithm::shared_fs_mutex::atomic_append::fs_mutex_append({}, "lockfile").value();
+  llfio::file_handle::extent_type maxlength = 0;
+  for(size_t n = 0; n < 10000; n++)
+  {
+    auto h = lock.lock(llfio::algorithm::shared_fs_mutex::shared_fs_mutex::entity_type(n % 16, true)).value();
+    maxlength = std::max(maxlength, lock.handle().maximum_extent().value());
+  }
+  // Every 32nd unlock compacts the idle lock file back to its header, so it should never exceed
+  // 33 records. Without compaction it would be over a megabyte.
+  std::cout << "atomic_append lock file maximum length was " << maxlength << std::endl;
+  BOOST_CHECK(maxlength <= 33 * 128);
+}
+
+KERNELTEST_TEST_KERNEL(integration, llfio, shared_fs_mutex_atomic_append, compaction, "Tests that llfio::algorithm::shared_fs_mutex::atomic_append compacts its lock file", TestAtomicAppendCompaction())
+
 
 /*
 
@@ -0,0 +1,100 @@
+/* Integration test kernel for whether stat_t::fill() relative to a base works
+(C) 2026 agent <agent@local>
+File Created: Oct 2026
+
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License in the accompanying file
+Licence.txt or at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+
+Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file Licence.txt or copy at
+          http://www.boost.org/LICENSE_1_0.txt)
+*/
+
+#include "../test_kernel_decl.hpp"
+
+static inline void TestStatFillRelative()
+{
+  using namespace LLFIO_V2_NAMESPACE;
+  auto dirh = directory_handle::temp_directory().value();
+  {
+    auto fh = file_handle::file(dirh, "file", file_handle::mode::write, file_handle::creation::if_needed).value();
+    fh.truncate(12345).value();
+    auto subdirh = directory_handle::directory(dirh, "dir", directory_handle::mode::write, directory_handle::creation::if_needed).value();
+
+    stat_t byhandle(nullptr), byleaf(nullptr);
+    BOOST_CHECK(byhandle.fill(fh).value() == byleaf.fill(dirh, "file").value());
+    BOOST_CHECK(byleaf.st_type == filesystem::file_type::regular);
+    BOOST_CHECK(byleaf.st_ino == byhandle.st_ino);
+    BOOST_CHECK(byleaf.st_dev == byhandle.st_dev);
+    BOOST_CHECK(byleaf.st_size == 12345);
+    BOOST_CHECK(byleaf.st_mtim == byhandle.st_mtim);
+
+    stat_t subdir(nullptr);
+    subdir.fill(dirh, "dir", stat_t::want::ino | stat_t::want::type).value();
+    BOOST_CHECK(subdir.st_type == filesystem::file_type::directory);
+    BOOST_CHECK(subdir.st_ino == subdirh.st_ino());
+  }
+  stat_t missing(nullptr);
+  auto r = missing.fill(dirh, "missing");
+  BOOST_REQUIRE(!r);
+  BOOST_CHECK(r.error() == errc::no_such_file_or_directory);
+  (void) algorithm::reduce(std::move(dirh)).value();
+}
+
+static inline void TestStatBatch()
+{
+  using namespace LLFIO_V2_NAMESPACE;
+  auto dirh = directory_handle::temp_directory().value();
+  {
+    static constexpr size_t count = 500;
+    for(size_t n = 0; n < count; n++)
+    {
+      auto fh = file_handle::file(dirh, std::to_string(n), file_handle::mode::write, file_handle::creation::if_needed).value();
+      fh.truncate(n).value();
+    }
+    std::vector<directory_entry> entries(count + 1);
+    directory_handle::buffers_type buffers(entries);
+    buffers = dirh.read({std::move(buffers)}).value();
+    BOOST_REQUIRE(buffers.done());
+    BOOST_REQUIRE(buffers.size() == count);
+    // Append an entry which does not exist
+    std::vector<directory_entry> batch(buffers.begin(), buffers.end());
+    batch.push_back(directory_entry{"missing", stat_t(nullptr)});
+    for(size_t threads : {(size_t) 1, (size_t) 0})
+    {
+      for(auto &entry : batch)
+      {
+        entry.stat.st_size = (handle::extent_type) -1;
+      }
+      std::unique_ptr<bool[]> filled(new bool[batch.size()]);
+      BOOST_CHECK(algorithm::stat_batch(dirh, batch, stat_t::want::ino | stat_t::want::size, {filled.get(), batch.size()}, threads).value() == count);
+      for(size_t n = 0; n < count; n++)
+      {
+        BOOST_CHECK(filled[n]);
+        stat_t expected(nullptr);
+        expected.fill(dirh, batch[n].leafname).value();
+        BOOST_CHECK(batch[n].stat.st_ino == expected.st_ino);
+        BOOST_CHECK(batch[n].stat.st_size == expected.st_size);
+      }
+      BOOST_CHECK(!filled[count]);
+      BOOST_CHECK(batch[count].stat.st_size == (handle::extent_type) -1);
+    }
+  }
+  (void) algorithm::reduce(std::move(dirh)).value();
+}
+
+KERNELTEST_TEST_KERNEL(integration, llfio, stat, fill_relative, "Tests that llfio::stat_t::fill() relative to a path_handle works as expected",
+                       TestStatFillRelative())
+KERNELTEST_TEST_KERNEL(integration, llfio, stat, batch, "Tests that llfio::algorithm::stat_batch() works as expected", TestStatBatch())
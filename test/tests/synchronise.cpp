@@ -0,0 +1,115 @@
+/* Integration test kernel for whether synchronise() works
+(C) 2026 agent <agent@local>
+File Created: Oct 2026
+
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License in the accompanying file
+Licence.txt or at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+
+Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file Licence.txt or copy at
+          http://www.boost.org/LICENSE_1_0.txt)
+*/
+
+#include "../test_kernel_decl.hpp"
+
+#include <chrono>
+#include <thread>
+
+static inline void TestSynchronise()
+{
+  static constexpr size_t big_file_extent = (size_t) 16 * 1024 * 1024;
+  using namespace LLFIO_V2_NAMESPACE;
+  using LLFIO_V2_NAMESPACE::file_handle;
+  auto write_file = [](const path_handle &base, path_view leaf, size_t length, char c)
+  {
+    auto fh = file_handle::file(base, leaf, file_handle::mode::write, file_handle::creation::if_needed).value();
+    std::vector<byte> buffer(length, to_byte(c));
+    fh.truncate(length).value();
+    fh.write(0, {{buffer.data(), buffer.size()}}).value();
+  };
+  auto read_file = [](const path_handle &base, path_view leaf)
+  {
+    auto fh = file_handle::file(base, leaf).value();
+    std::vector<byte> buffer((size_t) fh.maximum_extent().value());
+    fh.read(0, {{buffer.data(), buffer.size()}}).value();
+    return buffer;
+  };
+  auto srcdirh = directory_handle::temp_directory().value();
+  auto destdirh = directory_handle::temp_directory().value();
+  write_file(srcdirh, "small", 4096, 'a');
+  write_file(srcdirh, "big", big_file_extent, 'b');
+  write_file(srcdirh, "gone", 100, 'c');
+  auto subdirh = directory_handle::directory(srcdirh, "subdir", directory_handle::mode::write, directory_handle::creation::if_needed).value();
+  write_file(subdirh, "nested", 100, 'd');
+  auto kinddirh = directory_handle::directory(srcdirh, "kind", directory_handle::mode::write, directory_handle::creation::if_needed).value();
+  write_file(kinddirh, "nested", 100, 'e');
+
+  std::cout << "\nCalling llfio::algorithm::synchronise() on an empty destination ..." << std::endl;
+  auto summary = algorithm::synchronise(srcdirh, destdirh).value();
+  BOOST_CHECK(summary.entries_created == 7);
+  BOOST_CHECK(summary.entries_updated == 0);
+  BOOST_CHECK(summary.entries_removed == 0);
+  BOOST_CHECK(read_file(destdirh, "big") == read_file(srcdirh, "big"));
+  auto destsubdirh = directory_handle::directory(destdirh, "subdir").value();
+  BOOST_CHECK(read_file(destsubdirh, "nested") == read_file(subdirh, "nested"));
+
+  // Change a single block in the middle of the big file, and make other changes
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  {
+    auto fh = file_handle::file(srcdirh, "big", file_handle::mode::write).value();
+    byte buffer[4096];
+    memset(buffer, 'z', sizeof(buffer));
+    fh.write(big_file_extent / 2, {{buffer, sizeof(buffer)}}).value();
+  }
+  write_file(srcdirh, "small", 8192, 'f');
+  write_file(subdirh, "new", 100, 'g');
+  file_handle::file(srcdirh, "gone", file_handle::mode::write).value().unlink().value();
+  algorithm::reduce(std::move(kinddirh)).value();
+  write_file(srcdirh, "kind", 100, 'h');
+
+  std::cout << "Calling llfio::algorithm::synchronise() after changes ..." << std::endl;
+  // Never reflink, else filing systems which can would bypass the block comparison
+  algorithm::synchronise_visitor visitor;
+  visitor.reflink_changed_files = false;
+  summary = algorithm::synchronise(srcdirh, destdirh, &visitor).value();
+  std::cout << "Created " << summary.entries_created << ", updated " << summary.entries_updated << ", removed " << summary.entries_removed
+            << ", compared " << summary.bytes_compared << " bytes and copied " << summary.bytes_copied << " bytes." << std::endl;
+  BOOST_CHECK(summary.entries_created == 2);  // subdir/new, kind
+  BOOST_CHECK(summary.entries_updated == 2);  // big, small
+  BOOST_CHECK(summary.entries_removed == 3);  // gone, kind/, kind/nested
+  // Only the changed block of the big file should have been copied
+  BOOST_CHECK(summary.bytes_compared >= big_file_extent);
+  BOOST_CHECK(summary.bytes_copied < big_file_extent / 2);
+  BOOST_CHECK(read_file(destdirh, "big") == read_file(srcdirh, "big"));
+  BOOST_CHECK(read_file(destdirh, "small") == read_file(srcdirh, "small"));
+  BOOST_CHECK(read_file(destdirh, "kind") == read_file(srcdirh, "kind"));
+  BOOST_CHECK(read_file(destsubdirh, "new") == read_file(subdirh, "new"));
+  {
+    log_level_guard g(log_level::fatal);
+    BOOST_CHECK(!file_handle::file(destdirh, "gone"));
+  }
+
+  std::cout << "Calling llfio::algorithm::synchronise() without changes ..." << std::endl;
+  summary = algorithm::synchronise(srcdirh, destdirh).value();
+  BOOST_CHECK(summary.entries_created == 0);
+  BOOST_CHECK(summary.entries_updated == 0);
+  BOOST_CHECK(summary.entries_removed == 0);
+  BOOST_CHECK(summary.bytes_copied == 0);
+
+  algorithm::reduce(std::move(srcdirh)).value();
+  algorithm::reduce(std::move(destdirh)).value();
+}
+
+KERNELTEST_TEST_KERNEL(integration, llfio, algorithm, synchronise, "Tests that llfio::algorithm::synchronise() works as expected", TestSynchronise())